@@ -190,6 +190,7 @@ impl ImageMounterWindow {
         // explicitly deny mime types, rather than allowing them, as some may be reported wrong
         // and we want to allow mounting obfuscated VeraCrypt images
         content_type != "application/x-raw-disk-image-xz-compressed"
+            && content_type != "application/zstd"
     }
 
     /// Returns the [`udisks::Object`] corresponding to [`Self::file`].
@@ -0,0 +1,185 @@
+use std::io::Read;
+use std::os::fd::{AsFd, AsRawFd};
+use std::os::unix::fs::MetadataExt;
+
+// Defined in Linux/fs.h
+const BLK_IOCTL_CODE: u8 = 0x12;
+const BLKSSZGET_SEQ: u8 = 104;
+const BLKGETSIZE64_SEQ: u8 = 114;
+const BLKZEROOUT_SEQ: u8 = 127;
+
+nix::ioctl_read!(blkgetsize64, BLK_IOCTL_CODE, BLKGETSIZE64_SEQ, u64);
+nix::ioctl_read_bad!(
+    blksszget,
+    nix::request_code_none!(BLK_IOCTL_CODE, BLKSSZGET_SEQ),
+    libc::c_int
+);
+nix::ioctl_write_ptr_bad!(
+    blkzeroout,
+    nix::request_code_none!(BLK_IOCTL_CODE, BLKZEROOUT_SEQ),
+    [u64; 2]
+);
+
+/// How a range of a block device can be set to zeroes without writing them.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum ZeroMethod {
+    /// `BLKZEROOUT`, for devices that zero ranges themselves, e.g. with NVMe Write Zeroes or
+    /// SCSI WRITE SAME. SSDs usually just deallocate the range.
+    ZeroOut,
+}
+
+/// Device size in bytes of the block device from `fd`.
+///
+/// # Errors
+///
+/// Returns an error, if the given file descriptor is not for a block device.
+pub fn device_size(fd: impl AsFd) -> std::io::Result<u64> {
+    let mut block_device_size = 0;
+    if unsafe { blkgetsize64(fd.as_fd().as_raw_fd(), &mut block_device_size) } != Ok(0) {
+        log::error!("Error determining size of device");
+        return Err(std::io::Error::from(std::io::ErrorKind::InvalidInput));
+    }
+
+    Ok(block_device_size)
+}
+
+/// Logical block size in bytes of the block device from `fd`.
+///
+/// Direct I/O to the device must be aligned to this size.
+///
+/// # Errors
+///
+/// Returns an error, if the given file descriptor is not for a block device.
+pub fn logical_block_size(fd: impl AsFd) -> std::io::Result<u64> {
+    let mut logical_block_size = 0;
+    unsafe { blksszget(fd.as_fd().as_raw_fd(), &mut logical_block_size) }?;
+    Ok(logical_block_size as u64)
+}
+
+/// Enables or disables `O_DIRECT` on the open file description of `fd`.
+///
+/// # Errors
+///
+/// Returns an error, if the flags could not be changed, e.g. because the filesystem
+/// does not support direct I/O.
+pub fn set_direct_io(fd: impl AsFd, enable: bool) -> std::io::Result<()> {
+    let raw_fd = fd.as_fd().as_raw_fd();
+    let flags = unsafe { libc::fcntl(raw_fd, libc::F_GETFL) };
+    if flags < 0 {
+        return Err(std::io::Error::last_os_error());
+    }
+
+    let flags = if enable {
+        flags | libc::O_DIRECT
+    } else {
+        flags & !libc::O_DIRECT
+    };
+    if unsafe { libc::fcntl(raw_fd, libc::F_SETFL, flags) } < 0 {
+        return Err(std::io::Error::last_os_error());
+    }
+
+    Ok(())
+}
+
+/// Drops the cached pages of `fd` from the page cache, so reading it again reads from the
+/// device. Only clean pages are dropped, so the data must be synced before.
+///
+/// # Errors
+///
+/// Returns an error, if the kernel rejects the request.
+pub fn drop_cache(fd: impl AsFd) -> std::io::Result<()> {
+    let ret =
+        unsafe { libc::posix_fadvise(fd.as_fd().as_raw_fd(), 0, 0, libc::POSIX_FADV_DONTNEED) };
+    if ret != 0 {
+        return Err(std::io::Error::from_raw_os_error(ret));
+    }
+
+    Ok(())
+}
+
+/// Opens the file at `path` for reading with `O_DIRECT`.
+///
+/// # Errors
+///
+/// Returns an error, if the file could not be opened, e.g. because the filesystem
+/// does not support direct I/O.
+pub fn open_direct(path: &std::path::Path) -> std::io::Result<std::fs::File> {
+    use std::os::unix::fs::OpenOptionsExt;
+
+    std::fs::OpenOptions::new()
+        .read(true)
+        .custom_flags(libc::O_DIRECT)
+        .open(path)
+}
+
+/// Whether `O_DIRECT` is enabled on the open file description of `fd`.
+fn is_direct_io(fd: impl AsFd) -> std::io::Result<bool> {
+    let flags = unsafe { libc::fcntl(fd.as_fd().as_raw_fd(), libc::F_GETFL) };
+    if flags < 0 {
+        return Err(std::io::Error::last_os_error());
+    }
+    Ok(flags & libc::O_DIRECT != 0)
+}
+
+/// Reads a file that may have been opened with [`open_direct`].
+///
+/// A read that is not aligned as direct I/O requires fails with `EINVAL`, e.g. the one after a
+/// short read at the end of a disk image whose size is not a multiple of the block size. The
+/// rest of the file is then read through the page cache.
+pub struct BufferedFallback<'a>(pub &'a std::fs::File);
+
+impl Read for BufferedFallback<'_> {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        match self.0.read(buf) {
+            Err(err) if err.raw_os_error() == Some(libc::EINVAL) && is_direct_io(self.0)? => {
+                log::info!("Not using direct I/O for reading the rest of the disk image: {err}");
+                set_direct_io(self.0, false)?;
+                self.0.read(buf)
+            }
+            result => result,
+        }
+    }
+}
+
+/// Reads a queue attribute of the block device from sysfs.
+fn queue_attribute(file: &std::fs::File, name: &str) -> Option<String> {
+    let rdev = file.metadata().ok()?.rdev();
+    let dev_path = std::path::PathBuf::from(format!(
+        "/sys/dev/block/{}:{}",
+        libc::major(rdev),
+        libc::minor(rdev)
+    ));
+    // partitions have no queue of their own, it belongs to the whole disk
+    std::fs::read_to_string(dev_path.join("queue").join(name))
+        .or_else(|_| std::fs::read_to_string(dev_path.join("../queue").join(name)))
+        .ok()
+        .map(|value| value.trim().to_owned())
+}
+
+/// Returns how ranges of the block device `file` can be zeroed without writing zeroes.
+///
+/// Returns `None` if the device has no such way. A plain discard is never used, since
+/// `discard_zeroes_data` is always 0 since Linux 4.12 and nothing else tells whether a device
+/// reads back zeroes after a discard.
+pub fn zero_method(file: &std::fs::File) -> Option<ZeroMethod> {
+    queue_attribute(file, "write_zeroes_max_bytes")
+        .and_then(|value| value.parse::<u64>().ok())
+        .is_some_and(|value| value > 0)
+        .then_some(ZeroMethod::ZeroOut)
+}
+
+/// Sets `len` bytes at `offset` of the block device from `fd` to zeroes with `method`.
+///
+/// Both `offset` and `len` must be multiples of the logical block size.
+///
+/// # Errors
+///
+/// Returns an error, if the device rejects the request.
+pub fn zero_range(fd: impl AsFd, method: ZeroMethod, offset: u64, len: u64) -> std::io::Result<()> {
+    let range = [offset, len];
+    let raw_fd = fd.as_fd().as_raw_fd();
+    match method {
+        ZeroMethod::ZeroOut => unsafe { blkzeroout(raw_fd, &range) }?,
+    };
+    Ok(())
+}
@@ -0,0 +1,248 @@
+use std::time::{Duration, Instant};
+
+/// Minimum duration of a probe period.
+const PROBE_DURATION: Duration = Duration::from_millis(250);
+/// Minimum number of blocks in a probe period.
+const PROBE_MIN_BLOCKS: u32 = 8;
+/// A larger block size must be at least this much faster (in percent) to be picked.
+const MIN_GAIN: u64 = 5;
+
+/// Picks the request size of a copy by measuring the throughput of increasing block sizes
+/// during the first seconds of the copy.
+///
+/// Starting from the minimum block size, the size is doubled every probe period for as long
+/// as that makes the copy faster. Afterwards the tuner settles on the fastest size it has seen.
+/// The block size never exceeds the maximum block size, which bounds the memory needed for the
+/// buffers.
+#[derive(Debug)]
+pub struct BlockSizeTuner {
+    block_size: usize,
+    max_block_size: usize,
+    settled: bool,
+    best_block_size: usize,
+    best_rate: u64,
+    num_worse: u32,
+    probe_start: Option<Instant>,
+    probe_bytes: u64,
+    probe_blocks: u32,
+}
+
+impl BlockSizeTuner {
+    /// Creates a new tuner for block sizes between `min_block_size` and `max_block_size`.
+    pub fn new(min_block_size: usize, max_block_size: usize) -> Self {
+        let block_size = min_block_size.min(max_block_size);
+        Self {
+            block_size,
+            max_block_size,
+            settled: false,
+            best_block_size: block_size,
+            best_rate: 0,
+            num_worse: 0,
+            probe_start: None,
+            probe_bytes: 0,
+            probe_blocks: 0,
+        }
+    }
+
+    /// Returns the block size the next request should use.
+    pub fn block_size(&self) -> usize {
+        self.block_size
+    }
+
+    /// Records that a block of `bytes` bytes has been copied with the current block size.
+    pub fn add_block(&mut self, bytes: usize) {
+        self.add_block_at(bytes, Instant::now());
+    }
+
+    /// Records that a block of `bytes` bytes has been copied at `now`.
+    fn add_block_at(&mut self, bytes: usize, now: Instant) {
+        if self.settled {
+            return;
+        }
+
+        // the first block of a probe period only marks its start
+        let Some(probe_start) = self.probe_start else {
+            self.probe_start = Some(now);
+            return;
+        };
+
+        self.probe_bytes += bytes as u64;
+        self.probe_blocks += 1;
+        let elapsed = now.duration_since(probe_start);
+        if self.probe_blocks < PROBE_MIN_BLOCKS || elapsed < PROBE_DURATION {
+            return;
+        }
+
+        let rate = (self.probe_bytes as u128 * 1_000_000 / elapsed.as_micros()) as u64;
+        log::debug!(
+            "Block size {} KiB: {} KiB/s",
+            self.block_size / 1024,
+            rate / 1024
+        );
+
+        if rate * 100 > self.best_rate * (100 + MIN_GAIN) {
+            self.best_rate = rate;
+            self.best_block_size = self.block_size;
+            self.num_worse = 0;
+        } else {
+            self.num_worse += 1;
+        }
+
+        // stop when two larger sizes in a row did not help or the memory cap is reached
+        if self.num_worse >= 2 || self.block_size * 2 > self.max_block_size {
+            self.block_size = self.best_block_size;
+            self.settled = true;
+            log::debug!("Settled on block size {} KiB", self.block_size / 1024);
+            return;
+        }
+
+        self.block_size *= 2;
+        self.probe_start = None;
+        self.probe_bytes = 0;
+        self.probe_blocks = 0;
+    }
+}
+
+#[cfg(test)]
+mod block_size_tuner_tests {
+    use super::*;
+
+    const KIB: usize = 1024;
+
+    /// A copy with a simulated clock.
+    struct SimulatedCopy {
+        tuner: BlockSizeTuner,
+        now: Instant,
+    }
+
+    impl SimulatedCopy {
+        fn new(min_block_size: usize, max_block_size: usize) -> Self {
+            Self {
+                tuner: BlockSizeTuner::new(min_block_size, max_block_size),
+                now: Instant::now(),
+            }
+        }
+
+        /// Copies `num_blocks` blocks with a simulated device that takes `block_duration` for a
+        /// block of the given size. Returns the block size of every block.
+        fn run(
+            &mut self,
+            num_blocks: usize,
+            block_duration: impl Fn(usize) -> Duration,
+        ) -> Vec<usize> {
+            let mut block_sizes = Vec::new();
+            for _ in 0..num_blocks {
+                let block_size = self.tuner.block_size();
+                self.now += block_duration(block_size);
+                self.tuner.add_block_at(block_size, self.now);
+                block_sizes.push(block_size);
+            }
+            block_sizes
+        }
+    }
+
+    /// The distinct block sizes in the order they were used.
+    fn probed_sizes(block_sizes: &[usize]) -> Vec<usize> {
+        let mut sizes = block_sizes.to_vec();
+        sizes.dedup();
+        sizes
+    }
+
+    /// A device that takes 2 ms per request up to 256 KiB and gets slower per byte above that,
+    /// e.g. because larger requests are split.
+    fn device_with_sweet_spot(block_size: usize) -> Duration {
+        if block_size <= 256 * KIB {
+            Duration::from_millis(2)
+        } else {
+            Duration::from_micros(2500 * (block_size / (256 * KIB)) as u64)
+        }
+    }
+
+    #[test]
+    fn converges_to_fastest_size() {
+        let mut copy = SimulatedCopy::new(64 * KIB, 16 * 1024 * KIB);
+        let block_sizes = copy.run(2000, device_with_sweet_spot);
+
+        // two larger sizes are tried before going back to the fastest one
+        assert_eq!(
+            probed_sizes(&block_sizes),
+            [
+                64 * KIB,
+                128 * KIB,
+                256 * KIB,
+                512 * KIB,
+                1024 * KIB,
+                256 * KIB
+            ]
+        );
+        assert_eq!(copy.tuner.block_size(), 256 * KIB);
+        assert!(copy.tuner.settled);
+    }
+
+    #[test]
+    fn small_gain_is_not_picked() {
+        let mut copy = SimulatedCopy::new(64 * KIB, 16 * 1024 * KIB);
+        // 128 KiB blocks are twice as fast, larger ones only 4% faster than that
+        copy.run(2000, |block_size| {
+            let rate = match block_size {
+                size if size <= 64 * KIB => 100,
+                size if size <= 128 * KIB => 200,
+                _ => 208,
+            };
+            Duration::from_micros(block_size as u64 * 10 / rate)
+        });
+
+        assert_eq!(copy.tuner.block_size(), 128 * KIB);
+    }
+
+    #[test]
+    fn clamped_to_max_block_size() {
+        let mut copy = SimulatedCopy::new(64 * KIB, 256 * KIB);
+        // every request takes the same time, so larger blocks are always faster
+        let block_sizes = copy.run(2000, |_| Duration::from_millis(2));
+
+        assert_eq!(probed_sizes(&block_sizes), [64 * KIB, 128 * KIB, 256 * KIB]);
+        assert!(block_sizes.iter().all(|&size| size <= 256 * KIB));
+        assert!(copy.tuner.settled);
+    }
+
+    #[test]
+    fn min_block_size_clamped_to_max() {
+        let mut copy = SimulatedCopy::new(1024 * KIB, 256 * KIB);
+        assert_eq!(copy.tuner.block_size(), 256 * KIB);
+
+        let block_sizes = copy.run(100, |_| Duration::from_millis(50));
+        assert!(block_sizes.iter().all(|&size| size == 256 * KIB));
+        assert!(copy.tuner.settled);
+    }
+
+    #[test]
+    fn probe_needs_min_blocks_and_duration() {
+        // slow blocks: the probe still waits for the minimum number of blocks
+        let mut copy = SimulatedCopy::new(64 * KIB, 1024 * KIB);
+        let block_sizes = copy.run(PROBE_MIN_BLOCKS as usize, |_| Duration::from_secs(1));
+        assert!(block_sizes.iter().all(|&size| size == 64 * KIB));
+        copy.run(1, |_| Duration::from_secs(1));
+        assert_eq!(copy.tuner.block_size(), 128 * KIB);
+
+        // fast blocks: the probe still lasts the minimum duration
+        let mut copy = SimulatedCopy::new(64 * KIB, 1024 * KIB);
+        copy.run(250, |_| Duration::from_micros(990));
+        assert_eq!(copy.tuner.block_size(), 64 * KIB);
+        copy.run(10, |_| Duration::from_micros(990));
+        assert_eq!(copy.tuner.block_size(), 128 * KIB);
+    }
+
+    #[test]
+    fn settled_size_does_not_change() {
+        let mut copy = SimulatedCopy::new(64 * KIB, 16 * 1024 * KIB);
+        copy.run(2000, device_with_sweet_spot);
+        assert_eq!(copy.tuner.block_size(), 256 * KIB);
+
+        // the device getting much faster with large blocks later on does not matter anymore
+        let block_sizes = copy.run(1000, |block_size| {
+            Duration::from_micros(1_000_000 * 64 * KIB as u64 / block_size as u64)
+        });
+        assert!(block_sizes.iter().all(|&size| size == 256 * KIB));
+    }
+}
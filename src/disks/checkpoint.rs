@@ -0,0 +1,492 @@
+//! Checkpoints of restoring a disk image, so an interrupted restore can continue where it stopped
+//! instead of starting over.
+//!
+//! Besides how far the restore got, a checkpoint has a SHA-256 hash of every chunk written to the
+//! device, to make sure the data is still there before continuing after it. The checkpoints have
+//! the format of the ones of Create Disk Image (see `gducheckpoint.c`), plus the device. They are
+//! kept in the cache directory, as there is no place next to a device for them.
+//!
+//! The same hashes are used to verify a restored device by reading it back, see [`read_back`].
+
+use std::io::ErrorKind;
+use std::ops::Range;
+use std::os::unix::fs::FileExt;
+use std::path::PathBuf;
+use std::sync::{OnceLock, mpsc};
+
+use gtk::glib;
+use libgdu::gettext::gettext_f;
+
+use crate::page_aligned_buffer::PageAlignedBuffer;
+
+/// The size of the chunks that are hashed.
+pub const CHUNK_SIZE: u64 = 64 * 1024 * 1024;
+
+const GROUP: &str = "Checkpoint";
+
+fn sha256() -> glib::Checksum {
+    glib::Checksum::new(glib::ChecksumType::Sha256).expect("SHA-256 should be supported")
+}
+
+/// The hash of a chunk of zeroes, for the holes of sparse disk images that are zeroed on the
+/// device instead of written.
+fn zero_chunk_hash() -> &'static str {
+    static HASH: OnceLock<String> = OnceLock::new();
+    HASH.get_or_init(|| {
+        let zeroes = vec![0; 1024 * 1024];
+        let mut checksum = sha256();
+        for _ in 0..CHUNK_SIZE / zeroes.len() as u64 {
+            checksum.update(&zeroes);
+        }
+        checksum.string().expect("hash should be valid")
+    })
+}
+
+/// Hashes what is written to the device, chunk by chunk.
+#[derive(Debug)]
+pub struct ChunkHasher {
+    /// The hashes of the chunks written completely.
+    hashes: Vec<String>,
+    checksum: glib::Checksum,
+    chunk_filled: u64,
+}
+
+impl ChunkHasher {
+    /// Creates a hasher that continues after the chunks with the given `hashes`.
+    pub fn new(hashes: Vec<String>) -> Self {
+        Self {
+            hashes,
+            checksum: sha256(),
+            chunk_filled: 0,
+        }
+    }
+
+    /// Adds the next bytes written.
+    pub fn update(&mut self, mut data: &[u8]) {
+        while !data.is_empty() {
+            let len = data.len().min((CHUNK_SIZE - self.chunk_filled) as usize);
+            self.checksum.update(&data[..len]);
+            self.chunk_filled += len as u64;
+            if self.chunk_filled == CHUNK_SIZE {
+                let checksum = std::mem::replace(&mut self.checksum, sha256());
+                self.hashes
+                    .push(checksum.string().expect("hash should be valid"));
+                self.chunk_filled = 0;
+            }
+            data = &data[len..];
+        }
+    }
+
+    /// Like [`ChunkHasher::update`] for `len` zeroes.
+    pub fn update_zeroes(&mut self, mut len: u64) {
+        const ZEROES: [u8; 64 * 1024] = [0; 64 * 1024];
+        while len > 0 {
+            if self.chunk_filled == 0 && len >= CHUNK_SIZE {
+                self.hashes.push(zero_chunk_hash().to_owned());
+                len -= CHUNK_SIZE;
+                continue;
+            }
+            let n = len.min(ZEROES.len() as u64) as usize;
+            self.update(&ZEROES[..n]);
+            len -= n as u64;
+        }
+    }
+
+    /// The hashes of the chunks written completely.
+    pub fn hashes(&self) -> &[String] {
+        &self.hashes
+    }
+
+    /// The hashes of all chunks written, including the last one if it is not complete.
+    pub fn all_hashes(&self) -> Vec<String> {
+        let mut hashes = self.hashes.clone();
+        if self.chunk_filled > 0 {
+            hashes.push(
+                self.checksum
+                    .clone()
+                    .string()
+                    .expect("hash should be valid"),
+            );
+        }
+        hashes
+    }
+}
+
+/// Reads `len` bytes at `offset` back from `device` and returns their hash, to compare it with
+/// the one of [`ChunkHasher`].
+///
+/// The reads are rounded up to `alignment`, for devices opened with `O_DIRECT`. Reading the next
+/// block overlaps with hashing the previous one on another thread.
+///
+/// # Errors
+///
+/// Returns an error, if the device could not be read or ends before `offset + len`.
+pub fn read_back(
+    device: &std::fs::File,
+    offset: u64,
+    len: u64,
+    alignment: usize,
+) -> std::io::Result<String> {
+    const BLOCK_SIZE: usize = 4 * 1024 * 1024;
+    let (full_sender, full_receiver) = mpsc::channel::<(PageAlignedBuffer, usize)>();
+    let (free_sender, free_receiver) = mpsc::channel();
+    for _ in 0..2 {
+        free_sender
+            .send(PageAlignedBuffer::new(BLOCK_SIZE))
+            .expect("receiver should exist");
+    }
+
+    std::thread::scope(|scope| {
+        let hashing = scope.spawn(move || {
+            let mut checksum = sha256();
+            for (mut buffer, n) in full_receiver {
+                checksum.update(&buffer.as_mut_slice()[..n]);
+                // the reader is gone after an error
+                let _ = free_sender.send(buffer);
+            }
+            checksum.string().expect("hash should be valid")
+        });
+
+        let mut done = 0;
+        let result = loop {
+            if done == len {
+                break Ok(());
+            }
+            let mut buffer = free_receiver.recv().expect("hashing should not stop");
+            let wanted = (len - done).min(BLOCK_SIZE as u64) as usize;
+            let aligned = wanted.next_multiple_of(alignment).min(BLOCK_SIZE);
+            match device.read_at(&mut buffer.as_mut_slice()[..aligned], offset + done) {
+                Ok(0) => break Err(std::io::Error::from(ErrorKind::UnexpectedEof)),
+                Ok(n) => {
+                    let n = n.min(wanted);
+                    done += n as u64;
+                    full_sender
+                        .send((buffer, n))
+                        .expect("hashing should not stop");
+                }
+                // hand the buffer on, so the hashing thread hands it back
+                Err(err) if err.kind() == ErrorKind::Interrupted => full_sender
+                    .send((buffer, 0))
+                    .expect("hashing should not stop"),
+                Err(err) => break Err(err),
+            }
+        };
+        drop(full_sender);
+        let hash = hashing.join().expect("hashing should not panic");
+        result.map(|()| hash)
+    })
+}
+
+/// Reads back chunk `n` restored to `device` and returns whether it still has the `hash` of the
+/// checkpoint. The device is read without `O_DIRECT`.
+///
+/// # Errors
+///
+/// Returns an error, if the device could not be read.
+pub fn chunk_matches(device: &std::fs::File, n: usize, hash: &str) -> std::io::Result<bool> {
+    match read_back(device, n as u64 * CHUNK_SIZE, CHUNK_SIZE, 1) {
+        Ok(read_hash) => Ok(read_hash == hash),
+        // the device got smaller since
+        Err(err) if err.kind() == ErrorKind::UnexpectedEof => Ok(false),
+        Err(err) => Err(err),
+    }
+}
+
+/// The chunks read back from a device that do not match the ones written.
+#[derive(Debug, Default)]
+pub struct Mismatches(Vec<Range<u64>>);
+
+impl Mismatches {
+    /// Adds the chunk of `len` bytes at `offset`, which has to be after the ones added before.
+    pub fn add(&mut self, offset: u64, len: u64) {
+        match self.0.last_mut() {
+            Some(last) if last.end == offset => last.end = offset + len,
+            _ => self.0.push(offset..offset + len),
+        }
+    }
+
+    /// Whether all chunks matched.
+    pub fn is_empty(&self) -> bool {
+        self.0.is_empty()
+    }
+
+    /// The error listing the ranges that do not match. `size_for_display` formats their size.
+    pub fn into_error(self, size_for_display: impl FnOnce(u64) -> String) -> std::io::Error {
+        let num_bytes: u64 = self.0.iter().map(|range| range.end - range.start).sum();
+        let ranges: Vec<String> = self
+            .0
+            .iter()
+            .map(|range| format!("{}–{}", range.start, range.end))
+            .collect();
+        std::io::Error::new(
+            ErrorKind::InvalidData,
+            // Translators: Error shown if the data read back from the device after restoring a
+            // disk image is not what was written. The first {} is the amount of data
+            // (ex. "64 MB"), the second {} a list of the byte ranges (ex. "0–67108864").
+            gettext_f(
+                "{} of the data read back from the device does not match the disk image, at bytes {}. The device may be faulty.",
+                [size_for_display(num_bytes), ranges.join(", ")],
+            ),
+        )
+    }
+}
+
+/// A checkpoint of restoring a disk image to a device.
+#[derive(Debug, Default)]
+pub struct Checkpoint {
+    path: PathBuf,
+    source: String,
+    device: String,
+    size: u64,
+    /// The hashes of the chunks restored.
+    pub hashes: Vec<String>,
+}
+
+impl Checkpoint {
+    /// Loads the checkpoint of restoring `source` to `device` of `size` bytes, if there is one.
+    ///
+    /// `source` and `device` are strings identifying the disk image and the device, which should
+    /// stay the same when the device is attached again.
+    pub fn load(source: &str, device: &str, size: u64) -> Self {
+        let mut checksum = sha256();
+        checksum.update(format!("{source}\n{device}").as_bytes());
+        let name = checksum.string().expect("hash should be valid");
+        let path = glib::user_cache_dir()
+            .join("gnome-disk-utility")
+            .join("checkpoints")
+            .join(format!("{name}.ini"));
+
+        let mut checkpoint = Self {
+            path,
+            source: source.to_owned(),
+            device: device.to_owned(),
+            size,
+            hashes: Vec::new(),
+        };
+        match checkpoint.read_hashes() {
+            Ok(hashes) => checkpoint.hashes = hashes,
+            Err(err) if err.matches(glib::FileError::Noent) => {}
+            Err(err) => log::info!("Ignoring checkpoint {}: {err}", checkpoint.path.display()),
+        }
+        checkpoint
+    }
+
+    fn read_hashes(&self) -> Result<Vec<String>, glib::Error> {
+        let key_file = glib::KeyFile::new();
+        key_file.load_from_file(&self.path, glib::KeyFileFlags::NONE)?;
+
+        let hashes: Vec<String> = key_file
+            .string_list(GROUP, "ChunkHashes")?
+            .iter()
+            .map(|hash| hash.to_string())
+            .collect();
+        if key_file.string(GROUP, "Source")? != self.source
+            || key_file.string(GROUP, "Device")? != self.device
+            || key_file.uint64(GROUP, "Size")? != self.size
+            || key_file.uint64(GROUP, "ChunkSize")? != CHUNK_SIZE
+            || key_file.uint64(GROUP, "Offset")? != hashes.len() as u64 * CHUNK_SIZE
+            || hashes.iter().any(|hash| hash.len() != 64)
+        {
+            return Err(glib::Error::new(
+                glib::KeyFileError::InvalidValue,
+                "Checkpoint is of another restore",
+            ));
+        }
+        Ok(hashes)
+    }
+
+    /// The number of bytes the restore can continue after.
+    pub fn offset(&self) -> u64 {
+        self.hashes.len() as u64 * CHUNK_SIZE
+    }
+
+    /// Saves the checkpoint with the `hashes` of the chunks restored, which have to be synced to
+    /// the device before.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error, if the checkpoint could not be written.
+    pub fn save(&mut self, hashes: &[String]) -> std::io::Result<()> {
+        self.hashes = hashes.to_vec();
+
+        let key_file = glib::KeyFile::new();
+        key_file.set_string(GROUP, "Source", &self.source);
+        key_file.set_string(GROUP, "Device", &self.device);
+        key_file.set_uint64(GROUP, "Size", self.size);
+        key_file.set_uint64(GROUP, "ChunkSize", CHUNK_SIZE);
+        key_file.set_uint64(GROUP, "Offset", self.offset());
+        let hashes: Vec<&str> = self.hashes.iter().map(String::as_str).collect();
+        key_file.set_string_list(GROUP, "ChunkHashes", hashes.as_slice());
+
+        if let Some(dir) = self.path.parent() {
+            std::fs::create_dir_all(dir)?;
+        }
+        key_file
+            .save_to_file(&self.path)
+            .map_err(std::io::Error::other)
+    }
+
+    /// Removes the checkpoint, once the restore is complete.
+    pub fn remove(&self) {
+        if let Err(err) = std::fs::remove_file(&self.path) {
+            if err.kind() != ErrorKind::NotFound {
+                log::warn!("Error removing checkpoint {}: {err}", self.path.display());
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod checkpoint_tests {
+    use super::*;
+
+    fn hash(data: &[u8]) -> String {
+        let mut checksum = sha256();
+        checksum.update(data);
+        checksum.string().unwrap()
+    }
+
+    /// A chunk and a half of data that differs from chunk to chunk.
+    fn data() -> Vec<u8> {
+        let len = (CHUNK_SIZE + CHUNK_SIZE / 2) as usize;
+        (0..len).map(|n| (n / 4096 % 251) as u8).collect()
+    }
+
+    /// A file in the temporary directory that is removed again.
+    struct TempFile(PathBuf);
+
+    impl TempFile {
+        fn new(name: &str, data: &[u8]) -> Self {
+            let path =
+                std::env::temp_dir().join(format!("gdu-checkpoint-{}-{name}", std::process::id()));
+            std::fs::write(&path, data).unwrap();
+            Self(path)
+        }
+
+        fn open(&self) -> std::fs::File {
+            std::fs::File::open(&self.0).unwrap()
+        }
+    }
+
+    impl Drop for TempFile {
+        fn drop(&mut self) {
+            let _ = std::fs::remove_file(&self.0);
+        }
+    }
+
+    #[test]
+    fn hashes_split_at_chunk_boundaries() {
+        let data = data();
+        let chunk = CHUNK_SIZE as usize;
+        let expected = vec![hash(&data[..chunk]), hash(&data[chunk..])];
+
+        // the writes are not aligned to the chunks
+        let mut hasher = ChunkHasher::new(Vec::new());
+        for block in data.chunks(3 * 1024 * 1024 + 17) {
+            hasher.update(block);
+        }
+        assert_eq!(hasher.hashes(), &expected[..1]);
+        assert_eq!(hasher.all_hashes(), expected);
+
+        // nor do the writes of a continued restore start with a new chunk of the hasher
+        let mut hasher = ChunkHasher::new(vec!["previous".to_owned()]);
+        hasher.update(&data);
+        assert_eq!(
+            hasher.hashes(),
+            ["previous".to_owned(), expected[0].clone()]
+        );
+    }
+
+    #[test]
+    fn partial_final_chunk() {
+        let mut hasher = ChunkHasher::new(Vec::new());
+        assert!(hasher.all_hashes().is_empty());
+        hasher.update(b"disk image");
+        assert!(hasher.hashes().is_empty());
+        assert_eq!(hasher.all_hashes(), [hash(b"disk image")]);
+
+        // a chunk that is just complete has no partial chunk after it
+        let mut hasher = ChunkHasher::new(Vec::new());
+        hasher.update(&vec![1; CHUNK_SIZE as usize]);
+        assert_eq!(hasher.hashes().len(), 1);
+        assert_eq!(hasher.all_hashes().len(), 1);
+    }
+
+    #[test]
+    fn zeroes_hash_like_written_zeroes() {
+        let len = CHUNK_SIZE as usize * 2 + 1000;
+        let mut written = ChunkHasher::new(Vec::new());
+        written.update(b"data");
+        written.update(&vec![0; len]);
+
+        let mut zeroed = ChunkHasher::new(Vec::new());
+        zeroed.update(b"data");
+        zeroed.update_zeroes(len as u64);
+        assert_eq!(zeroed.all_hashes(), written.all_hashes());
+
+        // whole chunks of zeroes take the shortcut
+        let mut zeroed = ChunkHasher::new(Vec::new());
+        zeroed.update_zeroes(CHUNK_SIZE);
+        assert_eq!(zeroed.hashes(), [zero_chunk_hash().to_owned()]);
+        assert_eq!(
+            zero_chunk_hash(),
+            hash(&vec![0; CHUNK_SIZE as usize]).as_str()
+        );
+    }
+
+    #[test]
+    fn read_back_matches_hasher() {
+        let data = data();
+        let file = TempFile::new("read-back", &data);
+        let mut hasher = ChunkHasher::new(Vec::new());
+        hasher.update(&data);
+        let hashes = hasher.all_hashes();
+
+        let device = file.open();
+        assert_eq!(read_back(&device, 0, CHUNK_SIZE, 1).unwrap(), hashes[0]);
+        let rest = data.len() as u64 - CHUNK_SIZE;
+        assert_eq!(
+            read_back(&device, CHUNK_SIZE, rest, 512).unwrap(),
+            hashes[1]
+        );
+        let err = read_back(&device, CHUNK_SIZE, CHUNK_SIZE, 1).unwrap_err();
+        assert_eq!(err.kind(), ErrorKind::UnexpectedEof);
+    }
+
+    #[test]
+    fn chunk_mismatch_and_truncation() {
+        let mut data = data();
+        let chunk = CHUNK_SIZE as usize;
+        let hashes = vec![hash(&data[..chunk]), hash(&data[..chunk])];
+        let file = TempFile::new("chunk-matches", &data);
+        assert!(chunk_matches(&file.open(), 0, &hashes[0]).unwrap());
+        // the second chunk is different data and not even complete
+        assert!(!chunk_matches(&file.open(), 1, &hashes[1]).unwrap());
+
+        // a single changed byte
+        data[chunk / 2] ^= 0xff;
+        let file = TempFile::new("chunk-changed", &data);
+        assert!(!chunk_matches(&file.open(), 0, &hashes[0]).unwrap());
+
+        // the device is smaller than the checkpoint
+        let file = TempFile::new("chunk-truncated", &data[..chunk - 1]);
+        assert!(!chunk_matches(&file.open(), 0, &hashes[0]).unwrap());
+    }
+
+    #[test]
+    fn mismatches_merge_adjacent_chunks() {
+        let mut mismatches = Mismatches::default();
+        assert!(mismatches.is_empty());
+        mismatches.add(0, 10);
+        mismatches.add(10, 10);
+        mismatches.add(40, 5);
+        assert!(!mismatches.is_empty());
+        assert_eq!(mismatches.0, [0..20, 40..45]);
+
+        let err = mismatches.into_error(|num_bytes| format!("{num_bytes} bytes"));
+        assert_eq!(err.kind(), ErrorKind::InvalidData);
+        let message = err.to_string();
+        assert!(message.contains("25 bytes"), "{message}");
+        assert!(message.contains("0–20, 40–45"), "{message}");
+    }
+}
@@ -0,0 +1,69 @@
+use std::io::{ErrorKind, Read};
+
+use futures::channel::mpsc;
+use futures::{SinkExt, TryStreamExt};
+
+/// Size of the chunks [`ChunkSender::forward`] hands to the reader.
+pub const CHUNK_SIZE: usize = 4 * 1024 * 1024;
+/// Number of decoded chunks that may be waiting for the reader.
+const QUEUE_LENGTH: usize = 4;
+
+/// The sending side of [`spawn`], owned by the decoder thread.
+pub struct ChunkSender(mpsc::Sender<std::io::Result<Vec<u8>>>);
+
+impl ChunkSender {
+    /// Hands decoded data, or an error ending the stream, to the reader.
+    ///
+    /// Blocks while the reader is behind. Returns `false` once the reader is gone, e.g. because
+    /// the restore failed, so the thread should stop.
+    pub fn send(&mut self, chunk: std::io::Result<Vec<u8>>) -> bool {
+        futures::executor::block_on(self.0.send(chunk)).is_ok()
+    }
+
+    /// Reads all of `reader` and hands it to the reader in chunks.
+    ///
+    /// Returns `false` if reading failed or the reader is gone.
+    pub fn forward(&mut self, mut reader: impl Read) -> bool {
+        loop {
+            let chunk = read_chunk(&mut reader);
+            let failed = chunk.is_err();
+            let done = chunk.as_ref().is_ok_and(|chunk| chunk.len() < CHUNK_SIZE);
+            if !self.send(chunk) || failed {
+                return false;
+            }
+            if done {
+                return true;
+            }
+        }
+    }
+}
+
+/// Reads the next [`CHUNK_SIZE`] bytes of `reader`, or less at the end.
+pub fn read_chunk(reader: &mut impl Read) -> std::io::Result<Vec<u8>> {
+    let mut chunk = vec![0; CHUNK_SIZE];
+    let mut filled = 0;
+    while filled < chunk.len() {
+        match reader.read(&mut chunk[filled..]) {
+            Ok(0) => break,
+            Ok(n) => filled += n,
+            Err(err) if err.kind() == ErrorKind::Interrupted => continue,
+            Err(err) => return Err(err),
+        }
+    }
+    chunk.truncate(filled);
+    Ok(chunk)
+}
+
+/// Runs `decode` on a separate thread and returns a reader for the data it sends.
+///
+/// The thread already decodes the next chunks while the previous ones are consumed. Dropping the
+/// reader makes [`ChunkSender::send`] fail, which should stop the thread.
+pub fn spawn(
+    decode: impl FnOnce(&mut ChunkSender) + Send + 'static,
+) -> impl futures::io::AsyncRead + Unpin + 'static {
+    let (sender, receiver) = mpsc::channel(QUEUE_LENGTH);
+
+    std::thread::spawn(move || decode(&mut ChunkSender(sender)));
+
+    receiver.into_async_read()
+}
@@ -56,7 +56,7 @@ mod imp {
 
     impl GduEstimator {
         pub fn add_sample(&self, completed_bytes: u64) {
-            if completed_bytes >= self.completed_bytes.get() {
+            if completed_bytes < self.completed_bytes.get() {
                 return;
             }
             self.completed_bytes.set(completed_bytes);
@@ -69,7 +69,7 @@ mod imp {
                 time_usec: std::time::SystemTime::now()
                     .duration_since(std::time::UNIX_EPOCH)
                     .expect("`now()` should be after `UNIX_EPOCH`")
-                    .as_secs(),
+                    .as_micros() as u64,
                 value: completed_bytes,
             });
             self.update();
@@ -91,7 +91,10 @@ mod imp {
                 let speed = (sum_of_speeds / num_speeds as f64) as u64;
                 self.bytes_per_sec.set(speed);
                 if speed > 0 {
-                    let remaining_bytes = self.target_bytes.get() - self.completed_bytes.get();
+                    let remaining_bytes = self
+                        .target_bytes
+                        .get()
+                        .saturating_sub(self.completed_bytes.get());
                     self.usec_remaining
                         .set(G_USEC_PER_SEC as u64 * remaining_bytes / self.bytes_per_sec.get());
                 }
@@ -18,6 +18,7 @@
 #include <glib/gi18n.h>
 
 #include "gdu-attach-disk-image-dialog.h"
+#include "gdu-erase-multiple-disks-dialog.h"
 #include "gdu-format-volume-dialog.h"
 #include "gdu-job-manager.h"
 #include "gdu-log.h"
@@ -25,6 +26,7 @@
 #include "gdu-new-disk-image-dialog.h"
 #include "gdu-rust.h"
 #include "gdu-window.h"
+#include "gdubenchmarkcli.h"
 #include "gdulocaljob.h"
 #include "gdutypes.h"
 
@@ -178,11 +180,28 @@ cmd_verbose_cb (const gchar *option_name, const gchar *value, gpointer data, GEr
 
 static GOptionEntry opt_entries[] = {
     { "block-device", 0, 0, G_OPTION_ARG_STRING, NULL, N_("Select device"), "DEVICE" },
-      { "format-device", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Format selected device"), NULL },
-        { "verbose", 'v', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, cmd_verbose_cb,
-          N_("Show verbose logs, specify up to four times to increase log level"), NULL },
-          { "xid", 0, 0, G_OPTION_ARG_INT, NULL, N_("Ignored, kept for compatibility"), "ID" },
-            { "restore-disk-image", 0, 0, G_OPTION_ARG_FILENAME, NULL, N_("Restore disk image"), "FILE" }, { NULL } };
+    { "format-device", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Format selected device"), NULL },
+    { "verbose", 'v', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, cmd_verbose_cb,
+      N_("Show verbose logs, specify up to four times to increase log level"), NULL },
+    { "xid", 0, 0, G_OPTION_ARG_INT, NULL, N_("Ignored, kept for compatibility"), "ID" },
+    { "restore-disk-image", 0, 0, G_OPTION_ARG_FILENAME, NULL, N_("Restore disk image"), "FILE" },
+    { "benchmark", 0, 0, G_OPTION_ARG_FILENAME, NULL,
+      N_("Benchmark device without a window and print the results as JSON"), "DEVICE" },
+    { "benchmark-output", 0, 0, G_OPTION_ARG_FILENAME, NULL, N_("Write the benchmark results to FILE"), "FILE" },
+    { "benchmark-samples", 0, 0, G_OPTION_ARG_INT, NULL, N_("Number of transfer rate samples"), "N" },
+    { "benchmark-sample-size", 0, 0, G_OPTION_ARG_INT, NULL, N_("Size of a transfer rate sample in MiB"), "MIB" },
+    { "benchmark-access-samples", 0, 0, G_OPTION_ARG_INT, NULL, N_("Number of access time samples"), "N" },
+    { "benchmark-write", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Also benchmark writes, the data is put back"), NULL },
+    { "benchmark-queue-depth-sweep", 0, 0, G_OPTION_ARG_NONE, NULL, N_("Also benchmark reads at several queue depths"),
+      NULL },
+    { "benchmark-sustained-write", 0, 0, G_OPTION_ARG_NONE, NULL,
+      N_("Also write until the write cache runs out, needs --benchmark-write"), NULL },
+    { "benchmark-sustained-size", 0, 0, G_OPTION_ARG_INT, NULL, N_("Most data to write without stopping in GiB"),
+      "GIB" },
+    { "benchmark-sustained-minutes", 0, 0, G_OPTION_ARG_INT, NULL, N_("Longest time to write without stopping"),
+      "MINUTES" },
+    { NULL }
+};
 
 static void
 gdu_application_set_options (GduApplication *app)
@@ -190,6 +209,71 @@ gdu_application_set_options (GduApplication *app)
     g_application_add_main_option_entries (G_APPLICATION (app), opt_entries);
 }
 
+/* Looks up the positive integer option @name, if given */
+static gboolean
+lookup_positive_int (GVariantDict *options, const gchar *name, gint *value)
+{
+    if (!g_variant_dict_lookup (options, name, "i", value))
+        return TRUE;
+
+    if (*value > 0)
+        return TRUE;
+
+    g_printerr (_("--%s must be a positive number\n"), name);
+    return FALSE;
+}
+
+/* called in the local instance, before it tries to become the primary one */
+static gint
+gdu_application_handle_local_options (GApplication *_app, GVariantDict *options)
+{
+    GduBenchmarkOptions benchmark_options;
+    const gchar *opt_benchmark = NULL;
+    const gchar *opt_benchmark_output = NULL;
+    gint sample_size_mib = 0;
+    gint num_samples = 0;
+    gint num_access_samples = 0;
+    gint sustained_size_gib = 0;
+    gint sustained_minutes = 0;
+
+    /* a benchmark runs right here and exits, without a window or a primary instance */
+    if (!g_variant_dict_lookup (options, "benchmark", "^&ay", &opt_benchmark))
+        return -1;
+
+    /* the defaults of the schema rather than the settings of the dialog, so runs compare between machines */
+    gdu_benchmark_options_init (&benchmark_options);
+
+    g_variant_dict_lookup (options, "benchmark-output", "^&ay", &opt_benchmark_output);
+    g_variant_dict_lookup (options, "benchmark-write", "b", &benchmark_options.write);
+    g_variant_dict_lookup (options, "benchmark-queue-depth-sweep", "b", &benchmark_options.queue_depth_sweep);
+    g_variant_dict_lookup (options, "benchmark-sustained-write", "b", &benchmark_options.sustained_write);
+
+    if (!lookup_positive_int (options, "benchmark-samples", &num_samples)
+        || !lookup_positive_int (options, "benchmark-sample-size", &sample_size_mib)
+        || !lookup_positive_int (options, "benchmark-access-samples", &num_access_samples)
+        || !lookup_positive_int (options, "benchmark-sustained-size", &sustained_size_gib)
+        || !lookup_positive_int (options, "benchmark-sustained-minutes", &sustained_minutes))
+        return 2;
+
+    if (benchmark_options.sustained_write && !benchmark_options.write) {
+        g_printerr (_("--benchmark-sustained-write must be used together with --benchmark-write\n"));
+        return 2;
+    }
+
+    if (num_samples > 0)
+        benchmark_options.num_samples = num_samples;
+    if (sample_size_mib > 0)
+        benchmark_options.sample_size = (gsize) sample_size_mib * 1024 * 1024;
+    if (num_access_samples > 0)
+        benchmark_options.num_access_samples = num_access_samples;
+    if (sustained_size_gib > 0)
+        benchmark_options.sustained_write_size = (guint64) sustained_size_gib * 1024 * 1024 * 1024;
+    if (sustained_minutes > 0)
+        benchmark_options.sustained_write_usec = (gint64) sustained_minutes * 60 * G_USEC_PER_SEC;
+
+    return gdu_benchmark_cli_run (opt_benchmark, &benchmark_options, opt_benchmark_output);
+}
+
 /* called in primary instance */
 static gint
 gdu_application_command_line (GApplication *_app, GApplicationCommandLine *command_line)
@@ -298,6 +382,14 @@ attach_disk_image_activated (GSimpleAction *action, GVariant *parameter, gpointe
     gdu_attach_disk_image_dialog_show (GTK_WINDOW (app->window), app->disk_manager);
 }
 
+static void
+erase_multiple_disks_activated (GSimpleAction *action, GVariant *parameter, gpointer user_data)
+{
+    GduApplication *app = GDU_APPLICATION (user_data);
+
+    gdu_erase_multiple_disks_dialog_show (GTK_WINDOW (app->window), app->client);
+}
+
 static void
 about_activated (GSimpleAction *action, GVariant *parameter, gpointer user_data)
 {
@@ -350,6 +442,7 @@ help_activated (GSimpleAction *action, GVariant *parameter, gpointer user_data)
 
 static GActionEntry app_entries[] = { { "new_disk_image", new_disk_image_activated, NULL, NULL, NULL },
                                       { "attach_disk_image", attach_disk_image_activated, NULL, NULL, NULL },
+                                      { "erase_multiple_disks", erase_multiple_disks_activated, NULL, NULL, NULL },
                                       { "help", help_activated, NULL, NULL, NULL },
                                       { "about", about_activated, NULL, NULL, NULL },
                                       { "quit", gdu_application_quit, NULL, NULL, NULL } };
@@ -428,6 +521,7 @@ gdu_application_class_init (GduApplicationClass *klass)
 
     application_class = G_APPLICATION_CLASS (klass);
 
+    application_class->handle_local_options = gdu_application_handle_local_options;
     application_class->command_line = gdu_application_command_line;
     application_class->activate = gdu_application_activate;
     application_class->startup = gdu_application_startup;
@@ -25,6 +25,8 @@
 #include "gsk/gsk.h"
 #include "gtk/gtk.h"
 
+#include "gdubenchmark.h"
+
 struct _GduBenchmarkSample {
     GObject parent_instance;
 
@@ -49,6 +51,11 @@ struct _GduBenchmarkGraph {
     GListStore *read_samples;
     GListStore *write_samples;
     GListStore *atime_samples;
+    /* of GduBenchmarkSweepPoint, only set on the queue depth graph */
+    GArray *sweep_points;
+    /* of GduBenchmarkSustainedSample, only set on the sustained write graph */
+    GArray *sustained_samples;
+    GduBenchmarkSustainedResult *sustained_result;
 };
 
 G_DEFINE_FINAL_TYPE (GduBenchmarkGraph, gdu_benchmark_graph, ADW_TYPE_BIN)
@@ -68,7 +75,13 @@ struct _GduBenchmarkDialog {
     GtkWidget *sample_row;
     GtkWidget *sample_size_row;
     GtkWidget *access_samples_row;
+    GtkWidget *sweep_switch;
     GtkWidget *write_bench_switch;
+    GtkWidget *scratch_file_switch;
+    GtkWidget *sustained_settings_group;
+    GtkWidget *sustained_write_switch;
+    GtkWidget *sustained_size_row;
+    GtkWidget *sustained_minutes_row;
 
     /* Results Page */
     GtkWidget *benchmark_graph;
@@ -76,15 +89,32 @@ struct _GduBenchmarkDialog {
     GtkWidget *read_rate_row;
     GtkWidget *write_rate_row;
     GtkWidget *access_time_row;
+    GtkWidget *random_read_row;
+    GtkWidget *random_read_latency_row;
+    GtkWidget *random_write_row;
+    GtkWidget *random_write_latency_row;
+    GtkWidget *sweep_group;
+    GtkWidget *sweep_graph;
+    GtkWidget *sweep_sequential_row;
+    GtkWidget *sweep_random_row;
+    GtkWidget *sustained_group;
+    GtkWidget *sustained_graph;
+    GtkWidget *sustained_burst_row;
+    GtkWidget *sustained_cliff_row;
+    GtkWidget *sustained_steady_row;
 
     /* must hold benchmark_lock when reading/writing these */
     GError *benchmark_error;
+    GduBenchmarkRandomResult *random_read_result;
+    GduBenchmarkRandomResult *random_write_result;
     GCancellable *benchmark_cancellable;
     gboolean benchmark_in_progress;
     gboolean benchmark_update_timeout_pending;
     guint benchmark_update_timeout_id;
 
     GSettings *settings;
+    /* where to create the scratch file, or NULL to benchmark the device */
+    gchar *scratch_directory;
     UDisksClient *client;
     UDisksObject *object;
     UDisksBlock *block;
@@ -111,16 +141,28 @@ gdu_benchmark_dialog_load_options (GduBenchmarkDialog *self)
     gint sample_size_mib;
     gint num_access_samples;
     gboolean write_benchmark;
+    gboolean queue_depth_sweep;
+    gboolean sustained_write;
+    gint sustained_write_size_gib;
+    gint sustained_write_minutes;
 
     num_samples = g_settings_get_int (self->settings, "num-samples");
     sample_size_mib = g_settings_get_int (self->settings, "sample-size-mib");
     num_access_samples = g_settings_get_int (self->settings, "num-access-samples");
     write_benchmark = g_settings_get_boolean (self->settings, "do-write");
+    queue_depth_sweep = g_settings_get_boolean (self->settings, "do-queue-depth-sweep");
+    sustained_write = g_settings_get_boolean (self->settings, "do-sustained-write");
+    sustained_write_size_gib = g_settings_get_int (self->settings, "sustained-write-size-gib");
+    sustained_write_minutes = g_settings_get_int (self->settings, "sustained-write-minutes");
 
     adw_spin_row_set_value (ADW_SPIN_ROW (self->sample_row), num_samples);
     adw_spin_row_set_value (ADW_SPIN_ROW (self->sample_size_row), sample_size_mib);
     adw_spin_row_set_value (ADW_SPIN_ROW (self->access_samples_row), num_access_samples);
     adw_switch_row_set_active (ADW_SWITCH_ROW (self->write_bench_switch), write_benchmark);
+    adw_switch_row_set_active (ADW_SWITCH_ROW (self->sweep_switch), queue_depth_sweep);
+    adw_switch_row_set_active (ADW_SWITCH_ROW (self->sustained_write_switch), sustained_write);
+    adw_spin_row_set_value (ADW_SPIN_ROW (self->sustained_size_row), sustained_write_size_gib);
+    adw_spin_row_set_value (ADW_SPIN_ROW (self->sustained_minutes_row), sustained_write_minutes);
 }
 
 static void
@@ -130,16 +172,28 @@ gdu_benchmark_dialog_save_options (GduBenchmarkDialog *self)
     gint sample_size_mib;
     gint num_access_samples;
     gboolean write_benchmark;
+    gboolean queue_depth_sweep;
+    gboolean sustained_write;
+    gint sustained_write_size_gib;
+    gint sustained_write_minutes;
 
     num_samples = adw_spin_row_get_value (ADW_SPIN_ROW (self->sample_row));
     sample_size_mib = adw_spin_row_get_value (ADW_SPIN_ROW (self->sample_size_row));
     num_access_samples = adw_spin_row_get_value (ADW_SPIN_ROW (self->access_samples_row));
     write_benchmark = adw_switch_row_get_active (ADW_SWITCH_ROW (self->write_bench_switch));
+    queue_depth_sweep = adw_switch_row_get_active (ADW_SWITCH_ROW (self->sweep_switch));
+    sustained_write = adw_switch_row_get_active (ADW_SWITCH_ROW (self->sustained_write_switch));
+    sustained_write_size_gib = adw_spin_row_get_value (ADW_SPIN_ROW (self->sustained_size_row));
+    sustained_write_minutes = adw_spin_row_get_value (ADW_SPIN_ROW (self->sustained_minutes_row));
 
     g_settings_set_int (self->settings, "num-samples", num_samples);
     g_settings_set_int (self->settings, "sample-size-mib", sample_size_mib);
     g_settings_set_int (self->settings, "num-access-samples", num_access_samples);
     g_settings_set_boolean (self->settings, "do-write", write_benchmark);
+    g_settings_set_boolean (self->settings, "do-queue-depth-sweep", queue_depth_sweep);
+    g_settings_set_boolean (self->settings, "do-sustained-write", sustained_write);
+    g_settings_set_int (self->settings, "sustained-write-size-gib", sustained_write_size_gib);
+    g_settings_set_int (self->settings, "sustained-write-minutes", sustained_write_minutes);
 }
 
 static BenchmarkStats
@@ -657,12 +711,441 @@ draw_curve (GdkSnapshot *snapshot, GraphData *graph_data)
     gtk_snapshot_append_stroke (snapshot, path, stroke, graph_data->color);
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+/* Queue depth graph
+ *
+ * The sequential read rate (left axis) and random read IOPS (right axis) against the queue depth, which
+ * is on a log scale. Every number of jobs gets a pair of lines, solid for one job and dashed for more.
+ */
+
+#define SWEEP_NUM_HLINES 5
+
+static gdouble
+get_sweep_x (GraphData *graph_data, guint queue_depth)
+{
+    return graph_data->graph_x
+           + log2 (queue_depth) / log2 (GDU_BENCHMARK_SWEEP_MAX_QUEUE_DEPTH) * graph_data->graph_width;
+}
+
+static PangoLayout *
+create_label_layout (GtkWidget *widget, const PangoFontDescription *font_desc, const gchar *text)
+{
+    PangoLayout *layout;
+
+    layout = gtk_widget_create_pango_layout (widget, text);
+    pango_layout_set_font_description (layout, font_desc);
+
+    return layout;
+}
+
+static void
+append_label_layout (GtkSnapshot *snapshot, PangoLayout *layout, gdouble x, gdouble y, gfloat angle,
+                     const GdkRGBA *color)
+{
+    gtk_snapshot_save (snapshot);
+    gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (x, y));
+    gtk_snapshot_rotate (snapshot, angle);
+    gtk_snapshot_append_layout (snapshot, layout, color);
+    gtk_snapshot_restore (snapshot);
+}
+
+static gchar *
+format_axis_label (gdouble value, gboolean iops)
+{
+    /* MB/s and thousands of IOPS */
+    if (iops)
+        return g_strdup_printf ("%gk", value / 1000);
+    return g_strdup_printf ("%.0f", value / (1000 * 1000));
+}
+
+static void
+draw_sweep_curve (GtkSnapshot *snapshot, GraphData *graph_data, GArray *points, guint num_jobs, gboolean iops,
+                  gdouble max_value, const GdkRGBA *color)
+{
+    g_autoptr(GskPathBuilder) builder = NULL;
+    g_autoptr(GskStroke) stroke = NULL;
+    g_autoptr(GskPath) path = NULL;
+    gboolean first = TRUE;
+    guint n;
+
+    builder = gsk_path_builder_new ();
+    for (n = 0; n < points->len; n++) {
+        GduBenchmarkSweepPoint *point = &g_array_index (points, GduBenchmarkSweepPoint, n);
+        graphene_point_t p;
+
+        if (point->num_jobs != num_jobs)
+            continue;
+
+        p.x = get_sweep_x (graph_data, point->queue_depth);
+        p.y = graph_data->graph_y + graph_data->graph_height
+              - ((iops ? point->iops : point->bytes_per_sec) / max_value * graph_data->graph_height);
+
+        if (first)
+            gsk_path_builder_move_to (builder, p.x, p.y);
+        else
+            gsk_path_builder_line_to (builder, p.x, p.y);
+        gsk_path_builder_add_circle (builder, &p, 2);
+        gsk_path_builder_move_to (builder, p.x, p.y);
+        first = FALSE;
+    }
+
+    path = gsk_path_builder_free_to_path (g_steal_pointer (&builder));
+    stroke = gsk_stroke_new (GRAPH_CURVE_WIDTH);
+    if (num_jobs > 1)
+        gsk_stroke_set_dash (stroke, GRID_LINE_DASH, 2);
+    gtk_snapshot_append_stroke (snapshot, path, stroke, color);
+}
+
+static void
+gdu_benchmark_graph_snapshot_sweep (GduBenchmarkGraph *self, GtkSnapshot *snapshot)
+{
+    GtkWidget *widget = GTK_WIDGET (self);
+    g_autoptr(GArray) points = NULL;
+    g_autoptr(PangoFontDescription) label_font_desc = NULL;
+    g_autoptr(PangoFontDescription) axis_title_font_desc = NULL;
+    g_autoptr(PangoLayout) speed_title = NULL;
+    g_autoptr(PangoLayout) iops_title = NULL;
+    g_autoptr(PangoLayout) depth_title = NULL;
+    g_autoptr(GskPathBuilder) builder = NULL;
+    g_autoptr(GskStroke) stroke = NULL;
+    g_autoptr(GskPath) path = NULL;
+    PangoContext *pango_context;
+    GraphData graph_data = { 0 };
+    const GdkRGBA *text_color;
+    const GdkRGBA *grid_line_color;
+    gdouble max_bytes_per_sec = 1.0;
+    gdouble max_iops = 1.0;
+    gint left_width = 0, right_width = 0;
+    gint text_width, text_height = 0;
+    gint title_width, title_height;
+    gint font_size;
+    gdouble padding = 6;
+    guint prev_num_jobs = 0;
+    guint n, j;
+
+    /* the points are added by the benchmark thread */
+    G_LOCK (benchmark_lock);
+    points = g_array_copy (self->sweep_points);
+    G_UNLOCK (benchmark_lock);
+
+    for (n = 0; n < points->len; n++) {
+        GduBenchmarkSweepPoint *point = &g_array_index (points, GduBenchmarkSweepPoint, n);
+
+        max_bytes_per_sec = MAX (max_bytes_per_sec, point->bytes_per_sec);
+        max_iops = MAX (max_iops, point->iops);
+    }
+
+    /* round up to next multiple of 10 MB/s and 1000 IOPS per line */
+    max_bytes_per_sec = ceil (max_bytes_per_sec / (SWEEP_NUM_HLINES * 10 * 1000 * 1000))
+                        * SWEEP_NUM_HLINES * 10 * 1000 * 1000;
+    max_iops = ceil (max_iops / (SWEEP_NUM_HLINES * 1000)) * SWEEP_NUM_HLINES * 1000;
+
+    grid_line_color =
+        get_color_hc (widget, &GRID_LINE_COLOR, &GRID_LINE_COLOR_DARK, &GRID_LINE_COLOR_HC, &GRID_LINE_COLOR_HC_DARK);
+    text_color = get_color (widget, &LABEL_COLOR, &LABEL_COLOR_DARK);
+
+    pango_context = gtk_widget_get_pango_context (widget);
+    label_font_desc = pango_font_description_copy (pango_context_get_font_description (pango_context));
+    axis_title_font_desc = pango_font_description_copy (pango_context_get_font_description (pango_context));
+    font_size = pango_font_description_get_size (label_font_desc);
+    pango_font_description_set_absolute_size (label_font_desc, PANGO_SCALE_X_SMALL * font_size);
+    pango_font_description_set_absolute_size (axis_title_font_desc, PANGO_SCALE_SMALL * font_size);
+
+    speed_title = create_label_layout (widget, axis_title_font_desc, _("Sequential Read (MB/s)"));
+    iops_title = create_label_layout (widget, axis_title_font_desc, _("Random Read (IOPS)"));
+    depth_title = create_label_layout (widget, axis_title_font_desc, _("Queue Depth"));
+    pango_layout_get_pixel_size (depth_title, NULL, &title_height);
+
+    /* the graph is placed between the widest labels */
+    for (j = 0; j <= SWEEP_NUM_HLINES; j++) {
+        g_autofree gchar *speed_label = format_axis_label (j * max_bytes_per_sec / SWEEP_NUM_HLINES, FALSE);
+        g_autofree gchar *iops_label = format_axis_label (j * max_iops / SWEEP_NUM_HLINES, TRUE);
+        g_autoptr(PangoLayout) speed_layout = create_label_layout (widget, label_font_desc, speed_label);
+        g_autoptr(PangoLayout) iops_layout = create_label_layout (widget, label_font_desc, iops_label);
+
+        pango_layout_get_pixel_size (speed_layout, &text_width, &text_height);
+        left_width = MAX (left_width, text_width);
+        pango_layout_get_pixel_size (iops_layout, &text_width, &text_height);
+        right_width = MAX (right_width, text_width);
+    }
+
+    graph_data.width = gtk_widget_get_width (widget);
+    graph_data.height = gtk_widget_get_height (widget);
+    graph_data.graph_x = title_height + left_width + 2 * padding;
+    graph_data.graph_y = text_height / 2;
+    graph_data.graph_width = graph_data.width - graph_data.graph_x - (title_height + right_width + 2 * padding);
+    graph_data.graph_height = graph_data.height - graph_data.graph_y - (text_height + title_height + 2 * padding);
+    if (graph_data.graph_width <= 0 || graph_data.graph_height <= 0)
+        return;
+
+    gdu_benchmark_graph_draw_box (widget, snapshot, &graph_data);
+
+    builder = gsk_path_builder_new ();
+    for (j = 0; j <= SWEEP_NUM_HLINES; j++) {
+        g_autofree gchar *speed_label = format_axis_label (j * max_bytes_per_sec / SWEEP_NUM_HLINES, FALSE);
+        g_autofree gchar *iops_label = format_axis_label (j * max_iops / SWEEP_NUM_HLINES, TRUE);
+        g_autoptr(PangoLayout) speed_layout = create_label_layout (widget, label_font_desc, speed_label);
+        g_autoptr(PangoLayout) iops_layout = create_label_layout (widget, label_font_desc, iops_label);
+        gdouble y;
+
+        y = graph_data.graph_y + graph_data.graph_height - ((gdouble) j * graph_data.graph_height / SWEEP_NUM_HLINES);
+
+        pango_layout_get_pixel_size (speed_layout, &text_width, &text_height);
+        append_label_layout (snapshot, speed_layout, graph_data.graph_x - padding - text_width,
+                             y - (text_height / 2.0), 0, text_color);
+        pango_layout_get_pixel_size (iops_layout, &text_width, &text_height);
+        append_label_layout (snapshot, iops_layout, graph_data.graph_x + graph_data.graph_width + padding,
+                             y - (text_height / 2.0), 0, text_color);
+
+        if (j != 0 && j != SWEEP_NUM_HLINES) {
+            gsk_path_builder_move_to (builder, graph_data.graph_x, y);
+            gsk_path_builder_line_to (builder, graph_data.graph_x + graph_data.graph_width, y);
+        }
+    }
+
+    for (n = 1; n <= GDU_BENCHMARK_SWEEP_MAX_QUEUE_DEPTH; n *= 2) {
+        g_autofree gchar *label = g_strdup_printf ("%u", n);
+        g_autoptr(PangoLayout) layout = create_label_layout (widget, label_font_desc, label);
+        gdouble x = get_sweep_x (&graph_data, n);
+
+        pango_layout_get_pixel_size (layout, &text_width, &text_height);
+        append_label_layout (snapshot, layout, x - (text_width / 2.0),
+                             graph_data.graph_y + graph_data.graph_height + padding / 2, 0, text_color);
+
+        if (n != 1 && n != GDU_BENCHMARK_SWEEP_MAX_QUEUE_DEPTH) {
+            gsk_path_builder_move_to (builder, x, graph_data.graph_y);
+            gsk_path_builder_line_to (builder, x, graph_data.graph_y + graph_data.graph_height);
+        }
+    }
+
+    path = gsk_path_builder_free_to_path (g_steal_pointer (&builder));
+    stroke = gsk_stroke_new (GRID_LINE_WIDTH);
+    gtk_snapshot_append_stroke (snapshot, path, stroke, grid_line_color);
+
+    pango_layout_get_pixel_size (speed_title, &title_width, NULL);
+    append_label_layout (snapshot, speed_title, 0, graph_data.graph_y + (graph_data.graph_height + title_width) / 2.0,
+                         -90.0, text_color);
+    pango_layout_get_pixel_size (iops_title, &title_width, NULL);
+    append_label_layout (snapshot, iops_title, graph_data.width,
+                         graph_data.graph_y + (graph_data.graph_height - title_width) / 2.0, 90.0, text_color);
+    pango_layout_get_pixel_size (depth_title, &title_width, NULL);
+    append_label_layout (snapshot, depth_title, graph_data.graph_x + (graph_data.graph_width - title_width) / 2.0,
+                         graph_data.height - title_height, 0, text_color);
+
+    /* the points come ordered by the number of jobs */
+    for (n = 0; n < points->len; n++) {
+        GduBenchmarkSweepPoint *point = &g_array_index (points, GduBenchmarkSweepPoint, n);
+
+        if (point->num_jobs == prev_num_jobs)
+            continue;
+        prev_num_jobs = point->num_jobs;
+
+        draw_sweep_curve (snapshot, &graph_data, points, point->num_jobs, FALSE, max_bytes_per_sec,
+                          &READ_CURVE_COLOR);
+        draw_sweep_curve (snapshot, &graph_data, points, point->num_jobs, TRUE, max_iops, &IOPS_CURVE_COLOR);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Sustained write graph
+ *
+ * The write rate against the time spent writing. Once the writing is done, dashed lines mark where the
+ * write cache ran out and the steady rate after it.
+ */
+
+#define SUSTAINED_NUM_HLINES 5
+#define SUSTAINED_NUM_VLINES 6
+
+static void
+gdu_benchmark_graph_snapshot_sustained (GduBenchmarkGraph *self, GtkSnapshot *snapshot)
+{
+    GtkWidget *widget = GTK_WIDGET (self);
+    g_autoptr(GArray) samples = NULL;
+    g_autoptr(PangoFontDescription) label_font_desc = NULL;
+    g_autoptr(PangoFontDescription) axis_title_font_desc = NULL;
+    g_autoptr(PangoLayout) speed_title = NULL;
+    g_autoptr(PangoLayout) time_title = NULL;
+    g_autoptr(GskPathBuilder) builder = NULL;
+    g_autoptr(GskStroke) stroke = NULL;
+    g_autoptr(GskPath) path = NULL;
+    GduBenchmarkSustainedResult result = { 0 };
+    gboolean have_result = FALSE;
+    PangoContext *pango_context;
+    GraphData graph_data = { 0 };
+    const GdkRGBA *text_color;
+    const GdkRGBA *grid_line_color;
+    gdouble max_bytes_per_sec = 1.0;
+    gdouble max_sec = 1.0;
+    gint left_width = 0;
+    gint text_width, text_height = 0;
+    gint title_width, title_height;
+    gint font_size;
+    gdouble padding = 6;
+    guint n;
+
+    /* the samples are added by the benchmark thread */
+    G_LOCK (benchmark_lock);
+    samples = g_array_copy (self->sustained_samples);
+    if (self->sustained_result != NULL) {
+        result = *self->sustained_result;
+        have_result = TRUE;
+    }
+    G_UNLOCK (benchmark_lock);
+
+    for (n = 0; n < samples->len; n++) {
+        GduBenchmarkSustainedSample *sample = &g_array_index (samples, GduBenchmarkSustainedSample, n);
+
+        max_bytes_per_sec = MAX (max_bytes_per_sec, sample->bytes_per_sec);
+        max_sec = MAX (max_sec, (gdouble) sample->usec / G_USEC_PER_SEC);
+    }
+
+    /* round up to next multiple of 10 MB/s and a second per line */
+    max_bytes_per_sec = ceil (max_bytes_per_sec / (SUSTAINED_NUM_HLINES * 10 * 1000 * 1000))
+                        * SUSTAINED_NUM_HLINES * 10 * 1000 * 1000;
+    max_sec = ceil (max_sec / SUSTAINED_NUM_VLINES) * SUSTAINED_NUM_VLINES;
+
+    grid_line_color =
+        get_color_hc (widget, &GRID_LINE_COLOR, &GRID_LINE_COLOR_DARK, &GRID_LINE_COLOR_HC, &GRID_LINE_COLOR_HC_DARK);
+    text_color = get_color (widget, &LABEL_COLOR, &LABEL_COLOR_DARK);
+
+    pango_context = gtk_widget_get_pango_context (widget);
+    label_font_desc = pango_font_description_copy (pango_context_get_font_description (pango_context));
+    axis_title_font_desc = pango_font_description_copy (pango_context_get_font_description (pango_context));
+    font_size = pango_font_description_get_size (label_font_desc);
+    pango_font_description_set_absolute_size (label_font_desc, PANGO_SCALE_X_SMALL * font_size);
+    pango_font_description_set_absolute_size (axis_title_font_desc, PANGO_SCALE_SMALL * font_size);
+
+    speed_title = create_label_layout (widget, axis_title_font_desc, _("Write Rate (MB/s)"));
+    time_title = create_label_layout (widget, axis_title_font_desc, _("Time Spent Writing (s)"));
+    pango_layout_get_pixel_size (time_title, NULL, &title_height);
+
+    for (n = 0; n <= SUSTAINED_NUM_HLINES; n++) {
+        g_autofree gchar *label = format_axis_label (n * max_bytes_per_sec / SUSTAINED_NUM_HLINES, FALSE);
+        g_autoptr(PangoLayout) layout = create_label_layout (widget, label_font_desc, label);
+
+        pango_layout_get_pixel_size (layout, &text_width, &text_height);
+        left_width = MAX (left_width, text_width);
+    }
+
+    graph_data.width = gtk_widget_get_width (widget);
+    graph_data.height = gtk_widget_get_height (widget);
+    graph_data.graph_x = title_height + left_width + 2 * padding;
+    graph_data.graph_y = text_height / 2;
+    graph_data.graph_width = graph_data.width - graph_data.graph_x - 3 * padding;
+    graph_data.graph_height = graph_data.height - graph_data.graph_y - (text_height + title_height + 2 * padding);
+    if (graph_data.graph_width <= 0 || graph_data.graph_height <= 0)
+        return;
+
+    gdu_benchmark_graph_draw_box (widget, snapshot, &graph_data);
+
+    builder = gsk_path_builder_new ();
+    for (n = 0; n <= SUSTAINED_NUM_HLINES; n++) {
+        g_autofree gchar *label = format_axis_label (n * max_bytes_per_sec / SUSTAINED_NUM_HLINES, FALSE);
+        g_autoptr(PangoLayout) layout = create_label_layout (widget, label_font_desc, label);
+        gdouble y;
+
+        y = graph_data.graph_y + graph_data.graph_height
+            - ((gdouble) n * graph_data.graph_height / SUSTAINED_NUM_HLINES);
+
+        pango_layout_get_pixel_size (layout, &text_width, &text_height);
+        append_label_layout (snapshot, layout, graph_data.graph_x - padding - text_width, y - (text_height / 2.0), 0,
+                             text_color);
+
+        if (n != 0 && n != SUSTAINED_NUM_HLINES) {
+            gsk_path_builder_move_to (builder, graph_data.graph_x, y);
+            gsk_path_builder_line_to (builder, graph_data.graph_x + graph_data.graph_width, y);
+        }
+    }
+
+    for (n = 0; n <= SUSTAINED_NUM_VLINES; n++) {
+        g_autofree gchar *label = g_strdup_printf ("%.0f", n * max_sec / SUSTAINED_NUM_VLINES);
+        g_autoptr(PangoLayout) layout = create_label_layout (widget, label_font_desc, label);
+        gdouble x = graph_data.graph_x + ((gdouble) n * graph_data.graph_width / SUSTAINED_NUM_VLINES);
+
+        pango_layout_get_pixel_size (layout, &text_width, &text_height);
+        append_label_layout (snapshot, layout, x - (text_width / 2.0),
+                             graph_data.graph_y + graph_data.graph_height + padding / 2, 0, text_color);
+
+        if (n != 0 && n != SUSTAINED_NUM_VLINES) {
+            gsk_path_builder_move_to (builder, x, graph_data.graph_y);
+            gsk_path_builder_line_to (builder, x, graph_data.graph_y + graph_data.graph_height);
+        }
+    }
+
+    path = gsk_path_builder_free_to_path (g_steal_pointer (&builder));
+    stroke = gsk_stroke_new (GRID_LINE_WIDTH);
+    gtk_snapshot_append_stroke (snapshot, path, stroke, grid_line_color);
+    g_clear_pointer (&path, gsk_path_unref);
+    g_clear_pointer (&stroke, gsk_stroke_free);
+
+    pango_layout_get_pixel_size (speed_title, &title_width, NULL);
+    append_label_layout (snapshot, speed_title, 0, graph_data.graph_y + (graph_data.graph_height + title_width) / 2.0,
+                         -90.0, text_color);
+    pango_layout_get_pixel_size (time_title, &title_width, NULL);
+    append_label_layout (snapshot, time_title, graph_data.graph_x + (graph_data.graph_width - title_width) / 2.0,
+                         graph_data.height - title_height, 0, text_color);
+
+    if (samples->len > 0) {
+        builder = gsk_path_builder_new ();
+        for (n = 0; n < samples->len; n++) {
+            GduBenchmarkSustainedSample *sample = &g_array_index (samples, GduBenchmarkSustainedSample, n);
+            gdouble x, y;
+
+            x = graph_data.graph_x + (sample->usec / (max_sec * G_USEC_PER_SEC) * graph_data.graph_width);
+            y = graph_data.graph_y + graph_data.graph_height
+                - (sample->bytes_per_sec / max_bytes_per_sec * graph_data.graph_height);
+            if (n == 0)
+                gsk_path_builder_move_to (builder, x, y);
+            else
+                gsk_path_builder_line_to (builder, x, y);
+        }
+
+        path = gsk_path_builder_free_to_path (g_steal_pointer (&builder));
+        stroke = gsk_stroke_new (GRAPH_CURVE_WIDTH);
+        gtk_snapshot_append_stroke (snapshot, path, stroke, &WRITE_CURVE_COLOR);
+        g_clear_pointer (&path, gsk_path_unref);
+        g_clear_pointer (&stroke, gsk_stroke_free);
+    }
+
+    if (have_result && result.cliff_usec >= 0) {
+        gdouble x, y;
+
+        builder = gsk_path_builder_new ();
+
+        x = graph_data.graph_x + (result.cliff_usec / (max_sec * G_USEC_PER_SEC) * graph_data.graph_width);
+        gsk_path_builder_move_to (builder, x, graph_data.graph_y);
+        gsk_path_builder_line_to (builder, x, graph_data.graph_y + graph_data.graph_height);
+
+        y = graph_data.graph_y + graph_data.graph_height
+            - (result.steady_bytes_per_sec / max_bytes_per_sec * graph_data.graph_height);
+        gsk_path_builder_move_to (builder, x, y);
+        gsk_path_builder_line_to (builder, graph_data.graph_x + graph_data.graph_width, y);
+
+        path = gsk_path_builder_free_to_path (g_steal_pointer (&builder));
+        stroke = gsk_stroke_new (GRID_LINE_WIDTH);
+        gsk_stroke_set_dash (stroke, GRID_LINE_DASH, 2);
+        gtk_snapshot_append_stroke (snapshot, path, stroke, text_color);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
 static void
 gdu_benchmark_graph_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
 {
     GduBenchmarkGraph *self = GDU_BENCHMARK_GRAPH (widget);
     GraphData graph_data = { 0 };
 
+    if (self->sustained_samples != NULL) {
+        gdu_benchmark_graph_snapshot_sustained (self, snapshot);
+        return;
+    }
+
+    if (self->sweep_points != NULL) {
+        gdu_benchmark_graph_snapshot_sweep (self, snapshot);
+        return;
+    }
+
     graph_data.benchmark_size = self->benchmark_size;
     graph_data.width = gtk_widget_get_width (GTK_WIDGET (self));
     graph_data.height = gtk_widget_get_height (GTK_WIDGET (self));
@@ -699,6 +1182,72 @@ format_stats (gdouble stat, guint num_samples, gdouble is_atime)
     return g_strdup_printf ("%s <small>(%s)</small>", s, s2);
 }
 
+static gchar *
+format_random_iops (const GduBenchmarkRandomResult *result)
+{
+    /* Translators: The number of random 4 KiB reads or writes per second (ex. "12345 IOPS") */
+    return g_strdup_printf (_("%.0f IOPS"), result->iops);
+}
+
+/* The median and the tail of the latencies, in milliseconds */
+static gchar *
+format_random_latency (const GduBenchmarkRandomResult *result)
+{
+    const GduBenchmarkHistogram *latency = &result->latency;
+
+    /* Translators: Percentiles of the time random 4 KiB reads or writes took, in milliseconds. Each %.2f is
+     *              a time (ex. 0.12).
+     */
+    return g_strdup_printf (_("p50 %.2f msec · p99 %.2f msec · p99.9 %.2f msec"),
+                            gdu_benchmark_histogram_get_percentile (latency, 50.0) / 1000.0,
+                            gdu_benchmark_histogram_get_percentile (latency, 99.0) / 1000.0,
+                            gdu_benchmark_histogram_get_percentile (latency, 99.9) / 1000.0);
+}
+
+static gchar *
+format_rate (gdouble bytes_per_sec)
+{
+    g_autofree char *s = g_format_size ((guint64) bytes_per_sec);
+
+    return g_strdup_printf ("%s/s", s);
+}
+
+/* The fastest point of the queue depth sweep, or NULL if there is none */
+static gchar *
+format_sweep_best (GArray *points, gboolean iops)
+{
+    GduBenchmarkSweepPoint *best = NULL;
+    g_autofree char *s = NULL;
+    g_autofree char *s2 = NULL;
+    guint n;
+
+    for (n = 0; n < points->len; n++) {
+        GduBenchmarkSweepPoint *point = &g_array_index (points, GduBenchmarkSweepPoint, n);
+
+        if (best == NULL || (iops ? point->iops > best->iops : point->bytes_per_sec > best->bytes_per_sec))
+            best = point;
+    }
+
+    if (best == NULL)
+        return NULL;
+
+    if (iops) {
+        s = g_strdup_printf ("%.0f IOPS", best->iops);
+    } else {
+        g_autofree char *size = g_format_size ((guint64) best->bytes_per_sec);
+
+        s = g_strdup_printf ("%s/s", size);
+    }
+    /* Translators: Where the fastest read of the queue depth sweep was measured. The first %u is the queue
+     *              depth (ex. 32), the second %u the number of jobs reading at once (ex. 4).
+     */
+    s2 = g_strdup_printf (g_dngettext (GETTEXT_PACKAGE, "queue depth %u, %u job", "queue depth %u, %u jobs",
+                                       best->num_jobs),
+                          best->queue_depth, best->num_jobs);
+
+    return g_strdup_printf ("%s <small>(%s)</small>", s, s2);
+}
+
 static void
 update_dialog (GduBenchmarkDialog *self)
 {
@@ -706,6 +1255,10 @@ update_dialog (GduBenchmarkDialog *self)
     BenchmarkStats read_stats;
     BenchmarkStats write_stats;
     BenchmarkStats atime_stats;
+    g_autofree GduBenchmarkRandomResult *random_read_result = NULL;
+    g_autofree GduBenchmarkRandomResult *random_write_result = NULL;
+    g_autofree GduBenchmarkSustainedResult *sustained_result = NULL;
+    g_autoptr(GArray) sweep_points = NULL;
     g_autofree gchar *s = NULL;
 
     G_LOCK (benchmark_lock);
@@ -722,6 +1275,15 @@ update_dialog (GduBenchmarkDialog *self)
         adw_action_row_set_subtitle (ADW_ACTION_ROW (self->read_rate_row), s);
         adw_action_row_set_subtitle (ADW_ACTION_ROW (self->write_rate_row), s);
         adw_action_row_set_subtitle (ADW_ACTION_ROW (self->access_time_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_read_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_read_latency_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_write_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_write_latency_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sweep_sequential_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sweep_random_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sustained_burst_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sustained_cliff_row), s);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sustained_steady_row), s);
         return;
     }
 
@@ -756,7 +1318,80 @@ update_dialog (GduBenchmarkDialog *self)
         g_clear_pointer (&s, g_free);
     }
 
+    G_LOCK (benchmark_lock);
+    if (self->random_read_result != NULL)
+        random_read_result = g_memdup2 (self->random_read_result, sizeof (GduBenchmarkRandomResult));
+    if (self->random_write_result != NULL)
+        random_write_result = g_memdup2 (self->random_write_result, sizeof (GduBenchmarkRandomResult));
+    G_UNLOCK (benchmark_lock);
+
+    if (random_read_result != NULL) {
+        s = format_random_iops (random_read_result);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_read_row), s);
+        g_clear_pointer (&s, g_free);
+
+        s = format_random_latency (random_read_result);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_read_latency_row), s);
+        g_clear_pointer (&s, g_free);
+    }
+
+    if (random_write_result != NULL) {
+        s = format_random_iops (random_write_result);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_write_row), s);
+        g_clear_pointer (&s, g_free);
+
+        s = format_random_latency (random_write_result);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->random_write_latency_row), s);
+        g_clear_pointer (&s, g_free);
+    }
+
+    G_LOCK (benchmark_lock);
+    sweep_points = g_array_copy (GDU_BENCHMARK_GRAPH (self->sweep_graph)->sweep_points);
+    G_UNLOCK (benchmark_lock);
+
+    if (sweep_points->len > 0) {
+        s = format_sweep_best (sweep_points, FALSE);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sweep_sequential_row), s);
+        g_clear_pointer (&s, g_free);
+
+        s = format_sweep_best (sweep_points, TRUE);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sweep_random_row), s);
+        g_clear_pointer (&s, g_free);
+    }
+
+    G_LOCK (benchmark_lock);
+    if (GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_result != NULL)
+        sustained_result = g_memdup2 (GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_result,
+                                      sizeof (GduBenchmarkSustainedResult));
+    G_UNLOCK (benchmark_lock);
+
+    if (sustained_result != NULL) {
+        s = format_rate (sustained_result->burst_bytes_per_sec);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sustained_burst_row), s);
+        g_clear_pointer (&s, g_free);
+
+        s = format_rate (sustained_result->steady_bytes_per_sec);
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sustained_steady_row), s);
+        g_clear_pointer (&s, g_free);
+
+        if (sustained_result->cliff_offset >= 0) {
+            g_autofree char *size = g_format_size (sustained_result->cliff_offset);
+
+            /* Translators: Where the write cache of a drive ran out. The %s is the amount of data written until
+             *              then (ex. "24.3 GB") and the %.0f the number of seconds it took.
+             */
+            s = g_strdup_printf (_("After %s (%.0f s)"), size,
+                                 (gdouble) sustained_result->cliff_usec / G_USEC_PER_SEC);
+        } else {
+            s = g_strdup (_("Not reached"));
+        }
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (self->sustained_cliff_row), s);
+        g_clear_pointer (&s, g_free);
+    }
+
     gtk_widget_queue_draw (GTK_WIDGET (GDU_BENCHMARK_GRAPH (self->benchmark_graph)));
+    gtk_widget_queue_draw (self->sweep_graph);
+    gtk_widget_queue_draw (self->sustained_graph);
 }
 
 /* called on main / UI thread */
@@ -833,252 +1468,146 @@ open_for_benchmark (GduBenchmarkDialog *self, gint *fd)
     return NULL;
 }
 
-static GError *
-benchmark_transfer_rate (GduBenchmarkDialog *self, guchar *buffer, gint fd, glong page_size, guint64 disk_size)
+/* called on the benchmark thread */
+static void
+on_sample_cb (GduBenchmarkSampleType type, guint64 offset, gdouble value, gpointer user_data)
 {
-    guint n;
-    guint num_samples = 0;
-    gint sample_size = 0;
-    gboolean write_benchmark = 0;
-    GError *error = NULL;
-
-    g_assert (fd != -1);
-    g_assert (buffer != NULL);
-
-    num_samples = (guint) g_settings_get_int (self->settings, "num-samples");
-    sample_size = g_settings_get_int (self->settings, "sample-size-mib");
-    sample_size = sample_size * 1024 * 1024;
-    write_benchmark = g_settings_get_boolean (self->settings, "do-write");
+    GduBenchmarkDialog *self = user_data;
+    GduBenchmarkGraph *graph = GDU_BENCHMARK_GRAPH (self->benchmark_graph);
+    g_autoptr(GduBenchmarkSample) sample = NULL;
+    GListStore *samples;
 
-    for (n = 0; n < num_samples; n++) {
-        g_autofree char *s = NULL;
-        g_autofree char *s2 = NULL;
-        gint64 begin_usec;
-        gint64 end_usec;
-        gint64 offset;
-        gssize num_read;
-        GduBenchmarkSample *sample;
-
-        if (g_cancellable_set_error_if_cancelled (self->benchmark_cancellable, &error))
-            return error;
-
-        /* figure out offset and align to page-size */
-        offset = n * disk_size / num_samples;
-        offset &= ~(page_size - 1);
-
-        if (lseek (fd, offset, SEEK_SET) != offset) {
-            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %lld",
-                         (long long int) offset);
-            return error;
-        }
+    if (type == GDU_BENCHMARK_SAMPLE_READ)
+        samples = graph->read_samples;
+    else if (type == GDU_BENCHMARK_SAMPLE_WRITE)
+        samples = graph->write_samples;
+    else
+        samples = graph->atime_samples;
 
-        if (read (fd, buffer, page_size) != page_size) {
-            s = g_format_size_full (page_size, G_FORMAT_SIZE_LONG_FORMAT);
-            s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error pre-reading %s from offset %s", s,
-                         s2);
-            return error;
-        }
+    sample = gdu_benchmark_sample_new (offset, value);
 
-        if (lseek (fd, offset, SEEK_SET) != offset) {
-            s = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %s", s);
-            return error;
-        }
+    G_LOCK (benchmark_lock);
+    g_list_store_append (samples, sample);
+    G_UNLOCK (benchmark_lock);
 
-        begin_usec = g_get_monotonic_time ();
-        num_read = read (fd, buffer, sample_size);
-        if (G_UNLIKELY (num_read < 0)) {
-            s = g_format_size_full (sample_size, G_FORMAT_SIZE_LONG_FORMAT);
-            s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
-            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error reading %s from offset %s", s, s2);
-            return error;
-        }
-        end_usec = g_get_monotonic_time ();
+    bmt_schedule_update (self);
+}
 
-        sample = gdu_benchmark_sample_new (offset, ((gdouble) G_USEC_PER_SEC) * num_read / (end_usec - begin_usec));
+/* called on the benchmark thread */
+static void
+on_random_io_cb (gboolean write, const GduBenchmarkRandomResult *result, gpointer user_data)
+{
+    GduBenchmarkDialog *self = user_data;
+    GduBenchmarkRandomResult *copy;
 
-        G_LOCK (benchmark_lock);
-        g_list_store_append (GDU_BENCHMARK_GRAPH (self->benchmark_graph)->read_samples, sample);
-        G_UNLOCK (benchmark_lock);
+    copy = g_memdup2 (result, sizeof (GduBenchmarkRandomResult));
 
-        if (write_benchmark) {
-            gssize num_written;
-
-            /* and now write the same block again... */
-            if (lseek (fd, offset, SEEK_SET) != offset) {
-                g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %lld",
-                             (long long int) offset);
-                return error;
-            }
-            if (read (fd, buffer, page_size) != page_size) {
-                g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
-                             "Error pre-reading %lld bytes from offset %lld", (long long int) page_size,
-                             (long long int) offset);
-                return error;
-            }
-            if (lseek (fd, offset, SEEK_SET) != offset) {
-                g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %lld",
-                             (long long int) offset);
-                return error;
-            }
-
-            begin_usec = g_get_monotonic_time ();
-            num_written = write (fd, buffer, num_read);
-            if (G_UNLIKELY (num_written < 0)) {
-                g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
-                             "Error writing %lld bytes at offset %lld: %m", (long long int) num_read,
-                             (long long int) offset);
-                return error;
-            }
-
-            if (num_written != num_read) {
-                g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
-                             "Expected to write %lld bytes, only wrote %lld: %m", (long long int) num_read,
-                             (long long int) num_written);
-                return error;
-            }
-
-            if (fsync (fd) != 0) {
-                g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error syncing (at offset %lld): %m",
-                             (long long int) offset);
-                return error;
-            }
-            end_usec = g_get_monotonic_time ();
-
-            sample =
-                gdu_benchmark_sample_new (offset, ((gdouble) G_USEC_PER_SEC) * num_written / (end_usec - begin_usec));
-
-            G_LOCK (benchmark_lock);
-            g_list_store_append (GDU_BENCHMARK_GRAPH (self->benchmark_graph)->write_samples, sample);
-            G_UNLOCK (benchmark_lock);
-        }
-        bmt_schedule_update (self);
-    }
+    G_LOCK (benchmark_lock);
+    if (write)
+        self->random_write_result = copy;
+    else
+        self->random_read_result = copy;
+    G_UNLOCK (benchmark_lock);
 
-    return NULL;
+    bmt_schedule_update (self);
 }
 
-static GError *
-benchmark_access_time (GduBenchmarkDialog *self, guchar *buffer, gint fd, glong page_size, guint64 disk_size)
+/* called on the benchmark thread */
+static void
+on_sweep_point_cb (const GduBenchmarkSweepPoint *point, gpointer user_data)
 {
-    guint n;
-    GError *error = NULL;
-    guint num_access_samples = 0;
-    gdouble prev_offset = 0;
-    g_autoptr (GRand) rand = NULL;
-
-    g_assert (buffer != NULL);
-    g_assert (fd != -1);
+    GduBenchmarkDialog *self = user_data;
 
-    num_access_samples = (guint) g_settings_get_int (self->settings, "num-access-samples");
-    rand = g_rand_new_with_seed (42); /* want this to be deterministic (per size) so it's repeatable */
+    G_LOCK (benchmark_lock);
+    g_array_append_val (GDU_BENCHMARK_GRAPH (self->sweep_graph)->sweep_points, *point);
+    G_UNLOCK (benchmark_lock);
 
-    for (n = 0; n < num_access_samples; n++) {
-        gint64 begin_usec;
-        gint64 end_usec;
-        gint64 offset;
-        gssize num_read;
-        GduBenchmarkSample *sample;
+    bmt_schedule_update (self);
+}
 
-        if (g_cancellable_set_error_if_cancelled (self->benchmark_cancellable, &error)) {
-            return error;
-        }
+/* called on the benchmark thread */
+static void
+on_sustained_sample_cb (const GduBenchmarkSustainedSample *sample, gpointer user_data)
+{
+    GduBenchmarkDialog *self = user_data;
 
-        offset = (guint64) g_rand_double_range (rand, 0, (gdouble) disk_size);
-        offset &= ~(page_size - 1);
+    G_LOCK (benchmark_lock);
+    g_array_append_val (GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_samples, *sample);
+    G_UNLOCK (benchmark_lock);
 
-        if (lseek (fd, offset, SEEK_SET) != offset) {
-            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
-                         C_("benchmarking", "Error seeking to offset %lld: %m"), (long long int) offset);
-            return error;
-        }
+    bmt_schedule_update (self);
+}
 
-        begin_usec = g_get_monotonic_time ();
-        num_read = read (fd, buffer, page_size);
-        if (G_UNLIKELY (num_read < 0)) {
-            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno),
-                         C_("benchmarking", "Error reading %lld bytes from offset %lld"), (long long int) page_size,
-                            (long long int) offset);
-            return error;
-        }
-        end_usec = g_get_monotonic_time ();
-
-        sample = gdu_benchmark_sample_new (offset, (end_usec - begin_usec) / ((gdouble) G_USEC_PER_SEC));
-
-        {
-            gdouble sample_offset = sample->offset;
-            if (n != 0) {
-                sample->offset = fabs (sample->offset - prev_offset);
-                G_LOCK (benchmark_lock);
-                g_list_store_append (GDU_BENCHMARK_GRAPH (self->benchmark_graph)->atime_samples, sample);
-                G_UNLOCK (benchmark_lock);
-            }
-            prev_offset = sample_offset;
-        }
+/* called on the benchmark thread */
+static void
+on_sustained_result_cb (const GduBenchmarkSustainedResult *result, gpointer user_data)
+{
+    GduBenchmarkDialog *self = user_data;
 
-        bmt_schedule_update (self);
-    }
+    G_LOCK (benchmark_lock);
+    GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_result =
+        g_memdup2 (result, sizeof (GduBenchmarkSustainedResult));
+    G_UNLOCK (benchmark_lock);
 
-    return NULL;
+    bmt_schedule_update (self);
 }
 
+static const GduBenchmarkFuncs benchmark_funcs = {
+    .sample = on_sample_cb,
+    .random_io = on_random_io_cb,
+    .sweep_point = on_sweep_point_cb,
+    .sustained_sample = on_sustained_sample_cb,
+    .sustained_result = on_sustained_result_cb,
+};
+
 static gpointer
 benchmark_thread (gpointer user_data)
 {
     GduBenchmarkDialog *self = user_data;
+    GduBenchmarkOptions options;
     GError *error = NULL;
-    guchar *buffer = NULL;
-    g_autofree guchar *buffer_unaligned = NULL;
     gint fd = -1;
-    glong page_size;
     guint64 disk_size;
     guint inhibit_cookie;
-    gint sample_size_mib = 0;
 
-    sample_size_mib = g_settings_get_int (self->settings, "sample-size-mib");
+    gdu_benchmark_options_init_from_settings (&options, self->settings);
+    /* the sustained write is turned off along with choosing the scratch file */
+    options.scratch_file = self->scratch_directory != NULL;
+    options.sustained_write = options.sustained_write && !options.scratch_file;
 
     inhibit_cookie = gtk_application_inhibit ((gpointer) g_application_get_default (), self->parent_window,
                                               GTK_APPLICATION_INHIBIT_SUSPEND | GTK_APPLICATION_INHIBIT_LOGOUT,
                                               /* Translators: Reason why suspend/logout is being inhibited */
                                               "Benchmark in progress");
 
-    error = open_for_benchmark (self, &fd);
-    if (error != NULL) {
-        return end_benchmark (self, error, fd, inhibit_cookie);
-    }
-
-    /* We can't use udisks_block_get_size() because the media may have
-     * changed and udisks may not have noticed. TODO: maybe have a
-     * Block.GetSize() method instead...
-     */
-    if (ioctl (fd, BLKGETSIZE64, &disk_size) != 0) {
-        g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting size of device: %m");
-        return end_benchmark (self, error, fd, inhibit_cookie);
-    }
+    if (self->scratch_directory != NULL) {
+        /* the scratch file is benchmarked like a device of its size */
+        fd = gdu_benchmark_open_scratch_file (self->scratch_directory, &disk_size, self->benchmark_cancellable,
+                                              &error);
+        if (fd == -1) {
+            return end_benchmark (self, error, fd, inhibit_cookie);
+        }
+    } else {
+        error = open_for_benchmark (self, &fd);
+        if (error != NULL) {
+            return end_benchmark (self, error, fd, inhibit_cookie);
+        }
 
-    page_size = sysconf (_SC_PAGESIZE);
-    if (page_size < 1) {
-        g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting page size: %m\n");
-        return end_benchmark (self, error, fd, inhibit_cookie);
+        /* We can't use udisks_block_get_size() because the media may have
+         * changed and udisks may not have noticed. TODO: maybe have a
+         * Block.GetSize() method instead...
+         */
+        if (ioctl (fd, BLKGETSIZE64, &disk_size) != 0) {
+            g_set_error (&error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting size of device: %m");
+            return end_benchmark (self, error, fd, inhibit_cookie);
+        }
     }
 
-    buffer_unaligned = g_new0 (guchar, sample_size_mib * 1024 * 1024 + page_size);
-    buffer = (guchar *) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
-
     G_LOCK (benchmark_lock);
     GDU_BENCHMARK_GRAPH (self->benchmark_graph)->benchmark_size = disk_size;
     G_UNLOCK (benchmark_lock);
 
-    error = benchmark_transfer_rate (self, buffer, fd, page_size, disk_size);
-    if (error != NULL) {
-        return end_benchmark (self, error, fd, inhibit_cookie);
-    }
-
-    error = benchmark_access_time (self, buffer, fd, page_size, disk_size);
-    if (error != NULL) {
-        return end_benchmark (self, error, fd, inhibit_cookie);
-    }
+    gdu_benchmark_run (fd, disk_size, &options, &benchmark_funcs, self, self->benchmark_cancellable, &error);
 
     return end_benchmark (self, error, fd, inhibit_cookie);
 }
@@ -1102,6 +1631,19 @@ start_benchmark (GduBenchmarkDialog *self)
     GDU_BENCHMARK_GRAPH (self->benchmark_graph)->total_atime_samples =
         (guint) g_settings_get_int (self->settings, "num-access-samples");
 
+    G_LOCK (benchmark_lock);
+    g_clear_pointer (&self->random_read_result, g_free);
+    g_clear_pointer (&self->random_write_result, g_free);
+    g_array_set_size (GDU_BENCHMARK_GRAPH (self->sweep_graph)->sweep_points, 0);
+    g_array_set_size (GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_samples, 0);
+    g_clear_pointer (&GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_result, g_free);
+    G_UNLOCK (benchmark_lock);
+    gtk_widget_set_visible (self->sweep_group, g_settings_get_boolean (self->settings, "do-queue-depth-sweep"));
+    gtk_widget_set_visible (self->sustained_group,
+                            g_settings_get_boolean (self->settings, "do-write")
+                                && g_settings_get_boolean (self->settings, "do-sustained-write")
+                                && self->scratch_directory == NULL);
+
     sample_size = g_settings_get_int (self->settings, "sample-size-mib");
     sample_size = sample_size * 1024 * 1024;
 
@@ -1133,8 +1675,26 @@ on_start_clicked_cb (GduBenchmarkDialog *self, GtkButton *button)
 
     write_benchmark = g_settings_get_boolean (self->settings, "do-write");
 
-    /* ensure the device is unused (e.g. unmounted) before formatting it... */
-    if (write_benchmark)
+    /* the scratch file only stands in for the device when writing, reading alone is safe on the device */
+    g_clear_pointer (&self->scratch_directory, g_free);
+    if (write_benchmark && gtk_widget_get_visible (self->scratch_file_switch)
+        && adw_switch_row_get_active (ADW_SWITCH_ROW (self->scratch_file_switch))) {
+        UDisksFilesystem *filesystem = udisks_object_peek_filesystem (self->object);
+
+        self->scratch_directory = gdu_benchmark_find_scratch_directory (
+            filesystem != NULL ? udisks_filesystem_get_mount_points (filesystem) : NULL);
+        if (self->scratch_directory == NULL) {
+            gdu_utils_show_message (_("Cannot Benchmark Filesystem"),
+                                    _("There is no folder on the filesystem you are allowed to write to."),
+                                    GTK_WIDGET (self));
+            return;
+        }
+    }
+
+    /* ensure the device is unused (e.g. unmounted) before formatting it... a scratch file
+     * on the mounted filesystem can be written to right away
+     */
+    if (write_benchmark && self->scratch_directory == NULL)
         gdu_utils_ensure_unused (self->client, gdu_benchmark_dialog_get_window (self), self->object,
                                  (GAsyncReadyCallback) ensure_unused_cb, NULL, /* GCancellable */
                                  self);
@@ -1154,6 +1714,20 @@ gdu_benchmark_dialog_set_title (GduBenchmarkDialog *self)
     adw_window_title_set_subtitle (ADW_WINDOW_TITLE (self->window_title), udisks_object_info_get_one_liner (info));
 }
 
+/* A scratch file is too small to fill the write cache of the drive, so the sustained write needs the
+ * whole device
+ */
+static void
+on_write_options_changed_cb (GduBenchmarkDialog *self)
+{
+    gboolean scratch_file;
+
+    scratch_file = gtk_widget_get_visible (self->scratch_file_switch)
+                   && adw_switch_row_get_active (ADW_SWITCH_ROW (self->scratch_file_switch));
+    gtk_widget_set_sensitive (self->sustained_settings_group,
+                              adw_switch_row_get_active (ADW_SWITCH_ROW (self->write_bench_switch)) && !scratch_file);
+}
+
 static gboolean
 set_sample_size_unit_cb (AdwSpinRow *spin_row, gpointer *user_data)
 {
@@ -1198,6 +1772,9 @@ gdu_benchmark_graph_dispose (GObject *object)
     g_clear_object (&self->read_samples);
     g_clear_object (&self->write_samples);
     g_clear_object (&self->atime_samples);
+    g_clear_pointer (&self->sweep_points, g_array_unref);
+    g_clear_pointer (&self->sustained_samples, g_array_unref);
+    g_clear_pointer (&self->sustained_result, g_free);
 
     G_OBJECT_CLASS (gdu_benchmark_graph_parent_class)->dispose (object);
 }
@@ -1229,6 +1806,9 @@ gdu_benchmark_dialog_finalize (GObject *object)
     GduBenchmarkDialog *self = GDU_BENCHMARK_DIALOG (object);
 
     g_clear_handle_id (&self->benchmark_update_timeout_id, g_source_remove);
+    g_clear_pointer (&self->random_read_result, g_free);
+    g_clear_pointer (&self->random_write_result, g_free);
+    g_clear_pointer (&self->scratch_directory, g_free);
 
     G_OBJECT_CLASS (gdu_benchmark_dialog_parent_class)->finalize (object);
 }
@@ -1253,15 +1833,35 @@ gdu_benchmark_dialog_class_init (GduBenchmarkDialogClass *klass)
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sample_row);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sample_size_row);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, access_samples_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sweep_switch);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, write_bench_switch);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, scratch_file_switch);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_settings_group);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_write_switch);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_size_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_minutes_row);
 
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, benchmark_graph);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sample_size_action_row);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, read_rate_row);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, write_rate_row);
     gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, access_time_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, random_read_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, random_read_latency_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, random_write_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, random_write_latency_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sweep_group);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sweep_graph);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sweep_sequential_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sweep_random_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_group);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_graph);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_burst_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_cliff_row);
+    gtk_widget_class_bind_template_child (widget_class, GduBenchmarkDialog, sustained_steady_row);
 
     gtk_widget_class_bind_template_callback (widget_class, set_sample_size_unit_cb);
+    gtk_widget_class_bind_template_callback (widget_class, on_write_options_changed_cb);
     gtk_widget_class_bind_template_callback (widget_class, on_start_clicked_cb);
     gtk_widget_class_bind_template_callback (widget_class, on_cancel_clicked_cb);
 }
@@ -1273,12 +1873,19 @@ gdu_benchmark_dialog_init (GduBenchmarkDialog *self)
 
     self->settings = g_settings_new ("org.gnome.Disks.benchmark");
     self->benchmark_cancellable = g_cancellable_new ();
+
+    /* makes it draw the queue depth graph */
+    GDU_BENCHMARK_GRAPH (self->sweep_graph)->sweep_points = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSweepPoint));
+    /* and this one the sustained write graph */
+    GDU_BENCHMARK_GRAPH (self->sustained_graph)->sustained_samples =
+        g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSustainedSample));
 }
 
 void
 gdu_benchmark_dialog_show (GtkWindow *parent_window, UDisksObject *object, UDisksClient *client)
 {
     GduBenchmarkDialog *self;
+    UDisksFilesystem *filesystem;
 
     self = g_object_new (GDU_TYPE_BENCHMARK_DIALOG, NULL);
     self->object = g_object_ref (object);
@@ -1313,5 +1920,11 @@ gdu_benchmark_dialog_show (GtkWindow *parent_window, UDisksObject *object, UDisk
     if (gdu_utils_is_in_use (self->client, self->object))
         adw_switch_row_set_active (ADW_SWITCH_ROW (self->write_bench_switch), FALSE);
 
+    /* a mounted filesystem can be write benchmarked through a scratch file without unmounting it */
+    filesystem = udisks_object_peek_filesystem (self->object);
+    if (filesystem != NULL && g_strv_length ((gchar **) udisks_filesystem_get_mount_points (filesystem)) > 0)
+        gtk_widget_set_visible (self->scratch_file_switch, TRUE);
+    on_write_options_changed_cb (self);
+
     adw_dialog_present (ADW_DIALOG (self), GTK_WIDGET (parent_window));
 }
@@ -35,6 +35,9 @@ static const GdkRGBA WRITE_CURVE_COLOR = {
 static const GdkRGBA ATIME_DOT_COLOR = {
     .red = 58.0 / 255.0, .green = 148.0 / 255.0, .blue = 74.0 / 255.0, .alpha = 0.5
 };
+static const GdkRGBA IOPS_CURVE_COLOR = {
+    .red = 58.0 / 255.0, .green = 148.0 / 255.0, .blue = 74.0 / 255.0, .alpha = 1
+};
 
 static const GdkRGBA GRAPH_BG_COLOR = { .red = 1.0, .green = 1.0, .blue = 1.0, .alpha = 1 };
 static const GdkRGBA GRAPH_BG_COLOR_DARK = {
@@ -24,17 +24,20 @@
 
 #include "gdu-application.h"
 #include "gdu-job-manager.h"
+#include "gducheckpoint.h"
+#include "gducompressor.h"
+#include "gducopyengine.h"
 #include "gdudvdsupport.h"
 #include "gduestimator.h"
 #include "gdulocaljob.h"
+#include "gdurescuemap.h"
+#include "gduusedblocks.h"
 
 /* TODOs / ideas for Disk Image creation
  *
- * - Be tolerant of I/O errors like dd_rescue(1), see http://www.gnu.org/s/ddrescue/ddrescue.html
  * - Create images useful for Virtualization, e.g. vdi, vmdk, qcow2. Maybe use libguestfs for
  *   this. See http://libguestfs.org/
  * - Support a Apple DMG-ish format
- * - Sliding buffer size
  * - Update time remaining / speed exactly every 1/10th second instead of when we've read a full buffer
  *
  */
@@ -47,6 +50,11 @@ struct _GduCreateDiskImageDialog {
     GtkWidget *name_entry;
     GtkWidget *location_entry;
     GtkWidget *source_label;
+    GtkWidget *format_row;
+    GtkWidget *direct_io_row;
+    GtkWidget *used_blocks_row;
+    GtkWidget *rescue_row;
+    GtkWidget *checksum_row;
 
     /* UI state and user selections. Copy/job-owned state lives in CreateDiskImageJobData. */
     UDisksObject *object;
@@ -56,6 +64,47 @@ struct _GduCreateDiskImageDialog {
     GFile *directory;
 };
 
+/* In the order of the format row */
+typedef enum {
+    IMAGE_FORMAT_RAW,
+    IMAGE_FORMAT_XZ,
+    IMAGE_FORMAT_ZSTD,
+} ImageFormat;
+
+static const gchar *image_format_suffixes[] = { "", ".xz", ".zst" };
+
+typedef enum {
+    RESCUE_READ_TUNED,
+    RESCUE_READ_SMALL,
+    RESCUE_READ_SECTORS,
+} RescueReadSize;
+
+/* The passes of rescuing a disk image, like GNU ddrescue(1) does them:
+ * first copy everything that reads quickly, skipping ahead after read
+ * errors, then come back to the skipped and failed areas with ever smaller
+ * blocks. What is left after the last pass are the bad sectors.
+ */
+typedef struct {
+    /* the blocks of the rescue map the pass reads */
+    GduRescueStatus status;
+    /* what the blocks that can't be read become */
+    GduRescueStatus failed_status;
+    gboolean skip_after_errors;
+    RescueReadSize read_size;
+    const gchar *description;
+} RescuePass;
+
+static const RescuePass rescue_passes[] = {
+    { GDU_RESCUE_STATUS_NON_TRIED, GDU_RESCUE_STATUS_NON_TRIMMED, TRUE, RESCUE_READ_TUNED,
+      N_("Copying readable areas") },
+    { GDU_RESCUE_STATUS_NON_TRIED, GDU_RESCUE_STATUS_NON_TRIMMED, FALSE, RESCUE_READ_TUNED,
+      N_("Copying skipped areas") },
+    { GDU_RESCUE_STATUS_NON_TRIMMED, GDU_RESCUE_STATUS_NON_SCRAPED, FALSE, RESCUE_READ_SMALL,
+      N_("Retrying unreadable areas in smaller blocks") },
+    { GDU_RESCUE_STATUS_NON_SCRAPED, GDU_RESCUE_STATUS_BAD_SECTOR, FALSE, RESCUE_READ_SECTORS,
+      N_("Reading unreadable areas sector by sector") },
+};
+
 typedef struct {
     GtkWindow *window;
     UDisksBlock *block;
@@ -63,15 +112,37 @@ typedef struct {
 
     GFile *output_file;
     GFileOutputStream *output_file_stream;
+    /* owns output_file_stream when continuing a rescue */
+    GFileIOStream *output_file_io_stream;
     gchar *source_description;
+    ImageFormat format;
+    gboolean direct_io;
+    gboolean used_blocks_only;
+    gboolean rescue;
+    gboolean resume;
+    GFile *rescue_map_file;
+    /* for raw disk images that are not rescued */
+    GFile *checkpoint_file;
+    /* identifies the device in the checkpoint, also if it has another device file next time */
+    gchar *source_id;
+    /* for raw disk images with a checksum, the SHA-256 is saved there */
+    GFile *checksum_file;
+    /* the SHA-256 of the disk image once it is created */
+    gchar *checksum;
+    /* whether the checksum was not computed because the copy was continued, and whether
+     * checksum_file is left from an older disk image then
+     */
+    gboolean checksum_skipped;
+    gboolean checksum_file_stale;
 
     /* must hold copy_lock when reading/writing these */
     GMutex copy_lock;
     GduEstimator *estimator;
 
-    gboolean allocating_file;
     gboolean retrieving_dvd_keys;
+    guint rescue_pass;
     guint64 num_error_bytes;
+    guint64 num_sparse_bytes;
     gboolean played_read_error_sound;
 
     guint inhibit_cookie;
@@ -112,7 +183,8 @@ create_disk_image_job_data_free (gpointer user_data)
 
     create_disk_image_job_data_uninhibit (data);
 
-    delete_output_file = data->output_file_stream != NULL;
+    /* the disk image of a rescue that is continued is not ours to delete */
+    delete_output_file = data->output_file_stream != NULL && !data->resume;
 
     if (data->output_file_stream != NULL) {
         g_autoptr(GError) error = NULL;
@@ -137,12 +209,35 @@ create_disk_image_job_data_free (gpointer user_data)
     g_clear_object (&data->drive);
     g_clear_object (&data->output_file);
     g_clear_object (&data->output_file_stream);
+    g_clear_object (&data->output_file_io_stream);
+    g_clear_object (&data->rescue_map_file);
+    g_clear_object (&data->checkpoint_file);
+    g_clear_object (&data->checksum_file);
+    g_free (data->checksum);
+    g_clear_pointer (&data->source_id, g_free);
     g_clear_object (&data->estimator);
     g_clear_pointer (&data->source_description, g_free);
     g_mutex_clear (&data->copy_lock);
     g_free (data);
 }
 
+/* The rescue map and the checkpoint are kept next to the disk image, like ddrescue users usually do with
+ * their maps
+ */
+static GFile *
+get_sidecar_file (GFile *output_file, const gchar *suffix)
+{
+    g_autofree gchar *basename = NULL;
+    g_autofree gchar *sidecar_name = NULL;
+    g_autoptr(GFile) parent = NULL;
+
+    basename = g_file_get_basename (output_file);
+    sidecar_name = g_strconcat (basename, suffix, NULL);
+    parent = g_file_get_parent (output_file);
+
+    return g_file_get_child (parent, sidecar_name);
+}
+
 /* ---------------------------------------------------------------------------------------------------- */
 
 static void
@@ -175,8 +270,9 @@ create_disk_image_job_update (GduLocalJob *job)
     guint64 bytes_per_sec = 0;
     guint64 usec_remaining = 0;
     guint64 num_error_bytes = 0;
-    gboolean allocating_file = FALSE;
+    guint64 num_sparse_bytes = 0;
     gboolean retrieving_dvd_keys = FALSE;
+    guint rescue_pass = 0;
     gboolean played_read_error_sound = FALSE;
     gdouble progress = 0.0;
     gchar *s2, *s3;
@@ -188,16 +284,30 @@ create_disk_image_job_update (GduLocalJob *job)
         bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
         bytes_target = gdu_estimator_get_target_bytes (data->estimator);
         num_error_bytes = data->num_error_bytes;
+        num_sparse_bytes = data->num_sparse_bytes;
     }
-    allocating_file = data->allocating_file;
     retrieving_dvd_keys = data->retrieving_dvd_keys;
+    rescue_pass = data->rescue_pass;
     played_read_error_sound = data->played_read_error_sound;
     g_mutex_unlock (&data->copy_lock);
 
-    if (allocating_file) {
-        extra_markup = g_strdup (_("Allocating Disk Image"));
-    } else if (retrieving_dvd_keys) {
+    if (retrieving_dvd_keys) {
         extra_markup = g_strdup (_("Retrieving DVD keys"));
+    } else if (rescue_pass > 0) {
+        /* Translators: Shown while rescuing a disk image. The first %u is the number of the current
+         *              pass, the second %u the number of passes. The %s is what the pass does
+         *              (ex. "Copying skipped areas").
+         */
+        extra_markup = g_strdup_printf (_("Pass %u of %u: %s"), rescue_pass, (guint) G_N_ELEMENTS (rescue_passes),
+                                        _(rescue_passes[rescue_pass - 1].description));
+    } else if (num_sparse_bytes > 0) {
+        s2 = g_format_size (num_sparse_bytes);
+        /* Translators: Shown while creating a disk image when blocks that only
+         *              contain zeroes are left as holes in the image file instead
+         *              of being written. The %s is the amount of data (ex. "1.2 GB").
+         */
+        extra_markup = g_strdup_printf (_("%s of zeroes skipped"), s2);
+        g_free (s2);
     }
 
     if (num_error_bytes > 0) {
@@ -209,10 +319,14 @@ create_disk_image_job_update (GduLocalJob *job)
         /* TODO: once https://bugzilla.gnome.org/show_bug.cgi?id=657194 is resolved, use that instead
          * of hard-coding the color
          */
-        g_free (extra_markup);
-        extra_markup = g_strdup_printf ("<span foreground=\"#ff0000\">%s</span>", s3);
-        g_free (s3);
         g_free (s2);
+        s2 = extra_markup;
+        if (rescue_pass > 0)
+            extra_markup = g_strdup_printf ("%s — <span foreground=\"#ff0000\">%s</span>", s2, s3);
+        else
+            extra_markup = g_strdup_printf ("<span foreground=\"#ff0000\">%s</span>", s3);
+        g_free (s2);
+        g_free (s3);
     }
 
     gdu_local_job_set_bytes (job, bytes_target);
@@ -264,17 +378,21 @@ static void
 on_delete_response (GObject *object, GAsyncResult *response, gpointer user_data)
 {
     AdwAlertDialog *dialog = ADW_ALERT_DIALOG (object);
-    GFile *output_file = G_FILE (user_data);
-    g_autoptr(GError) error = NULL;
+    g_autoptr(GPtrArray) files = user_data;
+    guint n;
+
+    if (g_strcmp0 (adw_alert_dialog_choose_finish (dialog, response), "cancel") == 0)
+        return;
+
+    for (n = 0; n < files->len; n++) {
+        g_autoptr(GError) error = NULL;
 
-    if (g_strcmp0 (adw_alert_dialog_choose_finish (dialog, response), "cancel") != 0) {
-        if (!g_file_delete (output_file, NULL, &error)) {
+        if (!g_file_delete (G_FILE (files->pdata[n]), NULL, &error)
+            && !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND)) {
             g_warning ("Error deleting file: %s (%s, %d)", error->message, g_quark_to_string (error->domain),
                        error->code);
         }
     }
-
-    g_object_unref (output_file);
 }
 
 static void
@@ -296,6 +414,39 @@ on_create_disk_image_job_completed (GduLocalJob *job, GduLocalJobResult result,
 
     play_complete_sound (data);
 
+    if (data->checksum != NULL || data->checksum_skipped) {
+        g_autoptr(GNotification) notification = NULL;
+        g_autofree gchar *basename = g_file_get_basename (data->output_file);
+        g_autofree gchar *body = NULL;
+
+        if (data->checksum != NULL) {
+            /* Translators: Body of the notification shown once a disk image is created. The first %s is the name
+             * of the disk image file, the second %s is its SHA-256 checksum (64 hexadecimal digits).
+             */
+            body = g_strdup_printf (_("“%s” has the SHA-256 checksum %s"), basename, data->checksum);
+        } else if (data->checksum_file_stale) {
+            g_autofree gchar *checksum_basename = g_file_get_basename (data->checksum_file);
+
+            /* Translators: Body of the notification shown once a disk image is created by continuing an
+             * interrupted copy. The first %s is the name of the disk image file, the second %s the name of the
+             * checksum file next to it (ex. "disk.img.sha256").
+             */
+            body = g_strdup_printf (_("No SHA-256 checksum was computed for “%s” as the copy was continued. “%s” "
+                                      "is left from an older disk image and may not match."),
+                                    basename, checksum_basename);
+        } else {
+            /* Translators: Body of the notification shown once a disk image is created by continuing an
+             * interrupted copy. The %s is the name of the disk image file.
+             */
+            body = g_strdup_printf (_("No SHA-256 checksum was computed for “%s” as the copy was continued"),
+                                    basename);
+        }
+        /* Translators: Title of the notification shown once a disk image is created */
+        notification = g_notification_new (_("Disk Image Created"));
+        g_notification_set_body (notification, body);
+        g_application_send_notification (g_application_get_default (), "disk-image-created", notification);
+    }
+
     /* OK, we're done but we had to replace unreadable data with
      * zeroes. Bring up a modal dialog to inform the user of this and
      * allow him to delete the file, if so desired.
@@ -310,9 +461,13 @@ on_create_disk_image_job_completed (GduLocalJob *job, GduLocalJobResult result,
             bytes_target = gdu_estimator_get_target_bytes (data->estimator);
         g_mutex_unlock (&data->copy_lock);
 
+        /* the estimator of a rescue only covers the last pass */
+        if (data->rescue)
+            bytes_target = udisks_block_get_size (data->block);
+
         if (num_error_bytes > 0) {
             AdwDialog *dialog;
-            g_autoptr(GFile) output_file = NULL;
+            g_autoptr(GPtrArray) files = NULL;
             g_autofree gchar *s = NULL;
             gdouble percentage = 0.0;
 
@@ -340,87 +495,442 @@ on_create_disk_image_job_completed (GduLocalJob *job, GduLocalJobResult result,
             adw_alert_dialog_set_default_response (ADW_ALERT_DIALOG (dialog), "cancel");
             adw_alert_dialog_set_response_appearance (ADW_ALERT_DIALOG (dialog), "confirm", ADW_RESPONSE_DESTRUCTIVE);
 
-            output_file = g_object_ref (data->output_file);
+            files = g_ptr_array_new_with_free_func (g_object_unref);
+            g_ptr_array_add (files, g_object_ref (data->output_file));
+            if (data->rescue_map_file != NULL)
+                g_ptr_array_add (files, g_object_ref (data->rescue_map_file));
+            if (data->checksum_file != NULL)
+                g_ptr_array_add (files, g_object_ref (data->checksum_file));
             adw_alert_dialog_choose (ADW_ALERT_DIALOG (dialog), data->window != NULL ? GTK_WIDGET (data->window) : NULL,
-                                     NULL, on_delete_response, g_steal_pointer (&output_file));
+                                     NULL, on_delete_response, g_steal_pointer (&files));
         }
     }
 }
 
 /* ---------------------------------------------------------------------------------------------------- */
 
-/* Note that error on reading is *not* considered an error - instead 0
- * is returned.
- *
- * Error conditions include failure to seek or write to output.
+/* Number of buffers in flight between the reader and the writer stage */
+#define COPY_NUM_BUFFERS 4
+/* Upper bound for the memory used by all buffers */
+#define COPY_MEMORY_CAP (64 * 1024 * 1024)
+/* Smallest block size tried while tuning the block size */
+#define COPY_MIN_BLOCK_SIZE (64 * 1024)
+/* How often the rescue map is saved while rescuing */
+#define RESCUE_SAVE_INTERVAL_USEC (10 * G_USEC_PER_SEC)
+/* How often the checkpoint is saved while copying */
+#define CHECKPOINT_SAVE_INTERVAL_USEC (30 * G_USEC_PER_SEC)
+/* Limits for skipping ahead after a read error in the first rescue pass */
+#define RESCUE_MIN_SKIP_SIZE (64 * 1024)
+#define RESCUE_MAX_SKIP_SIZE (1024 * 1024 * 1024)
+
+/* State shared by the reader and writer stage of create_disk_image_job_run() */
+typedef struct {
+    GduLocalJob *job;
+    CreateDiskImageJobData *data;
+    gint fd;
+    GduDVDSupport *dvd_support;
+
+    /* only accessed from the writer stage */
+    gint output_fd;
+    gboolean output_direct_io;
+    /* for compressed disk images, written sequentially */
+    GOutputStream *compressed_stream;
+    guint64 compressed_offset;
+    guint64 num_bytes_completed;
+    gint64 last_update_usec;
+    /* whether the disk image and the map or checkpoint on disk can be used to continue the copy */
+    gboolean resumable;
+
+    /* for copying raw disk images, NULL otherwise */
+    GduCheckpoint *checkpoint;
+    /* the end of the data added to the checkpoint */
+    guint64 checkpoint_offset;
+    gint64 checkpoint_last_save_usec;
+
+    /* for rescuing, NULL otherwise */
+    GduRescueMap *rescue_map;
+    const RescuePass *rescue_pass;
+    guint rescue_sector_size;
+    gint64 rescue_last_save_usec;
+
+    /* only accessed from the reader stage */
+    gboolean input_direct_io;
+    guint64 rescue_skip_size;
+    guint64 rescue_skip_until;
+    guint64 rescue_max_skip_size;
+} CopyContext;
+
+/* Turns O_DIRECT on or off for @fd. Fails if the device or filesystem does not support direct I/O. */
+static gboolean
+set_direct_io (gint fd, gboolean enable)
+{
+    gint flags;
+
+    flags = fcntl (fd, F_GETFL);
+    if (flags == -1)
+        return FALSE;
+
+    if (enable)
+        flags |= O_DIRECT;
+    else
+        flags &= ~O_DIRECT;
+
+    return fcntl (fd, F_SETFL, flags) == 0;
+}
+
+/* Whether @errsv is what the block layer returns for sectors that can't be read */
+static gboolean
+is_medium_error (gint errsv)
+{
+    return errsv == EIO || errsv == ENODATA || errsv == EILSEQ;
+}
+
+/* Note that unreadable sectors are *not* considered an error - instead the
+ * unreadable part of the block is padded with zeroes.
  *
- * Returns: Number of bytes actually read (e.g. not include padding) -1 if @error is set.
+ * Error conditions include a read returning zero bytes (EOF) and any other
+ * error, e.g. because the device went away.
  */
-static gssize
-copy_span (gint fd, GOutputStream *output_stream, guint64 offset, guint64 size, guchar *buffer,
-           gboolean pad_with_zeroes, GduDVDSupport *dvd_support, GCancellable *cancellable, GError **error)
+static gboolean
+read_block (GduCopyBlock *block, gpointer user_data, GCancellable *cancellable, GError **error)
 {
-    gint64 ret = -1;
+    CopyContext *ctx = user_data;
     gssize num_bytes_read;
-    gsize num_bytes_to_write;
 
-    g_return_val_if_fail (-1, buffer != NULL);
-    g_return_val_if_fail (-1, G_IS_OUTPUT_STREAM (output_stream));
-    g_return_val_if_fail (-1, buffer != NULL);
-    g_return_val_if_fail (-1, cancellable == NULL || G_IS_CANCELLABLE (cancellable));
-    g_return_val_if_fail (-1, error == NULL || *error == NULL);
+    /* Don't spend time on an area that just failed to read, a later pass
+     * comes back to it
+     */
+    if (ctx->rescue_skip_until > block->offset) {
+        block->skipped = TRUE;
+        return TRUE;
+    }
 
-    if (dvd_support != NULL) {
-        num_bytes_read = gdu_dvd_support_read (dvd_support, fd, buffer, offset, size);
+    if (ctx->dvd_support != NULL) {
+        num_bytes_read = gdu_dvd_support_read (ctx->dvd_support, ctx->fd, block->data, block->offset, block->size);
     } else {
-        if (lseek (fd, offset, SEEK_SET) == (off_t) -1) {
-            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
-                         "Error seeking to offset %" G_GUINT64_FORMAT ": %s", offset, strerror (errno));
-            goto out;
-        }
     read_again:
-        num_bytes_read = read (fd, buffer, size);
+        num_bytes_read = pread (ctx->fd, block->data, block->size, block->offset);
         if (num_bytes_read < 0) {
-            if (errno == EAGAIN || errno == EINTR)
+            gint errsv = errno;
+
+            if (errsv == EAGAIN || errsv == EINTR)
+                goto read_again;
+
+            /* The device may reject direct I/O that is not aligned to its
+             * logical block size. Fall back to buffered I/O for the rest of
+             * the copy.
+             */
+            if (errsv == EINVAL && ctx->input_direct_io && set_direct_io (ctx->fd, FALSE)) {
+                ctx->input_direct_io = FALSE;
                 goto read_again;
+            }
+
+            if (!is_medium_error (errsv)) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+                g_prefix_error (error, "Error reading %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": ",
+                                block->size, block->offset);
+                return FALSE;
+            }
         } else {
             /* EOF */
             if (num_bytes_read == 0) {
                 g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
-                             "Reading from offset %" G_GUINT64_FORMAT " returned zero bytes", offset);
-                goto out;
+                             "Reading from offset %" G_GUINT64_FORMAT " returned zero bytes", block->offset);
+                return FALSE;
             }
         }
     }
 
     if (num_bytes_read < 0) {
-        /* do not consider this an error - treat as zero bytes read */
+        /* the sectors are unreadable - treat as zero bytes read */
         num_bytes_read = 0;
     }
 
-    num_bytes_to_write = num_bytes_read;
-    if (pad_with_zeroes && (guint64) num_bytes_read < size) {
-        memset (buffer + num_bytes_read, 0, size - num_bytes_read);
-        num_bytes_to_write = size;
+    block->num_read = num_bytes_read;
+    if (block->num_read < block->size)
+        memset (block->data + block->num_read, 0, block->size - block->num_read);
+
+    /* Skip twice as much after each failed read, like ddrescue does */
+    if (ctx->rescue_pass != NULL && ctx->rescue_pass->skip_after_errors) {
+        if (block->num_read < block->size) {
+            ctx->rescue_skip_size = CLAMP (ctx->rescue_skip_size * 2, RESCUE_MIN_SKIP_SIZE, ctx->rescue_max_skip_size);
+            ctx->rescue_skip_until = block->offset + block->size + ctx->rescue_skip_size;
+        } else {
+            ctx->rescue_skip_size = 0;
+        }
     }
 
-    if (!g_seekable_seek (G_SEEKABLE (output_stream), offset, G_SEEK_SET, cancellable, error)) {
-        g_prefix_error (error, "Error seeking to offset %" G_GUINT64_FORMAT ": ", offset);
-        goto out;
+    return TRUE;
+}
+
+/* Writes @size zeroes to @stream */
+static gboolean
+write_zeroes (GOutputStream *stream, guint64 size, GCancellable *cancellable, GError **error)
+{
+    static const guchar zeroes[64 * 1024] = { 0 };
+
+    while (size > 0) {
+        gsize num_bytes = MIN (size, sizeof zeroes);
+
+        if (!g_output_stream_write_all (stream, zeroes, num_bytes, NULL, cancellable, error))
+            return FALSE;
+        size -= num_bytes;
     }
 
-    if (!g_output_stream_write_all (G_OUTPUT_STREAM (output_stream), buffer, num_bytes_to_write, G_PRIORITY_DEFAULT,
-                                    cancellable, error)) {
-        g_prefix_error (error, "Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": ",
-                        num_bytes_to_write, offset);
-        goto out;
+    return TRUE;
+}
+
+/* The bytes that could not be read (yet) */
+static guint64
+get_rescue_num_error_bytes (GduRescueMap *map)
+{
+    return gdu_rescue_map_get_num_bytes (map, GDU_RESCUE_STATUS_NON_TRIMMED)
+           + gdu_rescue_map_get_num_bytes (map, GDU_RESCUE_STATUS_NON_SCRAPED)
+           + gdu_rescue_map_get_num_bytes (map, GDU_RESCUE_STATUS_BAD_SECTOR);
+}
+
+/* Makes sure the disk image has everything written so far before saving the rescue map or checkpoint */
+static gboolean
+sync_output (CopyContext *ctx, GCancellable *cancellable, GError **error)
+{
+    if (!g_output_stream_flush (G_OUTPUT_STREAM (ctx->data->output_file_stream), cancellable, error))
+        return FALSE;
+
+    if (ctx->output_fd != -1 && fdatasync (ctx->output_fd) != 0) {
+        gint errsv = errno;
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+        return FALSE;
     }
 
-    ret = num_bytes_read;
+    return TRUE;
+}
 
-out:
+static gboolean
+save_rescue_map (CopyContext *ctx, GCancellable *cancellable, GError **error)
+{
+    if (!sync_output (ctx, cancellable, error)
+        || !gdu_rescue_map_save (ctx->rescue_map, ctx->data->rescue_map_file, cancellable, error))
+        return FALSE;
+
+    ctx->rescue_last_save_usec = g_get_monotonic_time ();
+    ctx->resumable = TRUE;
+
+    return TRUE;
+}
+
+static gboolean
+save_checkpoint (CopyContext *ctx, GCancellable *cancellable, GError **error)
+{
+    if (!sync_output (ctx, cancellable, error)
+        || !gdu_checkpoint_save (ctx->checkpoint, ctx->data->checkpoint_file, cancellable, error))
+        return FALSE;
+
+    ctx->checkpoint_last_save_usec = g_get_monotonic_time ();
+    ctx->resumable = TRUE;
+
+    return TRUE;
+}
+
+/* Drops the parts of @extents before @offset */
+static void
+clip_extents (GArray *extents, guint64 offset)
+{
+    while (extents->len > 0) {
+        GduCopyExtent *extent = &g_array_index (extents, GduCopyExtent, 0);
+
+        if (extent->offset + extent->size <= offset) {
+            g_array_remove_index (extents, 0);
+            continue;
+        }
+        if (extent->offset < offset) {
+            extent->size -= offset - extent->offset;
+            extent->offset = offset;
+        }
+        break;
+    }
+}
+
+/* Error conditions include failure to seek or write to output. */
+static gboolean
+write_block (GduCopyBlock *block, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    CopyContext *ctx = user_data;
+    CreateDiskImageJobData *data = ctx->data;
+    GOutputStream *output_stream = G_OUTPUT_STREAM (data->output_file_stream);
+    g_autoptr(GError) local_error = NULL;
+    guint64 num_bytes_skipped = 0;
+    gint64 now_usec;
+
+    /* Skipped blocks are left as they are, a later pass reads them */
+    if (block->skipped)
+        goto written;
+
+    /* A compressed disk image is one stream, so the blocks that are not
+     * copied (see gdu_used_blocks_get_extents()) have to be written as
+     * zeroes - which compress to almost nothing.
+     */
+    if (ctx->compressed_stream != NULL) {
+        if (!write_zeroes (ctx->compressed_stream, block->offset - ctx->compressed_offset, cancellable, error)
+            || !g_output_stream_write_all (ctx->compressed_stream, block->data, block->size, NULL, cancellable,
+                                           error)) {
+            g_prefix_error (error, "Error compressing %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": ",
+                            block->size, block->offset);
+            return FALSE;
+        }
+        ctx->compressed_offset = block->offset + block->size;
+        goto written;
+    }
+
+    /* Leave blocks of zeroes as holes in the (sparse) disk image file.
+     * Punching the hole is cheap as the block has not been written before,
+     * if the filesystem does not support it, just write the zeroes.
+     */
+    if (ctx->output_fd != -1 && gdu_copy_block_is_zero (block)
+        && fallocate (ctx->output_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, block->offset, block->size) == 0) {
+        num_bytes_skipped = block->size;
+        goto written;
+    }
+
+write_again:
+    if (!g_seekable_seek (G_SEEKABLE (output_stream), block->offset, G_SEEK_SET, cancellable, error)) {
+        g_prefix_error (error, "Error seeking to offset %" G_GUINT64_FORMAT ": ", block->offset);
+        return FALSE;
+    }
+
+    if (!g_output_stream_write_all (output_stream, block->data, block->size, NULL, cancellable, &local_error)) {
+        /* The filesystem may reject direct I/O that is not aligned to its
+         * block size, e.g. for the last block of the device. Fall back to
+         * buffered I/O for the rest of the copy.
+         */
+        if (ctx->output_direct_io && g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT)
+            && set_direct_io (ctx->output_fd, FALSE)) {
+            ctx->output_direct_io = FALSE;
+            g_clear_error (&local_error);
+            goto write_again;
+        }
+        g_propagate_prefixed_error (error, g_steal_pointer (&local_error),
+                                    "Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": ",
+                                    block->size, block->offset);
+        return FALSE;
+    }
+
+written:
+    ctx->num_bytes_completed += block->size;
+
+    /* Only the whole sectors that were read are rescued, the rest of the
+     * block is left for the next pass
+     */
+    if (ctx->rescue_map != NULL && !block->skipped) {
+        guint64 num_rescued = block->num_read - block->num_read % ctx->rescue_sector_size;
+
+        gdu_rescue_map_set (ctx->rescue_map, block->offset, num_rescued, GDU_RESCUE_STATUS_FINISHED);
+        gdu_rescue_map_set (ctx->rescue_map, block->offset + num_rescued, block->size - num_rescued,
+                            ctx->rescue_pass->failed_status);
+        gdu_rescue_map_set_position (ctx->rescue_map, block->offset + block->size, ctx->rescue_pass->status);
+
+        if (g_get_monotonic_time () - ctx->rescue_last_save_usec > RESCUE_SAVE_INTERVAL_USEC
+            && !save_rescue_map (ctx, cancellable, error)) {
+            g_prefix_error (error, _("Error saving rescue map: "));
+            return FALSE;
+        }
+    }
+
+    /* The blocks that are not copied are zeroes in the disk image */
+    if (ctx->checkpoint != NULL) {
+        gdu_checkpoint_add_zeroes (ctx->checkpoint, block->offset - ctx->checkpoint_offset);
+        gdu_checkpoint_add_data (ctx->checkpoint, block->data, block->size);
+        ctx->checkpoint_offset = block->offset + block->size;
+
+        if (g_get_monotonic_time () - ctx->checkpoint_last_save_usec > CHECKPOINT_SAVE_INTERVAL_USEC
+            && !save_checkpoint (ctx, cancellable, error)) {
+            g_prefix_error (error, _("Error saving checkpoint: "));
+            return FALSE;
+        }
+    }
+
+    /* Update GUI - but only every 200 ms */
+    g_mutex_lock (&data->copy_lock);
+    if (ctx->rescue_map == NULL)
+        data->num_error_bytes += block->size - block->num_read;
+    data->num_sparse_bytes += num_bytes_skipped;
+    now_usec = g_get_monotonic_time ();
+    if (now_usec - ctx->last_update_usec > 200 * G_USEC_PER_SEC / 1000) {
+        if (ctx->rescue_map != NULL)
+            data->num_error_bytes = get_rescue_num_error_bytes (ctx->rescue_map);
+        gdu_estimator_add_sample (data->estimator, ctx->num_bytes_completed);
+        ctx->last_update_usec = now_usec;
+        g_mutex_unlock (&data->copy_lock);
+        gdu_local_job_queue_update (ctx->job);
+    } else {
+        g_mutex_unlock (&data->copy_lock);
+    }
 
-    return ret;
+    return TRUE;
+}
+
+/* Runs the passes of rescue_passes[] that have something left to do */
+static gboolean
+run_rescue_passes (CopyContext *ctx, GduCopyEngine *engine, GCancellable *cancellable, GError **error)
+{
+    CreateDiskImageJobData *data = ctx->data;
+    guint n;
+
+    for (n = 0; n < G_N_ELEMENTS (rescue_passes); n++) {
+        const RescuePass *pass = &rescue_passes[n];
+        g_autoptr(GArray) extents = NULL;
+        g_autoptr(GError) save_error = NULL;
+        guint64 num_bytes = 0;
+        guint i;
+
+        extents = gdu_rescue_map_get_extents (ctx->rescue_map, pass->status);
+        if (extents->len == 0)
+            continue;
+        for (i = 0; i < extents->len; i++)
+            num_bytes += g_array_index (extents, GduCopyExtent, i).size;
+
+        g_mutex_lock (&data->copy_lock);
+        g_clear_object (&data->estimator);
+        data->estimator = gdu_estimator_new (num_bytes);
+        data->rescue_pass = n + 1;
+        g_mutex_unlock (&data->copy_lock);
+        gdu_local_job_queue_update (ctx->job);
+
+        ctx->rescue_pass = pass;
+        ctx->rescue_skip_size = 0;
+        ctx->rescue_skip_until = 0;
+        ctx->num_bytes_completed = 0;
+
+        switch (pass->read_size) {
+        case RESCUE_READ_TUNED:
+            gdu_copy_engine_set_auto_tune (engine, COPY_MIN_BLOCK_SIZE);
+            gdu_copy_engine_set_block_size (engine, 0);
+            break;
+        case RESCUE_READ_SMALL:
+            gdu_copy_engine_set_auto_tune (engine, 0);
+            gdu_copy_engine_set_block_size (engine, COPY_MIN_BLOCK_SIZE);
+            break;
+        case RESCUE_READ_SECTORS:
+            gdu_copy_engine_set_auto_tune (engine, 0);
+            gdu_copy_engine_set_block_size (engine, ctx->rescue_sector_size);
+            break;
+        }
+
+        if (!gdu_copy_engine_run (engine, (GduCopyExtent *) extents->data, extents->len, read_block, write_block, ctx,
+                                  cancellable, error)) {
+            /* Save what was rescued so far, also when cancelled, so the rescue can be continued */
+            if (!save_rescue_map (ctx, NULL, &save_error))
+                g_warning ("Error saving rescue map: %s (%s, %d)", save_error->message,
+                           g_quark_to_string (save_error->domain), save_error->code);
+            return FALSE;
+        }
+
+        if (!save_rescue_map (ctx, cancellable, error)) {
+            g_prefix_error (error, _("Error saving rescue map: "));
+            return FALSE;
+        }
+    }
+
+    return TRUE;
 }
 
 static GduLocalJobResult
@@ -428,19 +938,17 @@ create_disk_image_job_run (GduLocalJob *job, GCancellable *cancellable, GError *
 {
     CreateDiskImageJobData *data = gdu_local_job_get_user_data (job);
     g_autoptr(GduDVDSupport) dvd_support = NULL;
-    g_autofree guchar *buffer_unaligned = NULL;
-    guchar *buffer;
+    g_autoptr(GduCopyEngine) engine = NULL;
+    g_autoptr(GArray) extents = NULL;
+    CopyContext ctx = { 0 };
+    GChecksum *checksum = NULL;
     guint64 block_device_size = 0;
-    glong page_size;
+    guint64 num_bytes_to_copy = 0;
+    gint logical_block_size = 0;
+    guint n;
     GError *error = NULL;
     GError *error2 = NULL;
-    gint64 last_update_usec = -1;
     gint fd = -1;
-    gint buffer_size;
-    guint64 num_bytes_completed = 0;
-
-    /* default to 1 MiB blocks */
-    buffer_size = (1 * 1024 * 1024);
 
     /* Most OSes put ACLs for logged-in users on /dev/sr* nodes (this is
      * so CD burning tools etc. work) so see if we can open the device
@@ -513,93 +1021,245 @@ create_disk_image_job_run (GduLocalJob *job, GCancellable *cancellable, GError *
         goto out;
     }
 
-    /* If supported, allocate space at once to ensure blocks are laid
-     * out contigously, see http://lwn.net/Articles/226710/
+    /* Only copy the blocks the filesystem uses if requested, the rest of the
+     * disk image is left as holes. This has to happen before enabling direct
+     * I/O as the allocation bitmaps are read with unaligned buffers. If the
+     * filesystem can't be parsed, just copy everything.
      */
-    if (G_IS_FILE_DESCRIPTOR_BASED (data->output_file_stream)) {
-        gint output_fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (data->output_file_stream));
-        gint rc;
+    if (data->used_blocks_only && !(data->rescue && data->resume)) {
+        extents = gdu_used_blocks_get_extents (fd, udisks_block_get_id_type (data->block), block_device_size, &error2);
+        if (extents == NULL) {
+            g_warning ("Copying all of %s: %s (%s, %d)", udisks_block_get_device (data->block), error2->message,
+                       g_quark_to_string (error2->domain), error2->code);
+            g_clear_error (&error2);
+        }
+    }
+    if (extents == NULL) {
+        GduCopyExtent extent = { 0, block_device_size };
 
-        g_mutex_lock (&data->copy_lock);
-        data->allocating_file = TRUE;
-        g_mutex_unlock (&data->copy_lock);
-        gdu_local_job_queue_update (job);
-
-        rc = fallocate (output_fd, 0, /* mode */
-                        (off_t) 0, (off_t) block_device_size);
-
-        if (rc != 0) {
-            if (errno == ENOSYS || errno == EOPNOTSUPP) {
-                /* If the kernel or filesystem does not support it, too
-                 * bad. Just continue.
-                 */
-            } else {
-                error = g_error_new (G_IO_ERROR, g_io_error_from_errno (errno), "%s", strerror (errno));
-                g_prefix_error (&error, _("Error allocating space for disk image file: "));
+        extents = g_array_new (FALSE, FALSE, sizeof (GduCopyExtent));
+        g_array_append_val (extents, extent);
+    }
+
+    ctx.output_fd = -1;
+    if (G_IS_FILE_DESCRIPTOR_BASED (data->output_file_stream))
+        ctx.output_fd = g_file_descriptor_based_get_fd (G_FILE_DESCRIPTOR_BASED (data->output_file_stream));
+
+    /* Compressed disk images are written as a stream, so there are no
+     * holes to leave and no writes to align for direct I/O
+     */
+    if (data->format != IMAGE_FORMAT_RAW) {
+        g_autoptr(GduCompressor) compressor = NULL;
+
+        compressor = gdu_compressor_new (data->format == IMAGE_FORMAT_XZ ? GDU_COMPRESSOR_FORMAT_XZ
+                                                                         : GDU_COMPRESSOR_FORMAT_ZSTD,
+                                         block_device_size, &error);
+        if (compressor == NULL)
+            goto out;
+        ctx.compressed_stream =
+            g_converter_output_stream_new (G_OUTPUT_STREAM (data->output_file_stream), G_CONVERTER (compressor));
+        ctx.output_fd = -1;
+    }
+
+    if (ioctl (fd, BLKSSZGET, &logical_block_size) != 0 || logical_block_size <= 0)
+        logical_block_size = 0;
+
+    /* A rescue starts with everything but the blocks that are not copied
+     * left to do, or continues where the saved map left off
+     */
+    if (data->rescue) {
+        if (data->resume) {
+            ctx.rescue_map = gdu_rescue_map_load (data->rescue_map_file, block_device_size, cancellable, &error);
+            if (ctx.rescue_map == NULL) {
+                g_prefix_error (&error, _("Error reading rescue map: "));
                 goto out;
             }
+        } else {
+            guint64 end = 0;
+
+            ctx.rescue_map = gdu_rescue_map_new (block_device_size);
+            for (n = 0; n < extents->len; n++) {
+                GduCopyExtent *extent = &g_array_index (extents, GduCopyExtent, n);
+
+                gdu_rescue_map_set (ctx.rescue_map, end, extent->offset - end, GDU_RESCUE_STATUS_FINISHED);
+                end = extent->offset + extent->size;
+            }
+            gdu_rescue_map_set (ctx.rescue_map, end, block_device_size - end, GDU_RESCUE_STATUS_FINISHED);
         }
+        ctx.rescue_sector_size = logical_block_size > 0 ? logical_block_size : 512;
+        ctx.rescue_max_skip_size = CLAMP (block_device_size / 100, RESCUE_MIN_SKIP_SIZE, RESCUE_MAX_SKIP_SIZE);
+        ctx.rescue_last_save_usec = g_get_monotonic_time ();
+    }
 
-        g_mutex_lock (&data->copy_lock);
-        data->allocating_file = FALSE;
-        g_mutex_unlock (&data->copy_lock);
-        gdu_local_job_queue_update (job);
+    /* Continue an interrupted copy after the chunks of the disk image that
+     * still match the checkpoint. If the checkpoint is of another device or
+     * can't be read, start over.
+     */
+    if (data->checkpoint_file != NULL) {
+        if (data->resume) {
+            ctx.checkpoint = gdu_checkpoint_load (data->checkpoint_file, &error2);
+            if (ctx.checkpoint == NULL) {
+                g_warning ("Starting over: %s (%s, %d)", error2->message, g_quark_to_string (error2->domain),
+                           error2->code);
+                g_clear_error (&error2);
+            } else if (!gdu_checkpoint_matches (ctx.checkpoint, data->source_id, block_device_size)
+                       || ctx.output_fd == -1) {
+                g_warning ("Starting over: checkpoint is not of %s", udisks_block_get_device (data->block));
+                g_clear_pointer (&ctx.checkpoint, gdu_checkpoint_free);
+            } else if (!gdu_checkpoint_verify (ctx.checkpoint, ctx.output_fd, cancellable, &error)) {
+                g_prefix_error (&error, _("Error reading disk image: "));
+                goto out;
+            }
+        }
+        if (ctx.checkpoint == NULL)
+            ctx.checkpoint = gdu_checkpoint_new (data->source_id, block_device_size);
+
+        /* Everything after the checkpoint is copied again, the blocks that
+         * are not copied have to be zeroes again
+         */
+        ctx.checkpoint_offset = gdu_checkpoint_get_offset (ctx.checkpoint);
+        clip_extents (extents, ctx.checkpoint_offset);
+        if (data->resume) {
+            if (!g_seekable_truncate (G_SEEKABLE (data->output_file_stream), ctx.checkpoint_offset, cancellable,
+                                      &error))
+                goto out;
+            ctx.resumable = TRUE;
+        }
+        ctx.checkpoint_last_save_usec = g_get_monotonic_time ();
     }
 
-    page_size = sysconf (_SC_PAGESIZE);
-    buffer_unaligned = g_new0 (guchar, buffer_size + page_size);
-    buffer = (guchar *) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+    /* Keep the copy out of the page cache if requested. All blocks are
+     * multiples of COPY_MIN_BLOCK_SIZE except for the last one, which ends
+     * at the end of the device, so reads stay aligned to the logical block
+     * size. This comes after verifying the checkpoint, which reads the disk
+     * image into unaligned buffers. If direct I/O is not supported, just
+     * continue with buffered I/O.
+     */
+    if (data->direct_io) {
+        if (logical_block_size == 0 || COPY_MIN_BLOCK_SIZE % logical_block_size != 0 || !set_direct_io (fd, TRUE))
+            g_info ("Not using direct I/O for reading %s", udisks_block_get_device (data->block));
+        else
+            ctx.input_direct_io = TRUE;
+
+        if (ctx.output_fd != -1 && set_direct_io (ctx.output_fd, TRUE))
+            ctx.output_direct_io = TRUE;
+        else
+            g_info ("Not using direct I/O for writing the disk image");
+    }
 
-    g_mutex_lock (&data->copy_lock);
-    data->estimator = gdu_estimator_new (block_device_size);
-    data->num_error_bytes = 0;
-    g_mutex_unlock (&data->copy_lock);
+    for (n = 0; n < extents->len; n++)
+        num_bytes_to_copy += g_array_index (extents, GduCopyExtent, n).size;
 
-    /* Read huge (e.g. 1 MiB) blocks and write it to the output
-     * file even if it was only partially read.
+    /* Set the final size of the disk image right away. Blocks that are all
+     * zeroes are not written but left as holes, so the file is sparse and
+     * does not need more space than the data on the device.
      */
-    num_bytes_completed = 0;
-    while (num_bytes_completed < block_device_size) {
-        gssize num_bytes_to_read;
-        gssize num_bytes_read;
-        gint64 now_usec;
+    if (ctx.compressed_stream == NULL && g_seekable_can_truncate (G_SEEKABLE (data->output_file_stream))) {
+        if (!g_seekable_truncate (G_SEEKABLE (data->output_file_stream), block_device_size, cancellable, &error)) {
+            g_prefix_error (&error, _("Error allocating space for disk image file: "));
+            goto out;
+        }
+    }
 
-        num_bytes_to_read = buffer_size;
-        if (num_bytes_to_read + num_bytes_completed > block_device_size)
-            num_bytes_to_read = block_device_size - num_bytes_completed;
+    g_mutex_lock (&data->copy_lock);
+    data->estimator = gdu_estimator_new (num_bytes_to_copy);
+    data->num_error_bytes = ctx.rescue_map != NULL ? get_rescue_num_error_bytes (ctx.rescue_map) : 0;
+    data->num_sparse_bytes = 0;
+    g_mutex_unlock (&data->copy_lock);
+    gdu_local_job_queue_update (job);
+
+    ctx.job = job;
+    ctx.data = data;
+    ctx.fd = fd;
+    ctx.dvd_support = dvd_support;
+    ctx.last_update_usec = g_get_monotonic_time ();
+
+    /* Read huge (64 KiB to 16 MiB, depending on what is fastest for the
+     * devices involved) blocks and write them to the output file even if
+     * they were only partially read. The writer stage works on one block
+     * while the reader stage already fills the next ones.
+     */
+    engine = gdu_copy_engine_new (COPY_NUM_BUFFERS, COPY_MEMORY_CAP / COPY_NUM_BUFFERS);
+    if (ctx.rescue_map != NULL) {
+        if (!run_rescue_passes (&ctx, engine, cancellable, &error))
+            goto out;
 
-        /* Update GUI - but only every 200 ms and only if last update isn't pending */
         g_mutex_lock (&data->copy_lock);
-        now_usec = g_get_monotonic_time ();
-        if (now_usec - last_update_usec > 200 * G_USEC_PER_SEC / 1000 || last_update_usec < 0) {
-            if (num_bytes_completed > 0)
-                gdu_estimator_add_sample (data->estimator, num_bytes_completed);
-            last_update_usec = now_usec;
-            g_mutex_unlock (&data->copy_lock);
-            gdu_local_job_queue_update (job);
-        } else {
-            g_mutex_unlock (&data->copy_lock);
+        data->num_error_bytes = get_rescue_num_error_bytes (ctx.rescue_map);
+        g_mutex_unlock (&data->copy_lock);
+
+        /* Keep the map only if it knows about bad sectors */
+        if (data->num_error_bytes == 0 && !g_file_delete (data->rescue_map_file, NULL, &error2)) {
+            if (!g_error_matches (error2, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+                g_warning ("Error deleting rescue map: %s (%s, %d)", error2->message,
+                           g_quark_to_string (error2->domain), error2->code);
+            g_clear_error (&error2);
+        }
+    } else {
+        /* Hash the disk image while copying it, instead of reading it again
+         * afterwards. That needs all of it to be copied in one go.
+         */
+        if (data->checksum_file != NULL && ctx.checkpoint_offset == 0) {
+            checksum = g_checksum_new (G_CHECKSUM_SHA256);
+            gdu_copy_engine_set_checksum (engine, checksum, block_device_size);
         }
 
-        num_bytes_read = copy_span (fd, G_OUTPUT_STREAM (data->output_file_stream), num_bytes_completed,
-                                    num_bytes_to_read, buffer, TRUE, /* pad_with_zeroes */
-                                    dvd_support, cancellable, &error);
-        if (num_bytes_read < 0)
+        gdu_copy_engine_set_auto_tune (engine, COPY_MIN_BLOCK_SIZE);
+        if (!gdu_copy_engine_run (engine, (GduCopyExtent *) extents->data, extents->len, read_block, write_block,
+                                  &ctx, cancellable, &error)) {
+            /* Save how far the copy got, also when cancelled, so it can be continued */
+            if (ctx.checkpoint != NULL && !save_checkpoint (&ctx, NULL, &error2)) {
+                g_warning ("Error saving checkpoint: %s (%s, %d)", error2->message,
+                           g_quark_to_string (error2->domain), error2->code);
+                g_clear_error (&error2);
+            }
             goto out;
+        }
+    }
 
-        /*g_print ("read %" G_GUINT64_FORMAT " bytes (requested %" G_GUINT64_FORMAT ") from offset %" G_GUINT64_FORMAT
-           "\n", num_bytes_read, num_bytes_to_read, num_bytes_completed);*/
+    if (ctx.checkpoint != NULL && !g_file_delete (data->checkpoint_file, NULL, &error2)) {
+        if (!g_error_matches (error2, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+            g_warning ("Error deleting checkpoint: %s (%s, %d)", error2->message, g_quark_to_string (error2->domain),
+                       error2->code);
+        g_clear_error (&error2);
+    }
 
-        if (num_bytes_read < num_bytes_to_read) {
-            guint64 num_bytes_skipped = num_bytes_to_read - num_bytes_read;
-            g_mutex_lock (&data->copy_lock);
-            data->num_error_bytes += num_bytes_skipped;
-            g_mutex_unlock (&data->copy_lock);
+    /* Save the checksum in the format of sha256sum(1), so it can be checked with it */
+    if (checksum != NULL) {
+        g_autofree gchar *basename = g_file_get_basename (data->output_file);
+        g_autofree gchar *contents = NULL;
+
+        data->checksum = g_strdup (g_checksum_get_string (checksum));
+        contents = g_strdup_printf ("%s  %s\n", data->checksum, basename);
+        if (!g_file_replace_contents (data->checksum_file, contents, strlen (contents), NULL, FALSE,
+                                      G_FILE_CREATE_REPLACE_DESTINATION, NULL, cancellable, &error2)) {
+            g_warning ("Error saving checksum: %s (%s, %d)", error2->message, g_quark_to_string (error2->domain),
+                       error2->code);
+            g_clear_error (&error2);
+        }
+    } else if (data->checksum_file != NULL) {
+        /* A continued copy is not hashed. The checksum file of an older disk
+         * image with the same name is kept, but the user is told about it.
+         */
+        data->checksum_skipped = TRUE;
+        data->checksum_file_stale = g_file_query_exists (data->checksum_file, NULL);
+    }
+
+    /* The disk image has the size of the device, also if the end was not copied */
+    if (ctx.compressed_stream != NULL) {
+        if (!write_zeroes (ctx.compressed_stream, block_device_size - ctx.compressed_offset, cancellable, &error)
+            || !g_output_stream_close (ctx.compressed_stream, cancellable, &error)) {
+            g_prefix_error (&error, _("Error writing compressed disk image: "));
+            goto out;
         }
-        num_bytes_completed += num_bytes_to_read;
     }
 
 out:
+    g_clear_object (&ctx.compressed_stream);
+    g_clear_pointer (&ctx.rescue_map, gdu_rescue_map_free);
+    g_clear_pointer (&ctx.checkpoint, gdu_checkpoint_free);
+    g_clear_pointer (&checksum, g_checksum_free);
+
     /* in either case, close the stream */
     if (!g_output_stream_close (G_OUTPUT_STREAM (data->output_file_stream), NULL, /* cancellable */
                                 &error2)) {
@@ -608,8 +1268,10 @@ out:
         g_clear_error (&error2);
     }
     g_clear_object (&data->output_file_stream);
+    g_clear_object (&data->output_file_io_stream);
 
-    if (error != NULL) {
+    /* An interrupted copy can be continued later, so keep what was copied so far */
+    if (error != NULL && !data->resume && !ctx.resumable) {
         /* Cleanup */
         if (!g_file_delete (data->output_file, NULL, &error2)) {
             g_warning ("Error deleting file: %s (%s, %d)", error2->message, g_quark_to_string (error2->domain),
@@ -638,6 +1300,43 @@ out:
     return GDU_LOCAL_JOB_RESULT_SUCCESS;
 }
 
+static gboolean
+is_rescue_enabled (GduCreateDiskImageDialog *self)
+{
+    return adw_combo_row_get_selected (ADW_COMBO_ROW (self->format_row)) == IMAGE_FORMAT_RAW
+           && adw_switch_row_get_active (ADW_SWITCH_ROW (self->rescue_row));
+}
+
+/* The file next to the disk image @output_file that an interrupted copy can be continued with, if any. Only
+ * raw disk images can be continued, compressed ones are written as one stream.
+ */
+static GFile *
+get_resume_file (GduCreateDiskImageDialog *self, GFile *output_file)
+{
+    if (is_rescue_enabled (self))
+        return get_sidecar_file (output_file, ".map");
+    if (adw_combo_row_get_selected (ADW_COMBO_ROW (self->format_row)) == IMAGE_FORMAT_RAW)
+        return get_sidecar_file (output_file, ".checkpoint");
+    return NULL;
+}
+
+/* The drive ID and partition number, which stay the same when the device is attached again */
+static gchar *
+get_source_id (GduCreateDiskImageDialog *self)
+{
+    UDisksPartition *partition;
+
+    if (self->drive == NULL || *udisks_drive_get_id (self->drive) == '\0')
+        return g_strdup (udisks_block_get_device (self->block));
+
+    partition = udisks_object_peek_partition (self->object);
+    if (partition != NULL)
+        return g_strdup_printf ("%s-part%u", udisks_drive_get_id (self->drive),
+                                udisks_partition_get_number (partition));
+
+    return g_strdup (udisks_drive_get_id (self->drive));
+}
+
 static CreateDiskImageJobData *
 create_disk_image_job_data_new (GduCreateDiskImageDialog *self, GFile *output_file,
                                 GFileOutputStream *output_file_stream)
@@ -658,6 +1357,22 @@ create_disk_image_job_data_new (GduCreateDiskImageDialog *self, GFile *output_fi
         data->drive = g_object_ref (self->drive);
     data->output_file = g_object_ref (output_file);
     data->output_file_stream = g_object_ref (output_file_stream);
+    data->format = adw_combo_row_get_selected (ADW_COMBO_ROW (self->format_row));
+    data->direct_io = adw_switch_row_get_active (ADW_SWITCH_ROW (self->direct_io_row));
+    data->used_blocks_only = gtk_widget_get_visible (self->used_blocks_row)
+                             && adw_switch_row_get_active (ADW_SWITCH_ROW (self->used_blocks_row));
+    data->rescue = is_rescue_enabled (self);
+    if (data->rescue)
+        data->rescue_map_file = get_sidecar_file (output_file, ".map");
+    else if (data->format == IMAGE_FORMAT_RAW)
+        data->checkpoint_file = get_sidecar_file (output_file, ".checkpoint");
+    data->source_id = get_source_id (self);
+    /* The checksum of a compressed disk image would be the one of the uncompressed data, which is not what
+     * sha256sum(1) computes for the file
+     */
+    if (data->format == IMAGE_FORMAT_RAW && !data->rescue
+        && adw_switch_row_get_active (ADW_SWITCH_ROW (self->checksum_row)))
+        data->checksum_file = get_sidecar_file (output_file, ".sha256");
 
     source_description = adw_action_row_get_subtitle (ADW_ACTION_ROW (self->source_label));
     data->source_description = g_strdup (source_description != NULL ? source_description : "");
@@ -679,14 +1394,32 @@ start_copying (GduCreateDiskImageDialog *self)
     g_autoptr(GduLocalJob) job = NULL;
     g_autoptr(GError) error = NULL;
     g_autoptr(GFile) output_file = NULL;
+    g_autoptr(GFile) resume_file = NULL;
+    g_autoptr(GFileIOStream) output_file_io_stream = NULL;
     g_autoptr(GFileOutputStream) output_file_stream = NULL;
 
     name = gtk_editable_get_text (GTK_EDITABLE (self->name_entry));
 
     output_file = g_file_get_child (self->directory, name);
-    output_file_stream = g_file_replace (output_file, NULL, /* etag */
-                                         FALSE,             /* make_backup */
-                                         G_FILE_CREATE_NONE, NULL, &error);
+    resume_file = get_resume_file (self, output_file);
+
+    /* Continue an interrupted copy in the existing disk image, see on_create_image_button_clicked_cb() */
+    if (resume_file != NULL && g_file_query_exists (output_file, NULL) && g_file_query_exists (resume_file, NULL)) {
+        output_file_io_stream = g_file_open_readwrite (output_file, NULL, &error);
+        if (output_file_io_stream != NULL) {
+            GOutputStream *stream = g_io_stream_get_output_stream (G_IO_STREAM (output_file_io_stream));
+
+            if (G_IS_FILE_OUTPUT_STREAM (stream))
+                output_file_stream = g_object_ref (G_FILE_OUTPUT_STREAM (stream));
+            else
+                g_set_error (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                             "Disk image can't be written to in place");
+        }
+    } else {
+        output_file_stream = g_file_replace (output_file, NULL, /* etag */
+                                             FALSE,             /* make_backup */
+                                             G_FILE_CREATE_NONE, NULL, &error);
+    }
     if (output_file_stream == NULL) {
         gdu_utils_show_error (gdu_create_disk_image_dialog_get_window (self), _("Error opening file for writing"),
                                                                                 error);
@@ -698,6 +1431,10 @@ start_copying (GduCreateDiskImageDialog *self)
     // gdu_utils_file_chooser_for_disk_images_set_default_folder (folder);
 
     data = create_disk_image_job_data_new (self, output_file, output_file_stream);
+    if (output_file_io_stream != NULL) {
+        data->output_file_io_stream = g_steal_pointer (&output_file_io_stream);
+        data->resume = TRUE;
+    }
     job = gdu_local_job_new (self->object, "x-gdu-create-disk-image",
                              _("Creating Disk Image"), create_disk_image_job_run, create_disk_image_job_update,
                                on_create_disk_image_job_completed, g_steal_pointer (&data),
@@ -762,6 +1499,7 @@ on_create_image_button_clicked_cb (GduCreateDiskImageDialog *self, GtkButton *bu
 {
     const gchar *name;
     g_autoptr(GFile) file = NULL;
+    g_autoptr(GFile) resume_file = NULL;
     ConfirmationDialogData *data;
     GtkWindow *window;
 
@@ -774,12 +1512,28 @@ on_create_image_button_clicked_cb (GduCreateDiskImageDialog *self, GtkButton *bu
         return;
     }
 
+    resume_file = get_resume_file (self, file);
+
     data = g_new0 (ConfirmationDialogData, 1);
-    data->message = _("Replace File?");
-    data->description = g_strdup_printf (_("A file named “%s” already exists in %s"), name,
-                                           gdu_utils_unfuse_path (g_file_get_path (self->directory)));
-    data->response_verb = _("Replace");
-    data->response_appearance = ADW_RESPONSE_DESTRUCTIVE;
+    if (resume_file != NULL && g_file_query_exists (resume_file, NULL)) {
+        if (is_rescue_enabled (self)) {
+            data->message = _("Continue Rescue?");
+            data->description = g_strdup_printf (_("The disk image “%s” in %s has a rescue map. Only the areas that have not been copied yet will be read."),
+                                                 name, gdu_utils_unfuse_path (g_file_get_path (self->directory)));
+        } else {
+            data->message = _("Continue Copying?");
+            data->description = g_strdup_printf (_("The disk image “%s” in %s was not copied completely. Copying will continue where it stopped."),
+                                                 name, gdu_utils_unfuse_path (g_file_get_path (self->directory)));
+        }
+        data->response_verb = _("Continue");
+        data->response_appearance = ADW_RESPONSE_SUGGESTED;
+    } else {
+        data->message = _("Replace File?");
+        data->description = g_strdup_printf (_("A file named “%s” already exists in %s"), name,
+                                             gdu_utils_unfuse_path (g_file_get_path (self->directory)));
+        data->response_verb = _("Replace");
+        data->response_appearance = ADW_RESPONSE_DESTRUCTIVE;
+    }
     data->callback = overwrite_response_cb;
     data->user_data = self;
 
@@ -813,6 +1567,33 @@ file_dialog_open_cb (GObject *object, GAsyncResult *res, gpointer user_data)
     }
 }
 
+static void
+on_format_row_selected_cb (GduCreateDiskImageDialog *self)
+{
+    g_autofree gchar *name = NULL;
+    guint format;
+    guint n;
+
+    /* Keep the name, but change the suffix of the compression format */
+    name = g_strdup (gtk_editable_get_text (GTK_EDITABLE (self->name_entry)));
+    for (n = 0; n < G_N_ELEMENTS (image_format_suffixes); n++) {
+        if (*image_format_suffixes[n] != '\0' && g_str_has_suffix (name, image_format_suffixes[n])) {
+            name[strlen (name) - strlen (image_format_suffixes[n])] = '\0';
+            break;
+        }
+    }
+
+    format = adw_combo_row_get_selected (ADW_COMBO_ROW (self->format_row));
+    if (format < G_N_ELEMENTS (image_format_suffixes)) {
+        g_autofree gchar *new_name = g_strconcat (name, image_format_suffixes[format], NULL);
+        gtk_editable_set_text (GTK_EDITABLE (self->name_entry), new_name);
+    }
+
+    /* Only raw disk images can be written in place */
+    gtk_widget_set_sensitive (self->rescue_row, format == IMAGE_FORMAT_RAW);
+    gtk_widget_set_sensitive (self->checksum_row, format == IMAGE_FORMAT_RAW);
+}
+
 static void
 on_choose_folder_button_clicked_cb (GduCreateDiskImageDialog *self)
 {
@@ -903,8 +1684,14 @@ gdu_create_disk_image_dialog_class_init (GduCreateDiskImageDialogClass *klass)
     gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, name_entry);
     gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, location_entry);
     gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, source_label);
+    gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, format_row);
+    gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, direct_io_row);
+    gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, used_blocks_row);
+    gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, rescue_row);
+    gtk_widget_class_bind_template_child (widget_class, GduCreateDiskImageDialog, checksum_row);
 
     gtk_widget_class_bind_template_callback (widget_class, on_choose_folder_button_clicked_cb);
+    gtk_widget_class_bind_template_callback (widget_class, on_format_row_selected_cb);
     gtk_widget_class_bind_template_callback (widget_class, on_create_image_button_clicked_cb);
 }
 
@@ -933,6 +1720,11 @@ gdu_create_disk_image_dialog_show (GtkWindow *parent_window, UDisksObject *objec
     gdu_create_disk_image_dialog_set_default_name (self);
     gdu_create_disk_image_dialog_update_directory (self);
 
+    /* Copying only the used blocks needs to understand the filesystem */
+    gtk_widget_set_visible (self->used_blocks_row,
+                            g_strcmp0 (udisks_block_get_id_usage (self->block), "filesystem") == 0
+                                && gdu_used_blocks_is_supported (udisks_block_get_id_type (self->block)));
+
     // gtk4 todo
     // gdu_utils_configure_file_chooser_for_disk_images (GTK_FILE_CHOOSER (self->folder_fcbutton),
     //                                                   FALSE,   /* set file types */
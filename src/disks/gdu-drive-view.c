@@ -18,6 +18,7 @@
 
 #include <adwaita.h>
 #include <glib/gi18n.h>
+#include <string.h>
 #include <udisks/udisks.h>
 
 #include "gdu-ata-smart-dialog.h"
@@ -28,9 +29,12 @@
 #include "gdu-drive-header.h"
 #include "gdu-format-disk-dialog.h"
 #include "gdu-item.h"
+#include "gdu-latency-heatmap.h"
 #include "gdu-manager.h"
 #include "gdu-rust.h"
 #include "gdu-space-allocation-bar.h"
+#include "gdu-test-disk-dialog.h"
+#include "gdusurfacescan.h"
 
 typedef enum {
     PROP_MOBILE = 1,
@@ -51,6 +55,8 @@ struct _GduDriveView {
     AdwActionRow *drive_size_row;
 
     GtkWidget *space_allocation_bar;
+    GtkWidget *latency_group;
+    GtkWidget *latency_heatmap;
     GtkListBox *drive_partitions_listbox;
 
     GduDrive *drive;
@@ -117,6 +123,7 @@ update_drive_view (GduDriveView *self)
     ENABLE ("view.create-image", GDU_FEATURE_CREATE_IMAGE);
     ENABLE ("view.restore-image", GDU_FEATURE_RESTORE_IMAGE);
     ENABLE ("view.benchmark", GDU_FEATURE_BENCHMARK);
+    ENABLE ("view.test", GDU_FEATURE_BENCHMARK);
     ENABLE ("view.smart", GDU_FEATURE_SMART);
     ENABLE ("view.settings", GDU_FEATURE_SETTINGS);
     ENABLE ("view.standby", GDU_FEATURE_STANDBY);
@@ -211,6 +218,22 @@ benchmark_disk_clicked_cb (GtkWidget *widget, const gchar *action_name, GVariant
     gdu_benchmark_dialog_show (drive_view_get_window (self), object, gdu_manager_get_client (manager));
 }
 
+static void
+test_disk_clicked_cb (GtkWidget *widget, const gchar *action_name, GVariant *parameter)
+{
+    GduDriveView *self = GDU_DRIVE_VIEW (widget);
+    UDisksObject *object;
+    GduManager *manager;
+
+    g_assert (GDU_IS_DRIVE_VIEW (self));
+
+    object = gdu_drive_get_object (self->drive);
+    manager = gdu_manager_get_default (NULL);
+    g_assert (object != NULL);
+
+    gdu_test_disk_dialog_show (drive_view_get_window (self), object, gdu_manager_get_client (manager));
+}
+
 static void
 smart_disk_clicked_cb (GtkWidget *widget, const gchar *action_name, GVariant *parameter)
 {
@@ -440,6 +463,60 @@ poweroff_drive_clicked_cb (GtkWidget *widget, const gchar *action_name, GVariant
     gdu_utils_show_confirmation (drive_view_get_window (self), data, affected_devices_widget);
 }
 
+static void
+update_latency_heatmap (GduDriveView *self)
+{
+    GArray *regions = self->drive ? gdu_drive_get_latency_regions (self->drive) : NULL;
+
+    gdu_latency_heatmap_set_regions (GDU_LATENCY_HEATMAP (self->latency_heatmap), regions);
+    gtk_widget_set_visible (self->latency_group, regions != NULL);
+}
+
+static void
+export_latency_save_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
+{
+    g_autoptr(GduDriveView) self = GDU_DRIVE_VIEW (user_data);
+    g_autoptr(GFile) file = NULL;
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *contents = NULL;
+    GArray *regions;
+
+    file = gtk_file_dialog_save_finish (GTK_FILE_DIALOG (source_object), res, NULL);
+    regions = self->drive ? gdu_drive_get_latency_regions (self->drive) : NULL;
+    if (file == NULL || regions == NULL)
+        return;
+
+    contents = gdu_surface_scan_format_regions_csv (regions);
+    if (!g_file_replace_contents (file, contents, strlen (contents), NULL, /* etag */
+                                  FALSE,                                 /* make_backup */
+                                  G_FILE_CREATE_REPLACE_DESTINATION, NULL, /* new_etag */
+                                  NULL,                                    /* cancellable */
+                                  &error))
+        gdu_utils_show_error (drive_view_get_window (self), _("Error exporting read latency"), error);
+}
+
+static void
+on_export_latency_clicked_cb (GduDriveView *self)
+{
+    g_autoptr(GtkFileDialog) file_dialog = NULL;
+    g_autofree gchar *name = NULL;
+
+    if (self->drive == NULL)
+        return;
+
+    /* Translators: The name of the file that the read latency of a disk is exported to. The %s is the model
+     *              of the disk.
+     */
+    name = g_strdup_printf (_("%s Read Latency.csv"), gdu_drive_get_model (self->drive));
+    g_strdelimit (name, "/", '-');
+
+    file_dialog = gtk_file_dialog_new ();
+    gtk_file_dialog_set_title (file_dialog, _("Export Read Latency"));
+    gtk_file_dialog_set_initial_name (file_dialog, name);
+    gtk_file_dialog_set_modal (file_dialog, TRUE);
+    gtk_file_dialog_save (file_dialog, drive_view_get_window (self), NULL, export_latency_save_cb, g_object_ref (self));
+}
+
 static void
 show_drive_dialog_clicked_cb (GtkWidget *widget, const gchar *action_name, GVariant *parameter)
 {
@@ -519,6 +596,8 @@ gdu_drive_view_class_init (GduDriveViewClass *klass)
     gtk_widget_class_bind_template_child (widget_class, GduDriveView, drive_size_row);
 
     gtk_widget_class_bind_template_child (widget_class, GduDriveView, space_allocation_bar);
+    gtk_widget_class_bind_template_child (widget_class, GduDriveView, latency_group);
+    gtk_widget_class_bind_template_child (widget_class, GduDriveView, latency_heatmap);
     gtk_widget_class_bind_template_child (widget_class, GduDriveView, drive_partitions_listbox);
 
     gtk_widget_class_install_action (widget_class, "view.format", NULL, format_disk_clicked_cb);
@@ -526,6 +605,7 @@ gdu_drive_view_class_init (GduDriveViewClass *klass)
     gtk_widget_class_install_action (widget_class, "view.restore-image", NULL, restore_disk_image_clicked_cb);
 
     gtk_widget_class_install_action (widget_class, "view.benchmark", NULL, benchmark_disk_clicked_cb);
+    gtk_widget_class_install_action (widget_class, "view.test", NULL, test_disk_clicked_cb);
     gtk_widget_class_install_action (widget_class, "view.smart", NULL, smart_disk_clicked_cb);
     gtk_widget_class_install_action (widget_class, "view.settings", NULL, drive_settings_clicked_cb);
 
@@ -539,6 +619,7 @@ gdu_drive_view_class_init (GduDriveViewClass *klass)
 
     gtk_widget_class_bind_template_callback (widget_class, on_copy_drive_model_clicked);
     gtk_widget_class_bind_template_callback (widget_class, on_copy_drive_serial_clicked);
+    gtk_widget_class_bind_template_callback (widget_class, on_export_latency_clicked_cb);
 
     properties[PROP_MOBILE] = g_param_spec_boolean (
         "mobile", NULL, NULL, FALSE, (G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
@@ -561,8 +642,10 @@ gdu_drive_view_set_drive (GduDriveView *self, GduDrive *drive)
     if (self->drive == drive)
         return;
 
-    if (self->drive != NULL)
+    if (self->drive != NULL) {
         g_signal_handlers_disconnect_by_func (self->drive, update_drive_view, self);
+        g_signal_handlers_disconnect_by_func (self->drive, update_latency_heatmap, self);
+    }
 
     g_set_object (&self->drive, drive);
     gdu_space_allocation_bar_set_drive (GDU_SPACE_ALLOCATION_BAR (self->space_allocation_bar), self->drive);
@@ -571,6 +654,10 @@ gdu_drive_view_set_drive (GduDriveView *self, GduDrive *drive)
         /* Partition-table interfaces can change without replacing the drive,
          * so keep the selected drive details in sync with the model. */
         g_signal_connect_object (drive, "changed", G_CALLBACK (update_drive_view), self, G_CONNECT_SWAPPED);
+        g_signal_connect_object (drive, "notify::latency-regions", G_CALLBACK (update_latency_heatmap), self,
+                                 G_CONNECT_SWAPPED);
         update_drive_view (self);
     }
+
+    update_latency_heatmap (self);
 }
@@ -52,10 +52,19 @@ struct _GduDrive {
 
     GduFeature features;
     bool in_progress;
+
+    /* GduSurfaceScanRegion of the last test of the disk */
+    GArray *latency_regions;
 };
 
 G_DEFINE_FINAL_TYPE (GduDrive, gdu_drive, GDU_TYPE_ITEM)
 
+typedef enum {
+    PROP_LATENCY_REGIONS = 1,
+} GduDriveProps;
+
+static GParamSpec *properties[PROP_LATENCY_REGIONS + 1];
+
 #define NUM_PARTITION_COLORS 7
 
 static const gchar *partition_colors[NUM_PARTITION_COLORS] = {
@@ -347,16 +356,30 @@ gdu_drive_finalize (GObject *object)
     g_clear_object (&self->drive);
     g_clear_object (&self->table);
     g_clear_object (&self->file_system);
+    g_clear_pointer (&self->latency_regions, g_array_unref);
 
     G_OBJECT_CLASS (gdu_drive_parent_class)->finalize (object);
 }
 
+static void
+gdu_drive_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+    GduDrive *self = GDU_DRIVE (object);
+
+    switch ((GduDriveProps) prop_id) {
+    case PROP_LATENCY_REGIONS:
+        g_value_set_boxed (value, self->latency_regions);
+        break;
+    }
+}
+
 static void
 gdu_drive_class_init (GduDriveClass *klass)
 {
     GObjectClass *object_class = G_OBJECT_CLASS (klass);
     GduItemClass *item_class = GDU_ITEM_CLASS (klass);
 
+    object_class->get_property = gdu_drive_get_property;
     object_class->dispose = gdu_drive_dispose;
     object_class->finalize = gdu_drive_finalize;
 
@@ -368,6 +391,12 @@ gdu_drive_class_init (GduDriveClass *klass)
     item_class->get_partitions = gdu_drive_get_partitions;
     item_class->get_features = gdu_drive_get_features;
     item_class->changed = gdu_drive_changed;
+
+    properties[PROP_LATENCY_REGIONS] =
+        g_param_spec_boxed ("latency-regions", NULL, NULL, G_TYPE_ARRAY,
+                            (G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS));
+
+    g_object_class_install_properties (object_class, G_N_ELEMENTS (properties), properties);
 }
 
 static void
@@ -1031,6 +1060,33 @@ gdu_drive_get_object (GduDrive *self)
     return self->object;
 }
 
+/* Returns the GduSurfaceScanRegion of every region of the last test of the disk, or NULL if it wasn't
+ * tested yet
+ */
+GArray *
+gdu_drive_get_latency_regions (GduDrive *self)
+{
+    g_return_val_if_fail (GDU_IS_DRIVE (self), NULL);
+
+    return self->latency_regions;
+}
+
+/* Takes a reference to @regions */
+void
+gdu_drive_set_latency_regions (GduDrive *self, GArray *regions)
+{
+    g_return_if_fail (GDU_IS_DRIVE (self));
+
+    if (self->latency_regions == regions)
+        return;
+
+    g_clear_pointer (&self->latency_regions, g_array_unref);
+    if (regions != NULL)
+        self->latency_regions = g_array_ref (regions);
+
+    g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_LATENCY_REGIONS]);
+}
+
 gpointer
 gdu_drive_get_object_for_format (GduDrive *self)
 {
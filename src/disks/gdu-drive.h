@@ -43,6 +43,8 @@ void gdu_drive_power_off_async (GduDrive *self, gpointer parent_window, GCancell
                                 GAsyncReadyCallback callback, gpointer user_data);
 gboolean gdu_drive_power_off_finish (GduDrive *self, GAsyncResult *result, GError **error);
 void gdu_drive_block_changed (GduDrive *self, gpointer object);
+GArray *gdu_drive_get_latency_regions (GduDrive *self);
+void gdu_drive_set_latency_regions (GduDrive *self, GArray *regions);
 
 /* xxx: to be removed once the dust settles */
 gpointer gdu_drive_get_object (GduDrive *self);
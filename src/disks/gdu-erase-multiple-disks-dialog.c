@@ -0,0 +1,584 @@
+/* gdu-erase-multiple-disks-dialog.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdu-erase-multiple-disks-dialog.h"
+
+#include <glib/gi18n.h>
+
+#include "gdu-application.h"
+#include "gdu-job-manager.h"
+#include "gduerase.h"
+#include "gduestimator.h"
+#include "gdulocaljob.h"
+
+/* All selected disks are erased by one job, every disk by a thread of its own, so a batch of disks
+ * takes as long as the slowest disk instead of the sum of all of them. The job reports the throughput
+ * and the time remaining of all disks together.
+ */
+
+/* How often the job is updated while the disks are erased */
+#define UPDATE_USEC (200 * G_USEC_PER_SEC / 1000)
+
+struct _GduEraseMultipleDisksDialog {
+    AdwDialog parent_instance;
+
+    GtkWidget *erase_button;
+    GtkWidget *disks_group;
+
+    UDisksClient *client;
+    /* the rows of the disks, each with its object */
+    GPtrArray *rows;
+};
+
+G_DEFINE_FINAL_TYPE (GduEraseMultipleDisksDialog, gdu_erase_multiple_disks_dialog, ADW_TYPE_DIALOG)
+
+typedef struct EraseDisksJobData EraseDisksJobData;
+
+typedef struct {
+    EraseDisksJobData *data;
+    UDisksObject *object;
+    gchar *name;
+    guint64 size;
+    GCancellable *cancellable;
+
+    /* must hold data->lock when reading/writing these */
+    GduEraseMethod method;
+    guint64 num_bytes_erased;
+    GError *error;
+} EraseTarget;
+
+struct EraseDisksJobData {
+    GtkWindow *window;
+    UDisksClient *client;
+    GPtrArray *targets;
+
+    /* must hold lock when reading/writing these */
+    GMutex lock;
+    GCond cond;
+    GduEstimator *estimator;
+    guint num_done;
+    guint num_failed;
+
+    guint inhibit_cookie;
+};
+
+static gpointer
+gdu_erase_multiple_disks_dialog_get_window (GduEraseMultipleDisksDialog *self)
+{
+    return gtk_widget_get_ancestor (GTK_WIDGET (self), GTK_TYPE_WINDOW);
+}
+
+static void
+erase_target_free (gpointer user_data)
+{
+    EraseTarget *target = user_data;
+
+    g_clear_object (&target->object);
+    g_clear_error (&target->error);
+    g_free (target->name);
+    g_free (target);
+}
+
+static void
+erase_disks_job_data_free (gpointer user_data)
+{
+    EraseDisksJobData *data = user_data;
+
+    if (data->inhibit_cookie > 0)
+        gtk_application_uninhibit (GTK_APPLICATION ((gpointer) g_application_get_default ()), data->inhibit_cookie);
+
+    g_clear_object (&data->window);
+    g_clear_object (&data->client);
+    g_clear_object (&data->estimator);
+    g_clear_pointer (&data->targets, g_ptr_array_unref);
+    g_mutex_clear (&data->lock);
+    g_cond_clear (&data->cond);
+    g_free (data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+erase_target_progress_cb (guint64 num_bytes, gpointer user_data)
+{
+    EraseTarget *target = user_data;
+
+    g_mutex_lock (&target->data->lock);
+    target->num_bytes_erased += num_bytes;
+    g_mutex_unlock (&target->data->lock);
+}
+
+static gpointer
+erase_target_thread_func (gpointer user_data)
+{
+    EraseTarget *target = user_data;
+    EraseDisksJobData *data = target->data;
+    GduEraseMethod method;
+    GError *error = NULL;
+    gboolean ret;
+
+    g_mutex_lock (&data->lock);
+    method = target->method;
+    g_mutex_unlock (&data->lock);
+
+    ret = gdu_erase_object (data->client, target->object, &method, erase_target_progress_cb, target,
+                            target->cancellable, &error);
+
+    g_mutex_lock (&data->lock);
+    target->method = method;
+    target->error = error;
+    /* the whole disk counts as done, also if it failed, so the time remaining stays sensible */
+    target->num_bytes_erased = target->size;
+    data->num_done++;
+    if (!ret)
+        data->num_failed++;
+    g_cond_signal (&data->cond);
+    g_mutex_unlock (&data->lock);
+
+    return NULL;
+}
+
+static GduLocalJobResult
+erase_disks_job_run (GduLocalJob *job, GCancellable *cancellable, GError **error)
+{
+    EraseDisksJobData *data = gdu_local_job_get_user_data (job);
+    g_autoptr(GPtrArray) threads = NULL;
+    g_autoptr(GString) errors = NULL;
+    guint n;
+
+    threads = g_ptr_array_new ();
+    for (n = 0; n < data->targets->len; n++) {
+        EraseTarget *target = data->targets->pdata[n];
+
+        target->cancellable = cancellable;
+        g_ptr_array_add (threads, g_thread_new ("erase-disk", erase_target_thread_func, target));
+    }
+
+    g_mutex_lock (&data->lock);
+    while (data->num_done < data->targets->len) {
+        guint64 num_bytes_erased = 0;
+
+        g_cond_wait_until (&data->cond, &data->lock, g_get_monotonic_time () + UPDATE_USEC);
+
+        for (n = 0; n < data->targets->len; n++)
+            num_bytes_erased += ((EraseTarget *) data->targets->pdata[n])->num_bytes_erased;
+        gdu_estimator_add_sample (data->estimator, num_bytes_erased);
+
+        g_mutex_unlock (&data->lock);
+        gdu_local_job_queue_update (job);
+        g_mutex_lock (&data->lock);
+    }
+    g_mutex_unlock (&data->lock);
+
+    for (n = 0; n < threads->len; n++)
+        g_thread_join (threads->pdata[n]);
+
+    if (g_cancellable_is_cancelled (cancellable))
+        return GDU_LOCAL_JOB_RESULT_CANCELLED;
+
+    /* One disk failing doesn't stop the others, all failures are reported at once */
+    errors = g_string_new (NULL);
+    for (n = 0; n < data->targets->len; n++) {
+        EraseTarget *target = data->targets->pdata[n];
+
+        if (target->error == NULL)
+            continue;
+        if (errors->len > 0)
+            g_string_append (errors, "\n");
+        g_string_append_printf (errors, "%s: %s", target->name, target->error->message);
+    }
+
+    if (errors->len > 0) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED, errors->str);
+        return GDU_LOCAL_JOB_RESULT_ERROR;
+    }
+
+    return GDU_LOCAL_JOB_RESULT_SUCCESS;
+}
+
+static void
+erase_disks_job_update (GduLocalJob *job)
+{
+    EraseDisksJobData *data = gdu_local_job_get_user_data (job);
+    g_autofree gchar *extra_markup = NULL;
+    guint64 bytes_completed;
+    guint64 bytes_target;
+    guint64 bytes_per_sec;
+    guint64 usec_remaining;
+    guint num_done;
+    guint num_failed;
+    guint num_disks;
+
+    g_mutex_lock (&data->lock);
+    bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
+    usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
+    bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
+    bytes_target = gdu_estimator_get_target_bytes (data->estimator);
+    num_done = data->num_done;
+    num_failed = data->num_failed;
+    g_mutex_unlock (&data->lock);
+
+    num_disks = data->targets->len;
+    /* Translators: Shown while erasing several disks at once. The first %u is the number of disks that
+     *              are done, the second %u the number of disks that are erased.
+     */
+    extra_markup = g_strdup_printf (dngettext (GETTEXT_PACKAGE, "%u of %u disk erased", "%u of %u disks erased",
+                                               num_disks),
+                                    num_done - num_failed, num_disks);
+    if (num_failed > 0) {
+        g_autofree gchar *s = extra_markup;
+        g_autofree gchar *s2 = NULL;
+
+        /* Translators: Appended to the progress of erasing several disks. The %u is the number of disks
+         *              that could not be erased.
+         */
+        s2 = g_strdup_printf (dngettext (GETTEXT_PACKAGE, "%u failed", "%u failed", num_failed), num_failed);
+        extra_markup = g_strdup_printf ("%s — <span foreground=\"#ff0000\">%s</span>", s, s2);
+    }
+
+    gdu_local_job_set_bytes (job, bytes_target);
+    gdu_local_job_set_rate (job, bytes_per_sec);
+
+    if (bytes_target != 0)
+        gdu_local_job_set_progress (job, ((gdouble) bytes_completed) / ((gdouble) bytes_target));
+    else
+        gdu_local_job_set_progress (job, 0.0);
+
+    if (usec_remaining == 0)
+        gdu_local_job_set_expected_end_time (job, 0);
+    else
+        gdu_local_job_set_expected_end_time (job, usec_remaining + g_get_real_time ());
+
+    gdu_local_job_set_extra_markup (job, extra_markup);
+}
+
+static void
+on_erase_disks_job_completed (GduLocalJob *job, GduLocalJobResult result, GError *error)
+{
+    EraseDisksJobData *data = gdu_local_job_get_user_data (job);
+    g_autoptr(GNotification) notification = NULL;
+    g_autofree gchar *body = NULL;
+
+    if (data == NULL)
+        return;
+
+    if (result == GDU_LOCAL_JOB_RESULT_ERROR) {
+        if (error != NULL)
+            gdu_utils_show_error (data->window, _("Error erasing disks"), error);
+        return;
+    }
+
+    if (result != GDU_LOCAL_JOB_RESULT_SUCCESS)
+        return;
+
+    /* Translators: Body of the notification shown once several disks are erased. The %u is the number of
+     *              disks.
+     */
+    body = g_strdup_printf (dngettext (GETTEXT_PACKAGE, "%u disk was erased", "%u disks were erased",
+                                       data->targets->len),
+                            data->targets->len);
+    /* Translators: Title of the notification shown once several disks are erased */
+    notification = g_notification_new (_("Disks Erased"));
+    g_notification_set_body (notification, body);
+    g_application_send_notification (g_application_get_default (), "disks-erased", notification);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static GList *
+get_selected_objects (GduEraseMultipleDisksDialog *self)
+{
+    GList *objects = NULL;
+    guint n;
+
+    for (n = 0; n < self->rows->len; n++) {
+        GtkWidget *row = self->rows->pdata[n];
+
+        if (adw_switch_row_get_active (ADW_SWITCH_ROW (row)))
+            objects = g_list_append (objects, g_object_get_data (G_OBJECT (row), "gdu-object"));
+    }
+
+    return objects;
+}
+
+static void
+start_erasing (GduEraseMultipleDisksDialog *self, GList *objects)
+{
+    EraseDisksJobData *data;
+    g_autoptr(GduLocalJob) job = NULL;
+    GtkWindow *window;
+    guint64 num_bytes = 0;
+    gboolean cancelable = TRUE;
+
+    data = g_new0 (EraseDisksJobData, 1);
+    g_mutex_init (&data->lock);
+    g_cond_init (&data->cond);
+    data->client = g_object_ref (self->client);
+    data->targets = g_ptr_array_new_with_free_func (erase_target_free);
+
+    window = gdu_erase_multiple_disks_dialog_get_window (self);
+    if (window != NULL)
+        data->window = g_object_ref (window);
+
+    for (GList *l = objects; l != NULL; l = l->next) {
+        g_autoptr(UDisksObjectInfo) info = NULL;
+        EraseTarget *target;
+
+        info = udisks_client_get_object_info (self->client, l->data);
+
+        target = g_new0 (EraseTarget, 1);
+        target->data = data;
+        target->object = g_object_ref (l->data);
+        target->name = g_strdup (udisks_object_info_get_one_liner (info));
+        target->size = udisks_block_get_size (udisks_object_peek_block (target->object));
+        target->method = gdu_erase_get_method (self->client, target->object);
+        g_ptr_array_add (data->targets, target);
+
+        if (!gdu_erase_method_is_cancelable (target->method))
+            cancelable = FALSE;
+
+        num_bytes += target->size;
+    }
+
+    data->estimator = gdu_estimator_new (num_bytes);
+    data->inhibit_cookie = gtk_application_inhibit ((gpointer) g_application_get_default (), data->window,
+                                                    GTK_APPLICATION_INHIBIT_SUSPEND | GTK_APPLICATION_INHIBIT_LOGOUT,
+                                                    /* Translators: Reason why suspend/logout is being inhibited */
+                                                    _("Erasing disks"));
+
+    /* the job is shown with the first disk */
+    job = gdu_local_job_new (objects->data, "x-gdu-erase-multiple-disks", _("Erasing Disks"), erase_disks_job_run,
+                             erase_disks_job_update, on_erase_disks_job_completed, data, erase_disks_job_data_free);
+    if (job == NULL)
+        return;
+
+    gdu_local_job_set_progress_valid (job, TRUE);
+    gdu_local_job_set_cancelable (job, cancelable);
+
+    if (!gdu_job_manager_enqueue (gdu_application_get_job_manager (), g_steal_pointer (&job)))
+        g_warning ("Failed to enqueue erase disks job");
+}
+
+static void
+ensure_unused_cb (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    g_autoptr(GduEraseMultipleDisksDialog) self = GDU_ERASE_MULTIPLE_DISKS_DIALOG (user_data);
+    g_autoptr(GList) objects = NULL;
+
+    if (gdu_utils_ensure_unused_list_finish (self->client, res, NULL)) {
+        objects = get_selected_objects (self);
+        if (objects != NULL)
+            start_erasing (self, objects);
+    }
+
+    adw_dialog_close (ADW_DIALOG (self));
+}
+
+static void
+on_confirmation_response_cb (GObject *object, GAsyncResult *response, gpointer user_data)
+{
+    GduEraseMultipleDisksDialog *self = GDU_ERASE_MULTIPLE_DISKS_DIALOG (user_data);
+    AdwAlertDialog *dialog = ADW_ALERT_DIALOG (object);
+    g_autoptr(GList) objects = NULL;
+
+    if (g_strcmp0 (adw_alert_dialog_choose_finish (dialog, response), "cancel") == 0)
+        return;
+
+    /* ensure the disks are unused (e.g. unmounted) before erasing them... */
+    objects = get_selected_objects (self);
+    gdu_utils_ensure_unused_list (self->client, gdu_erase_multiple_disks_dialog_get_window (self), objects,
+                                  ensure_unused_cb, NULL, /* GCancellable */
+                                  g_object_ref (self));
+}
+
+static void
+on_erase_clicked_cb (GduEraseMultipleDisksDialog *self, GtkButton *button)
+{
+    g_autoptr(GList) objects = NULL;
+    g_autoptr(GString) str = NULL;
+    ConfirmationDialogData *data;
+    GtkWidget *affected_devices_widget;
+    gboolean ata_secure_erase = FALSE;
+
+    g_assert (GDU_IS_ERASE_MULTIPLE_DISKS_DIALOG (self));
+
+    objects = get_selected_objects (self);
+    if (objects == NULL)
+        return;
+
+    for (GList *l = objects; l != NULL; l = l->next) {
+        GduEraseMethod method = gdu_erase_get_method (self->client, l->data);
+
+        if (method == GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE || method == GDU_ERASE_METHOD_ATA_SECURE_ERASE)
+            ata_secure_erase = TRUE;
+    }
+
+    affected_devices_widget = gdu_util_create_widget_from_objects (self->client, objects);
+
+    /* Translators: warning used when erasing several disks */
+    str = g_string_new (_("All data on the disks will be erased and will not be recoverable by data recovery "
+                          "services"));
+    if (ata_secure_erase) {
+        g_string_append (str, "\n\n");
+        g_string_append (str, _("<b>WARNING</b>: The Secure Erase command may take a very long time to complete, "
+                                "can’t be cancelled and may not work properly with some hardware. In the worst "
+                                "case, your drive may be rendered unusable or your system may crash or lock up."));
+    }
+
+    data = g_new0 (ConfirmationDialogData, 1);
+    data->message = _("Erase Disks?");
+    data->description = str->str;
+    data->response_verb = _("_Erase");
+    data->response_appearance = ADW_RESPONSE_DESTRUCTIVE;
+    data->callback = on_confirmation_response_cb;
+    data->user_data = self;
+
+    gdu_utils_show_confirmation (gdu_erase_multiple_disks_dialog_get_window (self), data, affected_devices_widget);
+}
+
+static void
+on_row_active_changed_cb (GduEraseMultipleDisksDialog *self)
+{
+    g_autoptr(GList) objects = get_selected_objects (self);
+
+    gtk_widget_set_sensitive (self->erase_button, objects != NULL);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+compare_objects_by_sort_key (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    UDisksClient *client = user_data;
+    g_autoptr(UDisksObjectInfo) info_a = NULL;
+    g_autoptr(UDisksObjectInfo) info_b = NULL;
+
+    info_a = udisks_client_get_object_info (client, *(UDisksObject **) a);
+    info_b = udisks_client_get_object_info (client, *(UDisksObject **) b);
+
+    return g_strcmp0 (udisks_object_info_get_sort_key (info_a), udisks_object_info_get_sort_key (info_b));
+}
+
+/* The whole-disk block devices of all drives with media */
+static GPtrArray *
+get_disks (UDisksClient *client)
+{
+    GPtrArray *disks;
+    GList *objects;
+
+    disks = g_ptr_array_new_with_free_func (g_object_unref);
+    objects = g_dbus_object_manager_get_objects (udisks_client_get_object_manager (client));
+
+    for (GList *l = objects; l != NULL; l = l->next) {
+        UDisksDrive *drive = udisks_object_peek_drive (UDISKS_OBJECT (l->data));
+        UDisksBlock *block;
+
+        if (drive == NULL || !udisks_drive_get_media_available (drive))
+            continue;
+
+        block = udisks_client_get_block_for_drive (client, drive, FALSE);
+        if (block == NULL)
+            continue;
+
+        if (udisks_block_get_size (block) > 0 && !udisks_block_get_read_only (block))
+            g_ptr_array_add (disks, g_dbus_interface_dup_object (G_DBUS_INTERFACE (block)));
+        g_object_unref (block);
+    }
+    g_list_free_full (objects, g_object_unref);
+
+    g_ptr_array_sort_with_data (disks, compare_objects_by_sort_key, client);
+
+    return disks;
+}
+
+static void
+populate_disks (GduEraseMultipleDisksDialog *self)
+{
+    g_autoptr(GPtrArray) disks = NULL;
+    guint n;
+
+    disks = get_disks (self->client);
+    for (n = 0; n < disks->len; n++) {
+        UDisksObject *object = disks->pdata[n];
+        g_autoptr(UDisksObjectInfo) info = NULL;
+        g_autofree gchar *size = NULL;
+        g_autofree gchar *subtitle = NULL;
+        GtkWidget *row;
+
+        info = udisks_client_get_object_info (self->client, object);
+        size = udisks_client_get_size_for_display (self->client,
+                                                   udisks_block_get_size (udisks_object_peek_block (object)), FALSE,
+                                                   FALSE);
+        /* Translators: Subtitle of a disk that can be erased. The first %s is the name of the device
+         *              (ex. "/dev/sda"), the second %s its size (ex. "1.0 TB") and the third %s how the
+         *              disk will be erased (ex. "ATA Secure Erase").
+         */
+        subtitle = g_strdup_printf (_("%s — %s — %s"), udisks_object_info_get_name (info), size,
+                                    gdu_erase_method_get_name (gdu_erase_get_method (self->client, object)));
+
+        row = adw_switch_row_new ();
+        adw_preferences_row_set_title (ADW_PREFERENCES_ROW (row), udisks_object_info_get_description (info));
+        adw_action_row_set_subtitle (ADW_ACTION_ROW (row), subtitle);
+        g_object_set_data_full (G_OBJECT (row), "gdu-object", g_object_ref (object), g_object_unref);
+        g_signal_connect_object (row, "notify::active", G_CALLBACK (on_row_active_changed_cb), self,
+                                 G_CONNECT_SWAPPED);
+
+        adw_preferences_group_add (ADW_PREFERENCES_GROUP (self->disks_group), row);
+        g_ptr_array_add (self->rows, row);
+    }
+}
+
+static void
+gdu_erase_multiple_disks_dialog_finalize (GObject *object)
+{
+    GduEraseMultipleDisksDialog *self = GDU_ERASE_MULTIPLE_DISKS_DIALOG (object);
+
+    g_clear_pointer (&self->rows, g_ptr_array_unref);
+    g_clear_object (&self->client);
+
+    G_OBJECT_CLASS (gdu_erase_multiple_disks_dialog_parent_class)->finalize (object);
+}
+
+static void
+gdu_erase_multiple_disks_dialog_class_init (GduEraseMultipleDisksDialogClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+    object_class->finalize = gdu_erase_multiple_disks_dialog_finalize;
+
+    gtk_widget_class_set_template_from_resource (widget_class, "/org/gnome/DiskUtility/ui/"
+                                                               "gdu-erase-multiple-disks-dialog.ui");
+
+    gtk_widget_class_bind_template_child (widget_class, GduEraseMultipleDisksDialog, erase_button);
+    gtk_widget_class_bind_template_child (widget_class, GduEraseMultipleDisksDialog, disks_group);
+
+    gtk_widget_class_bind_template_callback (widget_class, on_erase_clicked_cb);
+}
+
+static void
+gdu_erase_multiple_disks_dialog_init (GduEraseMultipleDisksDialog *self)
+{
+    gtk_widget_init_template (GTK_WIDGET (self));
+
+    self->rows = g_ptr_array_new ();
+}
+
+void
+gdu_erase_multiple_disks_dialog_show (GtkWindow *parent, UDisksClient *client)
+{
+    GduEraseMultipleDisksDialog *self;
+
+    self = g_object_new (GDU_TYPE_ERASE_MULTIPLE_DISKS_DIALOG, NULL);
+    self->client = g_object_ref (client);
+
+    populate_disks (self);
+
+    adw_dialog_present (ADW_DIALOG (self), GTK_WIDGET (parent));
+}
@@ -0,0 +1,23 @@
+/* gdu-erase-multiple-disks-dialog.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <adwaita.h>
+#include <gtk/gtk.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+#define GDU_TYPE_ERASE_MULTIPLE_DISKS_DIALOG (gdu_erase_multiple_disks_dialog_get_type ())
+G_DECLARE_FINAL_TYPE (GduEraseMultipleDisksDialog, gdu_erase_multiple_disks_dialog, GDU, ERASE_MULTIPLE_DISKS_DIALOG,
+                      AdwDialog)
+
+void gdu_erase_multiple_disks_dialog_show (GtkWindow *parent, UDisksClient *client);
+
+G_END_DECLS
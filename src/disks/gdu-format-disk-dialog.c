@@ -18,6 +18,10 @@
 #include <glib/gi18n.h>
 
 #include "gdu-application.h"
+#include "gdu-job-manager.h"
+#include "gduerase.h"
+#include "gduestimator.h"
+#include "gdulocaljob.h"
 
 /* ---------------------------------------------------------------------------------------------------- */
 
@@ -90,28 +94,200 @@ format_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
     adw_dialog_close (ADW_DIALOG (self));
 }
 
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Overwriting existing data is done by a local job instead of the "erase" option of Format(), so zeroing
+ * can be offloaded to the device (see gdu_erase_zero_fill()) and the progress is shown. The partition
+ * table is created once the disk is zeroed.
+ */
+typedef struct {
+    GtkWindow *window;
+    UDisksObject *object;
+    gchar *partitioning_type;
+    GduLocalJob *job;
+
+    /* must hold lock when reading/writing these */
+    GMutex lock;
+    GduEstimator *estimator;
+    guint64 num_bytes_zeroed;
+    gint64 last_update_usec;
+    gboolean formatting;
+
+    guint inhibit_cookie;
+} ZeroFillJobData;
+
+static void
+zero_fill_job_data_free (gpointer user_data)
+{
+    ZeroFillJobData *data = user_data;
+
+    if (data->inhibit_cookie > 0)
+        gtk_application_uninhibit (GTK_APPLICATION ((gpointer) g_application_get_default ()), data->inhibit_cookie);
+
+    g_clear_object (&data->window);
+    g_clear_object (&data->object);
+    g_clear_object (&data->estimator);
+    g_free (data->partitioning_type);
+    g_mutex_clear (&data->lock);
+    g_free (data);
+}
+
+static void
+zero_fill_progress_cb (guint64 num_bytes, gpointer user_data)
+{
+    ZeroFillJobData *data = user_data;
+    gboolean update = FALSE;
+    gint64 now_usec;
+
+    /* Update GUI - but only every 200 ms */
+    g_mutex_lock (&data->lock);
+    data->num_bytes_zeroed += num_bytes;
+    now_usec = g_get_monotonic_time ();
+    if (now_usec - data->last_update_usec > 200 * G_USEC_PER_SEC / 1000) {
+        gdu_estimator_add_sample (data->estimator, data->num_bytes_zeroed);
+        data->last_update_usec = now_usec;
+        update = TRUE;
+    }
+    g_mutex_unlock (&data->lock);
+
+    if (update)
+        gdu_local_job_queue_update (data->job);
+}
+
+static GduLocalJobResult
+zero_fill_job_run (GduLocalJob *job, GCancellable *cancellable, GError **out_error)
+{
+    ZeroFillJobData *data = gdu_local_job_get_user_data (job);
+    g_autoptr(GError) error = NULL;
+
+    data->job = job;
+
+    if (gdu_erase_zero_fill (data->object, zero_fill_progress_cb, data, cancellable, &error)) {
+        g_mutex_lock (&data->lock);
+        data->formatting = TRUE;
+        g_mutex_unlock (&data->lock);
+        gdu_local_job_queue_update (job);
+
+        udisks_block_call_format_sync (udisks_object_peek_block (data->object), data->partitioning_type,
+                                       g_variant_new ("a{sv}", NULL), /* options */
+                                       cancellable, &error);
+    }
+
+    if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED) || g_cancellable_is_cancelled (cancellable))
+        return GDU_LOCAL_JOB_RESULT_CANCELLED;
+
+    if (error != NULL) {
+        g_propagate_error (out_error, g_steal_pointer (&error));
+        return GDU_LOCAL_JOB_RESULT_ERROR;
+    }
+
+    return GDU_LOCAL_JOB_RESULT_SUCCESS;
+}
+
+static void
+zero_fill_job_update (GduLocalJob *job)
+{
+    ZeroFillJobData *data = gdu_local_job_get_user_data (job);
+    guint64 bytes_completed;
+    guint64 bytes_target;
+    guint64 bytes_per_sec;
+    guint64 usec_remaining;
+    gboolean formatting;
+
+    g_mutex_lock (&data->lock);
+    bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
+    usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
+    bytes_completed = gdu_estimator_get_completed_bytes (data->estimator);
+    bytes_target = gdu_estimator_get_target_bytes (data->estimator);
+    formatting = data->formatting;
+    g_mutex_unlock (&data->lock);
+
+    if (formatting) {
+        gdu_local_job_set_description (job, _("Formatting Disk"));
+        gdu_local_job_set_progress_valid (job, FALSE);
+        gdu_local_job_set_expected_end_time (job, 0);
+        return;
+    }
+
+    gdu_local_job_set_bytes (job, bytes_target);
+    gdu_local_job_set_rate (job, bytes_per_sec);
+
+    if (bytes_target != 0)
+        gdu_local_job_set_progress (job, ((gdouble) bytes_completed) / ((gdouble) bytes_target));
+    else
+        gdu_local_job_set_progress (job, 0.0);
+
+    if (usec_remaining == 0)
+        gdu_local_job_set_expected_end_time (job, 0);
+    else
+        gdu_local_job_set_expected_end_time (job, usec_remaining + g_get_real_time ());
+}
+
+static void
+on_zero_fill_job_completed (GduLocalJob *job, GduLocalJobResult result, GError *error)
+{
+    ZeroFillJobData *data = gdu_local_job_get_user_data (job);
+
+    if (data == NULL)
+        return;
+
+    if (result == GDU_LOCAL_JOB_RESULT_ERROR && error != NULL)
+        gdu_utils_show_error (data->window, _("Error formatting disk"), error);
+}
+
+static void
+start_zero_fill (GduFormatDiskDialog *self)
+{
+    ZeroFillJobData *data;
+    g_autoptr(GduLocalJob) job = NULL;
+    GtkWindow *window;
+
+    data = g_new0 (ZeroFillJobData, 1);
+    g_mutex_init (&data->lock);
+    data->object = g_object_ref (self->udisks_object);
+    data->partitioning_type = g_strdup (gdu_format_disk_dialog_get_partitioning_type (self));
+    data->estimator = gdu_estimator_new (udisks_block_get_size (self->udisks_block));
+
+    window = gdu_format_disk_dialog_get_window (self);
+    if (window != NULL)
+        data->window = g_object_ref (window);
+
+    data->inhibit_cookie = gtk_application_inhibit ((gpointer) g_application_get_default (), data->window,
+                                                    GTK_APPLICATION_INHIBIT_SUSPEND | GTK_APPLICATION_INHIBIT_LOGOUT,
+                                                    /* Translators: Reason why suspend/logout is being inhibited */
+                                                    _("Erasing disk"));
+
+    job = gdu_local_job_new (self->udisks_object, "x-gdu-zero-fill", _("Erasing Disk"), zero_fill_job_run,
+                             zero_fill_job_update, on_zero_fill_job_completed, data, zero_fill_job_data_free);
+    if (job == NULL)
+        return;
+
+    gdu_local_job_set_progress_valid (job, TRUE);
+    gdu_local_job_set_cancelable (job, TRUE);
+
+    if (!gdu_job_manager_enqueue (gdu_application_get_job_manager (), g_steal_pointer (&job)))
+        g_warning ("Failed to enqueue zero fill job");
+}
+
 static void
 ensure_unused_cb (GtkWindow *parent_window, GAsyncResult *res, gpointer user_data)
 {
     GduFormatDiskDialog *self = user_data;
-    const gchar *erase_type;
-    GVariantBuilder options_builder;
 
     if (!gdu_utils_ensure_unused_finish (self->udisks_client, res, NULL)) {
         adw_dialog_close (ADW_DIALOG (self));
         return;
     }
 
-    /* gtk4 todo : Waiting for design update
-    erase_type = gtk_combo_box_get_active_id (self->erase_combobox);
-    */
-    erase_type = "";
+    if (gtk_switch_get_active (GTK_SWITCH (self->erase_switch))) {
+        start_zero_fill (self);
+        adw_dialog_close (ADW_DIALOG (self));
+        return;
+    }
 
-    g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
-    if (erase_type && *erase_type)
-        g_variant_builder_add (&options_builder, "{sv}", "erase", g_variant_new_string (erase_type));
     udisks_block_call_format (self->udisks_block, gdu_format_disk_dialog_get_partitioning_type (self),
-                              g_variant_builder_end (&options_builder), NULL, /* GCancellable */
+                              g_variant_new ("a{sv}", NULL), /* options */
+                              NULL,                          /* GCancellable */
                               format_cb, self);
 }
 
@@ -145,7 +321,7 @@ on_format_clicked_cb (GduFormatDiskDialog *self, GtkButton *button)
 
     affected_devices_widget = gdu_util_create_widget_from_objects (self->udisks_client, objects);
 
-    if (erase_data) {
+    if (!erase_data) {
         /* Translators: warning used for quick format */
         str = g_string_new (_("All data on the disk will be lost but may still be recoverable by "
                             "data recovery services"));
@@ -155,8 +331,9 @@ on_format_clicked_cb (GduFormatDiskDialog *self, GtkButton *button)
                               "keep your private information from falling into the wrong hands"));
     } else {
         /* Translators: warning used when overwriting data */
-        str = g_string_new (_("All data on the disk will be overwritten and will likely not be "
-                            "recoverable by data recovery services"));
+        str = g_string_new (_("All data on the disk will be overwritten with zeroes. Solid-state "
+                            "drives may keep copies of the data that can still be recovered by "
+                            "data recovery services"));
     }
 
     /* gtk4 todo
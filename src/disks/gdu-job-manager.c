@@ -249,6 +249,31 @@ gdu_job_manager_get_n_jobs (GduJobManager *self)
     return g_list_model_get_n_items (G_LIST_MODEL (self->jobs));
 }
 
+/* Returns the unfinished job with @operation on @object_path, or NULL. */
+GduLocalJob *
+gdu_job_manager_find_job (GduJobManager *self, const gchar *object_path, const gchar *operation)
+{
+    GQueue *queue;
+
+    g_return_val_if_fail (GDU_IS_JOB_MANAGER (self), NULL);
+    g_return_val_if_fail (object_path != NULL, NULL);
+    g_return_val_if_fail (operation != NULL, NULL);
+
+    queue = g_hash_table_lookup (self->jobs_by_object_path, object_path);
+    if (queue == NULL)
+        return NULL;
+
+    for (GList *l = queue->head; l != NULL; l = l->next) {
+        GduLocalJob *job = GDU_LOCAL_JOB (l->data);
+
+        if (gdu_local_job_get_state (job) != GDU_LOCAL_JOB_STATE_FINISHED &&
+            g_strcmp0 (gdu_local_job_get_operation (job), operation) == 0)
+            return job;
+    }
+
+    return NULL;
+}
+
 void
 gdu_job_manager_cancel_job (GduJobManager *self, GduLocalJob *job)
 {
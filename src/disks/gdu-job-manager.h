@@ -23,6 +23,7 @@ guint gdu_job_manager_get_n_jobs (GduJobManager *self);
 
 /* Takes ownership of @job, regardless of whether enqueueing succeeds. */
 gboolean gdu_job_manager_enqueue (GduJobManager *self, GduLocalJob *job);
+GduLocalJob *gdu_job_manager_find_job (GduJobManager *self, const gchar *object_path, const gchar *operation);
 void gdu_job_manager_cancel_job (GduJobManager *self, GduLocalJob *job);
 void gdu_job_manager_cancel_all (GduJobManager *self);
 
@@ -0,0 +1,184 @@
+/* gdu-latency-heatmap.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#define G_LOG_DOMAIN "gdu-latency-heatmap"
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gdu-latency-heatmap.h"
+
+#include <glib/gi18n.h>
+
+#include "gdusurfacescan.h"
+
+/* A bar as wide as the space allocation bar, showing the regions of a disk from the start to the end in
+ * the color of their slowest read. A healthy disk is green all over, while weak areas show up as yellow,
+ * orange or red spots. Regions with errors are black, regions not read yet aren't drawn.
+ */
+
+static const GdkRGBA severity_colors[] = {
+    [GDU_SURFACE_SCAN_SEVERITY_FAST] = { 0.18, 0.76, 0.49, 1.0 },    /* green-4 */
+    [GDU_SURFACE_SCAN_SEVERITY_SLOW] = { 0.96, 0.76, 0.07, 1.0 },    /* yellow-4 */
+    [GDU_SURFACE_SCAN_SEVERITY_SLOWER] = { 0.90, 0.38, 0.00, 1.0 },  /* orange-4 */
+    [GDU_SURFACE_SCAN_SEVERITY_SLOWEST] = { 0.75, 0.11, 0.16, 1.0 }, /* red-4 */
+    [GDU_SURFACE_SCAN_SEVERITY_ERROR] = { 0.14, 0.12, 0.19, 1.0 },   /* dark-4 */
+};
+
+struct _GduLatencyHeatmap {
+    GtkWidget parent_instance;
+
+    GArray *regions;
+};
+
+G_DEFINE_FINAL_TYPE (GduLatencyHeatmap, gdu_latency_heatmap, GTK_TYPE_WIDGET)
+
+/* The worst region drawn at column @x, so a single bad region is never hidden by its neighbours */
+static GduSurfaceScanSeverity
+get_column_severity (GduLatencyHeatmap *self, gint x, gint width)
+{
+    GduSurfaceScanSeverity severity = GDU_SURFACE_SCAN_SEVERITY_NONE;
+    guint first, last;
+    guint n;
+
+    first = (guint64) x * self->regions->len / width;
+    last = MAX (first + 1, (guint64) (x + 1) * self->regions->len / width);
+    for (n = first; n < last && n < self->regions->len; n++) {
+        GduSurfaceScanRegion *region = &g_array_index (self->regions, GduSurfaceScanRegion, n);
+
+        severity = MAX (severity, gdu_surface_scan_region_get_severity (region));
+    }
+
+    return severity;
+}
+
+static void
+gdu_latency_heatmap_snapshot (GtkWidget *widget, GtkSnapshot *snapshot)
+{
+    GduLatencyHeatmap *self = GDU_LATENCY_HEATMAP (widget);
+    gint width = gtk_widget_get_width (widget);
+    gint height = gtk_widget_get_height (widget);
+    GduSurfaceScanSeverity run_severity = GDU_SURFACE_SCAN_SEVERITY_NONE;
+    gint run_start = 0;
+    gint x;
+
+    if (self->regions == NULL || self->regions->len == 0 || width <= 0)
+        return;
+
+    /* columns of the same color are drawn as one rectangle */
+    for (x = 0; x <= width; x++) {
+        GduSurfaceScanSeverity severity = x < width ? get_column_severity (self, x, width)
+                                                    : GDU_SURFACE_SCAN_SEVERITY_NONE;
+
+        if (x > 0 && severity == run_severity)
+            continue;
+
+        if (run_severity != GDU_SURFACE_SCAN_SEVERITY_NONE)
+            gtk_snapshot_append_color (snapshot, &severity_colors[run_severity],
+                                       &GRAPHENE_RECT_INIT (run_start, 0, x - run_start, height));
+        run_severity = severity;
+        run_start = x;
+    }
+}
+
+static gboolean
+gdu_latency_heatmap_query_tooltip (GtkWidget *widget, gint x, gint y, gboolean keyboard_mode, GtkTooltip *tooltip)
+{
+    GduLatencyHeatmap *self = GDU_LATENCY_HEATMAP (widget);
+    GduSurfaceScanRegion *region;
+    g_autofree gchar *start = NULL;
+    g_autofree gchar *end = NULL;
+    g_autofree gchar *text = NULL;
+    gint width = gtk_widget_get_width (widget);
+    guint n;
+
+    if (self->regions == NULL || self->regions->len == 0 || width <= 0)
+        return FALSE;
+
+    n = CLAMP ((guint64) MAX (x, 0) * self->regions->len / width, 0, self->regions->len - 1);
+    region = &g_array_index (self->regions, GduSurfaceScanRegion, n);
+
+    start = g_format_size (region->offset);
+    end = g_format_size (region->offset + region->size);
+
+    if (region->num_requests == 0) {
+        /* Translators: Tooltip of a region of a disk that wasn't read yet. The first %s is where the region
+         *              starts (ex. "1.0 GB") and the second %s where it ends.
+         */
+        text = g_strdup_printf (_("%s – %s: Not read yet"), start, end);
+    } else {
+        /* Translators: Tooltip of a region of a disk. The first %s is where the region starts (ex. "1.0 GB"),
+         *              the second %s where it ends, the first %.1f the average time the disk spent on a read of
+         *              the region in milliseconds and the second %.1f the longest time.
+         */
+        text = g_strdup_printf (_("%s – %s: %.1f ms average, %.1f ms slowest"), start, end,
+                                region->total_latency_usec / 1000.0 / region->num_requests,
+                                region->max_latency_usec / 1000.0);
+    }
+
+    if (region->num_error_bytes > 0) {
+        g_autofree gchar *s = text;
+        g_autofree gchar *errors = g_format_size (region->num_error_bytes);
+
+        /* Translators: Appended to the tooltip of a region of a disk. The %s is the amount of data that
+         *              couldn't be read or written (ex. "4.1 kB").
+         */
+        text = g_strdup_printf (_("%s\n%s failed"), s, errors);
+    }
+
+    gtk_tooltip_set_text (tooltip, text);
+
+    return TRUE;
+}
+
+static void
+gdu_latency_heatmap_finalize (GObject *object)
+{
+    GduLatencyHeatmap *self = GDU_LATENCY_HEATMAP (object);
+
+    g_clear_pointer (&self->regions, g_array_unref);
+
+    G_OBJECT_CLASS (gdu_latency_heatmap_parent_class)->finalize (object);
+}
+
+static void
+gdu_latency_heatmap_class_init (GduLatencyHeatmapClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+    object_class->finalize = gdu_latency_heatmap_finalize;
+
+    widget_class->snapshot = gdu_latency_heatmap_snapshot;
+    widget_class->query_tooltip = gdu_latency_heatmap_query_tooltip;
+}
+
+static void
+gdu_latency_heatmap_init (GduLatencyHeatmap *self)
+{
+    gtk_widget_set_size_request (GTK_WIDGET (self), -1, 25);
+    gtk_widget_set_overflow (GTK_WIDGET (self), GTK_OVERFLOW_HIDDEN);
+    gtk_widget_set_has_tooltip (GTK_WIDGET (self), TRUE);
+    gtk_widget_add_css_class (GTK_WIDGET (self), "latency-heatmap");
+}
+
+/* @regions is an array of GduSurfaceScanRegion, or NULL */
+void
+gdu_latency_heatmap_set_regions (GduLatencyHeatmap *self, GArray *regions)
+{
+    g_return_if_fail (GDU_IS_LATENCY_HEATMAP (self));
+
+    if (self->regions == regions)
+        return;
+
+    g_clear_pointer (&self->regions, g_array_unref);
+    if (regions != NULL)
+        self->regions = g_array_ref (regions);
+
+    gtk_widget_queue_draw (GTK_WIDGET (self));
+}
@@ -0,0 +1,20 @@
+/* gdu-latency-heatmap.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <adwaita.h>
+#include <gtk/gtk.h>
+
+G_BEGIN_DECLS
+
+#define GDU_TYPE_LATENCY_HEATMAP (gdu_latency_heatmap_get_type ())
+G_DECLARE_FINAL_TYPE (GduLatencyHeatmap, gdu_latency_heatmap, GDU, LATENCY_HEATMAP, GtkWidget)
+
+void gdu_latency_heatmap_set_regions (GduLatencyHeatmap *self, GArray *regions);
+
+G_END_DECLS
@@ -0,0 +1,485 @@
+/* gdu-test-disk-dialog.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdu-test-disk-dialog.h"
+
+#include <errno.h>
+#include <gio/gunixfdlist.h>
+#include <glib/gi18n.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "gdu-application.h"
+#include "gdu-drive.h"
+#include "gdu-job-manager.h"
+#include "gduestimator.h"
+#include "gdulocaljob.h"
+#include "gdusurfacescan.h"
+
+/* The dialog just starts the test, which then runs as a job in the background, so several disks can be
+ * tested at the same time, each by a job of its own. A test that repeats runs until the job is cancelled.
+ *
+ * The read latency of every region is published on the GduDrive of the disk as the test goes, so the drive
+ * view can show where the disk is slow.
+ */
+
+#define TEST_DISK_OPERATION "x-gdu-test-disk"
+
+struct _GduTestDiskDialog {
+    AdwDialog parent_instance;
+
+    GtkWidget *start_button;
+    GtkWidget *write_switch;
+    GtkWidget *repeat_switch;
+
+    UDisksObject *object;
+    UDisksClient *client;
+};
+
+G_DEFINE_FINAL_TYPE (GduTestDiskDialog, gdu_test_disk_dialog, ADW_TYPE_DIALOG)
+
+typedef struct {
+    GtkWindow *window;
+    UDisksObject *object;
+    gchar *name;
+    GduSurfaceScanMode mode;
+    /* 0 to repeat until cancelled */
+    guint num_passes;
+
+    /* only set by the job thread before the first update */
+    GduSurfaceScan *scan;
+    guint logical_block_size;
+
+    /* only used by the update func, restarted with every read or write over the disk */
+    GduEstimator *estimator;
+    guint estimator_pass;
+    gint estimator_pattern;
+    gboolean estimator_verifying;
+
+    guint inhibit_cookie;
+} TestDiskJobData;
+
+static gpointer
+gdu_test_disk_dialog_get_window (GduTestDiskDialog *self)
+{
+    return gtk_widget_get_ancestor (GTK_WIDGET (self), GTK_TYPE_WINDOW);
+}
+
+static void
+test_disk_job_data_free (gpointer user_data)
+{
+    TestDiskJobData *data = user_data;
+
+    if (data->inhibit_cookie > 0)
+        gtk_application_uninhibit (GTK_APPLICATION ((gpointer) g_application_get_default ()), data->inhibit_cookie);
+
+    g_clear_pointer (&data->scan, gdu_surface_scan_free);
+    g_clear_object (&data->estimator);
+    g_clear_object (&data->window);
+    g_clear_object (&data->object);
+    g_free (data->name);
+    g_free (data);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+open_device (TestDiskJobData *data, guint64 *out_size, GCancellable *cancellable, GError **error)
+{
+    GVariantBuilder options_builder;
+    g_autoptr(GVariant) fd_index = NULL;
+    g_autoptr(GUnixFDList) fd_list = NULL;
+    gint fd;
+
+    /* opened with O_DIRECT, so the disk is tested and not the page cache */
+    g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&options_builder, "{sv}", "writable",
+                           g_variant_new_boolean (data->mode == GDU_SURFACE_SCAN_MODE_WRITE));
+    if (!udisks_block_call_open_for_benchmark_sync (udisks_object_peek_block (data->object),
+                                                    g_variant_builder_end (&options_builder), NULL, /* fd_list */
+                                                    &fd_index, &fd_list, cancellable, error))
+        return -1;
+
+    fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+    if (fd == -1)
+        return -1;
+
+    /* We can't use udisks_block_get_size() because the media may have changed and udisks may not have
+     * noticed
+     */
+    if (ioctl (fd, BLKGETSIZE64, out_size) != 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting size of device: %m");
+        close (fd);
+        return -1;
+    }
+
+    if (ioctl (fd, BLKSSZGET, &data->logical_block_size) != 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting block size of device: %m");
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static void
+scan_progress_cb (GduSurfaceScan *scan, gpointer user_data)
+{
+    GduLocalJob *job = GDU_LOCAL_JOB (user_data);
+
+    gdu_local_job_queue_update (job);
+}
+
+static GduLocalJobResult
+test_disk_job_run (GduLocalJob *job, GCancellable *cancellable, GError **error)
+{
+    TestDiskJobData *data = gdu_local_job_get_user_data (job);
+    g_autoptr(GError) local_error = NULL;
+    guint64 size = 0;
+    gboolean ret;
+    gint fd;
+
+    fd = open_device (data, &size, cancellable, &local_error);
+    if (fd == -1)
+        goto out;
+
+    if (size == 0) {
+        g_set_error_literal (&local_error, G_IO_ERROR, G_IO_ERROR_FAILED, _("The disk has no media"));
+        close (fd);
+        goto out;
+    }
+
+    data->scan = gdu_surface_scan_new (fd, size, data->logical_block_size, data->mode);
+    ret = gdu_surface_scan_run (data->scan, data->num_passes, scan_progress_cb, job, cancellable, &local_error);
+    close (fd);
+
+    if (ret)
+        return GDU_LOCAL_JOB_RESULT_SUCCESS;
+
+out:
+    if (g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return GDU_LOCAL_JOB_RESULT_CANCELLED;
+
+    g_propagate_error (error, g_steal_pointer (&local_error));
+    return GDU_LOCAL_JOB_RESULT_ERROR;
+}
+
+static void
+publish_latency_regions (TestDiskJobData *data)
+{
+    g_autoptr(GArray) regions = NULL;
+    GduDrive *drive;
+
+    drive = g_object_get_data (G_OBJECT (data->object), "gdu-drive");
+    if (drive == NULL)
+        return;
+
+    regions = gdu_surface_scan_get_regions (data->scan);
+    gdu_drive_set_latency_regions (drive, regions);
+}
+
+static gchar *
+format_num_bad_blocks (TestDiskJobData *data, guint64 num_error_bytes)
+{
+    guint64 num_bad_blocks = num_error_bytes / data->logical_block_size;
+
+    /* Translators: The number of logical blocks of a disk that failed the test */
+    return g_strdup_printf (dngettext (GETTEXT_PACKAGE, "%" G_GUINT64_FORMAT " bad block",
+                                       "%" G_GUINT64_FORMAT " bad blocks", num_bad_blocks),
+                            num_bad_blocks);
+}
+
+static void
+test_disk_job_update (GduLocalJob *job)
+{
+    TestDiskJobData *data = gdu_local_job_get_user_data (job);
+    GduSurfaceScanStatus status;
+    g_autofree gchar *bad_blocks = NULL;
+    g_autofree gchar *extra_markup = NULL;
+    guint64 bytes_per_sec;
+    guint64 usec_remaining;
+
+    if (data->scan == NULL)
+        return;
+
+    gdu_surface_scan_get_status (data->scan, &status);
+
+    /* the progress starts over with every read or write over the disk */
+    if (data->estimator == NULL || data->estimator_pass != status.pass || data->estimator_pattern != status.pattern ||
+        data->estimator_verifying != status.verifying) {
+        g_clear_object (&data->estimator);
+        data->estimator = gdu_estimator_new (status.num_bytes_total);
+        data->estimator_pass = status.pass;
+        data->estimator_pattern = status.pattern;
+        data->estimator_verifying = status.verifying;
+    }
+    gdu_estimator_add_sample (data->estimator, status.num_bytes_done);
+    bytes_per_sec = gdu_estimator_get_bytes_per_sec (data->estimator);
+    usec_remaining = gdu_estimator_get_usec_remaining (data->estimator);
+
+    bad_blocks = format_num_bad_blocks (data, status.num_error_bytes);
+    if (status.pattern < 0) {
+        /* Translators: Shown while testing a disk. The %u is the number of the pass and the %s the number of
+         *              bad blocks found so far (ex. "0 bad blocks").
+         */
+        extra_markup = g_strdup_printf (_("Pass %u: Reading — %s"), status.pass, bad_blocks);
+    } else if (status.verifying) {
+        /* Translators: Shown while testing a disk. The %u is the number of the pass, 0x%02x the pattern that
+         *              is read back (ex. "0xaa") and the %s the number of bad blocks found so far.
+         */
+        extra_markup = g_strdup_printf (_("Pass %u: Verifying pattern 0x%02x — %s"), status.pass, status.pattern,
+                                        bad_blocks);
+    } else {
+        /* Translators: Shown while testing a disk. The %u is the number of the pass, 0x%02x the pattern that
+         *              is written (ex. "0xaa") and the %s the number of bad blocks found so far.
+         */
+        extra_markup = g_strdup_printf (_("Pass %u: Testing with pattern 0x%02x — %s"), status.pass, status.pattern,
+                                        bad_blocks);
+    }
+
+    if (status.num_error_bytes > 0) {
+        g_autofree gchar *s = extra_markup;
+
+        extra_markup = g_strdup_printf ("<span foreground=\"#ff0000\">%s</span>", s);
+    }
+
+    gdu_local_job_set_bytes (job, status.num_bytes_total);
+    gdu_local_job_set_rate (job, bytes_per_sec);
+
+    if (status.num_bytes_total != 0)
+        gdu_local_job_set_progress (job, ((gdouble) status.num_bytes_done) / ((gdouble) status.num_bytes_total));
+    else
+        gdu_local_job_set_progress (job, 0.0);
+
+    if (usec_remaining == 0)
+        gdu_local_job_set_expected_end_time (job, 0);
+    else
+        gdu_local_job_set_expected_end_time (job, usec_remaining + g_get_real_time ());
+
+    gdu_local_job_set_extra_markup (job, extra_markup);
+
+    publish_latency_regions (data);
+}
+
+static void
+on_test_disk_job_completed (GduLocalJob *job, GduLocalJobResult result, GError *error)
+{
+    TestDiskJobData *data = gdu_local_job_get_user_data (job);
+    g_autoptr(GNotification) notification = NULL;
+    g_autofree gchar *body = NULL;
+    GduSurfaceScanStatus status;
+
+    if (data == NULL || data->scan == NULL) {
+        if (data != NULL && result == GDU_LOCAL_JOB_RESULT_ERROR && error != NULL)
+            gdu_utils_show_error (data->window, _("Error testing disk"), error);
+        return;
+    }
+
+    publish_latency_regions (data);
+
+    if (result == GDU_LOCAL_JOB_RESULT_ERROR) {
+        if (error != NULL)
+            gdu_utils_show_error (data->window, _("Error testing disk"), error);
+        return;
+    }
+
+    /* a test that repeats only ends by being cancelled, so report what was found so far */
+    gdu_surface_scan_get_status (data->scan, &status);
+    if (status.num_error_bytes == 0) {
+        /* Translators: Body of the notification shown once a disk test ends. The %s is the name of the
+         *              disk.
+         */
+        body = g_strdup_printf (_("No bad blocks were found on %s"), data->name);
+    } else {
+        g_autofree gchar *bad_blocks = format_num_bad_blocks (data, status.num_error_bytes);
+
+        /* Translators: Body of the notification shown once a disk test ends. The first %s is the number of
+         *              bad blocks found (ex. "3 bad blocks") and the second %s the name of the disk.
+         */
+        body = g_strdup_printf (_("%s were found on %s"), bad_blocks, data->name);
+    }
+
+    /* Translators: Title of the notification shown once a disk test ends */
+    notification = g_notification_new (_("Disk Test Finished"));
+    g_notification_set_body (notification, body);
+    g_application_send_notification (g_application_get_default (), "disk-tested", notification);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+start_test (GduTestDiskDialog *self)
+{
+    g_autoptr(UDisksObjectInfo) info = NULL;
+    g_autoptr(GduLocalJob) job = NULL;
+    TestDiskJobData *data;
+    GtkWindow *window;
+
+    info = udisks_client_get_object_info (self->client, self->object);
+
+    data = g_new0 (TestDiskJobData, 1);
+    data->object = g_object_ref (self->object);
+    data->name = g_strdup (udisks_object_info_get_one_liner (info));
+    data->mode = adw_switch_row_get_active (ADW_SWITCH_ROW (self->write_switch)) ? GDU_SURFACE_SCAN_MODE_WRITE
+                                                                                   : GDU_SURFACE_SCAN_MODE_READ;
+    data->num_passes = adw_switch_row_get_active (ADW_SWITCH_ROW (self->repeat_switch)) ? 0 : 1;
+    data->logical_block_size = 512;
+
+    window = gdu_test_disk_dialog_get_window (self);
+    if (window != NULL)
+        data->window = g_object_ref (window);
+
+    data->inhibit_cookie = gtk_application_inhibit ((gpointer) g_application_get_default (), data->window,
+                                                    GTK_APPLICATION_INHIBIT_SUSPEND | GTK_APPLICATION_INHIBIT_LOGOUT,
+                                                    /* Translators: Reason why suspend/logout is being inhibited */
+                                                    _("Testing disk"));
+
+    job = gdu_local_job_new (self->object, TEST_DISK_OPERATION, _("Testing Disk"), test_disk_job_run,
+                             test_disk_job_update, on_test_disk_job_completed, data, test_disk_job_data_free);
+    if (job == NULL)
+        return;
+
+    gdu_local_job_set_progress_valid (job, TRUE);
+    gdu_local_job_set_cancelable (job, TRUE);
+
+    if (!gdu_job_manager_enqueue (gdu_application_get_job_manager (), g_steal_pointer (&job)))
+        g_warning ("Failed to enqueue test disk job");
+}
+
+static void
+ensure_unused_cb (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+    g_autoptr(GduTestDiskDialog) self = GDU_TEST_DISK_DIALOG (user_data);
+
+    if (gdu_utils_ensure_unused_list_finish (self->client, res, NULL))
+        start_test (self);
+
+    adw_dialog_close (ADW_DIALOG (self));
+}
+
+static void
+on_confirmation_response_cb (GObject *object, GAsyncResult *response, gpointer user_data)
+{
+    GduTestDiskDialog *self = GDU_TEST_DISK_DIALOG (user_data);
+    AdwAlertDialog *dialog = ADW_ALERT_DIALOG (object);
+    g_autoptr(GList) objects = NULL;
+
+    if (g_strcmp0 (adw_alert_dialog_choose_finish (dialog, response), "cancel") == 0)
+        return;
+
+    /* ensure the disk is unused (e.g. unmounted) before writing to it... */
+    objects = g_list_append (NULL, self->object);
+    gdu_utils_ensure_unused_list (self->client, gdu_test_disk_dialog_get_window (self), objects, ensure_unused_cb,
+                                  NULL, /* GCancellable */
+                                  g_object_ref (self));
+}
+
+static void
+on_start_clicked_cb (GduTestDiskDialog *self, GtkButton *button)
+{
+    g_autoptr(GList) objects = NULL;
+    ConfirmationDialogData *data;
+    GduLocalJob *running_job;
+
+    g_assert (GDU_IS_TEST_DISK_DIALOG (self));
+
+    running_job = gdu_job_manager_find_job (gdu_application_get_job_manager (),
+                                            g_dbus_object_get_object_path (G_DBUS_OBJECT (self->object)),
+                                            TEST_DISK_OPERATION);
+    if (running_job != NULL) {
+        gdu_utils_show_message (_("The Disk Is Already Being Tested"),
+                                _("Cancel the running test of the disk to start a new one"),
+                                GTK_WIDGET (gdu_test_disk_dialog_get_window (self)));
+        return;
+    }
+
+    /* just reading the disk leaves it unchanged, so it can even be mounted */
+    if (!adw_switch_row_get_active (ADW_SWITCH_ROW (self->write_switch))) {
+        start_test (self);
+        adw_dialog_close (ADW_DIALOG (self));
+        return;
+    }
+
+    objects = g_list_append (NULL, self->object);
+
+    data = g_new0 (ConfirmationDialogData, 1);
+    data->message = _("Test Disk?");
+    /* Translators: warning used when testing a disk by writing test patterns to it */
+    data->description = _("All data on the disk will be overwritten by the test patterns and will not be "
+                          "recoverable");
+    data->response_verb = _("_Test");
+    data->response_appearance = ADW_RESPONSE_DESTRUCTIVE;
+    data->callback = on_confirmation_response_cb;
+    data->user_data = self;
+
+    gdu_utils_show_confirmation (gdu_test_disk_dialog_get_window (self), data,
+                                 gdu_util_create_widget_from_objects (self->client, objects));
+}
+
+static void
+on_write_switch_changed_cb (GduTestDiskDialog *self)
+{
+    gboolean write = adw_switch_row_get_active (ADW_SWITCH_ROW (self->write_switch));
+
+    gtk_widget_remove_css_class (self->start_button, write ? "suggested-action" : "destructive-action");
+    gtk_widget_add_css_class (self->start_button, write ? "destructive-action" : "suggested-action");
+}
+
+static void
+gdu_test_disk_dialog_finalize (GObject *object)
+{
+    GduTestDiskDialog *self = GDU_TEST_DISK_DIALOG (object);
+
+    g_clear_object (&self->object);
+    g_clear_object (&self->client);
+
+    G_OBJECT_CLASS (gdu_test_disk_dialog_parent_class)->finalize (object);
+}
+
+static void
+gdu_test_disk_dialog_class_init (GduTestDiskDialogClass *klass)
+{
+    GObjectClass *object_class = G_OBJECT_CLASS (klass);
+    GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
+
+    object_class->finalize = gdu_test_disk_dialog_finalize;
+
+    gtk_widget_class_set_template_from_resource (widget_class, "/org/gnome/DiskUtility/ui/"
+                                                               "gdu-test-disk-dialog.ui");
+
+    gtk_widget_class_bind_template_child (widget_class, GduTestDiskDialog, start_button);
+    gtk_widget_class_bind_template_child (widget_class, GduTestDiskDialog, write_switch);
+    gtk_widget_class_bind_template_child (widget_class, GduTestDiskDialog, repeat_switch);
+
+    gtk_widget_class_bind_template_callback (widget_class, on_start_clicked_cb);
+    gtk_widget_class_bind_template_callback (widget_class, on_write_switch_changed_cb);
+}
+
+static void
+gdu_test_disk_dialog_init (GduTestDiskDialog *self)
+{
+    gtk_widget_init_template (GTK_WIDGET (self));
+}
+
+void
+gdu_test_disk_dialog_show (GtkWindow *parent, UDisksObject *object, UDisksClient *client)
+{
+    GduTestDiskDialog *self;
+
+    self = g_object_new (GDU_TYPE_TEST_DISK_DIALOG, NULL);
+    self->object = g_object_ref (object);
+    self->client = g_object_ref (client);
+
+    /* a read-only disk can only be read */
+    if (udisks_block_get_read_only (udisks_object_peek_block (object)))
+        gtk_widget_set_sensitive (self->write_switch, FALSE);
+
+    adw_dialog_present (ADW_DIALOG (self), GTK_WIDGET (parent));
+}
@@ -0,0 +1,22 @@
+/* gdu-test-disk-dialog.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <adwaita.h>
+#include <gtk/gtk.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+#define GDU_TYPE_TEST_DISK_DIALOG (gdu_test_disk_dialog_get_type ())
+G_DECLARE_FINAL_TYPE (GduTestDiskDialog, gdu_test_disk_dialog, GDU, TEST_DISK_DIALOG, AdwDialog)
+
+void gdu_test_disk_dialog_show (GtkWindow *parent, UDisksObject *object, UDisksClient *client);
+
+G_END_DECLS
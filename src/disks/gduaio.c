@@ -0,0 +1,141 @@
+/* gduaio.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gduaio.h"
+
+#include <errno.h>
+#include <linux/aio_abi.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* Linux native asynchronous I/O, so one thread can keep many requests in flight. That is what
+ * makes a device reach its full speed, a single pread() at a time only ever has one request queued.
+ *
+ * Requests are only asynchronous for files opened with O_DIRECT, otherwise io_submit() blocks until
+ * the request is done. The system calls are used directly, so there is no dependency on libaio.
+ */
+
+struct GduAio {
+    aio_context_t context;
+    guint max_requests;
+    guint num_in_flight;
+    struct io_event *io_events;
+};
+
+GduAio *
+gdu_aio_new (guint max_requests, GError **error)
+{
+    GduAio *aio;
+
+    g_return_val_if_fail (max_requests > 0, NULL);
+
+    aio = g_new0 (GduAio, 1);
+    aio->max_requests = max_requests;
+    aio->io_events = g_new0 (struct io_event, max_requests);
+
+    if (syscall (__NR_io_setup, max_requests, &aio->context) != 0) {
+        gint errsv = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+        g_prefix_error (error, "Error setting up asynchronous I/O: ");
+        g_free (aio->io_events);
+        g_free (aio);
+        return NULL;
+    }
+
+    return aio;
+}
+
+void
+gdu_aio_free (GduAio *aio)
+{
+    if (aio == NULL)
+        return;
+
+    /* waits for the requests still in flight */
+    syscall (__NR_io_destroy, aio->context);
+    g_free (aio->io_events);
+    g_free (aio);
+}
+
+guint
+gdu_aio_get_num_in_flight (GduAio *aio)
+{
+    return aio->num_in_flight;
+}
+
+/* Queues reading or writing @size bytes at @offset of @fd. @buffer must stay valid until the event for
+ * @user_data was returned by gdu_aio_get_events().
+ */
+gboolean
+gdu_aio_submit (GduAio *aio, gint fd, gboolean write, gpointer buffer, gsize size, guint64 offset,
+                gpointer user_data, GError **error)
+{
+    struct iocb iocb;
+    struct iocb *iocbs[1] = { &iocb };
+
+    g_return_val_if_fail (aio->num_in_flight < aio->max_requests, FALSE);
+
+    memset (&iocb, 0, sizeof iocb);
+    iocb.aio_data = (guint64) (guintptr) user_data;
+    iocb.aio_lio_opcode = write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+    iocb.aio_fildes = fd;
+    iocb.aio_buf = (guint64) (guintptr) buffer;
+    iocb.aio_nbytes = size;
+    iocb.aio_offset = offset;
+
+    while (syscall (__NR_io_submit, aio->context, 1, iocbs) != 1) {
+        gint errsv = errno;
+
+        if (errsv == EINTR || errsv == EAGAIN)
+            continue;
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+        g_prefix_error (error, "Error submitting request at offset %" G_GUINT64_FORMAT ": ", offset);
+        return FALSE;
+    }
+
+    aio->num_in_flight++;
+
+    return TRUE;
+}
+
+/* Waits for at least @min_events requests to complete and returns up to @max_events of them in @events.
+ *
+ * Returns the number of events, or -1 if @error is set.
+ */
+gint
+gdu_aio_get_events (GduAio *aio, guint min_events, GduAioEvent *events, guint max_events, GError **error)
+{
+    glong num_events;
+    glong n;
+
+    max_events = MIN (max_events, aio->max_requests);
+    min_events = MIN (min_events, MIN (max_events, aio->num_in_flight));
+
+    do {
+        num_events = syscall (__NR_io_getevents, aio->context, min_events, max_events, aio->io_events, NULL);
+    } while (num_events < 0 && errno == EINTR);
+
+    if (num_events < 0) {
+        gint errsv = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+        g_prefix_error (error, "Error waiting for asynchronous I/O: ");
+        return -1;
+    }
+
+    for (n = 0; n < num_events; n++) {
+        events[n].user_data = (gpointer) (guintptr) aio->io_events[n].data;
+        events[n].result = aio->io_events[n].res;
+    }
+    aio->num_in_flight -= num_events;
+
+    return num_events;
+}
@@ -0,0 +1,33 @@
+/* gduaio.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+    /* as passed to gdu_aio_submit() */
+    gpointer user_data;
+    /* the number of bytes transferred, or a negative errno value */
+    gint64 result;
+} GduAioEvent;
+
+GduAio *gdu_aio_new (guint max_requests, GError **error);
+void gdu_aio_free (GduAio *aio);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GduAio, gdu_aio_free)
+
+guint gdu_aio_get_num_in_flight (GduAio *aio);
+
+gboolean gdu_aio_submit (GduAio *aio, gint fd, gboolean write, gpointer buffer, gsize size, guint64 offset,
+                         gpointer user_data, GError **error);
+gint gdu_aio_get_events (GduAio *aio, guint min_events, GduAioEvent *events, guint max_events, GError **error);
+
+G_END_DECLS
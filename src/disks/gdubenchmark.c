@@ -0,0 +1,1088 @@
+/* gdubenchmark.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#define _GNU_SOURCE
+
+#include "gdubenchmark.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib/gi18n.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+#include "gduaio.h"
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Transfer rate and access time
+ *
+ * The classic benchmark: @num_samples reads (and writes of the same data) of @sample_size bytes spread
+ * evenly over the disk, and reads of a page at seeded random offsets. These keep a single request in
+ * flight at a time.
+ */
+
+static gboolean
+benchmark_transfer_rate (gint fd, guint64 disk_size, const GduBenchmarkOptions *options,
+                         const GduBenchmarkFuncs *funcs, gpointer user_data, guchar *buffer, glong page_size,
+                         GCancellable *cancellable, GError **error)
+{
+    guint n;
+
+    for (n = 0; n < options->num_samples; n++) {
+        g_autofree char *s = NULL;
+        g_autofree char *s2 = NULL;
+        gint64 begin_usec;
+        gint64 end_usec;
+        gint64 offset;
+        gssize num_read;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+        /* figure out offset and align to page-size */
+        offset = n * disk_size / options->num_samples;
+        offset &= ~(page_size - 1);
+
+        if (lseek (fd, offset, SEEK_SET) != offset) {
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %lld",
+                         (long long int) offset);
+            return FALSE;
+        }
+
+        if (read (fd, buffer, page_size) != page_size) {
+            s = g_format_size_full (page_size, G_FORMAT_SIZE_LONG_FORMAT);
+            s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error pre-reading %s from offset %s", s,
+                         s2);
+            return FALSE;
+        }
+
+        if (lseek (fd, offset, SEEK_SET) != offset) {
+            s = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %s", s);
+            return FALSE;
+        }
+
+        begin_usec = g_get_monotonic_time ();
+        num_read = read (fd, buffer, options->sample_size);
+        if (G_UNLIKELY (num_read < 0)) {
+            s = g_format_size_full (options->sample_size, G_FORMAT_SIZE_LONG_FORMAT);
+            s2 = g_format_size_full (offset, G_FORMAT_SIZE_LONG_FORMAT);
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error reading %s from offset %s", s, s2);
+            return FALSE;
+        }
+        end_usec = g_get_monotonic_time ();
+
+        if (funcs->sample != NULL)
+            funcs->sample (GDU_BENCHMARK_SAMPLE_READ, offset,
+                           ((gdouble) G_USEC_PER_SEC) * num_read / (end_usec - begin_usec), user_data);
+
+        if (options->write) {
+            gssize num_written;
+
+            /* and now write the same block again... */
+            if (lseek (fd, offset, SEEK_SET) != offset) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %lld",
+                             (long long int) offset);
+                return FALSE;
+            }
+            if (read (fd, buffer, page_size) != page_size) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                             "Error pre-reading %lld bytes from offset %lld", (long long int) page_size,
+                             (long long int) offset);
+                return FALSE;
+            }
+            if (lseek (fd, offset, SEEK_SET) != offset) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error seeking to offset %lld",
+                             (long long int) offset);
+                return FALSE;
+            }
+
+            begin_usec = g_get_monotonic_time ();
+            num_written = write (fd, buffer, num_read);
+            if (G_UNLIKELY (num_written < 0)) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                             "Error writing %lld bytes at offset %lld: %m", (long long int) num_read,
+                             (long long int) offset);
+                return FALSE;
+            }
+
+            if (num_written != num_read) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                             "Expected to write %lld bytes, only wrote %lld: %m", (long long int) num_read,
+                             (long long int) num_written);
+                return FALSE;
+            }
+
+            if (fsync (fd) != 0) {
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error syncing (at offset %lld): %m",
+                             (long long int) offset);
+                return FALSE;
+            }
+            end_usec = g_get_monotonic_time ();
+
+            if (funcs->sample != NULL)
+                funcs->sample (GDU_BENCHMARK_SAMPLE_WRITE, offset,
+                               ((gdouble) G_USEC_PER_SEC) * num_written / (end_usec - begin_usec), user_data);
+        }
+    }
+
+    return TRUE;
+}
+
+static gboolean
+benchmark_access_time (gint fd, guint64 disk_size, const GduBenchmarkOptions *options,
+                       const GduBenchmarkFuncs *funcs, gpointer user_data, guchar *buffer, glong page_size,
+                       GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GRand) rand = NULL;
+    gint64 prev_offset = 0;
+    guint n;
+
+    rand = g_rand_new_with_seed (42); /* want this to be deterministic (per size) so it's repeatable */
+
+    for (n = 0; n < options->num_access_samples; n++) {
+        gint64 begin_usec;
+        gint64 end_usec;
+        gint64 offset;
+        gssize num_read;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+        offset = (guint64) g_rand_double_range (rand, 0, (gdouble) disk_size);
+        offset &= ~(page_size - 1);
+
+        if (lseek (fd, offset, SEEK_SET) != offset) {
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                         C_("benchmarking", "Error seeking to offset %lld: %m"), (long long int) offset);
+            return FALSE;
+        }
+
+        begin_usec = g_get_monotonic_time ();
+        num_read = read (fd, buffer, page_size);
+        if (G_UNLIKELY (num_read < 0)) {
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                         C_("benchmarking", "Error reading %lld bytes from offset %lld"), (long long int) page_size,
+                         (long long int) offset);
+            return FALSE;
+        }
+        end_usec = g_get_monotonic_time ();
+
+        /* the first read only moves the head, the others are plotted against the distance moved */
+        if (n != 0 && funcs->sample != NULL)
+            funcs->sample (GDU_BENCHMARK_SAMPLE_ACCESS_TIME, ABS (offset - prev_offset),
+                           (end_usec - begin_usec) / ((gdouble) G_USEC_PER_SEC), user_data);
+        prev_offset = offset;
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Jobs
+ *
+ * A job is a thread with an AIO context of its own (see gduaio.c) that keeps a number of requests in
+ * flight, like a job of fio(1). Random offsets come from a seeded generator, so every run of a job reads
+ * or writes the same blocks and runs can be compared.
+ *
+ * Writes must not change the data on the disk, so a job writing at random offsets first reads a batch
+ * of blocks and then writes them back as they were. Only the writes are timed.
+ */
+
+#define JOB_RANDOM_BLOCK_SIZE (4 * 1024)
+#define JOB_SEQUENTIAL_BLOCK_SIZE (128 * 1024)
+#define JOB_MAX_QUEUE_DEPTH GDU_BENCHMARK_SWEEP_MAX_QUEUE_DEPTH
+#define JOB_MAX_JOBS 4
+#define JOB_WRITE_BATCH_SIZE 1024
+
+typedef struct {
+    gint fd;
+    guint index;
+    gboolean random;
+    gboolean write;
+    gsize block_size;
+    guint queue_depth;
+    gint64 duration_usec;
+    /* the part of the disk used by the job */
+    guint64 region_start;
+    guint64 region_size;
+    GCancellable *cancellable;
+
+    GRand *rand;
+    guint64 position;
+
+    guint64 num_requests;
+    gint64 elapsed_usec;
+    /* of the counted requests, or NULL */
+    GduBenchmarkHistogram *latency;
+    GError *error;
+} Job;
+
+static guint64
+job_get_next_offset (Job *job)
+{
+    guint64 offset;
+
+    if (job->random) {
+        offset = (guint64) g_rand_double_range (job->rand, 0, (gdouble) (job->region_size - job->block_size));
+        offset &= ~((guint64) job->block_size - 1);
+    } else {
+        if (job->position + job->block_size > job->region_size)
+            job->position = 0;
+        offset = job->position;
+        job->position += job->block_size;
+    }
+
+    return job->region_start + offset;
+}
+
+/* Blocks of a batch have a buffer of their own, otherwise every slot of the queue has one */
+static gboolean
+job_submit (Job *job, GduAio *aio, guchar *memory, const guint64 *offsets, guint block, gboolean write, guint slot)
+{
+    guint64 offset;
+    guchar *buffer;
+
+    offset = offsets != NULL ? offsets[block] : job_get_next_offset (job);
+    buffer = memory + (offsets != NULL ? block : slot) * job->block_size;
+
+    return gdu_aio_submit (aio, job->fd, write, buffer, job->block_size, offset, GUINT_TO_POINTER (slot),
+                           &job->error);
+}
+
+/* Keeps queue_depth requests in flight until @end_usec, or until the @num_blocks requests at @offsets
+ * are done. Only requests in the direction of the job are counted.
+ */
+static gboolean
+job_run_requests (Job *job, GduAio *aio, guchar *memory, const guint64 *offsets, guint num_blocks, gboolean write,
+                  gint64 end_usec)
+{
+    GduAioEvent events[JOB_MAX_QUEUE_DEPTH];
+    gint64 submit_usec[JOB_MAX_QUEUE_DEPTH];
+    gboolean counted = write == job->write;
+    guint next_block = 0;
+    guint slot;
+
+    for (slot = 0; slot < job->queue_depth && (offsets == NULL || next_block < num_blocks); slot++) {
+        submit_usec[slot] = g_get_monotonic_time ();
+        if (!job_submit (job, aio, memory, offsets, next_block++, write, slot))
+            break;
+    }
+
+    while (gdu_aio_get_num_in_flight (aio) > 0) {
+        gint num_events;
+        gint64 now_usec;
+        guint n;
+
+        num_events = gdu_aio_get_events (aio, 1, events, G_N_ELEMENTS (events), job->error == NULL ? &job->error
+                                                                                                    : NULL);
+        if (num_events < 0)
+            break;
+
+        now_usec = g_get_monotonic_time ();
+        for (n = 0; n < (guint) num_events; n++) {
+            slot = GPOINTER_TO_UINT (events[n].user_data);
+
+            if (events[n].result != (gint64) job->block_size) {
+                if (job->error == NULL) {
+                    g_set_error (&job->error, G_IO_ERROR, G_IO_ERROR_FAILED, "Error %s %" G_GSIZE_FORMAT " bytes",
+                                 write ? "writing" : "reading", job->block_size);
+                    if (events[n].result < 0)
+                        g_prefix_error (&job->error, "%s: ", g_strerror (-events[n].result));
+                }
+            } else if (counted) {
+                job->num_requests++;
+                if (job->latency != NULL)
+                    gdu_benchmark_histogram_add (job->latency, now_usec - submit_usec[slot]);
+            }
+
+            if (job->error != NULL || now_usec >= end_usec || (offsets != NULL && next_block >= num_blocks) ||
+                g_cancellable_set_error_if_cancelled (job->cancellable, &job->error))
+                continue;
+
+            submit_usec[slot] = now_usec;
+            job_submit (job, aio, memory, offsets, next_block++, write, slot);
+        }
+    }
+
+    return job->error == NULL;
+}
+
+static gpointer
+job_thread_func (gpointer user_data)
+{
+    Job *job = user_data;
+    g_autoptr(GduAio) aio = NULL;
+    g_autofree guchar *memory_unaligned = NULL;
+    g_autofree guint64 *offsets = NULL;
+    guint num_buffers;
+    glong page_size;
+    guchar *memory;
+    gint64 begin_usec;
+    gint64 end_usec;
+    guint n;
+
+    aio = gdu_aio_new (job->queue_depth, &job->error);
+    if (aio == NULL)
+        return NULL;
+
+    /* page-aligned buffers, for O_DIRECT */
+    num_buffers = job->write ? JOB_WRITE_BATCH_SIZE : job->queue_depth;
+    page_size = sysconf (_SC_PAGESIZE);
+    memory_unaligned = g_new0 (guchar, num_buffers * job->block_size + page_size);
+    memory = (guchar *) (((gintptr) (memory_unaligned + page_size)) & (~(page_size - 1)));
+
+    /* the same seed for every run */
+    job->rand = g_rand_new_with_seed (42 + job->index);
+    job->position = 0;
+
+    begin_usec = g_get_monotonic_time ();
+    end_usec = begin_usec + job->duration_usec;
+
+    if (!job->write) {
+        job_run_requests (job, aio, memory, NULL, 0, FALSE, end_usec);
+        job->elapsed_usec = g_get_monotonic_time () - begin_usec;
+    } else {
+        offsets = g_new (guint64, JOB_WRITE_BATCH_SIZE);
+        while (g_get_monotonic_time () < end_usec) {
+            for (n = 0; n < JOB_WRITE_BATCH_SIZE; n++)
+                offsets[n] = job_get_next_offset (job);
+
+            if (!job_run_requests (job, aio, memory, offsets, JOB_WRITE_BATCH_SIZE, FALSE, G_MAXINT64))
+                break;
+
+            /* the writes aren't done before they are on the disk */
+            begin_usec = g_get_monotonic_time ();
+            if (!job_run_requests (job, aio, memory, offsets, JOB_WRITE_BATCH_SIZE, TRUE, end_usec))
+                break;
+            if (fdatasync (job->fd) != 0) {
+                g_set_error (&job->error, G_IO_ERROR, g_io_error_from_errno (errno), "Error syncing: %s",
+                             g_strerror (errno));
+                break;
+            }
+            job->elapsed_usec += g_get_monotonic_time () - begin_usec;
+        }
+    }
+
+    g_clear_pointer (&job->rand, g_rand_free);
+
+    return NULL;
+}
+
+/* Runs @num_jobs jobs at once and returns the number of requests per second of all of them. The
+ * latencies of all requests are added to @latency, if not NULL.
+ */
+static gdouble
+run_jobs (gint fd, guint64 disk_size, gboolean random, gboolean write, guint num_jobs, guint queue_depth,
+          gint64 duration_usec, GduBenchmarkHistogram *latency, GCancellable *cancellable, GError **error)
+{
+    Job jobs[JOB_MAX_JOBS] = { 0 };
+    GThread *threads[JOB_MAX_JOBS];
+    gdouble requests_per_sec = 0.0;
+    gsize block_size;
+    guint n;
+
+    g_assert (num_jobs <= JOB_MAX_JOBS);
+    g_assert (queue_depth <= JOB_MAX_QUEUE_DEPTH);
+
+    block_size = random ? JOB_RANDOM_BLOCK_SIZE : JOB_SEQUENTIAL_BLOCK_SIZE;
+    for (n = 0; n < num_jobs; n++) {
+        Job *job = &jobs[n];
+
+        job->fd = fd;
+        job->index = n;
+        job->random = random;
+        job->write = write;
+        job->block_size = block_size;
+        job->queue_depth = queue_depth;
+        job->duration_usec = duration_usec;
+        job->cancellable = cancellable;
+        if (latency != NULL)
+            job->latency = g_new0 (GduBenchmarkHistogram, 1);
+        if (random) {
+            job->region_start = 0;
+            job->region_size = disk_size;
+        } else {
+            /* every job reads its own part of the disk sequentially */
+            job->region_start = (n * (disk_size / num_jobs)) & ~((guint64) block_size - 1);
+            job->region_size = disk_size / num_jobs;
+        }
+        threads[n] = g_thread_new ("benchmark-job", job_thread_func, job);
+    }
+
+    for (n = 0; n < num_jobs; n++)
+        g_thread_join (threads[n]);
+
+    for (n = 0; n < num_jobs; n++) {
+        if (latency != NULL)
+            gdu_benchmark_histogram_merge (latency, jobs[n].latency);
+        g_free (jobs[n].latency);
+
+        if (jobs[n].error != NULL) {
+            if (error != NULL && *error == NULL)
+                g_propagate_error (error, g_steal_pointer (&jobs[n].error));
+            else
+                g_clear_error (&jobs[n].error);
+            continue;
+        }
+        if (jobs[n].elapsed_usec > 0)
+            requests_per_sec += ((gdouble) G_USEC_PER_SEC) * jobs[n].num_requests / jobs[n].elapsed_usec;
+    }
+
+    return requests_per_sec;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Queue depth sweep
+ *
+ * Reading one block at a time, like the transfer rate and access time benchmarks do, only ever keeps one
+ * request queued. That is all a rotating disk can make use of, but a NVMe drive needs many requests in
+ * flight, often from several CPUs, to reach its rated speed. So the same reads are repeated at several
+ * queue depths and by one and by several jobs.
+ */
+
+#define SWEEP_POINT_USEC (1 * G_USEC_PER_SEC)
+
+static const guint sweep_queue_depths[] = { 1, 4, 16, 32, GDU_BENCHMARK_SWEEP_MAX_QUEUE_DEPTH };
+static const guint sweep_num_jobs[] = { 1, JOB_MAX_JOBS };
+
+/* Measures 4 KiB random reads and 128 KiB sequential reads of @fd, which must be opened with O_DIRECT,
+ * for every number of jobs and queue depth of the sweep. @func is called with every point.
+ */
+gboolean
+gdu_benchmark_queue_depth_sweep (gint fd, guint64 disk_size, GduBenchmarkSweepFunc func, gpointer user_data,
+                                 GCancellable *cancellable, GError **error)
+{
+    guint n, m;
+
+    g_return_val_if_fail (fd != -1, FALSE);
+
+    if (disk_size < JOB_SEQUENTIAL_BLOCK_SIZE * JOB_MAX_JOBS * 4) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "The disk is too small");
+        return FALSE;
+    }
+
+    for (n = 0; n < G_N_ELEMENTS (sweep_num_jobs); n++) {
+        for (m = 0; m < G_N_ELEMENTS (sweep_queue_depths); m++) {
+            GduBenchmarkSweepPoint point = { 0 };
+            GError *local_error = NULL;
+
+            point.num_jobs = sweep_num_jobs[n];
+            point.queue_depth = sweep_queue_depths[m];
+
+            point.iops = run_jobs (fd, disk_size, TRUE, FALSE, point.num_jobs, point.queue_depth, SWEEP_POINT_USEC,
+                                   NULL, cancellable, &local_error);
+            if (local_error == NULL)
+                point.bytes_per_sec = JOB_SEQUENTIAL_BLOCK_SIZE * run_jobs (fd, disk_size, FALSE, FALSE,
+                                                                            point.num_jobs, point.queue_depth,
+                                                                            SWEEP_POINT_USEC, NULL, cancellable,
+                                                                            &local_error);
+            if (local_error != NULL) {
+                g_propagate_error (error, local_error);
+                return FALSE;
+            }
+
+            if (func != NULL)
+                func (&point, user_data);
+        }
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Latency histogram
+ *
+ * Like HdrHistogram, values are counted in buckets that get wider with the value, so the histogram has
+ * a fixed size and the same relative precision for a 20 µs read from flash and a 2 s read from a
+ * failing disk.
+ */
+
+#define HISTOGRAM_LINEAR_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << (HISTOGRAM_LINEAR_BITS - 1))
+
+static guint
+histogram_get_bucket (gint64 usec)
+{
+    guint64 value = CLAMP (usec, 0, G_MAXUINT32);
+    guint shift;
+
+    if (value < (1 << HISTOGRAM_LINEAR_BITS))
+        return value;
+
+    /* the HISTOGRAM_LINEAR_BITS highest bits of the value */
+    shift = g_bit_storage (value) - HISTOGRAM_LINEAR_BITS;
+    return shift * HISTOGRAM_SUB_BUCKETS + (value >> shift);
+}
+
+/* The value in the middle of @bucket */
+static gint64
+histogram_get_bucket_value (guint bucket)
+{
+    guint shift;
+
+    if (bucket < (1 << HISTOGRAM_LINEAR_BITS))
+        return bucket;
+
+    shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+    return ((gint64) (bucket - shift * HISTOGRAM_SUB_BUCKETS) << shift) + ((1 << shift) >> 1);
+}
+
+void
+gdu_benchmark_histogram_add (GduBenchmarkHistogram *histogram, gint64 usec)
+{
+    g_return_if_fail (histogram != NULL);
+
+    histogram->counts[histogram_get_bucket (usec)]++;
+    histogram->total_count++;
+    histogram->max_usec = MAX (histogram->max_usec, usec);
+}
+
+void
+gdu_benchmark_histogram_merge (GduBenchmarkHistogram *histogram, const GduBenchmarkHistogram *other)
+{
+    guint n;
+
+    g_return_if_fail (histogram != NULL && other != NULL);
+
+    for (n = 0; n < GDU_BENCHMARK_HISTOGRAM_NUM_BUCKETS; n++)
+        histogram->counts[n] += other->counts[n];
+    histogram->total_count += other->total_count;
+    histogram->max_usec = MAX (histogram->max_usec, other->max_usec);
+}
+
+/* The latency @percentile percent of the values are at or below (ex. 99.9), or -1 if there are none */
+gint64
+gdu_benchmark_histogram_get_percentile (const GduBenchmarkHistogram *histogram, gdouble percentile)
+{
+    guint64 target;
+    guint64 count = 0;
+    guint n;
+
+    g_return_val_if_fail (histogram != NULL, -1);
+
+    if (histogram->total_count == 0)
+        return -1;
+
+    target = MAX (1, (guint64) ceil (histogram->total_count * CLAMP (percentile, 0.0, 100.0) / 100.0));
+    for (n = 0; n < GDU_BENCHMARK_HISTOGRAM_NUM_BUCKETS; n++) {
+        count += histogram->counts[n];
+        if (count >= target)
+            return MIN (histogram_get_bucket_value (n), histogram->max_usec);
+    }
+
+    return histogram->max_usec;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Random I/O
+ *
+ * 4 KiB requests at random offsets all over the disk, as a database does. At a queue depth of 32 the
+ * latencies include the time requests wait in the queue, which is what the slowest queries see.
+ */
+
+#define RANDOM_IO_USEC (5 * G_USEC_PER_SEC)
+#define RANDOM_IO_QUEUE_DEPTH 32
+
+/* Reads or writes 4 KiB blocks at random offsets of @fd, which must be opened with O_DIRECT. Writes
+ * put back what was read, but the device must not be in use.
+ */
+gboolean
+gdu_benchmark_random_io (gint fd, guint64 disk_size, gboolean write, GduBenchmarkRandomResult *result,
+                         GCancellable *cancellable, GError **error)
+{
+    GError *local_error = NULL;
+
+    g_return_val_if_fail (fd != -1, FALSE);
+    g_return_val_if_fail (result != NULL, FALSE);
+
+    memset (result, 0, sizeof (GduBenchmarkRandomResult));
+
+    if (disk_size < JOB_RANDOM_BLOCK_SIZE * JOB_WRITE_BATCH_SIZE) {
+        g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "The disk is too small");
+        return FALSE;
+    }
+
+    result->iops = run_jobs (fd, disk_size, TRUE, write, 1, RANDOM_IO_QUEUE_DEPTH, RANDOM_IO_USEC, &result->latency,
+                             cancellable, &local_error);
+    if (local_error != NULL) {
+        g_propagate_error (error, local_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Scratch file
+ *
+ * Writing to the device of a mounted filesystem would destroy it, but writing to a file on it does not.
+ * The file is preallocated and then filled, because reading preallocated space that was never written
+ * returns zeroes without reading the disk and the first write to it is slower than later ones. What is
+ * measured then is the filesystem and the device together, as applications see them.
+ */
+
+#define SCRATCH_FILE_MAX_SIZE (1024 * 1024 * 1024)
+#define SCRATCH_FILE_MIN_SIZE (64 * 1024 * 1024)
+#define SCRATCH_FILE_FILL_SIZE (8 * 1024 * 1024)
+
+/* A directory on the filesystem mounted at @mount_points that the user can write to, or NULL. The mount
+ * point itself usually only is writable by root, so directories of the user are tried first.
+ */
+gchar *
+gdu_benchmark_find_scratch_directory (const gchar *const *mount_points)
+{
+    const gchar *candidates[] = { g_get_user_cache_dir (), g_get_home_dir (), g_get_tmp_dir () };
+    struct stat mount_stat;
+    guint n;
+
+    if (mount_points == NULL || mount_points[0] == NULL)
+        return NULL;
+
+    if (stat (mount_points[0], &mount_stat) != 0)
+        return NULL;
+
+    for (n = 0; n < G_N_ELEMENTS (candidates); n++) {
+        struct stat candidate_stat;
+
+        if (stat (candidates[n], &candidate_stat) == 0 && candidate_stat.st_dev == mount_stat.st_dev &&
+            access (candidates[n], W_OK) == 0)
+            return g_strdup (candidates[n]);
+    }
+
+    if (access (mount_points[0], W_OK) == 0)
+        return g_strdup (mount_points[0]);
+
+    return NULL;
+}
+
+/* Creates a scratch file in @directory, opened with O_DIRECT, of up to 1 GiB but no more than a quarter
+ * of the free space. The file is deleted right away, so nothing is left behind when the benchmark is
+ * cancelled or crashes. Returns the file descriptor, or -1 if @error is set.
+ */
+gint
+gdu_benchmark_open_scratch_file (const gchar *directory, guint64 *size, GCancellable *cancellable, GError **error)
+{
+    g_autofree gchar *path = NULL;
+    g_autofree guchar *buffer_unaligned = NULL;
+    g_autoptr(GRand) rand = NULL;
+    struct statvfs vfs;
+    guint64 scratch_size;
+    guint64 offset;
+    glong page_size;
+    guchar *buffer;
+    gint fd;
+    guint n;
+
+    g_return_val_if_fail (directory != NULL, -1);
+    g_return_val_if_fail (size != NULL, -1);
+
+    if (statvfs (directory, &vfs) != 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting free space of %s: %s",
+                     directory, g_strerror (errno));
+        return -1;
+    }
+
+    scratch_size = MIN (SCRATCH_FILE_MAX_SIZE, (guint64) vfs.f_bavail * vfs.f_frsize / 4);
+    scratch_size &= ~((guint64) SCRATCH_FILE_FILL_SIZE - 1);
+    if (scratch_size < SCRATCH_FILE_MIN_SIZE) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NO_SPACE, "Not enough free space in %s", directory);
+        return -1;
+    }
+
+    path = g_build_filename (directory, ".gnome-disks-benchmark-XXXXXX", NULL);
+    fd = g_mkstemp_full (path, O_RDWR | O_DIRECT, 0600);
+    if (fd == -1) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error creating %s: %s", path,
+                     g_strerror (errno));
+        return -1;
+    }
+    unlink (path);
+
+    if (fallocate (fd, 0, 0, scratch_size) != 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error allocating %s: %s", path,
+                     g_strerror (errno));
+        goto out;
+    }
+
+    /* random data, since some drives compress or deduplicate */
+    page_size = sysconf (_SC_PAGESIZE);
+    buffer_unaligned = g_new0 (guchar, SCRATCH_FILE_FILL_SIZE + page_size);
+    buffer = (guchar *) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+    rand = g_rand_new_with_seed (42);
+    for (n = 0; n < SCRATCH_FILE_FILL_SIZE / sizeof (guint32); n++)
+        ((guint32 *) buffer)[n] = g_rand_int (rand);
+
+    for (offset = 0; offset < scratch_size; offset += SCRATCH_FILE_FILL_SIZE) {
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            goto out;
+
+        if (pwrite (fd, buffer, SCRATCH_FILE_FILL_SIZE, offset) != SCRATCH_FILE_FILL_SIZE) {
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error writing to %s: %s", path,
+                         g_strerror (errno));
+            goto out;
+        }
+    }
+
+    if (fdatasync (fd) != 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error syncing %s: %s", path,
+                     g_strerror (errno));
+        goto out;
+    }
+
+    *size = scratch_size;
+    return fd;
+
+out:
+    close (fd);
+    return -1;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* Sustained write
+ *
+ * Consumer SSDs first write to a cache of flash used as SLC, which is fast, and slow down a lot once it
+ * is full. Short writes spread over the disk never fill it, so this writes sequentially from the start
+ * of the disk for as long as asked and records the rate every second.
+ *
+ * Like the other write benchmarks, every chunk is read first and then written back as it was. The next
+ * chunks are read while one is written, so the drive gets writes without a break, and the rate is of
+ * the wall-clock time, reads included, as pauses would let the drive empty its cache.
+ */
+
+#define SUSTAINED_CHUNK_SIZE (8 * 1024 * 1024)
+/* chunks being read or written at once */
+#define SUSTAINED_NUM_CHUNKS 4
+#define SUSTAINED_SAMPLE_USEC (1 * G_USEC_PER_SEC)
+/* a drop to less than this of the burst rate is taken as the cache running out */
+#define SUSTAINED_CLIFF_RATIO 0.7
+
+static gint
+compare_doubles (gconstpointer a, gconstpointer b)
+{
+    gdouble da = *(const gdouble *) a;
+    gdouble db = *(const gdouble *) b;
+
+    return (da > db) - (da < db);
+}
+
+static gdouble
+get_median_rate (GArray *samples, guint first, guint num)
+{
+    g_autofree gdouble *rates = NULL;
+    guint n;
+
+    rates = g_new (gdouble, num);
+    for (n = 0; n < num; n++)
+        rates[n] = g_array_index (samples, GduBenchmarkSustainedSample, first + n).bytes_per_sec;
+    qsort (rates, num, sizeof (gdouble), compare_doubles);
+
+    return rates[num / 2];
+}
+
+/* Finds where the rate of @samples, an array of GduBenchmarkSustainedSample, falls for good. Medians are
+ * used throughout, so garbage collection stalls and other short dips aren't taken for the cliff.
+ */
+void
+gdu_benchmark_find_write_cliff (GArray *samples, GduBenchmarkSustainedResult *result)
+{
+    gdouble threshold;
+    guint num_burst;
+    guint n;
+
+    g_return_if_fail (samples != NULL && result != NULL);
+
+    memset (result, 0, sizeof (GduBenchmarkSustainedResult));
+    result->cliff_offset = -1;
+    result->cliff_usec = -1;
+
+    if (samples->len == 0)
+        return;
+
+    if (samples->len < 6) {
+        result->burst_bytes_per_sec = result->steady_bytes_per_sec = get_median_rate (samples, 0, samples->len);
+        return;
+    }
+
+    num_burst = MAX (3, samples->len / 10);
+    result->burst_bytes_per_sec = get_median_rate (samples, 0, num_burst);
+    result->steady_bytes_per_sec = get_median_rate (samples, samples->len - samples->len / 3, samples->len / 3);
+
+    if (result->steady_bytes_per_sec >= SUSTAINED_CLIFF_RATIO * result->burst_bytes_per_sec)
+        return;
+
+    /* the first three seconds in a row below the middle of both, mostly */
+    threshold = (result->burst_bytes_per_sec + result->steady_bytes_per_sec) / 2;
+    for (n = 0; n + 3 <= samples->len; n++) {
+        if (get_median_rate (samples, n, 3) < threshold) {
+            const GduBenchmarkSustainedSample *prev;
+
+            /* the three seconds may start with the last one before the cliff */
+            while (g_array_index (samples, GduBenchmarkSustainedSample, n).bytes_per_sec >= threshold)
+                n++;
+
+            prev = n > 0 ? &g_array_index (samples, GduBenchmarkSustainedSample, n - 1) : NULL;
+            result->cliff_offset = prev != NULL ? (gint64) prev->offset : 0;
+            result->cliff_usec = prev != NULL ? prev->usec : 0;
+            break;
+        }
+    }
+}
+
+static void
+add_sustained_sample (GArray *samples, gint64 usec, guint64 offset, guint64 num_bytes, gint64 sample_usec,
+                      GduBenchmarkSustainedFunc func, gpointer user_data)
+{
+    GduBenchmarkSustainedSample sample;
+
+    sample.usec = usec;
+    sample.offset = offset;
+    sample.bytes_per_sec = ((gdouble) G_USEC_PER_SEC) * num_bytes / MAX (sample_usec, 1);
+    g_array_append_val (samples, sample);
+    if (func != NULL)
+        func (&sample, user_data);
+}
+
+/* Writes @fd, which must be opened with O_DIRECT, sequentially until @max_bytes are written, @max_usec
+ * have passed or the end of the disk is reached. @func is called with every sample and @result is set
+ * from all samples in the end.
+ */
+gboolean
+gdu_benchmark_sustained_write (gint fd, guint64 disk_size, guint64 max_bytes, gint64 max_usec,
+                               GduBenchmarkSustainedFunc func, gpointer user_data,
+                               GduBenchmarkSustainedResult *result, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GArray) samples = NULL;
+    g_autoptr(GduAio) aio = NULL;
+    g_autofree guchar *memory_unaligned = NULL;
+    g_autoptr(GError) local_error = NULL;
+    GduAioEvent events[SUSTAINED_NUM_CHUNKS];
+    guint64 chunk_offsets[SUSTAINED_NUM_CHUNKS];
+    gboolean chunk_read[SUSTAINED_NUM_CHUNKS];
+    guint64 next_offset = 0;
+    guint64 num_bytes_written = 0;
+    guint64 sample_bytes = 0;
+    gint64 begin_usec;
+    gint64 sample_begin_usec;
+    gint64 now_usec;
+    glong page_size;
+    guchar *memory;
+    guint slot;
+
+    g_return_val_if_fail (fd != -1, FALSE);
+    g_return_val_if_fail (result != NULL, FALSE);
+
+    samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSustainedSample));
+
+    /* one request per chunk, reading it or writing it back */
+    aio = gdu_aio_new (SUSTAINED_NUM_CHUNKS, error);
+    if (aio == NULL)
+        return FALSE;
+
+    page_size = sysconf (_SC_PAGESIZE);
+    memory_unaligned = g_new0 (guchar, SUSTAINED_NUM_CHUNKS * SUSTAINED_CHUNK_SIZE + page_size);
+    memory = (guchar *) (((gintptr) (memory_unaligned + page_size)) & (~(page_size - 1)));
+
+    max_bytes = MIN (max_bytes, disk_size) & ~((guint64) SUSTAINED_CHUNK_SIZE - 1);
+    begin_usec = sample_begin_usec = g_get_monotonic_time ();
+
+    for (slot = 0; slot < SUSTAINED_NUM_CHUNKS && next_offset < max_bytes; slot++) {
+        chunk_offsets[slot] = next_offset;
+        chunk_read[slot] = FALSE;
+        next_offset += SUSTAINED_CHUNK_SIZE;
+        if (!gdu_aio_submit (aio, fd, FALSE, memory + slot * SUSTAINED_CHUNK_SIZE, SUSTAINED_CHUNK_SIZE,
+                             chunk_offsets[slot], GUINT_TO_POINTER (slot), &local_error))
+            break;
+    }
+
+    /* after an error, only wait for the requests in flight */
+    while (gdu_aio_get_num_in_flight (aio) > 0) {
+        gint num_events;
+        guint n;
+
+        num_events = gdu_aio_get_events (aio, 1, events, G_N_ELEMENTS (events),
+                                         local_error == NULL ? &local_error : NULL);
+        if (num_events < 0)
+            break;
+
+        for (n = 0; n < (guint) num_events; n++) {
+            slot = GPOINTER_TO_UINT (events[n].user_data);
+
+            if (events[n].result != SUSTAINED_CHUNK_SIZE) {
+                if (local_error == NULL) {
+                    g_set_error (&local_error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                 "Error %s %d bytes at offset %" G_GUINT64_FORMAT,
+                                 chunk_read[slot] ? "writing" : "reading", SUSTAINED_CHUNK_SIZE, chunk_offsets[slot]);
+                    if (events[n].result < 0)
+                        g_prefix_error (&local_error, "%s: ", g_strerror (-events[n].result));
+                }
+                continue;
+            }
+            if (local_error != NULL)
+                continue;
+
+            /* write the chunk back as it was */
+            if (!chunk_read[slot]) {
+                chunk_read[slot] = TRUE;
+                gdu_aio_submit (aio, fd, TRUE, memory + slot * SUSTAINED_CHUNK_SIZE, SUSTAINED_CHUNK_SIZE,
+                                chunk_offsets[slot], GUINT_TO_POINTER (slot), &local_error);
+                continue;
+            }
+
+            num_bytes_written += SUSTAINED_CHUNK_SIZE;
+            sample_bytes += SUSTAINED_CHUNK_SIZE;
+
+            /* read the next chunk while the others are written */
+            if (next_offset < max_bytes && g_get_monotonic_time () - begin_usec < max_usec
+                && !g_cancellable_set_error_if_cancelled (cancellable, &local_error)) {
+                chunk_offsets[slot] = next_offset;
+                chunk_read[slot] = FALSE;
+                next_offset += SUSTAINED_CHUNK_SIZE;
+                gdu_aio_submit (aio, fd, FALSE, memory + slot * SUSTAINED_CHUNK_SIZE, SUSTAINED_CHUNK_SIZE,
+                                chunk_offsets[slot], GUINT_TO_POINTER (slot), &local_error);
+            }
+        }
+
+        now_usec = g_get_monotonic_time ();
+        if (local_error == NULL && gdu_aio_get_num_in_flight (aio) > 0
+            && now_usec - sample_begin_usec >= SUSTAINED_SAMPLE_USEC) {
+            add_sustained_sample (samples, now_usec - begin_usec, num_bytes_written, sample_bytes,
+                                  now_usec - sample_begin_usec, func, user_data);
+            sample_bytes = 0;
+            sample_begin_usec = now_usec;
+        }
+    }
+
+    if (local_error != NULL) {
+        g_propagate_error (error, g_steal_pointer (&local_error));
+        return FALSE;
+    }
+
+    /* the drive may still hold the last writes in its cache */
+    if (fdatasync (fd) != 0) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error syncing: %s", g_strerror (errno));
+        return FALSE;
+    }
+    now_usec = g_get_monotonic_time ();
+    if (sample_bytes > 0)
+        add_sustained_sample (samples, now_usec - begin_usec, num_bytes_written, sample_bytes,
+                              now_usec - sample_begin_usec, func, user_data);
+
+    gdu_benchmark_find_write_cliff (samples, result);
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The defaults of the org.gnome.Disks.benchmark settings */
+void
+gdu_benchmark_options_init (GduBenchmarkOptions *options)
+{
+    g_return_if_fail (options != NULL);
+
+    memset (options, 0, sizeof (GduBenchmarkOptions));
+    options->num_samples = 100;
+    options->sample_size = 10 * 1024 * 1024;
+    options->num_access_samples = 1000;
+    options->sustained_write_size = (guint64) 32 * 1024 * 1024 * 1024;
+    options->sustained_write_usec = (gint64) 5 * 60 * G_USEC_PER_SEC;
+}
+
+void
+gdu_benchmark_options_init_from_settings (GduBenchmarkOptions *options, GSettings *settings)
+{
+    g_return_if_fail (options != NULL);
+    g_return_if_fail (G_IS_SETTINGS (settings));
+
+    memset (options, 0, sizeof (GduBenchmarkOptions));
+    options->num_samples = g_settings_get_int (settings, "num-samples");
+    options->sample_size = (gsize) g_settings_get_int (settings, "sample-size-mib") * 1024 * 1024;
+    options->num_access_samples = g_settings_get_int (settings, "num-access-samples");
+    options->write = g_settings_get_boolean (settings, "do-write");
+    options->queue_depth_sweep = g_settings_get_boolean (settings, "do-queue-depth-sweep");
+    options->sustained_write = g_settings_get_boolean (settings, "do-sustained-write");
+    options->sustained_write_size = (guint64) g_settings_get_int (settings, "sustained-write-size-gib") * 1024 * 1024
+                                    * 1024;
+    options->sustained_write_usec = (gint64) g_settings_get_int (settings, "sustained-write-minutes") * 60
+                                    * G_USEC_PER_SEC;
+}
+
+/* Runs every part of the benchmark @options ask for on @fd, which must be opened with O_DIRECT, and
+ * writable if @options->write is set. The results are passed to @funcs as they come, on the calling
+ * thread.
+ */
+gboolean
+gdu_benchmark_run (gint fd, guint64 disk_size, const GduBenchmarkOptions *options, const GduBenchmarkFuncs *funcs,
+                   gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    g_autofree guchar *buffer_unaligned = NULL;
+    GduBenchmarkRandomResult random_result;
+    GduBenchmarkSustainedResult sustained_result;
+    guchar *buffer;
+    glong page_size;
+
+    g_return_val_if_fail (fd != -1, FALSE);
+    g_return_val_if_fail (options != NULL && funcs != NULL, FALSE);
+
+    page_size = sysconf (_SC_PAGESIZE);
+    if (page_size < 1) {
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno), "Error getting page size: %m\n");
+        return FALSE;
+    }
+
+    /* the scratch file is too small to fill the write cache of the drive */
+    if (options->sustained_write && options->scratch_file) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                     "The sustained write needs the whole device, not a scratch file");
+        return FALSE;
+    }
+
+    buffer_unaligned = g_new0 (guchar, options->sample_size + page_size);
+    buffer = (guchar *) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+    if (!benchmark_transfer_rate (fd, disk_size, options, funcs, user_data, buffer, page_size, cancellable, error))
+        return FALSE;
+
+    if (!benchmark_access_time (fd, disk_size, options, funcs, user_data, buffer, page_size, cancellable, error))
+        return FALSE;
+
+    if (!gdu_benchmark_random_io (fd, disk_size, FALSE, &random_result, cancellable, error))
+        return FALSE;
+    if (funcs->random_io != NULL)
+        funcs->random_io (FALSE, &random_result, user_data);
+
+    if (options->write) {
+        if (!gdu_benchmark_random_io (fd, disk_size, TRUE, &random_result, cancellable, error))
+            return FALSE;
+        if (funcs->random_io != NULL)
+            funcs->random_io (TRUE, &random_result, user_data);
+    }
+
+    if (options->queue_depth_sweep
+        && !gdu_benchmark_queue_depth_sweep (fd, disk_size, funcs->sweep_point, user_data, cancellable, error))
+        return FALSE;
+
+    /* last, since it takes the longest */
+    if (options->write && options->sustained_write) {
+        if (!gdu_benchmark_sustained_write (fd, disk_size, options->sustained_write_size,
+                                            options->sustained_write_usec, funcs->sustained_sample, user_data,
+                                            &sustained_result, cancellable, error))
+            return FALSE;
+        if (funcs->sustained_result != NULL)
+            funcs->sustained_result (&sustained_result, user_data);
+    }
+
+    return TRUE;
+}
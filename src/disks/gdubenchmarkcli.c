@@ -0,0 +1,454 @@
+/* gdubenchmarkcli.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdubenchmarkcli.h"
+
+#include <errno.h>
+#include <gio/gunixfdlist.h>
+#include <glib-unix.h>
+#include <glib/gi18n.h>
+#include <linux/fs.h>
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Runs the benchmark without a window for `gnome-disks --benchmark DEVICE`, so it can be scripted and its
+ * results compared between machines. Every sample is written out as JSON, also when the benchmark fails or
+ * is interrupted, and the exit status tells whether it completed.
+ */
+
+typedef struct {
+    guint64 offset;
+    gdouble value;
+} Sample;
+
+typedef struct {
+    const GduBenchmarkOptions *options;
+    gint fd;
+    guint64 disk_size;
+    GCancellable *cancellable;
+    GMainLoop *loop;
+    GError *error;
+
+    /* of Sample, indexed by GduBenchmarkSampleType */
+    GArray *samples[GDU_BENCHMARK_SAMPLE_ACCESS_TIME + 1];
+    /* NULL until measured */
+    GduBenchmarkRandomResult *random_read;
+    GduBenchmarkRandomResult *random_write;
+    GArray *sweep_points;
+    GArray *sustained_samples;
+    GduBenchmarkSustainedResult *sustained_result;
+} Benchmark;
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* called on the benchmark thread */
+static void
+on_sample_cb (GduBenchmarkSampleType type, guint64 offset, gdouble value, gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+    Sample sample = { offset, value };
+
+    g_array_append_val (benchmark->samples[type], sample);
+}
+
+static void
+on_random_io_cb (gboolean write, const GduBenchmarkRandomResult *result, gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+    GduBenchmarkRandomResult **out = write ? &benchmark->random_write : &benchmark->random_read;
+
+    g_free (*out);
+    *out = g_memdup2 (result, sizeof (GduBenchmarkRandomResult));
+}
+
+static void
+on_sweep_point_cb (const GduBenchmarkSweepPoint *point, gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+
+    g_array_append_val (benchmark->sweep_points, *point);
+}
+
+static void
+on_sustained_sample_cb (const GduBenchmarkSustainedSample *sample, gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+
+    g_array_append_val (benchmark->sustained_samples, *sample);
+}
+
+static void
+on_sustained_result_cb (const GduBenchmarkSustainedResult *result, gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+
+    g_free (benchmark->sustained_result);
+    benchmark->sustained_result = g_memdup2 (result, sizeof (GduBenchmarkSustainedResult));
+}
+
+static const GduBenchmarkFuncs benchmark_funcs = {
+    .sample = on_sample_cb,
+    .random_io = on_random_io_cb,
+    .sweep_point = on_sweep_point_cb,
+    .sustained_sample = on_sustained_sample_cb,
+    .sustained_result = on_sustained_result_cb,
+};
+
+static gboolean
+on_benchmark_done (gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+
+    g_main_loop_quit (benchmark->loop);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer
+benchmark_thread (gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+
+    gdu_benchmark_run (benchmark->fd, benchmark->disk_size, benchmark->options, &benchmark_funcs, benchmark,
+                       benchmark->cancellable, &benchmark->error);
+
+    /* the main loop may not be running yet, so don't quit it from here */
+    g_idle_add (on_benchmark_done, benchmark);
+
+    return NULL;
+}
+
+/* Stops the benchmark on Ctrl+C, so the samples taken so far are still written out */
+static gboolean
+on_signal_cb (gpointer user_data)
+{
+    Benchmark *benchmark = user_data;
+
+    g_cancellable_cancel (benchmark->cancellable);
+
+    return G_SOURCE_CONTINUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static gint
+open_device (UDisksClient *client, const gchar *device, gboolean write, GCancellable *cancellable,
+             GError **error)
+{
+    GVariantBuilder options_builder;
+    g_autoptr(UDisksBlock) block = NULL;
+    g_autoptr(UDisksObject) object = NULL;
+    g_autoptr(GVariant) fd_index = NULL;
+    g_autoptr(GUnixFDList) fd_list = NULL;
+    struct stat statbuf;
+
+    if (stat (device, &statbuf) != 0) {
+        gint errsv = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), _("Error opening %s: %s"), device,
+                     g_strerror (errsv));
+        return -1;
+    }
+
+    if (S_ISBLK (statbuf.st_mode))
+        block = udisks_client_get_block_for_dev (client, statbuf.st_rdev);
+    if (block == NULL) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND, _("Error looking up block device for %s"), device);
+        return -1;
+    }
+
+    /* the data is put back after writing, but not what a mounted filesystem writes meanwhile */
+    object = UDISKS_OBJECT (g_dbus_interface_dup_object (G_DBUS_INTERFACE (block)));
+    if (write && gdu_utils_is_in_use (client, object)) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_BUSY,
+                     _("%s is in use, unmount or stop it before benchmarking writes"), device);
+        return -1;
+    }
+
+    g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+    g_variant_builder_add (&options_builder, "{sv}", "writable", g_variant_new_boolean (write));
+
+    if (!udisks_block_call_open_for_benchmark_sync (block, g_variant_builder_end (&options_builder),
+                                                    NULL, /* fd_list */
+                                                    &fd_index, &fd_list, cancellable, error))
+        return -1;
+
+    return g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+json_append_string (GString *json, const gchar *str)
+{
+    const gchar *p;
+
+    g_string_append_c (json, '"');
+    for (p = str; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\')
+            g_string_append_printf (json, "\\%c", *p);
+        else if ((guchar) *p < 0x20)
+            g_string_append_printf (json, "\\u%04x", (guchar) *p);
+        else
+            g_string_append_c (json, *p);
+    }
+    g_string_append_c (json, '"');
+}
+
+/* JSON has no infinity or NaN, a rate of a sample too fast to time is written as null */
+static void
+json_append_double (GString *json, gdouble value)
+{
+    gchar buf[G_ASCII_DTOSTR_BUF_SIZE];
+
+    if (!isfinite (value))
+        g_string_append (json, "null");
+    else
+        g_string_append (json, g_ascii_dtostr (buf, sizeof (buf), value));
+}
+
+static void
+json_append_samples (GString *json, const gchar *name, GArray *samples, const gchar *offset_name,
+                     const gchar *value_name)
+{
+    guint n;
+
+    g_string_append_printf (json, "  \"%s\": [", name);
+    for (n = 0; n < samples->len; n++) {
+        Sample *sample = &g_array_index (samples, Sample, n);
+
+        g_string_append_printf (json, "%s\n    {\"%s\": %" G_GUINT64_FORMAT ", \"%s\": ", n > 0 ? "," : "",
+                                offset_name, sample->offset, value_name);
+        json_append_double (json, sample->value);
+        g_string_append_c (json, '}');
+    }
+    g_string_append (json, samples->len > 0 ? "\n  ],\n" : "],\n");
+}
+
+static void
+json_append_random_result (GString *json, const gchar *name, const GduBenchmarkRandomResult *result)
+{
+    g_string_append_printf (json, "  \"%s\": ", name);
+    if (result == NULL) {
+        g_string_append (json, "null,\n");
+        return;
+    }
+
+    g_string_append (json, "{\"iops\": ");
+    json_append_double (json, result->iops);
+    g_string_append_printf (json,
+                            ", \"latency_usec\": {\"p50\": %" G_GINT64_FORMAT ", \"p99\": %" G_GINT64_FORMAT
+                            ", \"p99.9\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT "}},\n",
+                            gdu_benchmark_histogram_get_percentile (&result->latency, 50.0),
+                            gdu_benchmark_histogram_get_percentile (&result->latency, 99.0),
+                            gdu_benchmark_histogram_get_percentile (&result->latency, 99.9),
+                            result->latency.max_usec);
+}
+
+static void
+json_append_sweep (GString *json, GArray *points)
+{
+    guint n;
+
+    g_string_append (json, "  \"queue_depth_sweep\": [");
+    for (n = 0; n < points->len; n++) {
+        GduBenchmarkSweepPoint *point = &g_array_index (points, GduBenchmarkSweepPoint, n);
+
+        g_string_append_printf (json, "%s\n    {\"jobs\": %u, \"queue_depth\": %u, \"iops\": ", n > 0 ? "," : "",
+                                point->num_jobs, point->queue_depth);
+        json_append_double (json, point->iops);
+        g_string_append (json, ", \"bytes_per_sec\": ");
+        json_append_double (json, point->bytes_per_sec);
+        g_string_append_c (json, '}');
+    }
+    g_string_append (json, points->len > 0 ? "\n  ],\n" : "],\n");
+}
+
+static void
+json_append_sustained_write (GString *json, GArray *samples, const GduBenchmarkSustainedResult *result)
+{
+    guint n;
+
+    g_string_append (json, "  \"sustained_write\": {\n    \"samples\": [");
+    for (n = 0; n < samples->len; n++) {
+        GduBenchmarkSustainedSample *sample = &g_array_index (samples, GduBenchmarkSustainedSample, n);
+
+        g_string_append_printf (json,
+                                "%s\n      {\"usec\": %" G_GINT64_FORMAT ", \"offset\": %" G_GUINT64_FORMAT
+                                ", \"bytes_per_sec\": ",
+                                n > 0 ? "," : "", sample->usec, sample->offset);
+        json_append_double (json, sample->bytes_per_sec);
+        g_string_append_c (json, '}');
+    }
+    g_string_append (json, samples->len > 0 ? "\n    ],\n" : "],\n");
+
+    /* not known unless the whole sustained write was done */
+    if (result == NULL) {
+        g_string_append (json, "    \"burst_bytes_per_sec\": null,\n    \"steady_bytes_per_sec\": null,\n"
+                               "    \"cliff_offset\": null,\n    \"cliff_usec\": null\n  },\n");
+        return;
+    }
+
+    g_string_append (json, "    \"burst_bytes_per_sec\": ");
+    json_append_double (json, result->burst_bytes_per_sec);
+    g_string_append (json, ",\n    \"steady_bytes_per_sec\": ");
+    json_append_double (json, result->steady_bytes_per_sec);
+    if (result->cliff_offset < 0)
+        g_string_append (json, ",\n    \"cliff_offset\": null,\n    \"cliff_usec\": null\n  },\n");
+    else
+        g_string_append_printf (json,
+                                ",\n    \"cliff_offset\": %" G_GINT64_FORMAT ",\n    \"cliff_usec\": %" G_GINT64_FORMAT
+                                "\n  },\n",
+                                result->cliff_offset, result->cliff_usec);
+}
+
+/* The parts of the benchmark that weren't asked for are null, as are the results of parts not reached */
+static GString *
+benchmark_to_json (Benchmark *benchmark, const gchar *device)
+{
+    const GduBenchmarkOptions *options = benchmark->options;
+    g_autofree gchar *device_name = g_filename_display_name (device);
+    GString *json;
+
+    json = g_string_new ("{\n  \"device\": ");
+    json_append_string (json, device_name);
+    g_string_append_printf (json, ",\n  \"size\": %" G_GUINT64_FORMAT ",\n", benchmark->disk_size);
+
+    g_string_append_printf (json,
+                            "  \"options\": {\"samples\": %u, \"sample_size\": %" G_GSIZE_FORMAT
+                            ", \"access_samples\": %u, \"write\": %s, \"queue_depth_sweep\": %s, "
+                            "\"sustained_write\": %s, \"sustained_write_size\": %" G_GUINT64_FORMAT
+                            ", \"sustained_write_usec\": %" G_GINT64_FORMAT "},\n",
+                            options->num_samples, options->sample_size, options->num_access_samples,
+                            options->write ? "true" : "false", options->queue_depth_sweep ? "true" : "false",
+                            options->sustained_write ? "true" : "false", options->sustained_write_size,
+                            options->sustained_write_usec);
+
+    json_append_samples (json, "read_samples", benchmark->samples[GDU_BENCHMARK_SAMPLE_READ], "offset",
+                         "bytes_per_sec");
+    if (options->write)
+        json_append_samples (json, "write_samples", benchmark->samples[GDU_BENCHMARK_SAMPLE_WRITE], "offset",
+                             "bytes_per_sec");
+    else
+        g_string_append (json, "  \"write_samples\": null,\n");
+    json_append_samples (json, "access_time_samples", benchmark->samples[GDU_BENCHMARK_SAMPLE_ACCESS_TIME],
+                         "distance", "seconds");
+
+    json_append_random_result (json, "random_read", benchmark->random_read);
+    json_append_random_result (json, "random_write", benchmark->random_write);
+
+    if (options->queue_depth_sweep)
+        json_append_sweep (json, benchmark->sweep_points);
+    else
+        g_string_append (json, "  \"queue_depth_sweep\": null,\n");
+
+    if (options->write && options->sustained_write)
+        json_append_sustained_write (json, benchmark->sustained_samples, benchmark->sustained_result);
+    else
+        g_string_append (json, "  \"sustained_write\": null,\n");
+
+    g_string_append (json, "  \"error\": ");
+    if (benchmark->error != NULL)
+        json_append_string (json, benchmark->error->message);
+    else
+        g_string_append (json, "null");
+    g_string_append (json, "\n}\n");
+
+    return json;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Benchmarks @device with @options and writes the results as JSON to the file @output, or to the standard
+ * output if it's NULL or "-". Returns the exit status: 0 if the whole benchmark completed, 1 if it didn't.
+ */
+gint
+gdu_benchmark_cli_run (const gchar *device, const GduBenchmarkOptions *options, const gchar *output)
+{
+    g_autoptr(UDisksClient) client = NULL;
+    g_autoptr(GString) json = NULL;
+    g_autoptr(GError) error = NULL;
+    Benchmark benchmark = { 0 };
+    gint ret = 1;
+    guint n;
+
+    g_return_val_if_fail (device != NULL, 1);
+    g_return_val_if_fail (options != NULL, 1);
+
+    benchmark.options = options;
+    benchmark.fd = -1;
+    benchmark.cancellable = g_cancellable_new ();
+    benchmark.loop = g_main_loop_new (NULL, FALSE);
+    for (n = 0; n < G_N_ELEMENTS (benchmark.samples); n++)
+        benchmark.samples[n] = g_array_new (FALSE, FALSE, sizeof (Sample));
+    benchmark.sweep_points = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSweepPoint));
+    benchmark.sustained_samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSustainedSample));
+
+    client = udisks_client_new_sync (NULL, &benchmark.error);
+    if (client != NULL)
+        benchmark.fd = open_device (client, device, options->write, benchmark.cancellable, &benchmark.error);
+
+    if (benchmark.fd != -1 && ioctl (benchmark.fd, BLKGETSIZE64, &benchmark.disk_size) != 0) {
+        gint errsv = errno;
+
+        g_set_error (&benchmark.error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                     "Error getting size of device: %s", g_strerror (errsv));
+    }
+
+    if (benchmark.error == NULL) {
+        GThread *thread;
+        guint sigint_id, sigterm_id;
+
+        sigint_id = g_unix_signal_add (SIGINT, on_signal_cb, &benchmark);
+        sigterm_id = g_unix_signal_add (SIGTERM, on_signal_cb, &benchmark);
+
+        thread = g_thread_new ("benchmark-thread", benchmark_thread, &benchmark);
+        g_main_loop_run (benchmark.loop);
+        g_thread_join (thread);
+
+        g_source_remove (sigint_id);
+        g_source_remove (sigterm_id);
+    }
+
+    if (benchmark.fd != -1)
+        close (benchmark.fd);
+
+    json = benchmark_to_json (&benchmark, device);
+    if (output == NULL || g_strcmp0 (output, "-") == 0) {
+        fputs (json->str, stdout);
+        fflush (stdout);
+    } else if (!g_file_set_contents (output, json->str, json->len, &error)) {
+        g_printerr ("%s\n", error->message);
+        goto out;
+    }
+
+    if (benchmark.error != NULL) {
+        g_printerr ("%s\n", benchmark.error->message);
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    g_clear_error (&benchmark.error);
+    for (n = 0; n < G_N_ELEMENTS (benchmark.samples); n++)
+        g_array_unref (benchmark.samples[n]);
+    g_array_unref (benchmark.sweep_points);
+    g_array_unref (benchmark.sustained_samples);
+    g_free (benchmark.random_read);
+    g_free (benchmark.random_write);
+    g_free (benchmark.sustained_result);
+    g_main_loop_unref (benchmark.loop);
+    g_object_unref (benchmark.cancellable);
+    return ret;
+}
@@ -0,0 +1,16 @@
+/* gdubenchmarkcli.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include "gdubenchmark.h"
+
+G_BEGIN_DECLS
+
+gint gdu_benchmark_cli_run (const gchar *device, const GduBenchmarkOptions *options, const gchar *output);
+
+G_END_DECLS
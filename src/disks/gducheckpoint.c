@@ -0,0 +1,365 @@
+/* gducheckpoint.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gducheckpoint.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+/* A checkpoint of a copy that is written from start to end, so the copy can
+ * continue where it stopped after it was cancelled or the machine crashed.
+ * Besides how far the copy got, the checkpoint has a SHA-256 hash of every
+ * chunk copied, to make sure the data is still there before continuing
+ * after it. It is saved as a key file:
+ *
+ *   [Checkpoint]
+ *   Source=<what is copied, e.g. the ID of the drive>
+ *   Size=<the size of the source in bytes>
+ *   ChunkSize=<bytes per hash>
+ *   Offset=<bytes copied>
+ *   ChunkHashes=<hash of the first chunk>;<hash of the second chunk>;...
+ */
+
+#define CHECKPOINT_GROUP "Checkpoint"
+
+/* Size of the reads when verifying */
+#define VERIFY_BUFFER_SIZE (1024 * 1024)
+
+struct GduCheckpoint {
+    gchar *source;
+    guint64 size;
+    /* of the chunks copied completely */
+    GPtrArray *hashes;
+
+    /* the chunk being copied */
+    GChecksum *checksum;
+    guint64 chunk_filled;
+};
+
+/**
+ * gdu_checkpoint_new:
+ * @source: A string identifying the source of the copy.
+ * @size: The size of the source.
+ *
+ * Creates a checkpoint for a copy that has not started yet.
+ *
+ * Returns: (transfer full): A #GduCheckpoint.
+ */
+GduCheckpoint *
+gdu_checkpoint_new (const gchar *source, guint64 size)
+{
+    GduCheckpoint *checkpoint;
+
+    checkpoint = g_new0 (GduCheckpoint, 1);
+    checkpoint->source = g_strdup (source);
+    checkpoint->size = size;
+    checkpoint->hashes = g_ptr_array_new_with_free_func (g_free);
+    checkpoint->checksum = g_checksum_new (G_CHECKSUM_SHA256);
+
+    return checkpoint;
+}
+
+void
+gdu_checkpoint_free (GduCheckpoint *checkpoint)
+{
+    if (checkpoint == NULL)
+        return;
+
+    g_free (checkpoint->source);
+    g_ptr_array_unref (checkpoint->hashes);
+    g_checksum_free (checkpoint->checksum);
+    g_free (checkpoint);
+}
+
+static gboolean
+is_hash (const gchar *str)
+{
+    guint n;
+
+    for (n = 0; str[n] != '\0'; n++) {
+        if (!g_ascii_isxdigit (str[n]))
+            return FALSE;
+    }
+
+    return n == 64;
+}
+
+/**
+ * gdu_checkpoint_load:
+ * @file: The file to read.
+ * @error: Return location for error.
+ *
+ * Reads a checkpoint written by gdu_checkpoint_save().
+ *
+ * Returns: (transfer full): The checkpoint or %NULL if @error is set.
+ */
+GduCheckpoint *
+gdu_checkpoint_load (GFile *file, GError **error)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GKeyFile) key_file = NULL;
+    g_autofree gchar *contents = NULL;
+    g_autofree gchar *source = NULL;
+    g_auto(GStrv) hashes = NULL;
+    g_autoptr(GError) local_error = NULL;
+    gsize contents_length;
+    gsize num_hashes = 0;
+    guint64 size, chunk_size, offset;
+    gsize n;
+
+    if (!g_file_load_contents (file, NULL, &contents, &contents_length, NULL, error))
+        return NULL;
+
+    key_file = g_key_file_new ();
+    if (!g_key_file_load_from_data (key_file, contents, contents_length, G_KEY_FILE_NONE, error))
+        return NULL;
+
+    source = g_key_file_get_string (key_file, CHECKPOINT_GROUP, "Source", error);
+    if (source == NULL)
+        return NULL;
+    size = g_key_file_get_uint64 (key_file, CHECKPOINT_GROUP, "Size", &local_error);
+    if (local_error != NULL) {
+        g_propagate_error (error, g_steal_pointer (&local_error));
+        return NULL;
+    }
+    chunk_size = g_key_file_get_uint64 (key_file, CHECKPOINT_GROUP, "ChunkSize", NULL);
+    offset = g_key_file_get_uint64 (key_file, CHECKPOINT_GROUP, "Offset", NULL);
+    hashes = g_key_file_get_string_list (key_file, CHECKPOINT_GROUP, "ChunkHashes", &num_hashes, NULL);
+
+    if (chunk_size != GDU_CHECKPOINT_CHUNK_SIZE || offset != num_hashes * chunk_size || offset > size) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Checkpoint does not match its chunk hashes");
+        return NULL;
+    }
+
+    checkpoint = gdu_checkpoint_new (source, size);
+    for (n = 0; n < num_hashes; n++) {
+        if (!is_hash (hashes[n])) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid chunk hash in checkpoint: %s",
+                         hashes[n]);
+            return NULL;
+        }
+        g_ptr_array_add (checkpoint->hashes, g_ascii_strdown (hashes[n], -1));
+    }
+
+    return g_steal_pointer (&checkpoint);
+}
+
+/**
+ * gdu_checkpoint_save:
+ * @checkpoint: A #GduCheckpoint.
+ * @file: The file to write.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for error.
+ *
+ * Writes @checkpoint to @file, which is only replaced once the checkpoint
+ * has been written completely. The copy has to be synced to disk before.
+ *
+ * Returns: %TRUE on success, %FALSE if @error is set.
+ */
+gboolean
+gdu_checkpoint_save (GduCheckpoint *checkpoint, GFile *file, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GKeyFile) key_file = NULL;
+    g_autofree gchar *contents = NULL;
+    gsize contents_length;
+
+    key_file = g_key_file_new ();
+    g_key_file_set_string (key_file, CHECKPOINT_GROUP, "Source", checkpoint->source);
+    g_key_file_set_uint64 (key_file, CHECKPOINT_GROUP, "Size", checkpoint->size);
+    g_key_file_set_uint64 (key_file, CHECKPOINT_GROUP, "ChunkSize", GDU_CHECKPOINT_CHUNK_SIZE);
+    g_key_file_set_uint64 (key_file, CHECKPOINT_GROUP, "Offset", gdu_checkpoint_get_offset (checkpoint));
+    g_key_file_set_string_list (key_file, CHECKPOINT_GROUP, "ChunkHashes",
+                                (const gchar *const *) checkpoint->hashes->pdata, checkpoint->hashes->len);
+
+    contents = g_key_file_to_data (key_file, &contents_length, NULL);
+
+    return g_file_replace_contents (file, contents, contents_length, NULL, /* etag */
+                                    FALSE,                                 /* make_backup */
+                                    G_FILE_CREATE_NONE, NULL, cancellable, error);
+}
+
+/**
+ * gdu_checkpoint_matches:
+ * @checkpoint: A #GduCheckpoint.
+ * @source: A string identifying the source of the copy.
+ * @size: The size of the source.
+ *
+ * Returns: Whether @checkpoint is of a copy from @source.
+ */
+gboolean
+gdu_checkpoint_matches (GduCheckpoint *checkpoint, const gchar *source, guint64 size)
+{
+    g_return_val_if_fail (checkpoint != NULL, FALSE);
+
+    return g_strcmp0 (checkpoint->source, source) == 0 && checkpoint->size == size;
+}
+
+/**
+ * gdu_checkpoint_get_offset:
+ * @checkpoint: A #GduCheckpoint.
+ *
+ * Returns: The number of bytes the copy can continue after, always a
+ * multiple of %GDU_CHECKPOINT_CHUNK_SIZE.
+ */
+guint64
+gdu_checkpoint_get_offset (GduCheckpoint *checkpoint)
+{
+    g_return_val_if_fail (checkpoint != NULL, 0);
+
+    return (guint64) checkpoint->hashes->len * GDU_CHECKPOINT_CHUNK_SIZE;
+}
+
+static void
+finish_chunk (GduCheckpoint *checkpoint)
+{
+    g_ptr_array_add (checkpoint->hashes, g_strdup (g_checksum_get_string (checkpoint->checksum)));
+    g_checksum_reset (checkpoint->checksum);
+    checkpoint->chunk_filled = 0;
+}
+
+/**
+ * gdu_checkpoint_add_data:
+ * @checkpoint: A #GduCheckpoint.
+ * @data: The data copied.
+ * @size: The size of @data.
+ *
+ * Adds the next @size bytes of the copy to the hashes of @checkpoint.
+ */
+void
+gdu_checkpoint_add_data (GduCheckpoint *checkpoint, const guchar *data, gsize size)
+{
+    g_return_if_fail (checkpoint != NULL);
+
+    while (size > 0) {
+        gsize num_bytes = MIN (size, GDU_CHECKPOINT_CHUNK_SIZE - checkpoint->chunk_filled);
+
+        g_checksum_update (checkpoint->checksum, data, num_bytes);
+        checkpoint->chunk_filled += num_bytes;
+        if (checkpoint->chunk_filled == GDU_CHECKPOINT_CHUNK_SIZE)
+            finish_chunk (checkpoint);
+        data += num_bytes;
+        size -= num_bytes;
+    }
+}
+
+static const guchar zeroes[64 * 1024] = { 0 };
+
+/* The hash of a chunk of zeroes, for the large ranges of zeroes that are not copied but left as holes */
+static const gchar *
+get_zero_chunk_hash (void)
+{
+    static gsize initialized = 0;
+    static gchar *hash = NULL;
+
+    if (g_once_init_enter (&initialized)) {
+        g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+        guint n;
+
+        for (n = 0; n < GDU_CHECKPOINT_CHUNK_SIZE / sizeof zeroes; n++)
+            g_checksum_update (checksum, zeroes, sizeof zeroes);
+        hash = g_strdup (g_checksum_get_string (checksum));
+        g_once_init_leave (&initialized, 1);
+    }
+
+    return hash;
+}
+
+/**
+ * gdu_checkpoint_add_zeroes:
+ * @checkpoint: A #GduCheckpoint.
+ * @size: The number of zeroes.
+ *
+ * Like gdu_checkpoint_add_data() for @size zeroes.
+ */
+void
+gdu_checkpoint_add_zeroes (GduCheckpoint *checkpoint, guint64 size)
+{
+    g_return_if_fail (checkpoint != NULL);
+
+    while (size > 0) {
+        gsize num_bytes;
+
+        if (checkpoint->chunk_filled == 0 && size >= GDU_CHECKPOINT_CHUNK_SIZE) {
+            g_ptr_array_add (checkpoint->hashes, g_strdup (get_zero_chunk_hash ()));
+            size -= GDU_CHECKPOINT_CHUNK_SIZE;
+            continue;
+        }
+
+        num_bytes = MIN (size, sizeof zeroes);
+        gdu_checkpoint_add_data (checkpoint, zeroes, num_bytes);
+        size -= num_bytes;
+    }
+}
+
+/**
+ * gdu_checkpoint_verify:
+ * @checkpoint: A #GduCheckpoint.
+ * @fd: The copy to check, e.g. the disk image written.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for error.
+ *
+ * Reads back the chunks of the copy in @fd and drops the hashes from the
+ * first chunk that does not match on, so gdu_checkpoint_get_offset() is
+ * where the copy can continue.
+ *
+ * Returns: %TRUE on success, %FALSE if @error is set.
+ */
+gboolean
+gdu_checkpoint_verify (GduCheckpoint *checkpoint, gint fd, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GChecksum) checksum = NULL;
+    g_autofree guchar *buffer = NULL;
+    guint n;
+
+    g_return_val_if_fail (checkpoint != NULL, FALSE);
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    buffer = g_malloc (VERIFY_BUFFER_SIZE);
+
+    for (n = 0; n < checkpoint->hashes->len; n++) {
+        guint64 offset = (guint64) n * GDU_CHECKPOINT_CHUNK_SIZE;
+        guint64 end = offset + GDU_CHECKPOINT_CHUNK_SIZE;
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+        g_checksum_reset (checksum);
+        while (offset < end) {
+            gssize num_bytes_read;
+
+            num_bytes_read = pread (fd, buffer, MIN (end - offset, VERIFY_BUFFER_SIZE), offset);
+            if (num_bytes_read < 0) {
+                gint errsv = errno;
+
+                if (errsv == EINTR)
+                    continue;
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+                             "Error reading %" G_GUINT64_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": %s",
+                             MIN (end - offset, VERIFY_BUFFER_SIZE), offset, g_strerror (errsv));
+                return FALSE;
+            }
+            if (num_bytes_read == 0)
+                break;
+            g_checksum_update (checksum, buffer, num_bytes_read);
+            offset += num_bytes_read;
+        }
+
+        if (offset < end || g_strcmp0 (g_checksum_get_string (checksum), checkpoint->hashes->pdata[n]) != 0) {
+            g_info ("Chunk %u of the copy does not match the checkpoint", n);
+            break;
+        }
+    }
+
+    g_ptr_array_set_size (checkpoint->hashes, n);
+    g_checksum_reset (checkpoint->checksum);
+    checkpoint->chunk_filled = 0;
+
+    return TRUE;
+}
@@ -0,0 +1,34 @@
+/* gducheckpoint.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* The size of the chunks that are hashed */
+#define GDU_CHECKPOINT_CHUNK_SIZE (64 * 1024 * 1024)
+
+GduCheckpoint *gdu_checkpoint_new (const gchar *source, guint64 size);
+GduCheckpoint *gdu_checkpoint_load (GFile *file, GError **error);
+void gdu_checkpoint_free (GduCheckpoint *checkpoint);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GduCheckpoint, gdu_checkpoint_free)
+
+gboolean gdu_checkpoint_save (GduCheckpoint *checkpoint, GFile *file, GCancellable *cancellable, GError **error);
+
+gboolean gdu_checkpoint_matches (GduCheckpoint *checkpoint, const gchar *source, guint64 size);
+guint64 gdu_checkpoint_get_offset (GduCheckpoint *checkpoint);
+
+void gdu_checkpoint_add_data (GduCheckpoint *checkpoint, const guchar *data, gsize size);
+void gdu_checkpoint_add_zeroes (GduCheckpoint *checkpoint, guint64 size);
+
+gboolean gdu_checkpoint_verify (GduCheckpoint *checkpoint, gint fd, GCancellable *cancellable, GError **error);
+
+G_END_DECLS
@@ -0,0 +1,33 @@
+/* gducompressor.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+#define GDU_TYPE_COMPRESSOR (gdu_compressor_get_type ())
+#define GDU_COMPRESSOR(o) (G_TYPE_CHECK_INSTANCE_CAST ((o), GDU_TYPE_COMPRESSOR, GduCompressor))
+#define GDU_IS_COMPRESSOR(o) (G_TYPE_CHECK_INSTANCE_TYPE ((o), GDU_TYPE_COMPRESSOR))
+
+typedef struct GduCompressorClass GduCompressorClass;
+
+struct GduCompressorClass {
+    GObjectClass parent_class;
+};
+
+typedef enum {
+    GDU_COMPRESSOR_FORMAT_XZ,
+    GDU_COMPRESSOR_FORMAT_ZSTD,
+} GduCompressorFormat;
+
+GType gdu_compressor_get_type (void);
+GduCompressor *gdu_compressor_new (GduCompressorFormat format, guint64 size, GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GduCompressor, g_object_unref)
+G_END_DECLS
@@ -0,0 +1,469 @@
+/* gducopyengine.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gducopyengine.h"
+
+#include <string.h>
+#include <unistd.h>
+
+/* The engine keeps a pool of page-aligned buffers that cycle between two
+ * stages: the reader stage (the calling thread) fills free buffers and the
+ * writer stage (a dedicated thread) drains them again. With more than one
+ * buffer in flight the source is read while the previous blocks are still
+ * being written, so a copy runs at the speed of the slower device instead of
+ * the sum of both latencies.
+ *
+ * Optionally a third stage (another thread) adds every block to a checksum
+ * while the writer stage writes it, so hashing the copy does not need
+ * another pass over the data and does not add to the time per block.
+ *
+ * Optionally the engine tunes the block size: starting from a small block
+ * size it doubles the size every probe period for as long as that makes the
+ * copy faster, then settles on the fastest size it has seen. The memory used
+ * is bounded by the size of the buffers passed to gdu_copy_engine_new().
+ */
+
+/* Minimum duration and number of blocks of a probe period */
+#define TUNE_PROBE_USEC (250 * G_USEC_PER_SEC / 1000)
+#define TUNE_PROBE_MIN_BLOCKS 8
+/* A larger block size must be at least this much faster (in percent) to be picked */
+#define TUNE_MIN_GAIN 5
+
+struct GduCopyEngine {
+    guint num_buffers;
+    gsize buffer_size;
+    guchar *memory_unaligned;
+    GduCopyBlock *blocks;
+
+    /* Blocks ready to be filled by the reader stage */
+    GAsyncQueue *free_queue;
+    /* Blocks ready to be consumed by the writer stage */
+    GAsyncQueue *full_queue;
+    /* Blocks ready to be hashed by the checksum stage */
+    GAsyncQueue *hash_queue;
+    /* For each block, the number of stages still using it. The last one puts it on the free queue. */
+    gint *num_users;
+
+    GduCopyWriteFunc write_func;
+    gpointer user_data;
+    GCancellable *cancellable;
+
+    /* Set by the writer stage, read by the reader stage */
+    gint writer_failed;
+    GError *writer_error;
+
+    /* Only accessed from the checksum stage while running */
+    GChecksum *checksum;
+    guint64 checksum_size;
+    guint64 checksum_offset;
+    /* Set by the reader stage once all blocks were read */
+    gboolean all_read;
+
+    /* Block size tuning, only accessed from the reader stage */
+    gsize fixed_block_size;
+    gsize tune_min_block_size;
+    gsize block_size;
+    gboolean tune_settled;
+    gsize tune_best_block_size;
+    guint64 tune_best_rate;
+    guint tune_num_worse;
+    gint64 tune_probe_start_usec;
+    guint64 tune_probe_bytes;
+    guint tune_probe_blocks;
+};
+
+/* Pushed by the reader stage to make the writer and checksum stage exit */
+static GduCopyBlock end_of_stream;
+
+GduCopyEngine *
+gdu_copy_engine_new (guint num_buffers, gsize buffer_size)
+{
+    GduCopyEngine *engine;
+    glong page_size;
+    guchar *memory;
+    guint n;
+
+    g_return_val_if_fail (num_buffers > 0, NULL);
+    g_return_val_if_fail (buffer_size > 0, NULL);
+
+    page_size = sysconf (_SC_PAGESIZE);
+    /* keep every buffer page-aligned */
+    buffer_size = (buffer_size + page_size - 1) & (~(page_size - 1));
+
+    engine = g_new0 (GduCopyEngine, 1);
+    engine->num_buffers = num_buffers;
+    engine->buffer_size = buffer_size;
+    engine->memory_unaligned = g_new0 (guchar, num_buffers * buffer_size + page_size);
+    engine->blocks = g_new0 (GduCopyBlock, num_buffers);
+    engine->free_queue = g_async_queue_new ();
+    engine->full_queue = g_async_queue_new ();
+    engine->hash_queue = g_async_queue_new ();
+    engine->num_users = g_new0 (gint, num_buffers);
+
+    memory = (guchar *) (((gintptr) (engine->memory_unaligned + page_size)) & (~(page_size - 1)));
+    for (n = 0; n < num_buffers; n++)
+        engine->blocks[n].data = memory + n * buffer_size;
+
+    return engine;
+}
+
+void
+gdu_copy_engine_free (GduCopyEngine *engine)
+{
+    if (engine == NULL)
+        return;
+
+    g_async_queue_unref (engine->free_queue);
+    g_async_queue_unref (engine->full_queue);
+    g_async_queue_unref (engine->hash_queue);
+    g_clear_error (&engine->writer_error);
+    g_free (engine->num_users);
+    g_free (engine->blocks);
+    g_free (engine->memory_unaligned);
+    g_free (engine);
+}
+
+/**
+ * gdu_copy_engine_set_auto_tune:
+ * @engine: A #GduCopyEngine.
+ * @min_block_size: The block size to start tuning with or 0 to disable tuning.
+ *
+ * Makes gdu_copy_engine_run() measure the throughput of block sizes between
+ * @min_block_size and the buffer size of @engine during the first seconds of
+ * the copy and use the fastest one for the rest of it.
+ */
+void
+gdu_copy_engine_set_auto_tune (GduCopyEngine *engine, gsize min_block_size)
+{
+    g_return_if_fail (engine != NULL);
+
+    engine->tune_min_block_size = MIN (min_block_size, engine->buffer_size);
+}
+
+/**
+ * gdu_copy_engine_set_block_size:
+ * @engine: A #GduCopyEngine.
+ * @block_size: The block size to copy in or 0 to use the buffer size.
+ *
+ * Makes gdu_copy_engine_run() copy in blocks of @block_size, e.g. to read
+ * single sectors. This has no effect while tuning the block size.
+ */
+void
+gdu_copy_engine_set_block_size (GduCopyEngine *engine, gsize block_size)
+{
+    g_return_if_fail (engine != NULL);
+
+    engine->fixed_block_size = MIN (block_size, engine->buffer_size);
+}
+
+/**
+ * gdu_copy_engine_set_checksum:
+ * @engine: A #GduCopyEngine.
+ * @checksum: (nullable): The checksum to update or %NULL to not compute one.
+ * @size: The size of the data to hash.
+ *
+ * Makes gdu_copy_engine_run() add all blocks to @checksum, in order and on a
+ * thread of its own. The ranges before, between and after the extents (up to
+ * @size) are added as zeroes, so @checksum is the one of @size bytes of data
+ * that is only copied where the extents are, e.g. a sparse disk image. The
+ * trailing zeroes are only added if the copy succeeds.
+ */
+void
+gdu_copy_engine_set_checksum (GduCopyEngine *engine, GChecksum *checksum, guint64 size)
+{
+    g_return_if_fail (engine != NULL);
+
+    engine->checksum = checksum;
+    engine->checksum_size = size;
+    engine->checksum_offset = 0;
+}
+
+/**
+ * gdu_copy_block_is_zero:
+ * @block: A #GduCopyBlock.
+ *
+ * Checks whether @block only contains zeroes.
+ *
+ * Returns: %TRUE if all bytes of @block are zero.
+ */
+gboolean
+gdu_copy_block_is_zero (const GduCopyBlock *block)
+{
+    static const guchar zeroes[16] = { 0 };
+
+    if (block->size < sizeof zeroes)
+        return memcmp (block->data, zeroes, block->size) == 0;
+
+    /* If the first 16 bytes are zero and every byte equals the one 16 bytes
+     * before it, the whole block is zero. Comparing the block with itself
+     * like this lets the vectorized memcmp() scan it in a single pass.
+     */
+    if (memcmp (block->data, zeroes, sizeof zeroes) != 0)
+        return FALSE;
+
+    return memcmp (block->data, block->data + sizeof zeroes, block->size - sizeof zeroes) == 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+tune_reset (GduCopyEngine *engine)
+{
+    engine->tune_settled = engine->tune_min_block_size == 0;
+    if (!engine->tune_settled)
+        engine->block_size = engine->tune_min_block_size;
+    else if (engine->fixed_block_size > 0)
+        engine->block_size = engine->fixed_block_size;
+    else
+        engine->block_size = engine->buffer_size;
+    engine->tune_best_block_size = engine->block_size;
+    engine->tune_best_rate = 0;
+    engine->tune_num_worse = 0;
+    engine->tune_probe_start_usec = 0;
+    engine->tune_probe_bytes = 0;
+    engine->tune_probe_blocks = 0;
+}
+
+/* Called by the reader stage after a block of the current block size has been read */
+static void
+tune_add_block (GduCopyEngine *engine, gsize size)
+{
+    gint64 now_usec;
+    guint64 rate;
+
+    if (engine->tune_settled)
+        return;
+
+    now_usec = g_get_monotonic_time ();
+    if (engine->tune_probe_start_usec == 0) {
+        /* the first block of a probe period only marks its start */
+        engine->tune_probe_start_usec = now_usec;
+        return;
+    }
+
+    engine->tune_probe_bytes += size;
+    engine->tune_probe_blocks++;
+    if (engine->tune_probe_blocks < TUNE_PROBE_MIN_BLOCKS
+        || now_usec - engine->tune_probe_start_usec < TUNE_PROBE_USEC)
+        return;
+
+    /* The reader stage can only get ahead of the writer stage by the number
+     * of buffers, so this is the throughput of the whole pipeline.
+     */
+    rate = engine->tune_probe_bytes * G_USEC_PER_SEC / (now_usec - engine->tune_probe_start_usec);
+    g_debug ("Block size %" G_GSIZE_FORMAT " KiB: %" G_GUINT64_FORMAT " KiB/s", engine->block_size / 1024,
+             rate / 1024);
+
+    if (rate * 100 > engine->tune_best_rate * (100 + TUNE_MIN_GAIN)) {
+        engine->tune_best_rate = rate;
+        engine->tune_best_block_size = engine->block_size;
+        engine->tune_num_worse = 0;
+    } else {
+        engine->tune_num_worse++;
+    }
+
+    /* Stop when two larger sizes in a row did not help or the buffers are exhausted */
+    if (engine->tune_num_worse >= 2 || engine->block_size * 2 > engine->buffer_size) {
+        engine->block_size = engine->tune_best_block_size;
+        engine->tune_settled = TRUE;
+        g_debug ("Settled on block size %" G_GSIZE_FORMAT " KiB", engine->block_size / 1024);
+        return;
+    }
+
+    engine->block_size *= 2;
+    engine->tune_probe_start_usec = 0;
+    engine->tune_probe_bytes = 0;
+    engine->tune_probe_blocks = 0;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Called by the writer and checksum stage when they are done with @block */
+static void
+release_block (GduCopyEngine *engine, GduCopyBlock *block)
+{
+    if (g_atomic_int_dec_and_test (&engine->num_users[block - engine->blocks]))
+        g_async_queue_push (engine->free_queue, block);
+}
+
+static void
+checksum_add_zeroes (GduCopyEngine *engine, guint64 end)
+{
+    static const guchar zeroes[64 * 1024] = { 0 };
+
+    while (engine->checksum_offset < end) {
+        gsize num_bytes = MIN (end - engine->checksum_offset, sizeof zeroes);
+
+        g_checksum_update (engine->checksum, zeroes, num_bytes);
+        engine->checksum_offset += num_bytes;
+    }
+}
+
+static gpointer
+checksum_thread_func (gpointer user_data)
+{
+    GduCopyEngine *engine = user_data;
+
+    while (TRUE) {
+        GduCopyBlock *block;
+
+        block = g_async_queue_pop (engine->hash_queue);
+        if (block == &end_of_stream)
+            break;
+
+        checksum_add_zeroes (engine, block->offset);
+        g_checksum_update (engine->checksum, block->data, block->size);
+        engine->checksum_offset = block->offset + block->size;
+
+        release_block (engine, block);
+    }
+
+    if (g_atomic_int_get (&engine->all_read) && !g_atomic_int_get (&engine->writer_failed))
+        checksum_add_zeroes (engine, engine->checksum_size);
+
+    return NULL;
+}
+
+static gpointer
+writer_thread_func (gpointer user_data)
+{
+    GduCopyEngine *engine = user_data;
+
+    while (TRUE) {
+        GduCopyBlock *block;
+
+        block = g_async_queue_pop (engine->full_queue);
+        if (block == &end_of_stream)
+            break;
+
+        /* Once the writer stage failed, keep recycling blocks until the
+         * reader stage notices so it never waits for a free buffer forever.
+         */
+        if (!g_atomic_int_get (&engine->writer_failed)) {
+            if (!engine->write_func (block, engine->user_data, engine->cancellable, &engine->writer_error))
+                g_atomic_int_set (&engine->writer_failed, TRUE);
+        }
+
+        release_block (engine, block);
+    }
+
+    return NULL;
+}
+
+/**
+ * gdu_copy_engine_run:
+ * @engine: A #GduCopyEngine.
+ * @extents: (array length=num_extents): The extents to copy, sorted by offset.
+ * @num_extents: Number of elements in @extents.
+ * @read_func: Function called in the calling thread to fill a block.
+ * @write_func: Function called in the writer thread to consume a block.
+ * @user_data: User data for @read_func and @write_func.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for error.
+ *
+ * Copies @extents in blocks of at most the buffer size of @engine. A block
+ * never spans more than one extent. Blocks are handed to @write_func in order.
+ * @write_func must not modify the blocks, they may be hashed at the same time
+ * (see gdu_copy_engine_set_checksum()).
+ *
+ * If gdu_copy_engine_set_auto_tune() was called, blocks may be smaller than
+ * the buffer size. All blocks but the last of each extent are multiples of
+ * the minimum block size.
+ *
+ * Returns: %TRUE if all blocks were read and written, %FALSE if @error is set.
+ */
+gboolean
+gdu_copy_engine_run (GduCopyEngine *engine, const GduCopyExtent *extents, guint num_extents,
+                     GduCopyReadFunc read_func, GduCopyWriteFunc write_func, gpointer user_data,
+                     GCancellable *cancellable, GError **error)
+{
+    GThread *writer_thread;
+    GThread *checksum_thread = NULL;
+    GError *local_error = NULL;
+    guint n;
+
+    g_return_val_if_fail (engine != NULL, FALSE);
+    g_return_val_if_fail (extents != NULL || num_extents == 0, FALSE);
+    g_return_val_if_fail (read_func != NULL && write_func != NULL, FALSE);
+    g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+    engine->write_func = write_func;
+    engine->user_data = user_data;
+    engine->cancellable = cancellable;
+    engine->writer_failed = FALSE;
+    engine->all_read = FALSE;
+    g_clear_error (&engine->writer_error);
+    tune_reset (engine);
+
+    for (n = 0; n < engine->num_buffers; n++)
+        g_async_queue_push (engine->free_queue, &engine->blocks[n]);
+
+    writer_thread = g_thread_new ("copy-writer", writer_thread_func, engine);
+    if (engine->checksum != NULL)
+        checksum_thread = g_thread_new ("copy-checksum", checksum_thread_func, engine);
+
+    for (n = 0; n < num_extents; n++) {
+        guint64 offset = extents[n].offset;
+        guint64 end = extents[n].offset + extents[n].size;
+
+        while (offset < end) {
+            GduCopyBlock *block;
+
+            if (g_atomic_int_get (&engine->writer_failed))
+                goto out;
+
+            if (g_cancellable_set_error_if_cancelled (cancellable, &local_error))
+                goto out;
+
+            block = g_async_queue_pop (engine->free_queue);
+            block->offset = offset;
+            block->size = MIN (engine->block_size, end - offset);
+            block->num_read = 0;
+            block->skipped = FALSE;
+
+            if (!read_func (block, user_data, cancellable, &local_error)) {
+                g_async_queue_push (engine->free_queue, block);
+                goto out;
+            }
+
+            engine->num_users[block - engine->blocks] = checksum_thread != NULL ? 2 : 1;
+            g_async_queue_push (engine->full_queue, block);
+            if (checksum_thread != NULL)
+                g_async_queue_push (engine->hash_queue, block);
+            offset += block->size;
+
+            tune_add_block (engine, block->size);
+        }
+    }
+    g_atomic_int_set (&engine->all_read, TRUE);
+
+out:
+    g_async_queue_push (engine->full_queue, &end_of_stream);
+    g_thread_join (writer_thread);
+    if (checksum_thread != NULL) {
+        g_async_queue_push (engine->hash_queue, &end_of_stream);
+        g_thread_join (checksum_thread);
+    }
+
+    /* All blocks are back on the free queue now, the next run pushes them again */
+    while (g_async_queue_try_pop (engine->free_queue) != NULL)
+        ;
+
+    /* An error of the reader stage takes precedence */
+    if (local_error == NULL && engine->writer_failed)
+        local_error = g_steal_pointer (&engine->writer_error);
+    g_clear_error (&engine->writer_error);
+
+    if (local_error != NULL) {
+        g_propagate_error (error, local_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -0,0 +1,55 @@
+/* gducopyengine.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+    /* page-aligned, valid for the lifetime of the engine */
+    guchar *data;
+    guint64 offset;
+    gsize size;
+    /* number of bytes actually read, the rest of the block is padding */
+    gsize num_read;
+    /* set by the read function if it did not try to read the block at all */
+    gboolean skipped;
+} GduCopyBlock;
+
+typedef struct {
+    guint64 offset;
+    guint64 size;
+} GduCopyExtent;
+
+/* Called in the reader stage to fill @block->data with @block->size bytes from @block->offset.
+ * Called in the writer stage to consume a block previously filled by the reader stage.
+ *
+ * Both return FALSE and set @error to abort the copy. */
+typedef gboolean (*GduCopyReadFunc) (GduCopyBlock *block, gpointer user_data, GCancellable *cancellable,
+                                     GError **error);
+typedef gboolean (*GduCopyWriteFunc) (GduCopyBlock *block, gpointer user_data, GCancellable *cancellable,
+                                      GError **error);
+
+GduCopyEngine *gdu_copy_engine_new (guint num_buffers, gsize buffer_size);
+void gdu_copy_engine_free (GduCopyEngine *engine);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GduCopyEngine, gdu_copy_engine_free)
+
+void gdu_copy_engine_set_auto_tune (GduCopyEngine *engine, gsize min_block_size);
+void gdu_copy_engine_set_block_size (GduCopyEngine *engine, gsize block_size);
+void gdu_copy_engine_set_checksum (GduCopyEngine *engine, GChecksum *checksum, guint64 size);
+
+gboolean gdu_copy_block_is_zero (const GduCopyBlock *block);
+
+gboolean gdu_copy_engine_run (GduCopyEngine *engine, const GduCopyExtent *extents, guint num_extents,
+                              GduCopyReadFunc read_func, GduCopyWriteFunc write_func, gpointer user_data,
+                              GCancellable *cancellable, GError **error);
+
+G_END_DECLS
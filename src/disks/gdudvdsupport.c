@@ -12,6 +12,7 @@
 
 #include <dvdread/dvd_reader.h>
 #include <dvdread/dvd_udf.h>
+#include <dvdread/ifo_read.h>
 #include <glib-unix.h>
 #include <gmodule.h>
 #include <linux/fs.h>
@@ -77,6 +78,8 @@ typedef struct Range {
     guint64 start;
     guint64 end;
     gboolean scrambled;
+    /* the title set of title VOB files, which all use the same key, or 0 */
+    guint title_set;
 } Range;
 
 static gint
@@ -105,11 +108,32 @@ struct GduDVDSupport {
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* VIDEO_TS.IFO knows how many title sets the disc has, so the VOB files of the other title sets don't
+ * have to be looked up. If it can't be read, e.g. on a damaged disc, all 99 possible title sets are tried.
+ */
+static guint
+get_num_title_sets (GduDVDSupport *support)
+{
+    ifo_handle_t *vmg;
+    guint num_title_sets = 99;
+
+    vmg = ifoOpenVMGI (support->dvd);
+    if (vmg == NULL)
+        return num_title_sets;
+
+    if (vmg->vmgi_mat != NULL && vmg->vmgi_mat->vmg_nr_of_title_sets > 0)
+        num_title_sets = MIN (vmg->vmgi_mat->vmg_nr_of_title_sets, 99);
+    ifoClose (vmg);
+
+    return num_title_sets;
+}
+
 GduDVDSupport *
 gdu_dvd_support_new (const gchar *device_file, guint64 device_size)
 {
     GduDVDSupport *support = NULL;
     guint title;
+    guint num_title_sets;
     GList *scrambled_ranges = NULL;
     GList *l;
     guint64 pos;
@@ -165,12 +189,15 @@ gdu_dvd_support_new (const gchar *device_file, guint64 device_size)
      * fact that VOB files are in a known format, e.g. title 0 is always
      * VIDEO_TS.VOB and title 1 through 99 are always of the form
      * VTS_NN_M.VOB where 01 <= N <= 99 and 0 <= M <= 9. This way we can
-     * simply use libdvdread's UDFFindFile() function on all 991
-     * possible filenames...
+     * simply use libdvdread's UDFFindFile() function on the possible
+     * filenames. Since VIDEO_TS.IFO tells how many title sets there are
+     * and the parts of a title are numbered without gaps, only a few of
+     * the 991 possible filenames have to be looked up...
      *
      * See http://en.wikipedia.org/wiki/VOB for how VOB files work.
      */
-    for (title = 0; title <= 99; title++) {
+    num_title_sets = get_num_title_sets (support);
+    for (title = 0; title <= num_title_sets; title++) {
         gint part;
         Range *range;
 
@@ -189,11 +216,12 @@ gdu_dvd_support_new (const gchar *device_file, guint64 device_size)
             }
 
             vob_sector_offset = UDFFindFile (support->dvd, vob_filename, &vob_size);
-            if (vob_sector_offset == 0)
+            if (vob_sector_offset == 0) {
+                /* only the menu (part 0) is optional */
+                if (part > 0)
+                    break;
                 continue;
-
-            if (dvdcss_seek (support->dvdcss, vob_sector_offset, DVDCSS_SEEK_KEY) != (int) vob_sector_offset)
-                goto fail;
+            }
 
             if (vob_size == 0)
                 continue;
@@ -206,6 +234,8 @@ gdu_dvd_support_new (const gchar *device_file, guint64 device_size)
             range->start = vob_sector_offset * 2048ULL;
             range->end = range->start + rounded_vob_size;
             range->scrambled = TRUE;
+            if (title > 0 && part > 0)
+                range->title_set = title;
 
             if (G_UNLIKELY (support->debug)) {
                 g_print ("%s: %10" G_GUINT64_FORMAT " -> %10" G_GUINT64_FORMAT ": scrambled=%d\n", vob_filename,
@@ -250,6 +280,32 @@ gdu_dvd_support_new (const gchar *device_file, guint64 device_size)
         l = next;
     }
 
+    /* ... merge the title VOB files of each title set, which are contiguous and use the same key, so
+     * they are read in large requests with a single key change - on dual layer discs a title set can
+     * be several GB ...
+     */
+    l = scrambled_ranges;
+    while (l != NULL && l->next != NULL) {
+        Range *range = l->data;
+        Range *next = l->next->data;
+
+        if (range->title_set != 0 && next->title_set == range->title_set && next->start == range->end) {
+            range->end = next->end;
+            g_free (next);
+            scrambled_ranges = g_list_delete_link (scrambled_ranges, l->next);
+        } else {
+            l = l->next;
+        }
+    }
+
+    /* ... get the key of every range, libdvdcss caches them for when we're reading ... */
+    for (l = scrambled_ranges; l != NULL; l = l->next) {
+        gint block_offset = ((Range *) l->data)->start / 2048;
+
+        if (dvdcss_seek (support->dvdcss, block_offset, DVDCSS_SEEK_KEY) != block_offset)
+            goto fail;
+    }
+
     /* ... and build an array of ranges covering the entire disc */
     a = g_array_new (FALSE, /* zero-terminated */
                      FALSE, /* clear */
@@ -306,6 +362,29 @@ gdu_dvd_support_free (GduDVDSupport *support)
 
 /* ---------------------------------------------------------------------------------------------------- */
 
+/* The ranges are sorted and cover the entire disc without gaps, so the range of @offset is found by
+ * bisection. Returns num_ranges if @offset is beyond the end of the disc.
+ */
+static guint
+find_range (GduDVDSupport *support, guint64 offset)
+{
+    guint low = 0;
+    guint high = support->num_ranges;
+
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+
+        if (offset < support->ranges[mid].start)
+            high = mid;
+        else if (offset >= support->ranges[mid].end)
+            low = mid + 1;
+        else
+            return mid;
+    }
+
+    return support->num_ranges;
+}
+
 gssize
 gdu_dvd_support_read (GduDVDSupport *support, gint fd, guchar *buffer, guint64 offset, guint64 size)
 {
@@ -326,11 +405,7 @@ gdu_dvd_support_read (GduDVDSupport *support, gint fd, guchar *buffer, guint64 o
         && offset < support->last_read_range->end) {
         n = support->last_read_range - support->ranges;
     } else {
-        /* Otherwise look through all ranges, starting form the first */
-        for (n = 0; n < support->num_ranges; n++) {
-            if (offset >= support->ranges[n].start && offset < support->ranges[n].end)
-                break;
-        }
+        n = find_range (support, offset);
     }
 
     /* Break the read request into multiple requests not crossing any of
@@ -400,10 +475,8 @@ gdu_dvd_support_read (GduDVDSupport *support, gint fd, guchar *buffer, guint64 o
             g_assert (num_blocks_read <= num_blocks_to_request);
             num_bytes_read = num_blocks_read * 2048;
         } else {
-            if (lseek (fd, cur_offset, SEEK_SET) == (off_t) -1)
-                goto out;
         read_again:
-            num_bytes_read = read (fd, cur_buffer, num_to_read_in_range);
+            num_bytes_read = pread (fd, cur_buffer, num_to_read_in_range, cur_offset);
             if (num_bytes_read < 0) {
                 if (errno == EAGAIN || errno == EINTR)
                     goto read_again;
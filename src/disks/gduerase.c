@@ -0,0 +1,690 @@
+/* gduerase.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gduerase.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+
+#include <gio/gunixfdlist.h>
+#include <glib/gi18n.h>
+#include <linux/fs.h>
+
+/* Erases a whole device with the fastest method that makes sure the data can't be recovered:
+ *
+ * - ATA drives erase themselves with the (Enhanced) Security Erase Unit command, unless the
+ *   security feature set is frozen
+ * - NVMe namespaces are formatted with a cryptographic erase, or a user data erase if the
+ *   controller can't do that
+ * - eMMC devices that support secure discard discard all blocks with BLKSECDISCARD
+ * - everything else is overwritten with zeroes by several threads at once, so the queue of the
+ *   device is kept busy
+ *
+ * A plain BLKDISCARD is never used, since it only tells the device that the data is no longer
+ * needed and the device may still return or keep it.
+ */
+
+#define OVERWRITE_BLOCK_SIZE (4 * 1024 * 1024)
+#define OVERWRITE_MAX_THREADS 4
+/* BLKSECDISCARD and BLKZEROOUT are issued in chunks of this size so progress can be reported */
+#define RANGE_CHUNK_SIZE (1024 * 1024 * 1024)
+/* How often progress is estimated while the device erases itself */
+#define OPAQUE_UPDATE_USEC (500 * G_USEC_PER_SEC / 1000)
+
+static UDisksDriveAta *
+get_drive_ata (UDisksClient *client, UDisksObject *object)
+{
+    g_autoptr(UDisksDrive) drive = NULL;
+    GDBusObject *drive_object;
+
+    drive = udisks_client_get_drive_for_block (client, udisks_object_peek_block (object));
+    if (drive == NULL)
+        return NULL;
+
+    drive_object = g_dbus_interface_get_object (G_DBUS_INTERFACE (drive));
+    if (drive_object == NULL)
+        return NULL;
+
+    return udisks_object_get_drive_ata (UDISKS_OBJECT (drive_object));
+}
+
+/* Reads the sysfs attribute @name (ex. "queue/discard_max_bytes") of @block, or returns NULL */
+static gchar *
+read_sysfs_attribute (UDisksBlock *block, const gchar *name)
+{
+    guint64 device_number;
+    g_autofree gchar *dev_path = NULL;
+    g_autofree gchar *path = NULL;
+    gchar *contents = NULL;
+
+    device_number = udisks_block_get_device_number (block);
+    dev_path = g_strdup_printf ("/sys/dev/block/%u:%u", major (device_number), minor (device_number));
+    path = g_build_filename (dev_path, name, NULL);
+    if (!g_file_get_contents (path, &contents, NULL, NULL)) {
+        /* partitions have no queue or device of their own, they belong to the whole disk */
+        g_free (path);
+        path = g_build_filename (dev_path, "..", name, NULL);
+        if (!g_file_get_contents (path, &contents, NULL, NULL))
+            return NULL;
+    }
+
+    return g_strstrip (contents);
+}
+
+static gboolean
+has_nonzero_sysfs_attribute (UDisksBlock *block, const gchar *name)
+{
+    g_autofree gchar *value = read_sysfs_attribute (block, name);
+
+    return value != NULL && g_ascii_strtoull (value, NULL, 10) > 0;
+}
+
+/* Only eMMC has a secure erase the kernel issues for BLKSECDISCARD, most SSDs can discard but not securely.
+ * Whether a particular eMMC device supports it is only known once it's tried.
+ */
+static gboolean
+may_support_secure_discard (UDisksBlock *block)
+{
+    g_autofree gchar *type = NULL;
+
+    if (!has_nonzero_sysfs_attribute (block, "queue/discard_max_bytes"))
+        return FALSE;
+
+    type = read_sysfs_attribute (block, "device/type");
+    return g_strcmp0 (type, "MMC") == 0;
+}
+
+GduEraseMethod
+gdu_erase_get_method (UDisksClient *client, UDisksObject *object)
+{
+    g_autoptr(UDisksDriveAta) ata = NULL;
+    UDisksBlock *block;
+
+    block = udisks_object_peek_block (object);
+    g_return_val_if_fail (block != NULL, GDU_ERASE_METHOD_OVERWRITE);
+
+    /* a frozen drive rejects the command until it is power cycled */
+    ata = get_drive_ata (client, object);
+    if (ata != NULL && !udisks_drive_ata_get_security_frozen (ata)) {
+        if (udisks_drive_ata_get_security_enhanced_erase_unit_minutes (ata) > 0)
+            return GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE;
+        if (udisks_drive_ata_get_security_erase_unit_minutes (ata) > 0)
+            return GDU_ERASE_METHOD_ATA_SECURE_ERASE;
+    }
+
+#if UDISKS_CHECK_VERSION(2, 10, 0)
+    if (udisks_object_peek_nvme_namespace (object) != NULL)
+        return GDU_ERASE_METHOD_NVME_SECURE_ERASE;
+#endif
+
+    if (may_support_secure_discard (block))
+        return GDU_ERASE_METHOD_SECURE_DISCARD;
+
+    return GDU_ERASE_METHOD_OVERWRITE;
+}
+
+const gchar *
+gdu_erase_method_get_name (GduEraseMethod method)
+{
+    switch (method) {
+    case GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE:
+        return _("ATA Enhanced Secure Erase");
+    case GDU_ERASE_METHOD_ATA_SECURE_ERASE:
+        return _("ATA Secure Erase");
+    case GDU_ERASE_METHOD_NVME_SECURE_ERASE:
+        return _("NVMe Secure Erase");
+    case GDU_ERASE_METHOD_SECURE_DISCARD:
+        return _("Secure Discard");
+    case GDU_ERASE_METHOD_OVERWRITE:
+        return _("Overwrite with Zeroes");
+    }
+
+    g_return_val_if_reached (NULL);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The device erases itself, the call only returns once it's done */
+typedef struct {
+    UDisksClient *client;
+    UDisksObject *object;
+    GduEraseMethod method;
+    GCancellable *cancellable;
+
+    /* must hold lock when reading/writing these */
+    GMutex lock;
+    GCond cond;
+    gboolean done;
+    gboolean ret;
+    GError *error;
+} OpaqueData;
+
+/* Erasing takes minutes to hours, so unlike the udisks_*_call_*_sync() functions this never times out
+ * while the device is still at it
+ */
+static gboolean
+call_without_timeout (gpointer proxy, const gchar *method_name, GVariant *options, GCancellable *cancellable,
+                      GError **error)
+{
+    g_autoptr(GVariant) result = NULL;
+
+    result = g_dbus_proxy_call_sync (G_DBUS_PROXY (proxy), method_name, g_variant_new ("(@a{sv})", options),
+                                     G_DBUS_CALL_FLAGS_NONE, G_MAXINT, cancellable, error);
+    return result != NULL;
+}
+
+/* Only then nothing was erased and another method can be tried. After any other error the device may
+ * still be erasing, e.g. without a reply, or the user is to see it, e.g. for not authorizing the erase.
+ */
+static gboolean
+is_not_supported (const GError *error)
+{
+    return g_error_matches (error, UDISKS_ERROR, UDISKS_ERROR_NOT_SUPPORTED)
+           || g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)
+           || g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED)
+           || g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD);
+}
+
+static gboolean
+call_erase (OpaqueData *data, GError **error)
+{
+    GVariantBuilder options_builder;
+
+    g_variant_builder_init (&options_builder, G_VARIANT_TYPE_VARDICT);
+
+    if (data->method == GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE
+        || data->method == GDU_ERASE_METHOD_ATA_SECURE_ERASE) {
+        g_autoptr(UDisksDriveAta) ata = get_drive_ata (data->client, data->object);
+
+        if (ata == NULL) {
+            g_variant_builder_clear (&options_builder);
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, _("The drive is not an ATA drive"));
+            return FALSE;
+        }
+
+        g_variant_builder_add (&options_builder, "{sv}", "enhanced",
+                               g_variant_new_boolean (data->method == GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE));
+        /* not cancellable, see gdu_erase_method_is_cancelable() */
+        return call_without_timeout (ata, "SecurityEraseUnit", g_variant_builder_end (&options_builder), NULL,
+                                     error);
+    }
+
+#if UDISKS_CHECK_VERSION(2, 10, 0)
+    if (data->method == GDU_ERASE_METHOD_NVME_SECURE_ERASE) {
+        UDisksNVMeNamespace *nvme_namespace = udisks_object_peek_nvme_namespace (data->object);
+        g_autoptr(GError) crypto_error = NULL;
+        GVariantBuilder user_data_builder;
+
+        if (nvme_namespace == NULL) {
+            g_variant_builder_clear (&options_builder);
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, _("The device is not an NVMe namespace"));
+            return FALSE;
+        }
+
+        /* destroying the encryption key is instant, not every controller can do that though */
+        g_variant_builder_add (&options_builder, "{sv}", "secure_erase", g_variant_new_string ("crypto_erase"));
+        if (call_without_timeout (nvme_namespace, "FormatNamespace", g_variant_builder_end (&options_builder),
+                                  data->cancellable, &crypto_error))
+            return TRUE;
+        if (!is_not_supported (crypto_error)) {
+            g_propagate_error (error, g_steal_pointer (&crypto_error));
+            return FALSE;
+        }
+        g_info ("Cryptographic erase failed, erasing user data instead: %s", crypto_error->message);
+
+        g_variant_builder_init (&user_data_builder, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add (&user_data_builder, "{sv}", "secure_erase", g_variant_new_string ("user_data"));
+        return call_without_timeout (nvme_namespace, "FormatNamespace", g_variant_builder_end (&user_data_builder),
+                                     data->cancellable, error);
+    }
+#endif
+
+    g_variant_builder_clear (&options_builder);
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Unsupported erase method %d", data->method);
+    return FALSE;
+}
+
+static gpointer
+opaque_thread_func (gpointer user_data)
+{
+    OpaqueData *data = user_data;
+    GError *error = NULL;
+    gboolean ret;
+
+    ret = call_erase (data, &error);
+
+    g_mutex_lock (&data->lock);
+    data->ret = ret;
+    data->error = error;
+    data->done = TRUE;
+    g_cond_signal (&data->cond);
+    g_mutex_unlock (&data->lock);
+
+    return NULL;
+}
+
+/* The time the drive estimates for erasing itself, or 0 if unknown */
+static gint64
+get_estimated_usec (OpaqueData *data)
+{
+    g_autoptr(UDisksDriveAta) ata = NULL;
+    gint minutes = 0;
+
+    ata = get_drive_ata (data->client, data->object);
+    if (ata == NULL)
+        return 0;
+
+    if (data->method == GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE)
+        minutes = udisks_drive_ata_get_security_enhanced_erase_unit_minutes (ata);
+    else if (data->method == GDU_ERASE_METHOD_ATA_SECURE_ERASE)
+        minutes = udisks_drive_ata_get_security_erase_unit_minutes (ata);
+
+    return minutes * 60LL * G_USEC_PER_SEC;
+}
+
+/* Progress is interpolated from the estimate of the drive, but never reaches 100% before the drive is
+ * done. Without an estimate all of the device counts as erased once it's done.
+ */
+static gboolean
+erase_opaque (UDisksClient *client, UDisksObject *object, GduEraseMethod method, guint64 size,
+              GduEraseProgressFunc progress_func, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    OpaqueData data = { 0 };
+    GThread *thread;
+    gint64 start_usec;
+    gint64 estimated_usec;
+    guint64 num_bytes_reported = 0;
+    gboolean ret;
+
+    data.client = client;
+    data.object = object;
+    data.method = method;
+    data.cancellable = cancellable;
+    g_mutex_init (&data.lock);
+    g_cond_init (&data.cond);
+
+    estimated_usec = get_estimated_usec (&data);
+    start_usec = g_get_monotonic_time ();
+
+    thread = g_thread_new ("erase-opaque", opaque_thread_func, &data);
+
+    g_mutex_lock (&data.lock);
+    while (!data.done) {
+        guint64 num_bytes;
+
+        if (g_cond_wait_until (&data.cond, &data.lock, g_get_monotonic_time () + OPAQUE_UPDATE_USEC)
+            || estimated_usec == 0)
+            continue;
+
+        num_bytes = size * MIN ((gdouble) (g_get_monotonic_time () - start_usec) / estimated_usec, 0.99);
+        if (num_bytes > num_bytes_reported) {
+            progress_func (num_bytes - num_bytes_reported, user_data);
+            num_bytes_reported = num_bytes;
+        }
+    }
+    g_mutex_unlock (&data.lock);
+
+    g_thread_join (thread);
+
+    ret = data.ret;
+    if (ret)
+        progress_func (size - num_bytes_reported, user_data);
+    else
+        g_propagate_error (error, data.error);
+
+    g_mutex_clear (&data.lock);
+    g_cond_clear (&data.cond);
+
+    return ret;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Issues @request (BLKSECDISCARD or BLKZEROOUT) for all of the device, so the device
+ * erases the data itself
+ */
+static gboolean
+erase_ranges (gint fd, gulong request, guint64 size, GduEraseProgressFunc progress_func, gpointer user_data,
+              GCancellable *cancellable, GError **error)
+{
+    guint64 offset;
+
+    for (offset = 0; offset < size; offset += RANGE_CHUNK_SIZE) {
+        guint64 range[2];
+
+        if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+        range[0] = offset;
+        range[1] = MIN (RANGE_CHUNK_SIZE, size - offset);
+        if (ioctl (fd, request, range) != 0) {
+            gint errsv = errno;
+
+            /* only fall back to overwriting if nothing was erased yet */
+            g_set_error (error, G_IO_ERROR, offset == 0 ? g_io_error_from_errno (errsv) : G_IO_ERROR_FAILED, "%s",
+                         g_strerror (errsv));
+            g_prefix_error (error, _("Error erasing data at offset %" G_GUINT64_FORMAT ": "), offset);
+            return FALSE;
+        }
+
+        progress_func (range[1], user_data);
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+typedef struct {
+    gint fd;
+    guint64 size;
+    GduEraseProgressFunc progress_func;
+    gpointer user_data;
+    GCancellable *cancellable;
+
+    /* must hold lock when reading/writing these */
+    GMutex lock;
+    guint64 next_offset;
+    GError *error;
+} OverwriteData;
+
+static gboolean
+write_all_at (gint fd, const guchar *buffer, gsize size, guint64 offset, GError **error)
+{
+    while (size > 0) {
+        gssize num_bytes_written;
+
+        num_bytes_written = pwrite (fd, buffer, size, offset);
+        if (num_bytes_written < 0) {
+            gint errsv = errno;
+
+            if (errsv == EINTR || errsv == EAGAIN)
+                continue;
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+            g_prefix_error (error, _("Error writing %" G_GSIZE_FORMAT " bytes to offset %" G_GUINT64_FORMAT ": "),
+                            size, offset);
+            return FALSE;
+        }
+
+        buffer += num_bytes_written;
+        size -= num_bytes_written;
+        offset += num_bytes_written;
+    }
+
+    return TRUE;
+}
+
+/* Every thread takes the next block until the whole device is written or one of them fails */
+static gpointer
+overwrite_thread_func (gpointer user_data)
+{
+    OverwriteData *data = user_data;
+    guchar *buffer_unaligned;
+    guchar *buffer;
+    glong page_size;
+
+    /* page-aligned for O_DIRECT */
+    page_size = sysconf (_SC_PAGESIZE);
+    buffer_unaligned = g_new0 (guchar, OVERWRITE_BLOCK_SIZE + page_size);
+    buffer = (guchar *) (((gintptr) (buffer_unaligned + page_size)) & (~(page_size - 1)));
+
+    while (TRUE) {
+        GError *error = NULL;
+        guint64 offset;
+        gsize size;
+
+        g_mutex_lock (&data->lock);
+        offset = data->next_offset;
+        if (data->error != NULL || offset >= data->size) {
+            g_mutex_unlock (&data->lock);
+            break;
+        }
+        size = MIN (OVERWRITE_BLOCK_SIZE, data->size - offset);
+        data->next_offset += size;
+        g_mutex_unlock (&data->lock);
+
+        if (g_cancellable_set_error_if_cancelled (data->cancellable, &error)
+            || !write_all_at (data->fd, buffer, size, offset, &error)) {
+            g_mutex_lock (&data->lock);
+            if (data->error == NULL)
+                data->error = error;
+            else
+                g_error_free (error);
+            g_mutex_unlock (&data->lock);
+            break;
+        }
+
+        data->progress_func (size, data->user_data);
+    }
+
+    g_free (buffer_unaligned);
+
+    return NULL;
+}
+
+static gboolean
+erase_overwrite (gint fd, guint64 size, GduEraseProgressFunc progress_func, gpointer user_data,
+                 GCancellable *cancellable, GError **error)
+{
+    OverwriteData data = { 0 };
+    GThread *threads[OVERWRITE_MAX_THREADS];
+    guint num_threads;
+    gint flags;
+    guint n;
+
+    data.fd = fd;
+    data.size = size;
+    data.progress_func = progress_func;
+    data.user_data = user_data;
+    data.cancellable = cancellable;
+    g_mutex_init (&data.lock);
+
+    /* Zeroes don't need to go through the page cache. The size of a block device is a multiple of its
+     * logical block size, so every write is aligned.
+     */
+    flags = fcntl (fd, F_GETFL);
+    if (flags == -1 || fcntl (fd, F_SETFL, flags | O_DIRECT) != 0)
+        g_info ("Not using direct I/O for overwriting the device: %s", g_strerror (errno));
+
+    num_threads = CLAMP (g_get_num_processors (), 1, OVERWRITE_MAX_THREADS);
+    for (n = 0; n < num_threads; n++)
+        threads[n] = g_thread_new ("erase-overwrite", overwrite_thread_func, &data);
+    for (n = 0; n < num_threads; n++)
+        g_thread_join (threads[n]);
+
+    if (data.error == NULL && fsync (fd) != 0) {
+        gint errsv = errno;
+
+        g_set_error (&data.error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+        g_prefix_error (&data.error, _("Error syncing device: "));
+    }
+
+    g_mutex_clear (&data.lock);
+
+    if (data.error != NULL) {
+        g_propagate_error (error, data.error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Opens @block for writing and returns its size in @out_size */
+static gint
+open_device (UDisksBlock *block, guint64 *out_size, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GUnixFDList) fd_list = NULL;
+    g_autoptr(GVariant) fd_index = NULL;
+    gint fd;
+
+    if (!udisks_block_call_open_for_restore_sync (block, g_variant_new ("a{sv}", NULL), /* options */
+                                                  NULL,                                 /* fd_list */
+                                                  &fd_index, &fd_list, cancellable, error))
+        return -1;
+
+    fd = g_unix_fd_list_get (fd_list, g_variant_get_handle (fd_index), error);
+    if (fd == -1) {
+        g_prefix_error (error, "Error extracing fd with handle %d from D-Bus message: ",
+                        g_variant_get_handle (fd_index));
+        return -1;
+    }
+
+    /* The media may have changed since udisks looked at it */
+    if (ioctl (fd, BLKGETSIZE64, out_size) != 0) {
+        gint errsv = errno;
+
+        g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+        g_prefix_error (error, _("Error determining size of device: "));
+        close (fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/* Once started, a drive doesn't stop an ATA Security Erase Unit until it's done, even if the call is
+ * abandoned, and rejects I/O until then
+ */
+gboolean
+gdu_erase_method_is_cancelable (GduEraseMethod method)
+{
+    return method != GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE && method != GDU_ERASE_METHOD_ATA_SECURE_ERASE;
+}
+
+/* Erases all of @object with @method, see gdu_erase_get_method().
+ *
+ * If the method turns out not to be supported by the device, the next method that is tried is
+ * returned in @method. @progress_func is called from this thread or threads of its own.
+ */
+gboolean
+gdu_erase_object (UDisksClient *client, UDisksObject *object, GduEraseMethod *method,
+                  GduEraseProgressFunc progress_func, gpointer user_data, GCancellable *cancellable,
+                  GError **error)
+{
+    GError *local_error = NULL;
+    UDisksBlock *block;
+    guint64 size = 0;
+    gboolean ret = FALSE;
+    gint fd = -1;
+
+    g_return_val_if_fail (UDISKS_IS_OBJECT (object), FALSE);
+    g_return_val_if_fail (method != NULL, FALSE);
+
+    block = udisks_object_peek_block (object);
+    g_return_val_if_fail (block != NULL, FALSE);
+
+    if (*method == GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE || *method == GDU_ERASE_METHOD_ATA_SECURE_ERASE) {
+        ret = erase_opaque (client, object, *method, udisks_block_get_size (block), progress_func, user_data,
+                            cancellable, error);
+        goto out;
+    }
+
+    if (*method == GDU_ERASE_METHOD_NVME_SECURE_ERASE) {
+        if (erase_opaque (client, object, *method, udisks_block_get_size (block), progress_func, user_data,
+                          cancellable, &local_error)) {
+            ret = TRUE;
+            goto out;
+        }
+        if (!is_not_supported (local_error)) {
+            g_propagate_error (error, local_error);
+            goto out;
+        }
+        /* the controller doesn't support formatting, nothing was erased */
+        g_info ("NVMe secure erase failed, overwriting the device instead: %s", local_error->message);
+        g_clear_error (&local_error);
+        *method = GDU_ERASE_METHOD_OVERWRITE;
+    }
+
+    fd = open_device (block, &size, cancellable, error);
+    if (fd == -1)
+        goto out;
+
+    if (*method == GDU_ERASE_METHOD_SECURE_DISCARD) {
+        if (erase_ranges (fd, BLKSECDISCARD, size, progress_func, user_data, cancellable, &local_error)) {
+            ret = TRUE;
+            goto out;
+        }
+        if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+            g_propagate_error (error, local_error);
+            goto out;
+        }
+        g_clear_error (&local_error);
+        *method = GDU_ERASE_METHOD_OVERWRITE;
+    }
+
+    ret = erase_overwrite (fd, size, progress_func, user_data, cancellable, error);
+
+out:
+    if (fd != -1)
+        close (fd);
+
+    /* make udisks forget the partitions and filesystems that are gone now */
+    if (ret && !udisks_block_call_rescan_sync (block, g_variant_new ("a{sv}", NULL), /* options */
+                                               NULL, &local_error)) {
+        g_warning ("Error rescanning device: %s", local_error->message);
+        g_clear_error (&local_error);
+    }
+
+    return ret;
+}
+
+/* Sets all of @object to zeroes, the way that is fastest for the device:
+ *
+ * - devices that zero ranges themselves (SCSI WRITE SAME, NVMe and ATA Write Zeroes) get BLKZEROOUT
+ * - all other devices are written with zeroes, see erase_overwrite()
+ *
+ * Unlike gdu_erase_object() this doesn't make sure the data can't be recovered, an SSD may keep the
+ * old data in flash memory until it reuses it.
+ */
+gboolean
+gdu_erase_zero_fill (UDisksObject *object, GduEraseProgressFunc progress_func, gpointer user_data,
+                     GCancellable *cancellable, GError **error)
+{
+    GError *local_error = NULL;
+    UDisksBlock *block;
+    guint64 size = 0;
+    gboolean ret = FALSE;
+    gint fd;
+
+    g_return_val_if_fail (UDISKS_IS_OBJECT (object), FALSE);
+
+    block = udisks_object_peek_block (object);
+    g_return_val_if_fail (block != NULL, FALSE);
+
+    fd = open_device (block, &size, cancellable, error);
+    if (fd == -1)
+        return FALSE;
+
+    /* BLKZEROOUT works on every device, but without offloading the kernel just writes zeroes */
+    if (has_nonzero_sysfs_attribute (block, "queue/write_zeroes_max_bytes")) {
+        if (erase_ranges (fd, BLKZEROOUT, size, progress_func, user_data, cancellable, &local_error)) {
+            ret = TRUE;
+            goto out;
+        }
+        if (!g_error_matches (local_error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED)) {
+            g_propagate_error (error, local_error);
+            goto out;
+        }
+        g_info ("Zeroing is not offloaded to the device, writing zeroes instead: %s", local_error->message);
+        g_clear_error (&local_error);
+    }
+
+    ret = erase_overwrite (fd, size, progress_func, user_data, cancellable, error);
+
+out:
+    close (fd);
+
+    return ret;
+}
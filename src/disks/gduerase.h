@@ -0,0 +1,38 @@
+/* gduerase.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* From the fastest to the slowest method */
+typedef enum {
+    GDU_ERASE_METHOD_ATA_ENHANCED_SECURE_ERASE,
+    GDU_ERASE_METHOD_ATA_SECURE_ERASE,
+    GDU_ERASE_METHOD_NVME_SECURE_ERASE,
+    GDU_ERASE_METHOD_SECURE_DISCARD,
+    GDU_ERASE_METHOD_OVERWRITE,
+} GduEraseMethod;
+
+/* Called from the erasing threads with the number of bytes erased since the previous call */
+typedef void (*GduEraseProgressFunc) (guint64 num_bytes, gpointer user_data);
+
+GduEraseMethod gdu_erase_get_method (UDisksClient *client, UDisksObject *object);
+const gchar *gdu_erase_method_get_name (GduEraseMethod method);
+gboolean gdu_erase_method_is_cancelable (GduEraseMethod method);
+
+gboolean gdu_erase_object (UDisksClient *client, UDisksObject *object, GduEraseMethod *method,
+                           GduEraseProgressFunc progress_func, gpointer user_data, GCancellable *cancellable,
+                           GError **error);
+gboolean gdu_erase_zero_fill (UDisksObject *object, GduEraseProgressFunc progress_func, gpointer user_data,
+                              GCancellable *cancellable, GError **error);
+
+G_END_DECLS
@@ -281,6 +281,17 @@ gdu_local_job_task_thread_func (GTask *task, gpointer source_object, gpointer ta
     g_task_return_int (task, result);
 }
 
+static gpointer
+gdu_local_job_thread_func (gpointer user_data)
+{
+    g_autoptr(GTask) task = G_TASK (user_data);
+
+    gdu_local_job_task_thread_func (task, g_task_get_source_object (task), g_task_get_task_data (task),
+                                    g_task_get_cancellable (task));
+
+    return NULL;
+}
+
 static void
 gdu_local_job_task_completed_cb (GObject *source_object, GAsyncResult *res, gpointer user_data)
 {
@@ -319,7 +330,10 @@ gdu_local_job_start (GduLocalJob *job)
     gdu_local_job_set_state (job, GDU_LOCAL_JOB_STATE_RUNNING);
     udisks_job_set_start_time (UDISKS_JOB (job), g_get_real_time ());
 
-    g_task_run_in_thread (task, gdu_local_job_task_thread_func);
+    /* Jobs can run for hours, e.g. when testing many disks at once, so every job gets a thread of its own
+     * instead of waiting for a free thread in the limited pool of g_task_run_in_thread().
+     */
+    g_thread_unref (g_thread_new ("gdu-local-job", gdu_local_job_thread_func, g_object_ref (task)));
 }
 
 static gboolean
@@ -0,0 +1,379 @@
+/* gdurescuemap.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdurescuemap.h"
+
+#include <string.h>
+
+#include "gducopyengine.h"
+
+/* Keeps track of which parts of a device have been rescued into a disk
+ * image, in the mapfile format of GNU ddrescue(1). The map covers the whole
+ * device with contiguous blocks, adjacent blocks always have a different
+ * status. Since the format is the same, the map can also be continued or
+ * inspected with ddrescue and ddrescuelog.
+ */
+
+typedef struct {
+    guint64 offset;
+    guint64 size;
+    GduRescueStatus status;
+} GduRescueMapBlock;
+
+struct GduRescueMap {
+    guint64 size;
+    /* sorted by offset, without gaps */
+    GArray *blocks;
+
+    guint64 current_pos;
+    GduRescueStatus current_status;
+};
+
+/* Appends @block to the end of the map, or extends the last block if it has the same status */
+static void
+append_block (GduRescueMap *map, const GduRescueMapBlock *block)
+{
+    GduRescueMapBlock *last = NULL;
+
+    if (block->size == 0)
+        return;
+
+    if (map->blocks->len > 0)
+        last = &g_array_index (map->blocks, GduRescueMapBlock, map->blocks->len - 1);
+    if (last != NULL && last->status == block->status)
+        last->size += block->size;
+    else
+        g_array_append_vals (map->blocks, block, 1);
+}
+
+static GduRescueMap *
+rescue_map_new_empty (guint64 size)
+{
+    GduRescueMap *map;
+
+    map = g_new0 (GduRescueMap, 1);
+    map->size = size;
+    map->blocks = g_array_new (FALSE, FALSE, sizeof (GduRescueMapBlock));
+    map->current_status = GDU_RESCUE_STATUS_NON_TRIED;
+
+    return map;
+}
+
+/**
+ * gdu_rescue_map_new:
+ * @size: The size of the device.
+ *
+ * Creates a map for a device of @size bytes, none of which has been tried yet.
+ *
+ * Returns: (transfer full): A #GduRescueMap.
+ */
+GduRescueMap *
+gdu_rescue_map_new (guint64 size)
+{
+    GduRescueMap *map;
+    GduRescueMapBlock block = { 0, size, GDU_RESCUE_STATUS_NON_TRIED };
+
+    map = rescue_map_new_empty (size);
+    append_block (map, &block);
+
+    return map;
+}
+
+void
+gdu_rescue_map_free (GduRescueMap *map)
+{
+    if (map == NULL)
+        return;
+
+    g_array_unref (map->blocks);
+    g_free (map);
+}
+
+static gboolean
+is_status (gchar c)
+{
+    return c == GDU_RESCUE_STATUS_NON_TRIED || c == GDU_RESCUE_STATUS_NON_TRIMMED
+           || c == GDU_RESCUE_STATUS_NON_SCRAPED || c == GDU_RESCUE_STATUS_BAD_SECTOR
+           || c == GDU_RESCUE_STATUS_FINISHED;
+}
+
+/**
+ * gdu_rescue_map_load:
+ * @file: The mapfile to read.
+ * @size: The size of the device.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for error.
+ *
+ * Reads a mapfile written by gdu_rescue_map_save() or by GNU ddrescue. The
+ * map has to cover exactly @size bytes.
+ *
+ * Returns: (transfer full): The map or %NULL if @error is set.
+ */
+GduRescueMap *
+gdu_rescue_map_load (GFile *file, guint64 size, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+    g_autofree gchar *contents = NULL;
+    g_auto(GStrv) lines = NULL;
+    gboolean have_status_line = FALSE;
+    guint64 end = 0;
+    guint n;
+
+    if (!g_file_load_contents (file, cancellable, &contents, NULL, NULL, error))
+        return NULL;
+
+    map = rescue_map_new_empty (size);
+
+    lines = g_strsplit (contents, "\n", -1);
+    for (n = 0; lines[n] != NULL; n++) {
+        g_auto(GStrv) fields = NULL;
+        GduRescueMapBlock block;
+        gchar *endptr;
+
+        g_strstrip (lines[n]);
+        if (lines[n][0] == '\0' || lines[n][0] == '#')
+            continue;
+
+        fields = g_strsplit_set (lines[n], " \t", -1);
+        /* drop the empty fields between runs of whitespace */
+        {
+            guint i, j;
+
+            for (i = 0, j = 0; fields[i] != NULL; i++) {
+                if (fields[i][0] == '\0')
+                    g_free (fields[i]);
+                else
+                    fields[j++] = fields[i];
+            }
+            fields[j] = NULL;
+        }
+
+        /* The first line is the position and status of the current pass */
+        if (!have_status_line) {
+            if (g_strv_length (fields) < 2)
+                goto invalid;
+            map->current_pos = g_ascii_strtoull (fields[0], &endptr, 0);
+            if (*endptr != '\0' || strlen (fields[1]) != 1)
+                goto invalid;
+            map->current_status = fields[1][0];
+            have_status_line = TRUE;
+            continue;
+        }
+
+        if (g_strv_length (fields) != 3 || strlen (fields[2]) != 1 || !is_status (fields[2][0]))
+            goto invalid;
+        block.offset = g_ascii_strtoull (fields[0], &endptr, 0);
+        if (*endptr != '\0')
+            goto invalid;
+        block.size = g_ascii_strtoull (fields[1], &endptr, 0);
+        if (*endptr != '\0' || block.offset != end || block.size > size - end)
+            goto invalid;
+        block.status = fields[2][0];
+        end += block.size;
+
+        append_block (map, &block);
+    }
+
+    if (end != size) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "Mapfile covers %" G_GUINT64_FORMAT " bytes, the device has %" G_GUINT64_FORMAT " bytes", end,
+                     size);
+        return NULL;
+    }
+
+    return g_steal_pointer (&map);
+
+invalid:
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid line %u in mapfile: %s", n + 1, lines[n]);
+    return NULL;
+}
+
+/**
+ * gdu_rescue_map_save:
+ * @map: A #GduRescueMap.
+ * @file: The mapfile to write.
+ * @cancellable: (nullable): A #GCancellable.
+ * @error: Return location for error.
+ *
+ * Writes @map to @file. The previous contents of @file are only replaced
+ * once the new map has been written completely.
+ *
+ * Returns: %TRUE on success, %FALSE if @error is set.
+ */
+gboolean
+gdu_rescue_map_save (GduRescueMap *map, GFile *file, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GString) contents = NULL;
+    guint n;
+
+    contents = g_string_new ("# Mapfile. Created by GNOME Disks " PACKAGE_VERSION "\n");
+    g_string_append (contents, "# current_pos  current_status\n");
+    g_string_append_printf (contents, "0x%08" G_GINT64_MODIFIER "X     %c\n", map->current_pos, map->current_status);
+    g_string_append (contents, "#      pos        size  status\n");
+    for (n = 0; n < map->blocks->len; n++) {
+        GduRescueMapBlock *block = &g_array_index (map->blocks, GduRescueMapBlock, n);
+
+        g_string_append_printf (contents, "0x%08" G_GINT64_MODIFIER "X  0x%08" G_GINT64_MODIFIER "X  %c\n",
+                                block->offset, block->size, block->status);
+    }
+
+    return g_file_replace_contents (file, contents->str, contents->len, NULL, /* etag */
+                                    FALSE,                                    /* make_backup */
+                                    G_FILE_CREATE_NONE, NULL, cancellable, error);
+}
+
+/* Returns the index of the block containing @offset */
+static guint
+find_block (GduRescueMap *map, guint64 offset)
+{
+    guint low = 0;
+    guint high = map->blocks->len;
+
+    while (high - low > 1) {
+        guint middle = low + (high - low) / 2;
+
+        if (g_array_index (map->blocks, GduRescueMapBlock, middle).offset <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return low;
+}
+
+/**
+ * gdu_rescue_map_set:
+ * @map: A #GduRescueMap.
+ * @offset: The start of the range.
+ * @size: The size of the range.
+ * @status: The new status of the range.
+ *
+ * Sets the status of @size bytes from @offset.
+ */
+void
+gdu_rescue_map_set (GduRescueMap *map, guint64 offset, guint64 size, GduRescueStatus status)
+{
+    GduRescueMapBlock head, tail;
+    GduRescueMapBlock block = { offset, size, status };
+    guint64 end = offset + size;
+    guint first, last, n;
+
+    g_return_if_fail (map != NULL);
+    g_return_if_fail (offset <= map->size && size <= map->size - offset);
+
+    if (size == 0)
+        return;
+
+    /* Replace the blocks overlapping the range with the range and what
+     * is left of the first and the last of them
+     */
+    first = find_block (map, offset);
+    last = find_block (map, end - 1);
+    head = g_array_index (map->blocks, GduRescueMapBlock, first);
+    tail = g_array_index (map->blocks, GduRescueMapBlock, last);
+    g_array_remove_range (map->blocks, first, last - first + 1);
+
+    n = first;
+    if (head.offset < offset) {
+        head.size = offset - head.offset;
+        g_array_insert_val (map->blocks, n, head);
+        n++;
+    }
+    g_array_insert_val (map->blocks, n, block);
+    if (tail.offset + tail.size > end) {
+        tail.size = tail.offset + tail.size - end;
+        tail.offset = end;
+        g_array_insert_val (map->blocks, n + 1, tail);
+    }
+
+    /* Merge the new block with its neighbours of the same status */
+    if (n + 1 < map->blocks->len
+        && g_array_index (map->blocks, GduRescueMapBlock, n + 1).status == status) {
+        g_array_index (map->blocks, GduRescueMapBlock, n).size +=
+            g_array_index (map->blocks, GduRescueMapBlock, n + 1).size;
+        g_array_remove_index (map->blocks, n + 1);
+    }
+    if (n > 0 && g_array_index (map->blocks, GduRescueMapBlock, n - 1).status == status) {
+        g_array_index (map->blocks, GduRescueMapBlock, n - 1).size +=
+            g_array_index (map->blocks, GduRescueMapBlock, n).size;
+        g_array_remove_index (map->blocks, n);
+    }
+}
+
+/**
+ * gdu_rescue_map_set_position:
+ * @map: A #GduRescueMap.
+ * @offset: The offset the current pass has reached.
+ * @pass_status: The status of the blocks the current pass works on.
+ *
+ * Records where the current pass is. This is only informational, passes
+ * start over with the blocks that still have @pass_status.
+ */
+void
+gdu_rescue_map_set_position (GduRescueMap *map, guint64 offset, GduRescueStatus pass_status)
+{
+    g_return_if_fail (map != NULL);
+
+    map->current_pos = offset;
+    map->current_status = pass_status;
+}
+
+/**
+ * gdu_rescue_map_get_extents:
+ * @map: A #GduRescueMap.
+ * @status: The status to look for.
+ *
+ * Gets the ranges of the device that have @status.
+ *
+ * Returns: (transfer full) (element-type GduCopyExtent): The ranges, sorted by offset.
+ */
+GArray *
+gdu_rescue_map_get_extents (GduRescueMap *map, GduRescueStatus status)
+{
+    GArray *extents;
+    guint n;
+
+    g_return_val_if_fail (map != NULL, NULL);
+
+    extents = g_array_new (FALSE, FALSE, sizeof (GduCopyExtent));
+    for (n = 0; n < map->blocks->len; n++) {
+        GduRescueMapBlock *block = &g_array_index (map->blocks, GduRescueMapBlock, n);
+        GduCopyExtent extent = { block->offset, block->size };
+
+        if (block->status == status)
+            g_array_append_val (extents, extent);
+    }
+
+    return extents;
+}
+
+/**
+ * gdu_rescue_map_get_num_bytes:
+ * @map: A #GduRescueMap.
+ * @status: The status to look for.
+ *
+ * Returns: The number of bytes with @status.
+ */
+guint64
+gdu_rescue_map_get_num_bytes (GduRescueMap *map, GduRescueStatus status)
+{
+    guint64 ret = 0;
+    guint n;
+
+    g_return_val_if_fail (map != NULL, 0);
+
+    for (n = 0; n < map->blocks->len; n++) {
+        GduRescueMapBlock *block = &g_array_index (map->blocks, GduRescueMapBlock, n);
+
+        if (block->status == status)
+            ret += block->size;
+    }
+
+    return ret;
+}
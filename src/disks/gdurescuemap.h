@@ -0,0 +1,38 @@
+/* gdurescuemap.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+/* The characters used for the blocks in a GNU ddrescue mapfile */
+typedef enum {
+    GDU_RESCUE_STATUS_NON_TRIED = '?',
+    GDU_RESCUE_STATUS_NON_TRIMMED = '*',
+    GDU_RESCUE_STATUS_NON_SCRAPED = '/',
+    GDU_RESCUE_STATUS_BAD_SECTOR = '-',
+    GDU_RESCUE_STATUS_FINISHED = '+',
+} GduRescueStatus;
+
+GduRescueMap *gdu_rescue_map_new (guint64 size);
+GduRescueMap *gdu_rescue_map_load (GFile *file, guint64 size, GCancellable *cancellable, GError **error);
+void gdu_rescue_map_free (GduRescueMap *map);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GduRescueMap, gdu_rescue_map_free)
+
+gboolean gdu_rescue_map_save (GduRescueMap *map, GFile *file, GCancellable *cancellable, GError **error);
+
+void gdu_rescue_map_set (GduRescueMap *map, guint64 offset, guint64 size, GduRescueStatus status);
+void gdu_rescue_map_set_position (GduRescueMap *map, guint64 offset, GduRescueStatus pass_status);
+
+GArray *gdu_rescue_map_get_extents (GduRescueMap *map, GduRescueStatus status);
+guint64 gdu_rescue_map_get_num_bytes (GduRescueMap *map, GduRescueStatus status);
+
+G_END_DECLS
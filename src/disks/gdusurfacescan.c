@@ -0,0 +1,467 @@
+/* gdusurfacescan.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdusurfacescan.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gduaio.h"
+
+/* A surface scan reads all of a device, like badblocks(8) does, to find the areas that can't be read or
+ * are slow to read. A destructive scan writes each pattern to all of the device first and then reads it
+ * back, so it also finds areas that can't be written or don't keep the data.
+ *
+ * The device is read and written with many requests in flight at once (see gduaio.c), so a scan runs at
+ * the full sequential speed of the device. How long each read took and which bytes failed is recorded
+ * per region of the device, so slow or failing areas can be told apart from a disk that is slow overall.
+ * With QUEUE_DEPTH requests in flight a read mostly waits for the ones ahead of it, about 200 ms on a
+ * healthy hard disk, so the time recorded is the one the device spent on the read: the time since it
+ * completed the previous one.
+ *
+ * A request that fails is retried one logical block at a time, so only the blocks that actually fail
+ * count as errors.
+ */
+
+#define REQUEST_SIZE (1024 * 1024)
+#define QUEUE_DEPTH 32
+
+/* The patterns of badblocks -w */
+static const guchar patterns[] = { 0xaa, 0x55, 0xff, 0x00 };
+
+typedef struct {
+    /* page-aligned, for O_DIRECT */
+    guchar *buffer;
+    guint64 offset;
+    gsize size;
+    gint64 submit_usec;
+} Request;
+
+struct GduSurfaceScan {
+    gint fd;
+    guint64 size;
+    guint logical_block_size;
+    GduSurfaceScanMode mode;
+
+    guchar *memory_unaligned;
+    Request requests[QUEUE_DEPTH];
+    /* REQUEST_SIZE bytes of the pattern written or read back */
+    guchar *pattern_buffer;
+
+    /* a multiple of REQUEST_SIZE, so every request belongs to one region */
+    guint64 region_size;
+
+    /* must hold lock when reading/writing these */
+    GMutex lock;
+    GduSurfaceScanStatus status;
+    GArray *regions;
+};
+
+/* Scans @size bytes of @fd, which should be opened with O_DIRECT so requests are asynchronous
+ * and bypass the page cache
+ */
+GduSurfaceScan *
+gdu_surface_scan_new (gint fd, guint64 size, guint logical_block_size, GduSurfaceScanMode mode)
+{
+    GduSurfaceScan *scan;
+    glong page_size;
+    guchar *memory;
+    guint64 offset;
+    guint n;
+
+    g_return_val_if_fail (fd != -1, NULL);
+    g_return_val_if_fail (size > 0, NULL);
+    g_return_val_if_fail (logical_block_size > 0 && REQUEST_SIZE % logical_block_size == 0, NULL);
+
+    scan = g_new0 (GduSurfaceScan, 1);
+    scan->fd = fd;
+    scan->size = size;
+    scan->logical_block_size = logical_block_size;
+    scan->mode = mode;
+    scan->pattern_buffer = g_malloc0 (REQUEST_SIZE);
+    scan->status.pattern = -1;
+    g_mutex_init (&scan->lock);
+
+    page_size = sysconf (_SC_PAGESIZE);
+    scan->memory_unaligned = g_new0 (guchar, QUEUE_DEPTH * REQUEST_SIZE + page_size);
+    memory = (guchar *) (((gintptr) (scan->memory_unaligned + page_size)) & (~(page_size - 1)));
+    for (n = 0; n < QUEUE_DEPTH; n++)
+        scan->requests[n].buffer = memory + n * REQUEST_SIZE;
+
+    scan->region_size = (size + GDU_SURFACE_SCAN_NUM_REGIONS - 1) / GDU_SURFACE_SCAN_NUM_REGIONS;
+    scan->region_size = (scan->region_size + REQUEST_SIZE - 1) / REQUEST_SIZE * REQUEST_SIZE;
+    scan->regions = g_array_new (FALSE, TRUE, sizeof (GduSurfaceScanRegion));
+    for (offset = 0; offset < size; offset += scan->region_size) {
+        GduSurfaceScanRegion region = { 0 };
+
+        region.offset = offset;
+        region.size = MIN (scan->region_size, size - offset);
+        g_array_append_val (scan->regions, region);
+    }
+
+    return scan;
+}
+
+void
+gdu_surface_scan_free (GduSurfaceScan *scan)
+{
+    if (scan == NULL)
+        return;
+
+    g_array_unref (scan->regions);
+    g_mutex_clear (&scan->lock);
+    g_free (scan->pattern_buffer);
+    g_free (scan->memory_unaligned);
+    g_free (scan);
+}
+
+void
+gdu_surface_scan_get_status (GduSurfaceScan *scan, GduSurfaceScanStatus *out_status)
+{
+    g_mutex_lock (&scan->lock);
+    *out_status = scan->status;
+    g_mutex_unlock (&scan->lock);
+}
+
+/* Returns a copy of the GduSurfaceScanRegion of every region, in the order of the device */
+GArray *
+gdu_surface_scan_get_regions (GduSurfaceScan *scan)
+{
+    GArray *regions;
+
+    g_mutex_lock (&scan->lock);
+    regions = g_array_sized_new (FALSE, FALSE, sizeof (GduSurfaceScanRegion), scan->regions->len);
+    g_array_append_vals (regions, scan->regions->data, scan->regions->len);
+    g_mutex_unlock (&scan->lock);
+
+    return regions;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The latencies of the last read over the device are kept while writing the next pattern */
+static void
+start_step (GduSurfaceScan *scan, guint pass, gint pattern, gboolean verifying)
+{
+    guint n;
+
+    g_mutex_lock (&scan->lock);
+    scan->status.pass = pass;
+    scan->status.pattern = pattern;
+    scan->status.verifying = verifying;
+    scan->status.num_bytes_done = 0;
+    scan->status.num_bytes_total = scan->size;
+    if (pattern < 0 || verifying) {
+        for (n = 0; n < scan->regions->len; n++) {
+            GduSurfaceScanRegion *region = &g_array_index (scan->regions, GduSurfaceScanRegion, n);
+
+            region->num_requests = 0;
+            region->total_latency_usec = 0;
+            region->max_latency_usec = 0;
+            memset (region->latency_histogram, 0, sizeof (region->latency_histogram));
+        }
+    }
+    g_mutex_unlock (&scan->lock);
+}
+
+static void
+record_request (GduSurfaceScan *scan, Request *request, gboolean write, gint64 latency_usec,
+                guint64 num_error_bytes)
+{
+    GduSurfaceScanRegion *region;
+
+    g_mutex_lock (&scan->lock);
+    region = &g_array_index (scan->regions, GduSurfaceScanRegion, request->offset / scan->region_size);
+    if (!write)
+        gdu_surface_scan_region_add_read (region, latency_usec);
+    region->num_error_bytes += num_error_bytes;
+    scan->status.num_bytes_done += request->size;
+    scan->status.num_error_bytes += num_error_bytes;
+    g_mutex_unlock (&scan->lock);
+}
+
+static guint64
+count_mismatched_bytes (GduSurfaceScan *scan, Request *request)
+{
+    guint64 num_error_bytes = 0;
+    gsize offset;
+
+    for (offset = 0; offset < request->size; offset += scan->logical_block_size) {
+        if (memcmp (request->buffer + offset, scan->pattern_buffer + offset, scan->logical_block_size) != 0)
+            num_error_bytes += scan->logical_block_size;
+    }
+
+    return num_error_bytes;
+}
+
+/* Repeats a failed request one logical block at a time and returns the number of bytes that failed */
+static guint64
+retry_request (GduSurfaceScan *scan, Request *request, gboolean write, gboolean verify)
+{
+    guint64 num_error_bytes = 0;
+    gsize offset;
+
+    for (offset = 0; offset < request->size; offset += scan->logical_block_size) {
+        guchar *block = request->buffer + offset;
+        gssize num_bytes;
+
+        do {
+            if (write)
+                num_bytes = pwrite (scan->fd, block, scan->logical_block_size, request->offset + offset);
+            else
+                num_bytes = pread (scan->fd, block, scan->logical_block_size, request->offset + offset);
+        } while (num_bytes < 0 && errno == EINTR);
+
+        if (num_bytes != (gssize) scan->logical_block_size)
+            num_error_bytes += scan->logical_block_size;
+        else if (verify && memcmp (block, scan->pattern_buffer + offset, scan->logical_block_size) != 0)
+            num_error_bytes += scan->logical_block_size;
+    }
+
+    return num_error_bytes;
+}
+
+/* Writes the pattern to or reads all of the device, with QUEUE_DEPTH requests in flight.
+ *
+ * Once cancelled or failed no more requests are submitted, but the ones in flight are still waited for.
+ */
+static gboolean
+run_step (GduSurfaceScan *scan, GduAio *aio, gboolean write, gboolean verify,
+          GduSurfaceScanProgressFunc progress_func, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    Request *free_requests[QUEUE_DEPTH];
+    GduAioEvent events[QUEUE_DEPTH];
+    guint num_free_requests = 0;
+    guint64 next_offset = 0;
+    gint64 last_completion_usec = 0;
+    gboolean ret = TRUE;
+    guint n;
+
+    for (n = 0; n < QUEUE_DEPTH; n++) {
+        /* writing doesn't change the buffers, so they keep the pattern */
+        if (write)
+            memcpy (scan->requests[n].buffer, scan->pattern_buffer, REQUEST_SIZE);
+        free_requests[num_free_requests++] = &scan->requests[n];
+    }
+
+    while (TRUE) {
+        gint64 first_submit_usec = G_MAXINT64;
+        gint64 latency_usec;
+        gint64 now_usec;
+        gboolean retried = FALSE;
+        gint num_events;
+
+        while (ret && num_free_requests > 0 && next_offset < scan->size) {
+            Request *request = free_requests[num_free_requests - 1];
+
+            if (g_cancellable_set_error_if_cancelled (cancellable, error)) {
+                ret = FALSE;
+                break;
+            }
+
+            request->offset = next_offset;
+            request->size = MIN (REQUEST_SIZE, scan->size - next_offset);
+            request->submit_usec = g_get_monotonic_time ();
+            if (!gdu_aio_submit (aio, scan->fd, write, request->buffer, request->size, request->offset, request,
+                                 error)) {
+                ret = FALSE;
+                break;
+            }
+
+            num_free_requests--;
+            next_offset += request->size;
+        }
+
+        if (gdu_aio_get_num_in_flight (aio) == 0)
+            break;
+
+        num_events = gdu_aio_get_events (aio, 1, events, QUEUE_DEPTH, ret ? error : NULL);
+        if (num_events < 0) {
+            ret = FALSE;
+            break;
+        }
+        /* all of the batch completed by now, the retries of failed requests below must not count */
+        now_usec = g_get_monotonic_time ();
+        for (n = 0; n < (guint) num_events; n++)
+            first_submit_usec = MIN (first_submit_usec, ((Request *) events[n].user_data)->submit_usec);
+        latency_usec = gdu_surface_scan_get_service_usec (now_usec, last_completion_usec, first_submit_usec,
+                                                          num_events);
+        last_completion_usec = now_usec;
+
+        for (n = 0; n < (guint) num_events; n++) {
+            Request *request = events[n].user_data;
+            guint64 num_error_bytes = 0;
+
+            if (events[n].result != (gint64) request->size) {
+                num_error_bytes = retry_request (scan, request, write, verify);
+                retried = TRUE;
+            } else if (verify) {
+                num_error_bytes = count_mismatched_bytes (scan, request);
+            }
+
+            record_request (scan, request, write, latency_usec, num_error_bytes);
+            free_requests[num_free_requests++] = request;
+        }
+
+        /* the device was busy with the retries, which aren't the time of the next requests either */
+        if (retried)
+            last_completion_usec = g_get_monotonic_time ();
+
+        if (progress_func != NULL)
+            progress_func (scan, user_data);
+    }
+
+    return ret;
+}
+
+/* Scans the device @num_passes times, or until @cancellable is cancelled if @num_passes is 0.
+ *
+ * Failing blocks don't make the scan fail, they are counted in the status and the regions.
+ */
+gboolean
+gdu_surface_scan_run (GduSurfaceScan *scan, guint num_passes, GduSurfaceScanProgressFunc progress_func,
+                      gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    g_autoptr(GduAio) aio = NULL;
+    guint pass;
+    guint n;
+
+    aio = gdu_aio_new (QUEUE_DEPTH, error);
+    if (aio == NULL)
+        return FALSE;
+
+    for (pass = 1; num_passes == 0 || pass <= num_passes; pass++) {
+        if (scan->mode == GDU_SURFACE_SCAN_MODE_READ) {
+            start_step (scan, pass, -1, FALSE);
+            if (!run_step (scan, aio, FALSE, FALSE, progress_func, user_data, cancellable, error))
+                return FALSE;
+            continue;
+        }
+
+        for (n = 0; n < G_N_ELEMENTS (patterns); n++) {
+            memset (scan->pattern_buffer, patterns[n], REQUEST_SIZE);
+
+            start_step (scan, pass, patterns[n], FALSE);
+            if (!run_step (scan, aio, TRUE, FALSE, progress_func, user_data, cancellable, error))
+                return FALSE;
+
+            /* make sure the pattern is read back from the medium and not the cache of the drive */
+            if (fdatasync (scan->fd) != 0) {
+                gint errsv = errno;
+
+                g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv), "%s", g_strerror (errsv));
+                g_prefix_error (error, "Error syncing device: ");
+                return FALSE;
+            }
+
+            start_step (scan, pass, patterns[n], TRUE);
+            if (!run_step (scan, aio, FALSE, TRUE, progress_func, user_data, cancellable, error))
+                return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+guint
+gdu_surface_scan_get_latency_bucket (gint64 latency_usec)
+{
+    guint64 latency_msec = MAX (latency_usec, 0) / 1000;
+
+    /* the number of bits of the latency in ms, so 0 ms is bucket 0, 1 ms bucket 1, 2-3 ms bucket 2...
+     * g_bit_storage() takes 0 to need 1 bit
+     */
+    if (latency_msec == 0)
+        return 0;
+    return MIN (g_bit_storage (latency_msec), GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS - 1);
+}
+
+/* The time the device spent on each of @num_completed requests that were all completed at @now_usec.
+ *
+ * The device works on one request after the other, so it started on the first of them when it completed
+ * the request before, at @last_completion_usec, or when the first of them was submitted at
+ * @first_submit_usec if it was idle until then.
+ */
+gint64
+gdu_surface_scan_get_service_usec (gint64 now_usec, gint64 last_completion_usec, gint64 first_submit_usec,
+                                   guint num_completed)
+{
+    g_return_val_if_fail (num_completed > 0, 0);
+
+    return MAX (now_usec - MAX (last_completion_usec, first_submit_usec), 0) / num_completed;
+}
+
+void
+gdu_surface_scan_region_add_read (GduSurfaceScanRegion *region, gint64 latency_usec)
+{
+    region->num_requests++;
+    region->total_latency_usec += latency_usec;
+    region->max_latency_usec = MAX (region->max_latency_usec, latency_usec);
+    region->latency_histogram[gdu_surface_scan_get_latency_bucket (latency_usec)]++;
+}
+
+GduSurfaceScanSeverity
+gdu_surface_scan_region_get_severity (const GduSurfaceScanRegion *region)
+{
+    guint bucket;
+
+    if (region->num_error_bytes > 0)
+        return GDU_SURFACE_SCAN_SEVERITY_ERROR;
+    if (region->num_requests == 0)
+        return GDU_SURFACE_SCAN_SEVERITY_NONE;
+
+    /* A 1 MiB read takes below 32 ms on any disk that still reads at 32 MB/s, like the inner tracks of an
+     * old hard disk. Reads of half a second or more are the disk retrying a sector.
+     */
+    bucket = gdu_surface_scan_get_latency_bucket (region->max_latency_usec);
+    if (bucket <= 5)
+        return GDU_SURFACE_SCAN_SEVERITY_FAST;
+    if (bucket <= 7)
+        return GDU_SURFACE_SCAN_SEVERITY_SLOW;
+    if (bucket <= 9)
+        return GDU_SURFACE_SCAN_SEVERITY_SLOWER;
+    return GDU_SURFACE_SCAN_SEVERITY_SLOWEST;
+}
+
+/* Formats @regions as CSV with a header line, a line per region and the latency histogram in the last
+ * columns, for analysing the results of many disks with other tools
+ */
+gchar *
+gdu_surface_scan_format_regions_csv (GArray *regions)
+{
+    GString *str;
+    guint n, m;
+
+    str = g_string_new ("offset,size,reads,mean_latency_usec,max_latency_usec,error_bytes");
+    for (m = 0; m < GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS - 1; m++)
+        g_string_append_printf (str, ",reads_below_%u_msec", 1u << m);
+    g_string_append_printf (str, ",reads_from_%u_msec\n", 1u << (GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS - 2));
+
+    for (n = 0; n < regions->len; n++) {
+        GduSurfaceScanRegion *region = &g_array_index (regions, GduSurfaceScanRegion, n);
+        gint64 mean_latency_usec = 0;
+
+        if (region->num_requests > 0)
+            mean_latency_usec = region->total_latency_usec / region->num_requests;
+
+        g_string_append_printf (str,
+                                "%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%u,%" G_GINT64_FORMAT ",%" G_GINT64_FORMAT
+                                ",%" G_GUINT64_FORMAT,
+                                region->offset, region->size, region->num_requests, mean_latency_usec,
+                                region->max_latency_usec, region->num_error_bytes);
+        for (m = 0; m < GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS; m++)
+            g_string_append_printf (str, ",%u", region->latency_histogram[m]);
+        g_string_append_c (str, '\n');
+    }
+
+    return g_string_free (str, FALSE);
+}
@@ -0,0 +1,90 @@
+/* gdusurfacescan.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+    /* reads all of the device, which is left unchanged */
+    GDU_SURFACE_SCAN_MODE_READ,
+    /* writes every pattern to all of the device and reads it back, destroying all data on it */
+    GDU_SURFACE_SCAN_MODE_WRITE,
+} GduSurfaceScanMode;
+
+/* The device is split into this many regions of the same size */
+#define GDU_SURFACE_SCAN_NUM_REGIONS 1024
+
+/* Read latencies are counted in buckets that double in size: bucket 0 is below 1 ms, bucket n from
+ * 2^(n-1) ms up to 2^n ms and the last bucket is everything slower
+ */
+#define GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS 16
+
+/* How a region of the device reads, from the slowest read of the region */
+typedef enum {
+    /* not read yet */
+    GDU_SURFACE_SCAN_SEVERITY_NONE = -1,
+    GDU_SURFACE_SCAN_SEVERITY_FAST,
+    GDU_SURFACE_SCAN_SEVERITY_SLOW,
+    GDU_SURFACE_SCAN_SEVERITY_SLOWER,
+    GDU_SURFACE_SCAN_SEVERITY_SLOWEST,
+    /* some of the region couldn't be read or written */
+    GDU_SURFACE_SCAN_SEVERITY_ERROR,
+} GduSurfaceScanSeverity;
+
+typedef struct {
+    guint64 offset;
+    guint64 size;
+    /* the reads of the region in the last read over the device. The latency of a read is the time the
+     * device spent on it, not the time it waited behind the other requests in flight
+     */
+    guint num_requests;
+    gint64 total_latency_usec;
+    gint64 max_latency_usec;
+    guint32 latency_histogram[GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS];
+    /* the bytes that couldn't be read or written, or were read back wrong, in all passes */
+    guint64 num_error_bytes;
+} GduSurfaceScanRegion;
+
+typedef struct {
+    /* starting at 1 */
+    guint pass;
+    /* the pattern written or read back, or -1 when just reading */
+    gint pattern;
+    gboolean verifying;
+    /* of the current read or write over the device */
+    guint64 num_bytes_done;
+    guint64 num_bytes_total;
+    /* in all passes */
+    guint64 num_error_bytes;
+} GduSurfaceScanStatus;
+
+/* Called from the thread running the scan whenever requests complete */
+typedef void (*GduSurfaceScanProgressFunc) (GduSurfaceScan *scan, gpointer user_data);
+
+GduSurfaceScan *gdu_surface_scan_new (gint fd, guint64 size, guint logical_block_size, GduSurfaceScanMode mode);
+void gdu_surface_scan_free (GduSurfaceScan *scan);
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (GduSurfaceScan, gdu_surface_scan_free)
+
+gboolean gdu_surface_scan_run (GduSurfaceScan *scan, guint num_passes, GduSurfaceScanProgressFunc progress_func,
+                               gpointer user_data, GCancellable *cancellable, GError **error);
+
+void gdu_surface_scan_get_status (GduSurfaceScan *scan, GduSurfaceScanStatus *out_status);
+GArray *gdu_surface_scan_get_regions (GduSurfaceScan *scan);
+
+guint gdu_surface_scan_get_latency_bucket (gint64 latency_usec);
+gint64 gdu_surface_scan_get_service_usec (gint64 now_usec, gint64 last_completion_usec, gint64 first_submit_usec,
+                                          guint num_completed);
+void gdu_surface_scan_region_add_read (GduSurfaceScanRegion *region, gint64 latency_usec);
+GduSurfaceScanSeverity gdu_surface_scan_region_get_severity (const GduSurfaceScanRegion *region);
+gchar *gdu_surface_scan_format_regions_csv (GArray *regions);
+
+G_END_DECLS
@@ -22,6 +22,18 @@ typedef struct _GduCreateFilesystemWidget GduCreateFilesystemWidget;
 struct _GduEstimator;
 typedef struct _GduEstimator GduEstimator;
 
+struct GduAio;
+typedef struct GduAio GduAio;
+
+struct GduCheckpoint;
+typedef struct GduCheckpoint GduCheckpoint;
+
+struct GduCompressor;
+typedef struct GduCompressor GduCompressor;
+
+struct GduCopyEngine;
+typedef struct GduCopyEngine GduCopyEngine;
+
 struct GduDVDSupport;
 typedef struct GduDVDSupport GduDVDSupport;
 
@@ -31,6 +43,12 @@ typedef struct _GduLocalJob GduLocalJob;
 struct _GduJobManager;
 typedef struct _GduJobManager GduJobManager;
 
+struct GduRescueMap;
+typedef struct GduRescueMap GduRescueMap;
+
+struct GduSurfaceScan;
+typedef struct GduSurfaceScan GduSurfaceScan;
+
 struct GduXzDecompressor;
 typedef struct GduXzDecompressor GduXzDecompressor;
 
@@ -0,0 +1,655 @@
+/* gduusedblocks.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gduusedblocks.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gducopyengine.h"
+
+/* Finds the blocks a filesystem actually uses by reading its allocation
+ * bitmap, so a disk image of it only has to copy those - like partclone(8)
+ * does. Supported are ext2/3/4, FAT12/16/32 and NTFS. Everything else (and
+ * unusual layouts of the supported filesystems) should be copied in full.
+ */
+
+/* Unused gaps smaller than this between used extents are copied anyway, as
+ * one large read is faster than two smaller ones and a seek
+ */
+#define MIN_GAP_SIZE (1024 * 1024)
+
+/* Extents are aligned to this, so they can be read with direct I/O */
+#define EXTENT_ALIGNMENT (64 * 1024)
+
+/* Size of the chunks allocation tables are read in */
+#define READ_CHUNK_SIZE (1024 * 1024)
+
+static guint16
+get_le16 (const guchar *p)
+{
+    return (guint16) p[0] | ((guint16) p[1] << 8);
+}
+
+static guint32
+get_le32 (const guchar *p)
+{
+    return (guint32) get_le16 (p) | ((guint32) get_le16 (p + 2) << 16);
+}
+
+static guint64
+get_le64 (const guchar *p)
+{
+    return (guint64) get_le32 (p) | ((guint64) get_le32 (p + 4) << 32);
+}
+
+static gboolean
+read_at (gint fd, guint64 offset, gpointer buffer, gsize size, GError **error)
+{
+    guchar *p = buffer;
+
+    while (size > 0) {
+        gssize num_bytes_read;
+
+        num_bytes_read = pread (fd, p, size, offset);
+        if (num_bytes_read < 0) {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+            g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errno),
+                         "Error reading %" G_GSIZE_FORMAT " bytes from offset %" G_GUINT64_FORMAT ": %s", size,
+                         offset, g_strerror (errno));
+            return FALSE;
+        }
+        if (num_bytes_read == 0) {
+            g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                         "Reading from offset %" G_GUINT64_FORMAT " returned zero bytes", offset);
+            return FALSE;
+        }
+
+        p += num_bytes_read;
+        offset += num_bytes_read;
+        size -= num_bytes_read;
+    }
+
+    return TRUE;
+}
+
+/* Adds [@offset, @offset + @size) to @extents. Ranges have to be added in
+ * increasing order.
+ */
+static void
+add_used (GArray *extents, guint64 offset, guint64 size)
+{
+    GduCopyExtent extent;
+    guint64 end;
+
+    if (size == 0)
+        return;
+
+    end = (offset + size + EXTENT_ALIGNMENT - 1) / EXTENT_ALIGNMENT * EXTENT_ALIGNMENT;
+    offset -= offset % EXTENT_ALIGNMENT;
+    size = end - offset;
+
+    if (extents->len > 0) {
+        GduCopyExtent *last = &g_array_index (extents, GduCopyExtent, extents->len - 1);
+
+        if (offset <= last->offset + last->size + MIN_GAP_SIZE) {
+            last->size = MAX (last->offset + last->size, offset + size) - last->offset;
+            return;
+        }
+    }
+
+    extent.offset = offset;
+    extent.size = size;
+    g_array_append_val (extents, extent);
+}
+
+static gboolean
+bitmap_test (const guchar *bitmap, guint64 n)
+{
+    return (bitmap[n >> 3] & (1 << (n & 7))) != 0;
+}
+
+static void
+bitmap_set (guchar *bitmap, guint64 num_bits, guint64 start, guint64 count)
+{
+    guint64 n;
+
+    for (n = start; n < start + count && n < num_bits; n++)
+        bitmap[n >> 3] |= 1 << (n & 7);
+}
+
+/* Adds the units of @bitmap that are in use, where bit n (least significant
+ * bit first) is the unit at @offset + n * @unit_size.
+ */
+static void
+add_bitmap (GArray *extents, const guchar *bitmap, guint64 num_bits, guint64 offset, guint64 unit_size)
+{
+    guint64 n = 0;
+
+    while (n < num_bits) {
+        guint64 start;
+
+        /* skip unused units, a whole byte at a time where possible */
+        if ((n & 7) == 0 && n + 8 <= num_bits && bitmap[n >> 3] == 0x00) {
+            n += 8;
+            continue;
+        }
+        if (!bitmap_test (bitmap, n)) {
+            n++;
+            continue;
+        }
+
+        start = n;
+        while (n < num_bits) {
+            if ((n & 7) == 0 && n + 8 <= num_bits && bitmap[n >> 3] == 0xff)
+                n += 8;
+            else if (bitmap_test (bitmap, n))
+                n++;
+            else
+                break;
+        }
+
+        add_used (extents, offset + start * unit_size, (n - start) * unit_size);
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* ext2/3/4, see https://www.kernel.org/doc/html/latest/filesystems/ext4/globals.html */
+
+#define EXT_SUPERBLOCK_OFFSET 1024
+#define EXT_MAGIC 0xef53
+
+#define EXT_FEATURE_COMPAT_SPARSE_SUPER2 0x0200
+#define EXT_FEATURE_INCOMPAT_META_BG 0x0010
+#define EXT_FEATURE_INCOMPAT_64BIT 0x0080
+#define EXT_FEATURE_RO_COMPAT_SPARSE_SUPER 0x0001
+#define EXT_FEATURE_RO_COMPAT_GDT_CSUM 0x0010
+#define EXT_FEATURE_RO_COMPAT_METADATA_CSUM 0x0400
+
+#define EXT_BG_BLOCK_UNINIT 0x0002
+
+static gboolean
+ext_is_power_of (guint64 n, guint base)
+{
+    while (n % base == 0)
+        n /= base;
+    return n == 1;
+}
+
+/* Whether @group has a copy of the superblock and the group descriptors */
+static gboolean
+ext_group_has_super (guint64 group, gboolean sparse_super)
+{
+    if (group <= 1 || !sparse_super)
+        return TRUE;
+
+    return ext_is_power_of (group, 3) || ext_is_power_of (group, 5) || ext_is_power_of (group, 7);
+}
+
+static GArray *
+get_ext_extents (gint fd, guint64 device_size, GError **error)
+{
+    g_autoptr(GArray) extents = NULL;
+    g_autofree guchar *descriptors = NULL;
+    g_autofree guchar *bitmap = NULL;
+    guchar sb[1024];
+    guint32 compat, incompat, ro_compat;
+    guint64 block_size, blocks_count, first_data_block, blocks_per_group;
+    guint64 num_groups, num_gdt_blocks, reserved_gdt_blocks, inode_table_blocks;
+    guint32 inodes_per_group, inode_size, log_block_size;
+    guint desc_size;
+    gboolean have_bg_flags, sparse_super;
+    guint64 group;
+
+    if (!read_at (fd, EXT_SUPERBLOCK_OFFSET, sb, sizeof sb, error))
+        return NULL;
+
+    if (get_le16 (sb + 0x38) != EXT_MAGIC)
+        goto invalid;
+
+    compat = get_le32 (sb + 0x5c);
+    incompat = get_le32 (sb + 0x60);
+    ro_compat = get_le32 (sb + 0x64);
+
+    /* The group descriptors are not in one place with meta_bg */
+    if ((incompat & EXT_FEATURE_INCOMPAT_META_BG) != 0) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                     "Filesystems with the meta_bg feature are not supported");
+        return NULL;
+    }
+
+    log_block_size = get_le32 (sb + 0x18);
+    if (log_block_size > 6)
+        goto invalid;
+    block_size = 1024 << log_block_size;
+
+    blocks_count = get_le32 (sb + 0x04);
+    desc_size = 32;
+    if ((incompat & EXT_FEATURE_INCOMPAT_64BIT) != 0) {
+        blocks_count |= (guint64) get_le32 (sb + 0x150) << 32;
+        desc_size = get_le16 (sb + 0xfe);
+    }
+
+    first_data_block = get_le32 (sb + 0x14);
+    blocks_per_group = get_le32 (sb + 0x20);
+    inodes_per_group = get_le32 (sb + 0x28);
+    inode_size = get_le32 (sb + 0x4c) >= 1 ? get_le16 (sb + 0x58) : 128;
+    reserved_gdt_blocks = get_le16 (sb + 0xce);
+
+    if (desc_size < 32 || desc_size > block_size || blocks_per_group == 0 || blocks_per_group > block_size * 8
+        || inodes_per_group == 0 || inode_size == 0 || blocks_count <= first_data_block
+        || blocks_count * block_size > device_size)
+        goto invalid;
+
+    num_groups = (blocks_count - first_data_block + blocks_per_group - 1) / blocks_per_group;
+    num_gdt_blocks = (num_groups * desc_size + block_size - 1) / block_size;
+    inode_table_blocks = ((guint64) inodes_per_group * inode_size + block_size - 1) / block_size;
+    /* the flags of the group descriptors are only maintained with checksums */
+    have_bg_flags = (ro_compat & (EXT_FEATURE_RO_COMPAT_GDT_CSUM | EXT_FEATURE_RO_COMPAT_METADATA_CSUM)) != 0;
+    sparse_super = (ro_compat & EXT_FEATURE_RO_COMPAT_SPARSE_SUPER) != 0;
+
+    descriptors = g_malloc (num_gdt_blocks * block_size);
+    if (!read_at (fd, (first_data_block + 1) * block_size, descriptors, num_gdt_blocks * block_size, error))
+        return NULL;
+
+    extents = g_array_new (FALSE, FALSE, sizeof (GduCopyExtent));
+
+    /* The boot sector and the superblock, which are outside of the first
+     * group with 1 KiB blocks
+     */
+    add_used (extents, 0, (first_data_block + 1) * block_size);
+
+    bitmap = g_malloc (block_size);
+    for (group = 0; group < num_groups; group++) {
+        const guchar *desc = descriptors + group * desc_size;
+        guint64 group_start = first_data_block + group * blocks_per_group;
+        guint64 group_blocks = MIN (blocks_per_group, blocks_count - group_start);
+        guint64 block_bitmap, inode_bitmap, inode_table;
+
+        block_bitmap = get_le32 (desc + 0x00);
+        inode_bitmap = get_le32 (desc + 0x04);
+        inode_table = get_le32 (desc + 0x08);
+        if (desc_size >= 64) {
+            block_bitmap |= (guint64) get_le32 (desc + 0x20) << 32;
+            inode_bitmap |= (guint64) get_le32 (desc + 0x24) << 32;
+            inode_table |= (guint64) get_le32 (desc + 0x28) << 32;
+        }
+
+        if (have_bg_flags && (get_le16 (desc + 0x12) & EXT_BG_BLOCK_UNINIT) != 0) {
+            /* The block bitmap of this group has never been written. The
+             * only blocks in use are the group's own metadata, computed the
+             * same way the kernel does. With sparse_super2 the backups are
+             * elsewhere, so just copy the whole group.
+             */
+            if ((compat & EXT_FEATURE_COMPAT_SPARSE_SUPER2) != 0) {
+                memset (bitmap, 0xff, block_size);
+            } else {
+                memset (bitmap, 0x00, block_size);
+                if (ext_group_has_super (group, sparse_super))
+                    bitmap_set (bitmap, group_blocks, 0, 1 + num_gdt_blocks + reserved_gdt_blocks);
+                if (block_bitmap >= group_start)
+                    bitmap_set (bitmap, group_blocks, block_bitmap - group_start, 1);
+                if (inode_bitmap >= group_start)
+                    bitmap_set (bitmap, group_blocks, inode_bitmap - group_start, 1);
+                if (inode_table >= group_start)
+                    bitmap_set (bitmap, group_blocks, inode_table - group_start, inode_table_blocks);
+            }
+        } else {
+            if (block_bitmap >= blocks_count)
+                goto invalid;
+            if (!read_at (fd, block_bitmap * block_size, bitmap, block_size, error))
+                return NULL;
+        }
+
+        add_bitmap (extents, bitmap, group_blocks, group_start * block_size, block_size);
+    }
+
+    return g_steal_pointer (&extents);
+
+invalid:
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid or unsupported ext2/3/4 filesystem");
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* FAT12/16/32, see Microsoft's "FAT: General Overview of On-Disk Format" */
+
+static GArray *
+get_fat_extents (gint fd, guint64 device_size, GError **error)
+{
+    g_autoptr(GArray) extents = NULL;
+    g_autofree guchar *buffer = NULL;
+    g_autofree guchar *bitmap = NULL;
+    guchar bs[512];
+    guint64 bytes_per_sector, sectors_per_cluster, reserved_sectors, num_fats, root_entries;
+    guint64 fat_size, total_sectors, root_dir_sectors, first_data_sector;
+    guint64 cluster_count, cluster_size, fat_offset, num_entries, n;
+    guint fat_bits;
+
+    if (!read_at (fd, 0, bs, sizeof bs, error))
+        return NULL;
+
+    if (bs[510] != 0x55 || bs[511] != 0xaa)
+        goto invalid;
+
+    bytes_per_sector = get_le16 (bs + 11);
+    sectors_per_cluster = bs[13];
+    reserved_sectors = get_le16 (bs + 14);
+    num_fats = bs[16];
+    root_entries = get_le16 (bs + 17);
+    total_sectors = get_le16 (bs + 19) != 0 ? get_le16 (bs + 19) : get_le32 (bs + 32);
+    fat_size = get_le16 (bs + 22) != 0 ? get_le16 (bs + 22) : get_le32 (bs + 36);
+
+    if (bytes_per_sector < 512 || bytes_per_sector > 4096 || (bytes_per_sector & (bytes_per_sector - 1)) != 0
+        || sectors_per_cluster == 0 || (sectors_per_cluster & (sectors_per_cluster - 1)) != 0
+        || reserved_sectors == 0 || num_fats == 0 || fat_size == 0)
+        goto invalid;
+
+    root_dir_sectors = (root_entries * 32 + bytes_per_sector - 1) / bytes_per_sector;
+    first_data_sector = reserved_sectors + num_fats * fat_size + root_dir_sectors;
+    if (total_sectors <= first_data_sector || total_sectors * bytes_per_sector > device_size)
+        goto invalid;
+
+    cluster_count = (total_sectors - first_data_sector) / sectors_per_cluster;
+    if (cluster_count < 4085)
+        fat_bits = 12;
+    else if (cluster_count < 65525)
+        fat_bits = 16;
+    else
+        fat_bits = 32;
+
+    /* the FAT has an entry for every cluster, numbered from 2 */
+    num_entries = cluster_count + 2;
+    if ((num_entries * fat_bits + 7) / 8 > fat_size * bytes_per_sector)
+        goto invalid;
+
+    extents = g_array_new (FALSE, FALSE, sizeof (GduCopyExtent));
+
+    /* The boot sector, the reserved sectors, the FATs and the root directory */
+    add_used (extents, 0, first_data_sector * bytes_per_sector);
+
+    cluster_size = sectors_per_cluster * bytes_per_sector;
+    fat_offset = reserved_sectors * bytes_per_sector;
+
+    if (fat_bits == 12) {
+        gsize fat12_size = num_entries * 3 / 2 + 2;
+
+        /* FAT12 is small enough to read at once, entries are 1.5 bytes */
+        buffer = g_malloc0 (fat12_size);
+        bitmap = g_malloc0 (num_entries / 8 + 1);
+        if (!read_at (fd, fat_offset, buffer, MIN (fat12_size, fat_size * bytes_per_sector), error))
+            return NULL;
+
+        for (n = 2; n < num_entries; n++) {
+            guint16 value = get_le16 (buffer + n + n / 2);
+
+            value = (n & 1) != 0 ? value >> 4 : value & 0x0fff;
+            if (value != 0)
+                bitmap_set (bitmap, cluster_count, n - 2, 1);
+        }
+        add_bitmap (extents, bitmap, cluster_count, first_data_sector * bytes_per_sector, cluster_size);
+
+        return g_steal_pointer (&extents);
+    }
+
+    /* FAT16 and FAT32 entries are 2 and 4 bytes, read the FAT in chunks */
+    buffer = g_malloc (READ_CHUNK_SIZE);
+    bitmap = g_malloc (READ_CHUNK_SIZE / 2 / 8 + 1);
+    for (n = 2; n < num_entries;) {
+        guint entry_size = fat_bits / 8;
+        guint64 num = MIN (READ_CHUNK_SIZE / entry_size, num_entries - n);
+        guint64 i;
+
+        if (!read_at (fd, fat_offset + n * entry_size, buffer, num * entry_size, error))
+            return NULL;
+
+        memset (bitmap, 0, (num + 7) / 8);
+        for (i = 0; i < num; i++) {
+            guint32 value = entry_size == 2 ? get_le16 (buffer + i * 2) : get_le32 (buffer + i * 4) & 0x0fffffff;
+
+            if (value != 0)
+                bitmap_set (bitmap, num, i, 1);
+        }
+        add_bitmap (extents, bitmap, num,
+                    first_data_sector * bytes_per_sector + (n - 2) * cluster_size, cluster_size);
+        n += num;
+    }
+
+    return g_steal_pointer (&extents);
+
+invalid:
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid or unsupported FAT filesystem");
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+/* NTFS, the cluster bitmap is the unnamed $DATA attribute of the $Bitmap file (MFT record 6) */
+
+#define NTFS_BITMAP_RECORD 6
+#define NTFS_ATTR_DATA 0x80
+#define NTFS_ATTR_END 0xffffffff
+
+/* Reads a @size bytes little-endian integer, sign-extended if @is_signed */
+static guint64
+ntfs_get_varint (const guchar *p, guint size, gboolean is_signed)
+{
+    guint64 value = 0;
+    guint n;
+
+    for (n = 0; n < size; n++)
+        value |= (guint64) p[n] << (8 * n);
+    if (is_signed && size > 0 && size < 8 && (p[size - 1] & 0x80) != 0)
+        value |= G_MAXUINT64 << (8 * size);
+
+    return value;
+}
+
+static GArray *
+get_ntfs_extents (gint fd, guint64 device_size, GError **error)
+{
+    g_autoptr(GArray) extents = NULL;
+    g_autofree guchar *record = NULL;
+    g_autofree guchar *buffer = NULL;
+    guchar bs[512];
+    guint64 bytes_per_sector, cluster_size, total_sectors, mft_lcn, record_size, volume_size, num_clusters;
+    guint64 bitmap_size, num_bitmap_bytes, lcn;
+    guint usa_offset, usa_count, attr_offset, attr_length = 0, n;
+    const guchar *attr = NULL;
+    const guchar *p, *end;
+    gint8 clusters_per_record;
+
+    if (!read_at (fd, 0, bs, sizeof bs, error))
+        return NULL;
+
+    if (memcmp (bs + 3, "NTFS    ", 8) != 0)
+        goto invalid;
+
+    bytes_per_sector = get_le16 (bs + 0x0b);
+    if (bytes_per_sector < 256 || bytes_per_sector > 4096 || (bytes_per_sector & (bytes_per_sector - 1)) != 0)
+        goto invalid;
+    /* values above 0x80 are negative shifts, for clusters of 64 KiB and more */
+    if (bs[0x0d] <= 0x80)
+        cluster_size = bs[0x0d] * bytes_per_sector;
+    else if (256 - bs[0x0d] <= 31)
+        cluster_size = 1 << (256 - bs[0x0d]);
+    else
+        goto invalid;
+
+    total_sectors = get_le64 (bs + 0x28);
+    mft_lcn = get_le64 (bs + 0x30);
+    clusters_per_record = (gint8) bs[0x40];
+    if (clusters_per_record > 0)
+        record_size = clusters_per_record * cluster_size;
+    else if (clusters_per_record >= -31)
+        record_size = 1 << -clusters_per_record;
+    else
+        goto invalid;
+
+    volume_size = total_sectors * bytes_per_sector;
+    if (cluster_size == 0 || record_size < 512 || record_size > 65536 || volume_size > device_size
+        || mft_lcn * cluster_size + (NTFS_BITMAP_RECORD + 1) * record_size > volume_size)
+        goto invalid;
+    num_clusters = volume_size / cluster_size;
+
+    record = g_malloc (record_size);
+    if (!read_at (fd, mft_lcn * cluster_size + NTFS_BITMAP_RECORD * record_size, record, record_size, error))
+        return NULL;
+    if (memcmp (record, "FILE", 4) != 0)
+        goto invalid;
+
+    /* Undo the update sequence array: the last two bytes of every 512 bytes
+     * of the record are stored in the array and replaced by a check value
+     */
+    usa_offset = get_le16 (record + 0x04);
+    usa_count = get_le16 (record + 0x06);
+    if (usa_count == 0 || usa_offset + usa_count * 2 > record_size || (usa_count - 1) * 512 > record_size)
+        goto invalid;
+    for (n = 1; n < usa_count; n++) {
+        guchar *sector_end = record + n * 512 - 2;
+
+        if (memcmp (sector_end, record + usa_offset, 2) != 0)
+            goto invalid;
+        memcpy (sector_end, record + usa_offset + n * 2, 2);
+    }
+
+    /* Find the unnamed, non-resident $DATA attribute */
+    attr_offset = get_le16 (record + 0x14);
+    while (attr_offset + 16 <= record_size) {
+        const guchar *a = record + attr_offset;
+        guint32 type = get_le32 (a);
+
+        if (type == NTFS_ATTR_END)
+            break;
+        attr_length = get_le32 (a + 0x04);
+        if (attr_length < 16 || attr_offset + attr_length > record_size)
+            goto invalid;
+        if (type == NTFS_ATTR_DATA && a[0x08] == 1 && a[0x09] == 0 && attr_length >= 0x40) {
+            attr = a;
+            break;
+        }
+        attr_offset += attr_length;
+    }
+    if (attr == NULL) {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "No cluster bitmap found in the MFT");
+        return NULL;
+    }
+
+    bitmap_size = get_le64 (attr + 0x30);
+    if (bitmap_size * 8 < num_clusters)
+        goto invalid;
+
+    extents = g_array_new (FALSE, FALSE, sizeof (GduCopyExtent));
+    buffer = g_malloc (READ_CHUNK_SIZE);
+
+    /* Walk the runlist of the bitmap; each run is a header byte with the
+     * sizes of the length and the (relative) cluster offset that follow
+     */
+    num_bitmap_bytes = 0;
+    lcn = 0;
+    p = attr + get_le16 (attr + 0x20);
+    end = attr + attr_length;
+    while (p < end && *p != 0 && num_bitmap_bytes * 8 < num_clusters) {
+        guint length_size = *p & 0x0f;
+        guint offset_size = *p >> 4;
+        guint64 run_bytes, run_offset;
+
+        /* sparse runs (no offset) do not occur in $Bitmap */
+        if (length_size == 0 || length_size > 8 || offset_size == 0 || offset_size > 8
+            || p + 1 + length_size + offset_size > end)
+            goto invalid;
+
+        run_bytes = ntfs_get_varint (p + 1, length_size, FALSE) * cluster_size;
+        lcn += ntfs_get_varint (p + 1 + length_size, offset_size, TRUE);
+        p += 1 + length_size + offset_size;
+
+        if (lcn >= num_clusters)
+            goto invalid;
+
+        for (run_offset = 0; run_offset < run_bytes && num_bitmap_bytes * 8 < num_clusters;) {
+            guint64 num = MIN (MIN (READ_CHUNK_SIZE, run_bytes - run_offset), (num_clusters + 7) / 8 - num_bitmap_bytes);
+
+            if (!read_at (fd, lcn * cluster_size + run_offset, buffer, num, error))
+                return NULL;
+            add_bitmap (extents, buffer, MIN (num * 8, num_clusters - num_bitmap_bytes * 8),
+                        num_bitmap_bytes * 8 * cluster_size, cluster_size);
+            run_offset += num;
+            num_bitmap_bytes += num;
+        }
+    }
+    if (num_bitmap_bytes * 8 < num_clusters)
+        goto invalid;
+
+    /* The backup boot sector is right after the last cluster */
+    if (volume_size + bytes_per_sector <= device_size)
+        add_used (extents, volume_size, bytes_per_sector);
+
+    return g_steal_pointer (&extents);
+
+invalid:
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, "Invalid or unsupported NTFS filesystem");
+    return NULL;
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/**
+ * gdu_used_blocks_is_supported:
+ * @fs_type: A filesystem type, as in #UDisksBlock:id-type.
+ *
+ * Returns: Whether gdu_used_blocks_get_extents() knows how to read the
+ *   allocation bitmap of @fs_type.
+ */
+gboolean
+gdu_used_blocks_is_supported (const gchar *fs_type)
+{
+    return g_strcmp0 (fs_type, "ext2") == 0 || g_strcmp0 (fs_type, "ext3") == 0 || g_strcmp0 (fs_type, "ext4") == 0
+           || g_strcmp0 (fs_type, "vfat") == 0 || g_strcmp0 (fs_type, "ntfs") == 0;
+}
+
+/**
+ * gdu_used_blocks_get_extents:
+ * @fd: A file descriptor for the device with the filesystem.
+ * @fs_type: The type of the filesystem, as in #UDisksBlock:id-type.
+ * @device_size: The size of the device.
+ * @error: Return location for error or %NULL.
+ *
+ * Reads the allocation bitmap of the filesystem on @fd. The filesystem
+ * must not be mounted read-write, or the result may be outdated by the time
+ * it is used.
+ *
+ * Returns: (transfer full): An array of #GduCopyExtent in increasing order
+ *   with the parts of the device that are in use, or %NULL if @error is set.
+ */
+GArray *
+gdu_used_blocks_get_extents (gint fd, const gchar *fs_type, guint64 device_size, GError **error)
+{
+    GArray *extents;
+
+    if (g_str_has_prefix (fs_type, "ext") && gdu_used_blocks_is_supported (fs_type)) {
+        extents = get_ext_extents (fd, device_size, error);
+    } else if (g_strcmp0 (fs_type, "vfat") == 0) {
+        extents = get_fat_extents (fd, device_size, error);
+    } else if (g_strcmp0 (fs_type, "ntfs") == 0) {
+        extents = get_ntfs_extents (fd, device_size, error);
+    } else {
+        g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED, "Filesystem type %s is not supported", fs_type);
+        return NULL;
+    }
+
+    /* The alignment may have moved the end of the last extent past the end of the device */
+    if (extents != NULL && extents->len > 0) {
+        GduCopyExtent *last = &g_array_index (extents, GduCopyExtent, extents->len - 1);
+
+        last->size = MIN (last->offset + last->size, device_size) - last->offset;
+    }
+
+    return extents;
+}
@@ -0,0 +1,20 @@
+/* gduusedblocks.h
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#pragma once
+
+#include <gio/gio.h>
+
+#include "gdutypes.h"
+
+G_BEGIN_DECLS
+
+gboolean gdu_used_blocks_is_supported (const gchar *fs_type);
+
+GArray *gdu_used_blocks_get_extents (gint fd, const gchar *fs_type, guint64 device_size, GError **error);
+
+G_END_DECLS
@@ -1,9 +1,16 @@
 mod config;
 
+mod block_device;
+mod block_size_tuner;
+mod checkpoint;
+mod decoder_thread;
 mod estimator;
 mod ffi;
 mod gdu_combo_row;
 mod localjob;
 mod page_aligned_buffer;
 mod restore_disk_image_dialog;
+mod restore_target;
+mod xz_decoder;
+mod zstd_decoder;
 pub use restore_disk_image_dialog::GduRestoreDiskImageDialog;
@@ -46,6 +46,9 @@ mod imp {
         rate: Cell<u64>,
         #[property(get, set)]
         start_time: Cell<u64>,
+        /// Set by [`super::LocalJob::cancel`], the code running the job checks it.
+        #[property(get)]
+        pub(super) canceled: Cell<bool>,
     }
 
     #[glib::object_subclass]
@@ -73,4 +76,14 @@ impl LocalJob {
             .property("object", BoxedUdisksObject(object))
             .build()
     }
+
+    /// Asks the code running the job to stop, if the job is cancelable, and emits `canceled`.
+    pub fn cancel(&self) {
+        if !self.cancelable() || self.canceled() {
+            return;
+        }
+        self.imp().canceled.set(true);
+        self.notify_canceled();
+        self.emit_by_name::<()>("canceled", &[]);
+    }
 }
@@ -57,8 +57,23 @@ impl PageAlignedBuffer {
         // [`self.size`] bytes
         unsafe { std::slice::from_raw_parts_mut(self.buffer_ptr, self.size) }
     }
+
+    /// Returns a slice of the allocated buffer.
+    pub fn as_slice(&self) -> &[u8] {
+        // SAFETY: see [`Self::as_mut_slice`], a shared reference to the buffer only gives out
+        // shared references to the memory
+        unsafe { std::slice::from_raw_parts(self.buffer_ptr, self.size) }
+    }
 }
 
+// SAFETY: the buffer exclusively owns its memory, so it can be moved to another thread, e.g. to
+// write it on a worker thread.
+unsafe impl Send for PageAlignedBuffer {}
+
+// SAFETY: the memory can only be changed through an exclusive reference, so a buffer can be
+// shared between threads, e.g. to write it to several devices at once.
+unsafe impl Sync for PageAlignedBuffer {}
+
 impl Drop for PageAlignedBuffer {
     fn drop(&mut self) {
         unsafe {
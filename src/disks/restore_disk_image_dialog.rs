@@ -1,10 +1,15 @@
+use std::cell::RefCell;
 use std::collections::HashMap;
-use std::io::{ErrorKind, Read};
+use std::io::{ErrorKind, Seek, SeekFrom};
 use std::ops::Sub;
-use std::os::fd::{AsRawFd, OwnedFd};
+use std::os::unix::fs::{FileExt, MetadataExt};
+use std::rc::Rc;
+use std::sync::Arc;
+use std::sync::atomic::Ordering;
 
 use adw::prelude::*;
-use async_std::io::{ReadExt, WriteExt};
+use async_std::io::ReadExt;
+use futures::StreamExt;
 use gettextrs::{gettext, pgettext};
 use gtk::glib::property::PropertySet;
 use gtk::subclass::prelude::*;
@@ -12,28 +17,205 @@ use gtk::{gio, glib};
 use libgdu::ConfirmationDialogResponse;
 use libgdu::gettext::gettext_f;
 
+use crate::block_device;
+use crate::block_size_tuner::BlockSizeTuner;
+use crate::checkpoint::{self, Checkpoint, ChunkHasher};
 use crate::estimator::{self, Estimator};
 use crate::ffi;
+use crate::localjob::LocalJob;
 use crate::page_aligned_buffer::PageAlignedBuffer;
+use crate::restore_target::{Block, RestoreTarget, TargetOptions};
+use crate::xz_decoder;
+use crate::zstd_decoder;
 
-/// Device size in bytes of the block device from `fd`.
+/// Reads from `input_stream` until `buffer` is full or the end of the stream is reached.
 ///
-/// # Errors
-///
-/// Returns an error, if the given file descriptor is not for a block device.
-fn device_size(fd: &OwnedFd) -> std::io::Result<u64> {
-    // Defined in Linux/fs.h
-    const BLKGETSIZE64_CODE: u8 = 0x12;
-    const BLKGETSIZE64_SEQ: u8 = 114;
-    nix::ioctl_read!(blkgetsize64, BLKGETSIZE64_CODE, BLKGETSIZE64_SEQ, u64);
+/// Returns the number of bytes read, which is only less than the size of `buffer` at the end of
+/// the stream.
+async fn read_block(
+    input_stream: &mut (impl async_std::io::Read + std::marker::Unpin),
+    buffer: &mut [u8],
+) -> std::io::Result<usize> {
+    let mut filled = 0;
+    while filled < buffer.len() {
+        match input_stream.read(&mut buffer[filled..]).await {
+            Ok(0) => break,
+            Ok(n) => filled += n,
+            Err(err) if err.kind() == ErrorKind::Interrupted => continue,
+            Err(err) => return Err(err),
+        }
+    }
+    Ok(filled)
+}
+
+/// What a restore found out about the checksum saved next to the disk image.
+enum ChecksumResult {
+    /// There is no checksum of the data written.
+    Absent,
+    /// The data written matches the checksum.
+    Matched(String),
+    /// The restore was continued, so the data before the checkpoint was not read to check it.
+    NotChecked,
+}
+
+/// The error of a restore that was canceled, which is not shown to the user.
+#[derive(Debug)]
+struct Canceled;
+
+impl std::fmt::Display for Canceled {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "The restore was canceled")
+    }
+}
+
+impl std::error::Error for Canceled {}
+
+/// Returns an error if `job` was canceled.
+fn check_canceled(job: Option<&LocalJob>) -> std::io::Result<()> {
+    match job {
+        Some(job) if job.canceled() => Err(std::io::Error::other(Canceled)),
+        _ => Ok(()),
+    }
+}
+
+fn is_canceled(err: &(dyn std::error::Error + 'static)) -> bool {
+    err.downcast_ref::<std::io::Error>()
+        .and_then(|err| err.get_ref())
+        .is_some_and(|err| err.is::<Canceled>())
+}
+
+/// Returns the offset of the first data at or after `offset` in the sparse `file`, or the size of
+/// the file if there is only a hole left.
+fn next_data(file: &std::fs::File, offset: u64, file_size: u64) -> std::io::Result<u64> {
+    use std::os::fd::AsRawFd;
+
+    let data_offset =
+        unsafe { libc::lseek(file.as_raw_fd(), offset as libc::off_t, libc::SEEK_DATA) };
+    if data_offset >= 0 {
+        Ok(data_offset as u64)
+    } else {
+        let err = std::io::Error::last_os_error();
+        match err.raw_os_error() {
+            Some(libc::ENXIO) => Ok(file_size),
+            _ => Err(err),
+        }
+    }
+}
 
-    let mut block_device_size = 0;
-    if unsafe { blkgetsize64(fd.as_raw_fd(), &mut block_device_size) } != Ok(0) {
-        log::error!("Error determining size of device");
-        return Err(std::io::Error::from(std::io::ErrorKind::InvalidInput));
+/// Whether `data` contains only zeroes.
+fn is_zero(data: &[u8]) -> bool {
+    // compare the buffer against itself shifted by a few bytes, which is done with memcmp
+    const HEAD: usize = 16;
+    if data.len() <= HEAD {
+        return data.iter().all(|byte| *byte == 0);
     }
+    data[..HEAD].iter().all(|byte| *byte == 0) && data[..data.len() - HEAD] == data[HEAD..]
+}
+
+/// Adds `len` zeroes to `checksum`, for the holes of sparse disk images.
+fn checksum_zeroes(checksum: &mut glib::Checksum, mut len: u64) {
+    const ZEROES: [u8; 64 * 1024] = [0; 64 * 1024];
+    while len > 0 {
+        let n = len.min(ZEROES.len() as u64) as usize;
+        checksum.update(&ZEROES[..n]);
+        len -= n as u64;
+    }
+}
+
+/// Reads the SHA-256 checksum saved next to the disk image at `path` by Create Disk Image (or
+/// `sha256sum`), if there is one.
+fn saved_checksum(path: &std::path::Path) -> Option<String> {
+    let mut checksum_path = path.as_os_str().to_owned();
+    checksum_path.push(".sha256");
+    let contents = std::fs::read_to_string(checksum_path).ok()?;
+    let checksum = contents.split_whitespace().next()?.to_ascii_lowercase();
+    if checksum.len() != 64 || !checksum.bytes().all(|byte| byte.is_ascii_hexdigit()) {
+        log::info!("Ignoring invalid checksum of {}", path.display());
+        return None;
+    }
+    Some(checksum)
+}
+
+/// A device the disk image is restored to along with others, see
+/// [`GduRestoreDiskImageDialog::restore_to_destinations`].
+struct Destination {
+    block: udisks::block::BlockProxy<'static>,
+    name: String,
+    job: Rc<LocalJob>,
+    estimator: Estimator,
+    verifying: bool,
+    target: Option<RestoreTarget>,
+    result: Result<(), Box<dyn std::error::Error>>,
+}
+
+/// Updates the progress of `job` from `estimator`, or sets it to complete if `done`.
+fn update_local_job(job: &LocalJob, estimator: Option<&Estimator>, done: bool) {
+    let (bytes_per_sec, usec_remaining, completed_bytes, target_bytes) =
+        if let Some(estimator) = estimator {
+            (
+                estimator.bytes_per_sec(),
+                estimator.usec_remaining(),
+                estimator.completed_bytes(),
+                estimator.target_bytes(),
+            )
+        } else {
+            (0, 0, 0, 0)
+        };
+
+    job.set_bytes(target_bytes);
+    job.set_rate(bytes_per_sec);
+
+    let progress = if done {
+        1.0
+    } else if target_bytes != 0 {
+        completed_bytes as f64 / target_bytes as f64
+    } else {
+        0.0
+    };
+    job.set_progress(progress);
+
+    let end_time = if usec_remaining == 0 {
+        0
+    } else {
+        usec_remaining + glib::real_time() as u64
+    };
+    job.set_expected_end_time(end_time);
+}
 
-    Ok(block_device_size)
+/// The compression of a disk image.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+enum Compression {
+    None,
+    Xz,
+    Zstd,
+}
+
+impl Compression {
+    fn from_content_type(content_type: &str) -> Self {
+        if content_type.ends_with("-xz-compressed") {
+            Self::Xz
+        } else if content_type == "application/zstd" || content_type.ends_with("-zstd-compressed") {
+            Self::Zstd
+        } else {
+            Self::None
+        }
+    }
+}
+
+/// The disk image to restore, as shown in the dialog.
+#[derive(Debug, Clone)]
+struct ImageInfo {
+    name: String,
+    compression: Compression,
+    /// The size of the decompressed data, `None` if the disk image does not store it, or why it
+    /// could not be read.
+    size: Result<Option<u64>, String>,
+}
+
+thread_local! {
+    /// Uncompressed sizes of the compressed disk images already looked at, by device, inode and
+    /// modification time.
+    static UNCOMPRESSED_SIZES: RefCell<HashMap<(u32, u64, u64), Option<u64>>> = RefCell::default();
 }
 
 mod imp {
@@ -42,9 +224,9 @@ mod imp {
         rc::Rc,
     };
 
-    use adw::subclass::dialog::AdwDialogImpl;
+    use adw::subclass::dialog::{AdwDialogImpl, AdwDialogImplExt};
 
-    use crate::{config, gdu_combo_row::GduComboRow, localjob::LocalJob};
+    use crate::{config, gdu_combo_row::GduComboRow};
 
     use super::*;
 
@@ -52,6 +234,7 @@ mod imp {
     #[template(resource = "/org/gnome/DiskUtility/ui/gdu-restore-disk-image-dialog.ui")]
     pub struct GduRestoreDiskImageDialog {
         pub(super) restore_file: RefCell<Option<gio::File>>,
+        pub(super) image_info: RefCell<Option<ImageInfo>>,
         pub(super) block_size: Cell<u64>,
         pub(super) client: RefCell<Option<udisks::Client>>,
         pub(super) object: RefCell<Option<udisks::Object>>,
@@ -59,7 +242,11 @@ mod imp {
         pub(super) drive: RefCell<Option<udisks::drive::DriveProxy<'static>>>,
         pub(super) inhibit_cookie: Cell<Option<u32>>,
         pub(super) destination_drives: RefCell<Vec<udisks::Object>>,
+        /// The devices the disk image can be restored to as well, with their rows.
+        pub(super) additional_destinations: RefCell<Vec<(udisks::Object, adw::SwitchRow)>>,
         pub(super) local_job: RefCell<Option<Rc<LocalJob>>>,
+        /// The jobs of the devices, when restoring to several devices at once.
+        pub(super) destination_jobs: RefCell<Vec<Rc<LocalJob>>>,
 
         #[template_child]
         pub(super) size_row: TemplateChild<adw::ActionRow>,
@@ -72,6 +259,12 @@ mod imp {
         #[template_child]
         pub(super) destination_row: TemplateChild<GduComboRow>,
         #[template_child]
+        pub(super) additional_destinations_row: TemplateChild<adw::ExpanderRow>,
+        #[template_child]
+        pub(super) direct_io_row: TemplateChild<adw::SwitchRow>,
+        #[template_child]
+        pub(super) verify_row: TemplateChild<adw::SwitchRow>,
+        #[template_child]
         pub(super) error_banner: TemplateChild<adw::Banner>,
         #[template_child]
         pub(super) warning_banner: TemplateChild<adw::Banner>,
@@ -123,7 +316,18 @@ mod imp {
     }
 
     impl WidgetImpl for GduRestoreDiskImageDialog {}
-    impl AdwDialogImpl for GduRestoreDiskImageDialog {}
+    impl AdwDialogImpl for GduRestoreDiskImageDialog {
+        fn closed(&self) {
+            // closing the dialog while restoring stops the restore
+            if let Some(job) = self.local_job.borrow().as_ref() {
+                job.cancel();
+            }
+            for job in self.destination_jobs.borrow().iter() {
+                job.cancel();
+            }
+            self.parent_closed();
+        }
+    }
 }
 
 glib::wrapper! {
@@ -163,9 +367,13 @@ impl GduRestoreDiskImageDialog {
             imp.destination_row.remove_css_class("property");
             dialog.populate_destination_combobox().await;
         }
+        dialog.populate_additional_destinations().await;
 
         dialog.display_size_warning();
         dialog.present(parent_window);
+        glib::spawn_future_local(glib::clone!(@weak dialog => async move {
+            dialog.load_image_info().await;
+        }));
         dialog
     }
 
@@ -185,6 +393,7 @@ impl GduRestoreDiskImageDialog {
         //TODO: use a method call for this so it works on e.g. floppy drives where e.g. we don't know the size
         imp.block_size.set(block.size().await.unwrap_or_default());
         imp.block.replace(Some(block));
+        self.update_additional_destinations();
     }
 
     /// Returns a the [`gtk::Window`] of the dialog.
@@ -192,57 +401,142 @@ impl GduRestoreDiskImageDialog {
         self.ancestor(gtk::Window::static_type()).and_downcast()
     }
 
-    /// Displays an error banner, if the disk image is too large,
-    /// or a warning banner if the disk image is much smaller, than the target device.
-    fn display_size_warning(&self) -> Option<()> {
+    /// Looks up the name, compression and size of the [`restore_file`] and displays them.
+    ///
+    /// Compressed images are sized from their index on a separate thread. The sizes are cached by
+    /// inode and modification time, so the file is only read once.
+    async fn load_image_info(&self) {
         let imp = self.imp();
-        let client = self.client();
-        let mut restore_warning = None;
-        let mut restore_error = None;
+        imp.image_info.replace(None);
+        self.display_size_warning();
 
-        let Some(file) = &*imp.restore_file.borrow() else {
-            imp.start_restore_button.set_sensitive(false);
-            return None;
+        let Some(file) = imp.restore_file.borrow().clone() else {
+            return;
         };
+        let image_info = Self::query_image_info(&file).await;
+        // another image may have been chosen in the meantime
+        if imp.restore_file.borrow().as_ref() != Some(&file) {
+            return;
+        }
+        imp.image_info.replace(image_info);
+        self.display_size_warning();
+    }
 
+    async fn query_image_info(file: &gio::File) -> Option<ImageInfo> {
         let info = file
-            .query_info(
+            .query_info_future(
                 &format!(
-                    "{},{},{}",
+                    "{},{},{},{},{},{},{}",
                     gio::FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
                     gio::FILE_ATTRIBUTE_STANDARD_DISPLAY_NAME,
-                    gio::FILE_ATTRIBUTE_STANDARD_SIZE
+                    gio::FILE_ATTRIBUTE_STANDARD_SIZE,
+                    gio::FILE_ATTRIBUTE_UNIX_DEVICE,
+                    gio::FILE_ATTRIBUTE_UNIX_INODE,
+                    gio::FILE_ATTRIBUTE_TIME_MODIFIED,
+                    gio::FILE_ATTRIBUTE_TIME_MODIFIED_USEC
                 ),
                 gio::FileQueryInfoFlags::empty(),
-                gio::Cancellable::NONE,
+                glib::Priority::DEFAULT,
             )
+            .await
             .ok()?;
-        let name = info.display_name();
-
-        let is_xz_compressed = info.content_type()?.ends_with("-xz-compressed");
-        let size = if is_xz_compressed {
-            let filestream = file.read(gio::Cancellable::NONE).ok()?.into_read();
-            liblzma::uncompressed_size(filestream).unwrap_or_else(|_| {
-                restore_error = Some(gettext("File does not appear to be XZ compressed"));
-                0
-            })
-        } else {
-            info.size() as u64
+        let name = info.display_name().to_string();
+        let compression = Compression::from_content_type(&info.content_type()?);
+        if compression == Compression::None {
+            return Some(ImageInfo {
+                name,
+                compression,
+                size: Ok(Some(info.size() as u64)),
+            });
+        }
+
+        // files without an inode, e.g. on some network shares, are not cached
+        let key = info.has_attribute(gio::FILE_ATTRIBUTE_UNIX_INODE).then(|| {
+            (
+                info.attribute_uint32(gio::FILE_ATTRIBUTE_UNIX_DEVICE),
+                info.attribute_uint64(gio::FILE_ATTRIBUTE_UNIX_INODE),
+                info.attribute_uint64(gio::FILE_ATTRIBUTE_TIME_MODIFIED) * 1_000_000
+                    + info.attribute_uint32(gio::FILE_ATTRIBUTE_TIME_MODIFIED_USEC) as u64,
+            )
+        });
+        let cached_size =
+            key.and_then(|key| UNCOMPRESSED_SIZES.with_borrow(|sizes| sizes.get(&key).copied()));
+        let size = match cached_size {
+            Some(size) => Ok(size),
+            None => {
+                let file = file.clone();
+                gio::spawn_blocking(move || {
+                    let mut input = file
+                        .read(gio::Cancellable::NONE)
+                        .map_err(std::io::Error::other)?
+                        .into_read();
+                    match compression {
+                        Compression::Xz => xz_decoder::uncompressed_size(&mut input).map(Some),
+                        Compression::Zstd => zstd_decoder::uncompressed_size(&mut input),
+                        Compression::None => unreachable!("uncompressed images are not decoded"),
+                    }
+                })
+                .await
+                .expect("reading the size of the disk image should not panic")
+            }
         };
+        if let (Some(key), Ok(size)) = (key, &size) {
+            UNCOMPRESSED_SIZES.with_borrow_mut(|sizes| sizes.insert(key, *size));
+        }
 
-        // Translators: When shown for a compressed disk image in the "Size" field.
-        // The %s is the uncompressed size as a long string e.g. "4.2 MB (4,300,123 bytes)".
-        let size_str = gettext_f(
-            if is_xz_compressed {
-                "{} when decompressed"
-            } else {
-                "{}"
-            },
-            [client.size_for_display(size, false, true)],
-        );
+        let size = size.map_err(|err| {
+            log::info!("Error reading the uncompressed size of the disk image: {err}");
+            match compression {
+                Compression::Zstd => gettext("File does not appear to be Zstandard compressed"),
+                _ => gettext("File does not appear to be XZ compressed"),
+            }
+        });
+        Some(ImageInfo {
+            name,
+            compression,
+            size,
+        })
+    }
+
+    /// Displays an error banner, if the disk image is too large,
+    /// or a warning banner if the disk image is much smaller, than the target device.
+    fn display_size_warning(&self) -> Option<()> {
+        let imp = self.imp();
+        let client = self.client();
+        let mut restore_warning = None;
+        let mut restore_error = None;
+
+        let Some(image_info) = imp.image_info.borrow().clone() else {
+            imp.start_restore_button.set_sensitive(false);
+            return None;
+        };
+        let size = image_info.size.unwrap_or_else(|err| {
+            restore_error = Some(err);
+            Some(0)
+        });
+
+        let size_str = match size {
+            // Translators: When shown for a compressed disk image in the "Size" field.
+            // The %s is the uncompressed size as a long string e.g. "4.2 MB (4,300,123 bytes)".
+            Some(size) => gettext_f(
+                if image_info.compression != Compression::None {
+                    "{} when decompressed"
+                } else {
+                    "{}"
+                },
+                [client.size_for_display(size, false, true)],
+            ),
+            // Translators: Shown in the "Size" field for a compressed disk image that does not
+            // store its uncompressed size
+            None => gettext("Unknown until decompressed"),
+        };
+        let size_known = size.is_some();
+        let size = size.unwrap_or_default();
 
         let block_left_over_size = imp.block_size.get() as i64 - size as i64;
-        if size == 0 {
+        if restore_error.is_some() || !size_known {
+            // the size is not known
+        } else if size == 0 {
             restore_error = Some(gettext("Cannot restore image of size 0"));
         } else if block_left_over_size > 1000 * 1000 {
             // Only complain if slack is bigger than 1MB
@@ -267,15 +561,15 @@ impl GduRestoreDiskImageDialog {
         imp.warning_banner.set_revealed(restore_warning.is_some());
         imp.start_restore_button
             .set_sensitive(restore_error.is_none());
-        imp.image_row.set_subtitle(&name);
+        imp.image_row.set_subtitle(&image_info.name);
         imp.size_row.set_subtitle(&size_str);
 
         Some(())
     }
 
-    async fn populate_destination_combobox(&self) {
-        let mut drives: Vec<udisks::Object> = Vec::new();
-        let drive_names = gtk::StringList::default();
+    /// Returns the devices a disk image can be restored to, with their names.
+    async fn destination_candidates(&self) -> Vec<(udisks::Object, String)> {
+        let mut candidates = Vec::new();
 
         let client = self.client();
         for object in client
@@ -303,8 +597,18 @@ impl GduRestoreDiskImageDialog {
             };
 
             let info = client.object_info(&object).await;
-            drive_names.append(&info.one_liner.unwrap());
             let object = client.object(block.inner().path().to_owned()).unwrap();
+            candidates.push((object, info.one_liner.unwrap()));
+        }
+
+        candidates
+    }
+
+    async fn populate_destination_combobox(&self) {
+        let drive_names = gtk::StringList::default();
+        let mut drives: Vec<udisks::Object> = Vec::new();
+        for (object, name) in self.destination_candidates().await {
+            drive_names.append(&name);
             drives.push(object);
         }
 
@@ -313,6 +617,46 @@ impl GduRestoreDiskImageDialog {
         self.imp().destination_drives.replace(drives);
     }
 
+    /// Lists the devices the disk image can be restored to along with the destination, so the
+    /// disk image is only read once for all of them.
+    async fn populate_additional_destinations(&self) {
+        let imp = self.imp();
+        let mut destinations = Vec::new();
+        for (object, name) in self.destination_candidates().await {
+            let row = adw::SwitchRow::builder().title(name).build();
+            imp.additional_destinations_row.add_row(&row);
+            destinations.push((object, row));
+        }
+
+        imp.additional_destinations_row
+            .set_visible(destinations.len() > 1);
+        imp.additional_destinations.replace(destinations);
+        self.update_additional_destinations();
+    }
+
+    /// Hides the destination from the additional destinations.
+    fn update_additional_destinations(&self) {
+        let imp = self.imp();
+        let object = imp.object.borrow();
+        for (candidate, row) in imp.additional_destinations.borrow().iter() {
+            let is_destination = object
+                .as_ref()
+                .is_some_and(|object| object.object_path() == candidate.object_path());
+            row.set_visible(!is_destination);
+        }
+    }
+
+    /// The additional destinations that are selected.
+    fn selected_additional_destinations(&self) -> Vec<udisks::Object> {
+        self.imp()
+            .additional_destinations
+            .borrow()
+            .iter()
+            .filter(|(_, row)| row.is_visible() && row.is_active())
+            .map(|(object, _)| object.clone())
+            .collect()
+    }
+
     //NOTE: this should be kept in sync with `src/disks/gdu-manager.c`
     async fn should_display(&self, object: &udisks::Object) -> udisks::Result<bool> {
         let block = object.block().await?;
@@ -365,6 +709,7 @@ impl GduRestoreDiskImageDialog {
         let selected_drive =
             self.imp().destination_drives.borrow()[combo_row.selected() as usize].clone();
         self.set_destination_object(selected_drive).await;
+        // the size of the image is already known, only the destination changed
         self.display_size_warning();
     }
 
@@ -388,8 +733,11 @@ impl GduRestoreDiskImageDialog {
     async fn on_start_restore_button_clicked_cb(&self, _button: &gtk::Button) {
         let imp = self.imp();
         let object = imp.object.borrow().clone().unwrap();
+        let mut objects = vec![object.clone()];
+        objects.extend(self.selected_additional_destinations());
         let affected_devices_widget =
-            libgdu::create_widget_from_objects(&self.client(), &[&object]).await;
+            libgdu::create_widget_from_objects(&self.client(), &objects.iter().collect::<Vec<_>>())
+                .await;
 
         let confirmation_dialog = libgdu::ConfirmationDialog {
             message: gettext("Are you sure you want to write the disk image to the device?"),
@@ -413,25 +761,12 @@ impl GduRestoreDiskImageDialog {
     async fn restore_disk_image(&self, object: &udisks::Object) -> Option<()> {
         let imp = self.imp();
         let file = imp.restore_file.borrow().clone()?;
-        let info = match file.query_info(
-            &format!(
-                "{},{}",
-                gio::FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
-                gio::FILE_ATTRIBUTE_STANDARD_SIZE
-            ),
-            gio::FileQueryInfoFlags::empty(),
-            gio::Cancellable::NONE,
-        ) {
-            Ok(info) => info,
-            Err(err) => {
-                libgdu::show_error(self, &gettext("Error determining size of file"), err.into())
-                    .await;
-                return None;
-            }
-        };
-
-        let mut input_size = info.size() as u64;
-        let mut input_stream = match file.read(gio::Cancellable::NONE) {
+        // The restore button is only sensitive once the size is read. A disk image that does not
+        // store its size is restored as if it filled the device, writing past its end fails.
+        let image_info = imp.image_info.borrow().clone()?;
+        let input_size = image_info.size.ok()?.unwrap_or(imp.block_size.get());
+        let compression = image_info.compression;
+        let input_stream = match file.read(gio::Cancellable::NONE) {
             Ok(stream) => stream.into_read(),
             Err(err) => {
                 libgdu::show_error(self, &gettext("Error opening file for reading"), err.into())
@@ -440,12 +775,52 @@ impl GduRestoreDiskImageDialog {
             }
         };
 
-        let is_xz_compressed = info.content_type()?.ends_with("-xz-compressed");
-        let input_stream: &mut dyn Read = if is_xz_compressed {
-            input_size = liblzma::uncompressed_size(&mut input_stream).ok()?;
-            &mut liblzma::read::XzDecoder::new(input_stream)
+        let direct_io = imp.direct_io_row.is_active();
+        let verify = imp.verify_row.is_active();
+        // Compressed images are read through the decoder's own buffers, which do not meet the
+        // alignment requirements of direct I/O
+        // Local raw images are read from a plain file, so the holes of sparse images can be found
+        // and skipped
+        let raw_input = if compression != Compression::None {
+            None
         } else {
-            &mut input_stream
+            file.path().and_then(|path| {
+                if direct_io {
+                    match block_device::open_direct(&path) {
+                        Ok(direct_input) => return Some(direct_input),
+                        Err(err) => {
+                            log::info!("Not using direct I/O for reading the disk image: {err}")
+                        }
+                    }
+                }
+                std::fs::File::open(&path).ok()
+            })
+        };
+        // Compressed images of local files are decoded on their own thread, so decoding the next
+        // blocks overlaps with writing the previous ones to the device
+        let compressed_input = match compression {
+            Compression::None => None,
+            _ => file.path().and_then(|path| std::fs::File::open(path).ok()),
+        };
+        let mut input_stream: Box<dyn futures::io::AsyncRead + Unpin + '_> = match compression {
+            Compression::Xz => match compressed_input {
+                Some(compressed_input) => Box::new(xz_decoder::spawn_decoder(compressed_input)),
+                None => Box::new(futures::io::AllowStdIo::new(xz_decoder::decoder(
+                    input_stream,
+                ))),
+            },
+            Compression::Zstd => match compressed_input {
+                Some(compressed_input) => Box::new(zstd_decoder::spawn_decoder(compressed_input)),
+                None => Box::new(futures::io::AllowStdIo::new(
+                    zstd_decoder::decoder(input_stream).ok()?,
+                )),
+            },
+            Compression::None => match raw_input.as_ref() {
+                Some(raw_input) => Box::new(futures::io::AllowStdIo::new(
+                    block_device::BufferedFallback(raw_input),
+                )),
+                None => Box::new(futures::io::AllowStdIo::new(input_stream)),
+            },
         };
 
         let application = self
@@ -463,6 +838,34 @@ impl GduRestoreDiskImageDialog {
         );
         imp.inhibit_cookie.set(Some(inhibit_cookie));
 
+        let additional_objects = self.selected_additional_destinations();
+        if !additional_objects.is_empty() {
+            let mut objects = vec![object.clone()];
+            objects.extend(additional_objects);
+            libgdu::ensure_unused_list(
+                &self.client(),
+                &self.window()?,
+                &objects.iter().collect::<Vec<_>>(),
+            )
+            .await
+            .ok()?;
+
+            self.restore_to_destinations(
+                &objects,
+                &mut input_stream,
+                input_size,
+                direct_io,
+                verify,
+            )
+            .await;
+
+            self.play_complete_sound();
+            application.uninhibit(imp.inhibit_cookie.take()?);
+            self.set_visible(false);
+            self.close();
+            return Some(());
+        }
+
         libgdu::ensure_unused(&self.client(), &self.window()?, object)
             .await
             .ok()?;
@@ -476,25 +879,77 @@ impl GduRestoreDiskImageDialog {
         imp.local_job.replace(Some(local_job));
 
         let block = imp.block.borrow().clone()?;
+        // Smaller disk images are restored again quickly, so they are neither hashed for
+        // checkpoints nor continued
+        const MIN_CHECKPOINT_SIZE: u64 = 16 * checkpoint::CHUNK_SIZE;
+        let image_id = file
+            .path()
+            .filter(|_| input_size >= MIN_CHECKPOINT_SIZE)
+            .and_then(|path| Self::image_id(&path).ok());
+        let checkpoint_ids = match image_id {
+            Some(image_id) => Some((image_id, self.device_id(object, &block).await)),
+            None => None,
+        };
+        // The checksum is of the disk image file, which is only what is written to the device
+        // for uncompressed disk images
+        let expected_checksum = match compression {
+            Compression::None => file.path().and_then(|path| saved_checksum(&path)),
+            _ => None,
+        };
         let res = self
             .copy_disk_image(
                 block,
-                &mut futures::io::AllowStdIo::new(input_stream),
+                &mut input_stream,
+                raw_input.as_ref(),
                 input_size,
+                direct_io,
+                verify,
+                checkpoint_ids,
+                expected_checksum,
             )
             .await;
 
         self.play_complete_sound();
         application.uninhibit(imp.inhibit_cookie.take()?);
 
-        if let Err(err) = res {
-            libgdu::show_error(self, &gettext("Error restoring disk image"), err).await;
-        } else {
-            // successfully written image to device
-            self.update_job(None, true);
-            // clear job
-            if let Some(job) = imp.local_job.take() {
-                ffi::destroy_local_job(job);
+        match res {
+            Err(err) if is_canceled(&*err) => {
+                log::info!("Restore canceled");
+                if let Some(job) = imp.local_job.take() {
+                    ffi::destroy_local_job(job);
+                }
+            }
+            Err(err) => {
+                libgdu::show_error(self, &gettext("Error restoring disk image"), err).await;
+            }
+            Ok(checksum) => {
+                // successfully written image to device
+                self.update_job(None, true);
+                let body = match checksum {
+                    // Translators: Body of the notification shown once a disk image is restored. The
+                    // {} is the SHA-256 checksum of the disk image (64 hexadecimal digits).
+                    ChecksumResult::Matched(checksum) => Some(gettext_f(
+                        "The data written matches the SHA-256 checksum {}",
+                        [checksum],
+                    )),
+                    // Translators: Body of the notification shown once a disk image is restored,
+                    // if there is a checksum saved next to it that could not be checked
+                    ChecksumResult::NotChecked => Some(gettext(
+                        "The restore was continued, so the SHA-256 checksum was not checked",
+                    )),
+                    ChecksumResult::Absent => None,
+                };
+                if let Some(body) = body {
+                    // Translators: Title of the notification shown once a disk image is restored
+                    // and there is a checksum saved next to it
+                    let notification = gio::Notification::new(&gettext("Disk Image Restored"));
+                    notification.set_body(Some(&body));
+                    application.send_notification(Some("disk-image-restored"), &notification);
+                }
+                // clear job
+                if let Some(job) = imp.local_job.take() {
+                    ffi::destroy_local_job(job);
+                }
             }
         }
 
@@ -503,15 +958,74 @@ impl GduRestoreDiskImageDialog {
         Some(())
     }
 
+    /// Identifies the disk image at `path` for checkpoints, which only continue restoring the
+    /// same, unmodified disk image.
+    fn image_id(path: &std::path::Path) -> std::io::Result<String> {
+        let metadata = std::fs::metadata(path)?;
+        Ok(format!(
+            "{}:{}:{}:{}:{}",
+            path.display(),
+            metadata.dev(),
+            metadata.ino(),
+            metadata.size(),
+            metadata.mtime_nsec() as i128 + metadata.mtime() as i128 * 1_000_000_000
+        ))
+    }
+
+    /// Identifies the device for checkpoints by the drive ID, which stays the same when the
+    /// device is attached again.
+    async fn device_id(
+        &self,
+        object: &udisks::Object,
+        block: &udisks::block::BlockProxy<'static>,
+    ) -> String {
+        let drive = self.imp().drive.borrow().clone();
+        let drive_id = match drive {
+            Some(drive) => drive.id().await.unwrap_or_default(),
+            None => String::new(),
+        };
+        if drive_id.is_empty() {
+            return block.inner().path().to_string();
+        }
+        match object.partition().await {
+            Ok(partition) => format!(
+                "{drive_id}-part{}",
+                partition.number().await.unwrap_or_default()
+            ),
+            Err(_) => drive_id,
+        }
+    }
+
     /// Copies the disk image from the `input_stream` to the given block device.
+    ///
+    /// With `direct_io` the device is written with `O_DIRECT`, so the copy does not
+    /// leave the page cache full of dirty pages.
+    ///
+    /// If the device can zero ranges itself (see [`block_device::zero_method`]), blocks of zeroes
+    /// are not written but zeroed by the device. `input_file` is the file `input_stream` reads
+    /// from for raw images; its holes are zeroed the same way without even reading them.
+    ///
+    /// With `verify` the device is read back after writing it, see [`Self::verify_device`].
+    ///
+    /// With `checkpoint_ids` (the disk image and the device, see [`Checkpoint::load`]) the copy
+    /// saves checkpoints, and continues after the last one if it was interrupted before.
+    ///
+    /// With `expected_checksum` (the SHA-256 of the disk image), the data is hashed while it is
+    /// written, and the copy fails if it does not match. A restore that is continued is not
+    /// checked, as the data before the checkpoint is not read.
     async fn copy_disk_image(
         &self,
         block: udisks::block::BlockProxy<'static>,
         input_stream: &mut (impl async_std::io::Read + std::marker::Unpin),
+        input_file: Option<&std::fs::File>,
         input_size: u64,
+        direct_io: bool,
+        verify: bool,
+        checkpoint_ids: Option<(String, String)>,
+        expected_checksum: Option<String>,
         // we return a boxed error so we can return different error types
         // we don't use anyhow here, as the show error function expects a box
-    ) -> Result<(), Box<dyn std::error::Error>> {
+    ) -> Result<ChecksumResult, Box<dyn std::error::Error>> {
         let fd: std::os::fd::OwnedFd = block
             .open_for_restore(udisks::standard_options(false))
             .await?
@@ -520,7 +1034,7 @@ impl GduRestoreDiskImageDialog {
         // We can't use udisks_block_get_size() because the media may have
         // changed and udisks may not have noticed. TODO: maybe have a
         // Block.GetSize() method instead...
-        let block_device_size = device_size(&fd)?;
+        let block_device_size = block_device::device_size(&fd)?;
 
         if block_device_size == 0 {
             log::error!("Device is size 0");
@@ -528,46 +1042,301 @@ impl GduRestoreDiskImageDialog {
         }
         self.imp().block_size.set(block_device_size as u64);
 
-        // default to 1 MiB blocks
-        const BUFFER_SIZE: usize = 1024 * 1024;
-        let mut page_buffer = PageAlignedBuffer::new(BUFFER_SIZE);
-        let buffer_slice = page_buffer.as_mut_slice();
+        let logical_block_size = block_device::logical_block_size(&fd)?;
+        let device = Arc::new(std::fs::File::from(fd));
+
+        // Continue an interrupted restore of the same disk image after the chunks that are still
+        // on the device. This happens before enabling direct I/O, as the chunks are read back
+        // with unaligned buffers.
+        let mut checkpoint = checkpoint_ids
+            .map(|(source, device)| Checkpoint::load(&source, &device, block_device_size));
+        if let Some(checkpoint) = checkpoint.as_mut().filter(|c| !c.hashes.is_empty()) {
+            self.verify_checkpoint(&device, checkpoint).await?;
+        }
+        let resume_offset = checkpoint
+            .as_ref()
+            .map_or(0, |c| c.offset())
+            .min(input_size / checkpoint::CHUNK_SIZE * checkpoint::CHUNK_SIZE);
+        let mut hasher = match checkpoint.as_ref() {
+            Some(c) => Some(ChunkHasher::new(
+                c.hashes[..(resume_offset / checkpoint::CHUNK_SIZE) as usize].to_vec(),
+            )),
+            None if verify => Some(ChunkHasher::new(Vec::new())),
+            None => None,
+        };
+        // whether the device has to be kept as it is on errors, to continue the restore later
+        let mut resumable = resume_offset > 0;
+        let mut image_checksum = expected_checksum
+            .as_ref()
+            .filter(|_| resume_offset == 0)
+            .map(|_| {
+                glib::Checksum::new(glib::ChecksumType::Sha256)
+                    .expect("SHA-256 should be supported")
+            });
+
+        // Direct I/O has to be aligned to the logical block size of the device, which all but the
+        // last block are, as the block sizes are multiples of the minimum block size
+        let mut direct_io_alignment = None;
+        if direct_io {
+            match block_device::set_direct_io(&*device, true) {
+                Ok(()) => direct_io_alignment = Some(logical_block_size as usize),
+                Err(err) => log::info!("Not using direct I/O for writing the device: {err}"),
+            }
+        }
+
+        // Buffer for the largest block size the tuner may pick, the tuner starts with 64 KiB
+        // blocks and settles on whatever is fastest for the image and the device
+        const MAX_BLOCK_SIZE: usize = 16 * 1024 * 1024;
+        const MIN_BLOCK_SIZE: usize = 64 * 1024;
+        let mut page_buffer = Some(PageAlignedBuffer::new(MAX_BLOCK_SIZE));
+        let mut tuner = BlockSizeTuner::new(MIN_BLOCK_SIZE, MAX_BLOCK_SIZE);
 
         let estimator = estimator::Estimator::new(input_size);
 
-        // Read huge (e.g. 1 MiB) blocks and write it to the output device even if it was only
-        // partially read
+        // Read huge (e.g. 1 MiB) blocks and write them to the output device. The writes happen
+        // on a worker thread, directly from the page aligned buffer, so they neither block the
+        // UI nor need an extra copy.
         let mut bytes_completed = 0;
         let update_interval = std::time::Duration::from_millis(200);
         // set initial timer back by the update interval, so the UI is refreshed on the first cycle
-        let update_timer = std::time::Instant::now().sub(update_interval);
-        let mut device = async_std::fs::File::from(std::fs::File::from(fd));
-        let copy_result: Result<(), std::io::Error> = loop {
+        let mut update_timer = std::time::Instant::now().sub(update_interval);
+        let checkpoint_interval = std::time::Duration::from_secs(30);
+        let mut checkpoint_timer = std::time::Instant::now();
+        let zero_method = block_device::zero_method(&device);
+        if let Some(zero_method) = zero_method {
+            log::debug!("Zeroing ranges of the device with {zero_method:?}");
+        }
+
+        let job = self.imp().local_job.borrow().clone();
+
+        // Skip what was restored before. Compressed disk images have to be decoded up to there.
+        if resume_offset > 0 {
+            log::info!("Continuing restore after {resume_offset} bytes");
+            let skip_result = match input_file {
+                Some(mut input_file) => input_file
+                    .seek(SeekFrom::Start(resume_offset))
+                    .map(|_| resume_offset),
+                None => {
+                    let buffer = page_buffer.as_mut().expect("buffer should be available");
+                    let mut skipped = 0;
+                    while skipped < resume_offset {
+                        check_canceled(job.as_deref())?;
+                        let len = (resume_offset - skipped).min(MAX_BLOCK_SIZE as u64) as usize;
+                        match read_block(input_stream, &mut buffer.as_mut_slice()[..len]).await {
+                            Ok(0) => break,
+                            Ok(n) => skipped += n as u64,
+                            Err(err) => return Err(err.into()),
+                        }
+                    }
+                    Ok(skipped)
+                }
+            };
+            if skip_result? != resume_offset {
+                log::error!("Disk image is smaller than the checkpoint");
+                return Err(std::io::Error::from(std::io::ErrorKind::UnexpectedEof).into());
+            }
+            bytes_completed = resume_offset;
+        }
+
+        let mut copy_result: Result<(), std::io::Error> = loop {
+            if let Err(err) = check_canceled(job.as_deref()) {
+                break Err(err);
+            }
+
             // update GUI
             if update_timer.elapsed() >= update_interval {
                 estimator.add_sample(bytes_completed);
                 //TODO: add a progress bar?
-                self.update_job(Some(&estimator), false)
+                self.update_job(Some(&estimator), false);
+                update_timer = std::time::Instant::now();
             }
 
-            //TODO: check if using kernel calls like std's (file) copy does is faster
-            //or using BufWriter
-            let read_bytes = match input_stream.read(buffer_slice).await {
-                // we finished reading all bytes
-                Ok(0) => break Ok(()),
-                Ok(n) => n,
-                Err(err) if err.kind() == ErrorKind::Interrupted => continue,
-                Err(err) => break Err(err),
-            };
+            // save a checkpoint of what is on the device by now
+            if let (Some(checkpoint), Some(hasher)) = (checkpoint.as_mut(), hasher.as_ref()) {
+                if checkpoint_timer.elapsed() >= checkpoint_interval {
+                    if let Err(err) = Self::save_checkpoint(&device, checkpoint, hasher).await {
+                        log::error!("Error saving checkpoint: {err}");
+                        break Err(err);
+                    }
+                    resumable = checkpoint.offset() > 0;
+                    checkpoint_timer = std::time::Instant::now();
+                }
+            }
 
-            if let Err(err) = device.write_all(&buffer_slice[..read_bytes]).await {
+            // Let the device zero the holes of a sparse image instead of reading and writing them.
+            // Large holes are zeroed in chunks to keep the progress moving.
+            if let (Some(mut input_file), Some(zero_method)) = (input_file, zero_method) {
+                const MAX_ZERO_SIZE: u64 = 1024 * 1024 * 1024;
+                let data_offset = match next_data(input_file, bytes_completed, input_size) {
+                    Ok(offset) => offset.min(input_size),
+                    Err(err) => break Err(err),
+                };
+                let hole_end = if data_offset == input_size {
+                    input_size
+                } else {
+                    data_offset / MIN_BLOCK_SIZE as u64 * MIN_BLOCK_SIZE as u64
+                };
+                let hole_size = hole_end.saturating_sub(bytes_completed).min(MAX_ZERO_SIZE);
+                if hole_size > 0 && hole_size % logical_block_size == 0 {
+                    let writer = device.clone();
+                    let offset = bytes_completed;
+                    let mut zero_hasher = hasher.take();
+                    let mut zero_checksum = image_checksum.take();
+                    let (zero_result, zero_hasher, zero_checksum) =
+                        gio::spawn_blocking(move || {
+                            let result =
+                                block_device::zero_range(&*writer, zero_method, offset, hole_size);
+                            if let Some(zero_hasher) = zero_hasher.as_mut() {
+                                zero_hasher.update_zeroes(hole_size);
+                            }
+                            if let Some(zero_checksum) = zero_checksum.as_mut() {
+                                checksum_zeroes(zero_checksum, hole_size);
+                            }
+                            (result, zero_hasher, zero_checksum)
+                        })
+                        .await
+                        .expect("zeroing the device should not panic");
+                    hasher = zero_hasher;
+                    image_checksum = zero_checksum;
+                    if let Err(err) = zero_result
+                        .and_then(|_| input_file.seek(SeekFrom::Start(offset + hole_size)))
+                    {
+                        log::error!("Error zeroing device: {}", err);
+                        break Err(err);
+                    }
+                    bytes_completed += hole_size;
+                    continue;
+                }
+            }
+
+            let block_size = tuner.block_size();
+            let mut buffer = page_buffer
+                .take()
+                .expect("buffer should be returned by the writer");
+            let read_bytes =
+                match read_block(input_stream, &mut buffer.as_mut_slice()[..block_size]).await {
+                    // we finished reading all bytes
+                    Ok(0) => break Ok(()),
+                    Ok(n) => n,
+                    Err(err) => break Err(err),
+                };
+
+            // the last block of the image may not be aligned
+            if direct_io_alignment.is_some_and(|alignment| read_bytes % alignment != 0) {
+                if let Err(err) = block_device::set_direct_io(&*device, false) {
+                    break Err(err);
+                }
+                direct_io_alignment = None;
+            }
+
+            let writer = device.clone();
+            let offset = bytes_completed;
+            let mut block_hasher = hasher.take();
+            let mut block_checksum = image_checksum.take();
+            let (buffer, block_hasher, block_checksum, write_result) =
+                gio::spawn_blocking(move || {
+                    let mut buffer = buffer;
+                    let data = &buffer.as_mut_slice()[..read_bytes];
+                    let write = || match zero_method {
+                        Some(zero_method)
+                            if read_bytes as u64 % logical_block_size == 0 && is_zero(data) =>
+                        {
+                            block_device::zero_range(
+                                &*writer,
+                                zero_method,
+                                offset,
+                                read_bytes as u64,
+                            )
+                        }
+                        _ => writer.write_all_at(data, offset),
+                    };
+                    if block_hasher.is_none() && block_checksum.is_none() {
+                        let result = write();
+                        return (buffer, block_hasher, block_checksum, result);
+                    }
+                    // hash the block on another thread while it is written, so hashing does not
+                    // add to the time the copy takes
+                    let (block_hasher, block_checksum, result) = std::thread::scope(|scope| {
+                        let hashing = scope.spawn(move || {
+                            if let Some(block_hasher) = block_hasher.as_mut() {
+                                block_hasher.update(data);
+                            }
+                            if let Some(block_checksum) = block_checksum.as_mut() {
+                                block_checksum.update(data);
+                            }
+                            (block_hasher, block_checksum)
+                        });
+                        let result = write();
+                        let (block_hasher, block_checksum) =
+                            hashing.join().expect("hashing should not panic");
+                        (block_hasher, block_checksum, result)
+                    });
+                    (buffer, block_hasher, block_checksum, result)
+                })
+                .await
+                .expect("writing to the device should not panic");
+            page_buffer = Some(buffer);
+            hasher = block_hasher;
+            image_checksum = block_checksum;
+
+            if let Err(err) = write_result {
                 log::error!("Error writing to device: {}", err);
                 break Err(err);
             }
             bytes_completed += read_bytes as u64;
+            tuner.add_block(read_bytes);
         };
 
-        if copy_result.is_err() {
+        // flush what is left in the page cache before rescanning the device
+        if copy_result.is_ok() {
+            let writer = device.clone();
+            copy_result = gio::spawn_blocking(move || writer.sync_all())
+                .await
+                .expect("syncing the device should not panic");
+        }
+
+        if verify && copy_result.is_ok() {
+            let hashes = hasher
+                .as_ref()
+                .map(ChunkHasher::all_hashes)
+                .unwrap_or_default();
+            copy_result = self
+                .verify_device(&device, hashes, bytes_completed, logical_block_size)
+                .await;
+        }
+
+        // A disk image that does not match its checksum was corrupted since it was created, so
+        // neither keep what was restored nor continue restoring it later
+        let checksum_mismatch = match (&copy_result, &expected_checksum, image_checksum) {
+            (Ok(()), Some(expected), Some(checksum)) => {
+                checksum.string().as_ref() != Some(expected)
+            }
+            _ => false,
+        };
+        if checksum_mismatch {
+            log::error!("Disk image does not match its checksum");
+            copy_result = Err(std::io::Error::new(
+                ErrorKind::InvalidData,
+                gettext("The disk image does not match the checksum saved next to it"),
+            ));
+        }
+
+        if let Some(checkpoint) = checkpoint.as_mut() {
+            if copy_result.is_ok() || checksum_mismatch {
+                checkpoint.remove();
+                resumable = false;
+            } else if let Some(hasher) = hasher.as_ref() {
+                // keep as much as possible for continuing later
+                match Self::save_checkpoint(&device, checkpoint, hasher).await {
+                    Ok(()) => resumable = checkpoint.offset() > 0,
+                    Err(err) => log::error!("Error saving checkpoint: {err}"),
+                }
+            }
+        }
+
+        // Don't leave a half-written device that looks like it has the disk image, unless the
+        // restore can be continued
+        if copy_result.is_err() && !resumable {
             if let Err(err) = block.format("empty", HashMap::new()).await {
                 log::error!("Error wiping device on error path: {err}");
             }
@@ -578,44 +1347,351 @@ impl GduRestoreDiskImageDialog {
             log::error!("Error rescanning device: {}", err);
         };
 
-        Ok(copy_result?)
+        copy_result?;
+        Ok(match expected_checksum {
+            Some(_) if resume_offset > 0 => ChecksumResult::NotChecked,
+            Some(checksum) => ChecksumResult::Matched(checksum),
+            None => ChecksumResult::Absent,
+        })
     }
 
-    fn update_job(&self, estimator: Option<&Estimator>, done: bool) {
-        let Some(ref mut job) = *self.imp().local_job.borrow_mut() else {
-            return;
+    /// Reads back the chunks of `checkpoint` that are on `device` and drops the hashes from the
+    /// first chunk that does not match on, as the first phase of a restore that is continued.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error, if the device could not be read or the job was canceled.
+    async fn verify_checkpoint(
+        &self,
+        device: &Arc<std::fs::File>,
+        checkpoint: &mut Checkpoint,
+    ) -> std::io::Result<()> {
+        let job = self.imp().local_job.borrow().clone();
+        if let Some(job) = job.as_ref() {
+            // Translators: this is the description of the job, while the data written by an
+            // interrupted restore is read back before continuing after it
+            job.set_description(gettext("Checking Previously Restored Data"));
+        }
+
+        let estimator = estimator::Estimator::new(checkpoint.offset());
+        let mut num_verified = 0;
+        while num_verified < checkpoint.hashes.len() {
+            check_canceled(job.as_deref())?;
+            let reader = device.clone();
+            let hash = checkpoint.hashes[num_verified].clone();
+            let matches = gio::spawn_blocking(move || {
+                checkpoint::chunk_matches(&reader, num_verified, &hash)
+            })
+            .await
+            .expect("reading the device should not panic")?;
+            if !matches {
+                log::info!("Chunk {num_verified} on the device does not match the checkpoint");
+                break;
+            }
+            num_verified += 1;
+            estimator.add_sample(num_verified as u64 * checkpoint::CHUNK_SIZE);
+            self.update_job(Some(&estimator), false);
+        }
+        checkpoint.hashes.truncate(num_verified);
+
+        if let Some(job) = job.as_ref() {
+            job.set_description(gettext("Restoring Disk Image"));
+        }
+        Ok(())
+    }
+
+    /// Reads back the `size` bytes restored to `device` and compares them with the `hashes` of
+    /// the chunks written (see [`ChunkHasher`]), as a second phase of the job.
+    ///
+    /// Some cheap flash drives drop writes without an error, so the data is read from the device
+    /// itself, with `O_DIRECT` or at least after dropping it from the page cache. The device has
+    /// to be synced before.
+    ///
+    /// # Errors
+    ///
+    /// Returns an error with the ranges that do not match, or if the device could not be read.
+    async fn verify_device(
+        &self,
+        device: &Arc<std::fs::File>,
+        hashes: Vec<String>,
+        size: u64,
+        logical_block_size: u64,
+    ) -> std::io::Result<()> {
+        let job = self.imp().local_job.borrow().clone();
+        if let Some(job) = job.as_ref() {
+            // Translators: this is the description of the job, once the disk image was written
+            // and the device is read back to compare it with the disk image
+            job.set_description(gettext("Verifying Restored Disk Image"));
+        }
+
+        let alignment = match block_device::set_direct_io(&**device, true) {
+            Ok(()) => logical_block_size as usize,
+            Err(err) => {
+                log::info!("Not using direct I/O for verifying the device: {err}");
+                block_device::set_direct_io(&**device, false)?;
+                block_device::drop_cache(&**device)?;
+                1
+            }
         };
 
-        let (bytes_per_sec, usec_remaining, completed_bytes, target_bytes) =
-            if let Some(estimator) = estimator {
-                (
-                    estimator.bytes_per_sec(),
-                    estimator.usec_remaining(),
-                    estimator.completed_bytes(),
-                    estimator.target_bytes(),
-                )
-            } else {
-                (0, 0, 0, 0)
+        let estimator = estimator::Estimator::new(size);
+        let mut mismatches = checkpoint::Mismatches::default();
+        for (n, hash) in hashes.into_iter().enumerate() {
+            check_canceled(job.as_deref())?;
+            let offset = n as u64 * checkpoint::CHUNK_SIZE;
+            let len = checkpoint::CHUNK_SIZE.min(size - offset);
+            let reader = device.clone();
+            let read_hash =
+                gio::spawn_blocking(move || checkpoint::read_back(&reader, offset, len, alignment))
+                    .await
+                    .expect("reading the device should not panic")?;
+            if read_hash != hash {
+                log::error!("Chunk {n} read back from the device does not match the disk image");
+                mismatches.add(offset, len);
+            }
+            estimator.add_sample(offset + len);
+            self.update_job(Some(&estimator), false);
+        }
+
+        if mismatches.is_empty() {
+            return Ok(());
+        }
+        let client = self.client();
+        Err(mismatches.into_error(|num_bytes| client.size_for_display(num_bytes, false, false)))
+    }
+
+    /// Restores the disk image from `input_stream` to all of `objects` at once, see
+    /// [`crate::restore_target`].
+    ///
+    /// Every device has a job of its own, and the errors are shown for each device. Restores to
+    /// several devices neither save checkpoints nor check the checksum of the disk image.
+    async fn restore_to_destinations(
+        &self,
+        objects: &[udisks::Object],
+        input_stream: &mut (impl async_std::io::Read + std::marker::Unpin),
+        input_size: u64,
+        direct_io: bool,
+        verify: bool,
+    ) {
+        // Blocks are as large as the largest ones of a single device, as there is no single
+        // device to tune the block size for
+        const BLOCK_SIZE: usize = 4 * 1024 * 1024;
+        const RING_LENGTH: usize = 16;
+
+        let client = self.client();
+        let mut destinations = Vec::new();
+        for object in objects {
+            let Ok(block) = object.block().await else {
+                continue;
+            };
+            let name = client
+                .object_info(object)
+                .await
+                .one_liner
+                .unwrap_or_default();
+            let job = ffi::create_local_job(object);
+            job.set_operation("x-gdu-restore-disk-image");
+            // Translators: this is the description of the job
+            job.set_description(gettext("Restoring Disk Image"));
+            job.set_progress_valid(true);
+            job.set_cancelable(true);
+            self.imp().destination_jobs.borrow_mut().push(job.clone());
+            let target = Self::open_target(&block, input_size, direct_io, verify).await;
+            let (target, result) = match target {
+                Ok(target) => (Some(target), Ok(())),
+                Err(err) => (None, Err(err)),
             };
+            destinations.push(Destination {
+                block,
+                name,
+                job,
+                estimator: Estimator::new(input_size),
+                verifying: false,
+                target,
+                result,
+            });
+        }
 
-        job.set_bytes(target_bytes);
-        job.set_rate(bytes_per_sec);
+        // the buffers of blocks the writers are done with come back through `ring`
+        let (ring, mut free_buffers) = futures::channel::mpsc::unbounded();
+        for _ in 0..RING_LENGTH {
+            ring.unbounded_send(PageAlignedBuffer::new(BLOCK_SIZE))
+                .expect("ring should be open");
+        }
 
-        let progress = if done {
-            1.0
-        } else if target_bytes != 0 {
-            completed_bytes as f64 / target_bytes as f64
-        } else {
-            0.0
-        };
-        job.set_progress(progress);
+        let update_interval = std::time::Duration::from_millis(200);
+        let mut update_timer = std::time::Instant::now().sub(update_interval);
+        let mut offset = 0;
+        let read_result = loop {
+            Self::cancel_destinations(&mut destinations);
+            if update_timer.elapsed() >= update_interval {
+                Self::update_destinations(&mut destinations);
+                update_timer = std::time::Instant::now();
+            }
 
-        let end_time = if usec_remaining == 0 {
-            0
-        } else {
-            usec_remaining + glib::real_time() as u64
+            let running = destinations
+                .iter()
+                .any(|d| d.target.as_ref().is_some_and(|t| !t.is_finished()));
+            if !running {
+                break Ok(());
+            }
+
+            let mut buffer = free_buffers.next().await.expect("ring should be open");
+            let read_bytes = match read_block(input_stream, buffer.as_mut_slice()).await {
+                Ok(0) => break Ok(()),
+                Ok(n) => n,
+                Err(err) => break Err(err),
+            };
+
+            let zero = is_zero(&buffer.as_slice()[..read_bytes]);
+            let block = Arc::new(Block::new(buffer, read_bytes, offset, zero, ring.clone()));
+            for target in destinations.iter_mut().filter_map(|d| d.target.as_mut()) {
+                // a writer that stopped keeps its error until it is joined
+                target.send(&block);
+            }
+            offset += read_bytes as u64;
         };
-        job.set_expected_end_time(end_time);
+
+        // let the writers sync (and verify) their devices
+        for target in destinations.iter_mut().filter_map(|d| d.target.as_mut()) {
+            target.finish();
+        }
+        while destinations
+            .iter()
+            .any(|d| d.target.as_ref().is_some_and(|t| !t.is_finished()))
+        {
+            Self::cancel_destinations(&mut destinations);
+            Self::update_destinations(&mut destinations);
+            glib::timeout_future(update_interval).await;
+        }
+
+        for destination in &mut destinations {
+            if let Some(mut target) = destination.target.take() {
+                let result = target.join();
+                destination.result = match &read_result {
+                    Err(err) => Err(std::io::Error::new(err.kind(), err.to_string()).into()),
+                    Ok(()) => result.map_err(Into::into),
+                };
+            }
+
+            if let Err(err) = std::mem::replace(&mut destination.result, Ok(())) {
+                // Don't leave a half-written device that looks like it has the disk image
+                if let Err(err) = destination.block.format("empty", HashMap::new()).await {
+                    log::error!("Error wiping device on error path: {err}");
+                }
+                if destination.job.canceled() {
+                    log::info!("Restore to {} canceled", destination.name);
+                } else {
+                    // Translators: Heading of the error shown if restoring a disk image to one
+                    // of several devices failed. The {} is the name of the device.
+                    let title = gettext_f("Error restoring disk image to {}", [&destination.name]);
+                    libgdu::show_error(self, &title, err).await;
+                }
+            } else {
+                update_local_job(&destination.job, None, true);
+            }
+
+            // request that the OS / kernel re-scans the device
+            if let Err(err) = destination.block.rescan(HashMap::new()).await {
+                log::error!("Error rescanning device: {}", err);
+            };
+            ffi::destroy_local_job(destination.job.clone());
+        }
+        self.imp().destination_jobs.borrow_mut().clear();
+    }
+
+    /// Opens the device of `block` for restoring a disk image of `input_size` bytes to it, and
+    /// starts its writer.
+    async fn open_target(
+        block: &udisks::block::BlockProxy<'static>,
+        input_size: u64,
+        direct_io: bool,
+        verify: bool,
+    ) -> Result<RestoreTarget, Box<dyn std::error::Error>> {
+        let fd: std::os::fd::OwnedFd = block
+            .open_for_restore(udisks::standard_options(false))
+            .await?
+            .into();
+
+        if block_device::device_size(&fd)? < input_size {
+            return Err(std::io::Error::new(
+                ErrorKind::InvalidInput,
+                gettext("The disk image is bigger than the device"),
+            )
+            .into());
+        }
+
+        let logical_block_size = block_device::logical_block_size(&fd)?;
+        let device = std::fs::File::from(fd);
+        let mut direct_io_alignment = None;
+        if direct_io {
+            match block_device::set_direct_io(&device, true) {
+                Ok(()) => direct_io_alignment = Some(logical_block_size as usize),
+                Err(err) => log::info!("Not using direct I/O for writing the device: {err}"),
+            }
+        }
+        let zero_method = block_device::zero_method(&device);
+
+        Ok(RestoreTarget::spawn(
+            device,
+            TargetOptions {
+                logical_block_size,
+                direct_io_alignment,
+                zero_method,
+                verify,
+            },
+        ))
+    }
+
+    /// Stops the writers of the `destinations` whose jobs were canceled. The others keep going.
+    fn cancel_destinations(destinations: &mut [Destination]) {
+        for destination in destinations.iter_mut().filter(|d| d.job.canceled()) {
+            if let Some(target) = destination.target.as_mut() {
+                target.cancel();
+            }
+        }
+    }
+
+    /// Updates the jobs of `destinations` with how far their writers got.
+    fn update_destinations(destinations: &mut [Destination]) {
+        for destination in destinations {
+            let Some(target) = destination.target.as_ref() else {
+                continue;
+            };
+            let progress = target.progress();
+            if progress.verifying.load(Ordering::Relaxed) && !destination.verifying {
+                // Translators: this is the description of the job, once the disk image was
+                // written and the device is read back to compare it with the disk image
+                destination
+                    .job
+                    .set_description(gettext("Verifying Restored Disk Image"));
+                destination.estimator = Estimator::new(destination.estimator.target_bytes());
+                destination.verifying = true;
+            }
+            destination
+                .estimator
+                .add_sample(progress.bytes.load(Ordering::Relaxed));
+            update_local_job(&destination.job, Some(&destination.estimator), false);
+        }
+    }
+
+    /// Syncs what `hasher` has hashed to `device` and saves it as `checkpoint`.
+    async fn save_checkpoint(
+        device: &Arc<std::fs::File>,
+        checkpoint: &mut Checkpoint,
+        hasher: &ChunkHasher,
+    ) -> std::io::Result<()> {
+        let writer = device.clone();
+        gio::spawn_blocking(move || writer.sync_data())
+            .await
+            .expect("syncing the device should not panic")?;
+        checkpoint.save(hasher.hashes())
+    }
+
+    fn update_job(&self, estimator: Option<&Estimator>, done: bool) {
+        if let Some(job) = self.imp().local_job.borrow().as_ref() {
+            update_local_job(job, estimator, done);
+        }
     }
 
     #[template_callback]
@@ -625,7 +1701,7 @@ impl GduRestoreDiskImageDialog {
             .build();
         if let Ok(file) = file_dialog.open_future(self.window().as_ref()).await {
             self.imp().restore_file.set(Some(file));
-            self.display_size_warning();
+            self.load_image_info().await;
         }
     }
 }
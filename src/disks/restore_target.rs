@@ -0,0 +1,254 @@
+//! Writing one disk image to several devices at once.
+//!
+//! The disk image is read (and decompressed) once into a ring of shared [`Block`]s. Every device
+//! has a [`RestoreTarget`] with a writer thread of its own, which writes the blocks at the pace of
+//! its device. The buffers of the ring are reused once every writer is done with them, so a slow
+//! device only holds back the others once the ring is full. A device failing or being canceled
+//! does not stop the others.
+
+use std::os::unix::fs::FileExt;
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, mpsc};
+use std::thread::JoinHandle;
+
+use futures::channel::mpsc as async_mpsc;
+use gtk::glib;
+
+use crate::block_device::{self, ZeroMethod};
+use crate::checkpoint::{self, ChunkHasher};
+use crate::page_aligned_buffer::PageAlignedBuffer;
+
+/// A block of the disk image, shared by the writers of all targets.
+///
+/// The buffer goes back to the ring once the last writer drops the block.
+pub struct Block {
+    buffer: Option<PageAlignedBuffer>,
+    len: usize,
+    offset: u64,
+    /// Whether the block contains only zeroes, so devices can zero the range instead.
+    zero: bool,
+    ring: async_mpsc::UnboundedSender<PageAlignedBuffer>,
+}
+
+impl Block {
+    /// Creates the block of the first `len` bytes of `buffer` at `offset` of the disk image.
+    pub fn new(
+        buffer: PageAlignedBuffer,
+        len: usize,
+        offset: u64,
+        zero: bool,
+        ring: async_mpsc::UnboundedSender<PageAlignedBuffer>,
+    ) -> Self {
+        Self {
+            buffer: Some(buffer),
+            len,
+            offset,
+            zero,
+            ring,
+        }
+    }
+
+    fn data(&self) -> &[u8] {
+        let buffer = self.buffer.as_ref().expect("buffer should be set");
+        &buffer.as_slice()[..self.len]
+    }
+}
+
+impl Drop for Block {
+    fn drop(&mut self) {
+        if let Some(buffer) = self.buffer.take() {
+            // the reader is gone once all of the disk image was read
+            let _ = self.ring.unbounded_send(buffer);
+        }
+    }
+}
+
+/// How a [`RestoreTarget`] writes its device.
+#[derive(Debug, Clone, Copy)]
+pub struct TargetOptions {
+    /// The logical block size of the device.
+    pub logical_block_size: u64,
+    /// The alignment of direct I/O, if the device was opened with `O_DIRECT`.
+    pub direct_io_alignment: Option<usize>,
+    /// How blocks of zeroes are zeroed instead of written, see [`block_device::zero_method`].
+    pub zero_method: Option<ZeroMethod>,
+    /// Whether to read the device back after writing it.
+    pub verify: bool,
+}
+
+/// How far a [`RestoreTarget`] got, updated by its writer thread.
+#[derive(Debug, Default)]
+pub struct TargetProgress {
+    /// The bytes written, or read back once verifying.
+    pub bytes: AtomicU64,
+    /// Whether the device is read back.
+    pub verifying: AtomicBool,
+}
+
+/// A device written by a thread of its own.
+pub struct RestoreTarget {
+    progress: Arc<TargetProgress>,
+    canceled: Arc<AtomicBool>,
+    sender: Option<mpsc::Sender<Arc<Block>>>,
+    thread: Option<JoinHandle<std::io::Result<()>>>,
+}
+
+impl RestoreTarget {
+    /// Starts the writer thread of `device`.
+    pub fn spawn(device: std::fs::File, options: TargetOptions) -> Self {
+        let progress = Arc::new(TargetProgress::default());
+        let canceled = Arc::new(AtomicBool::new(false));
+        let (sender, receiver) = mpsc::channel();
+        let thread_progress = progress.clone();
+        let thread_canceled = canceled.clone();
+        let thread = std::thread::Builder::new()
+            .name("restore-writer".to_owned())
+            .spawn(move || {
+                write_device(
+                    &device,
+                    options,
+                    &receiver,
+                    &thread_progress,
+                    &thread_canceled,
+                )
+            })
+            .expect("thread should be spawned");
+
+        Self {
+            progress,
+            canceled,
+            sender: Some(sender),
+            thread: Some(thread),
+        }
+    }
+
+    /// How far the target got.
+    pub fn progress(&self) -> &TargetProgress {
+        &self.progress
+    }
+
+    /// Hands `block` to the writer.
+    ///
+    /// Returns `false` once the writer stopped because of an error.
+    pub fn send(&mut self, block: &Arc<Block>) -> bool {
+        match self.sender.as_ref() {
+            Some(sender) if sender.send(block.clone()).is_ok() => true,
+            _ => {
+                self.sender = None;
+                false
+            }
+        }
+    }
+
+    /// Tells the writer that all of the disk image was sent, so it syncs (and verifies) the
+    /// device and stops.
+    pub fn finish(&mut self) {
+        self.sender = None;
+    }
+
+    /// Stops the writer after the block it is writing, without syncing or verifying the device.
+    /// The blocks sent to it but not written yet go back to the ring.
+    pub fn cancel(&mut self) {
+        self.canceled.store(true, Ordering::Relaxed);
+        self.finish();
+    }
+
+    /// Whether the writer thread stopped, because it is done or failed.
+    pub fn is_finished(&self) -> bool {
+        self.thread.as_ref().is_none_or(JoinHandle::is_finished)
+    }
+
+    /// Waits for the writer thread and returns how writing the device went.
+    pub fn join(&mut self) -> std::io::Result<()> {
+        self.finish();
+        match self.thread.take() {
+            Some(thread) => thread.join().expect("writing the device should not panic"),
+            None => Ok(()),
+        }
+    }
+}
+
+/// The writer thread of a [`RestoreTarget`].
+fn write_device(
+    device: &std::fs::File,
+    options: TargetOptions,
+    receiver: &mpsc::Receiver<Arc<Block>>,
+    progress: &TargetProgress,
+    canceled: &AtomicBool,
+) -> std::io::Result<()> {
+    let check_canceled = || {
+        if canceled.load(Ordering::Relaxed) {
+            return Err(std::io::Error::new(
+                std::io::ErrorKind::Interrupted,
+                "The restore was canceled",
+            ));
+        }
+        Ok(())
+    };
+    let mut direct_io_alignment = options.direct_io_alignment;
+    let mut hasher = options.verify.then(|| ChunkHasher::new(Vec::new()));
+    let mut size = 0;
+
+    // the sender is dropped once all blocks were sent
+    for block in receiver {
+        check_canceled()?;
+        let data = block.data();
+
+        // the last block of the image may not be aligned
+        if direct_io_alignment.is_some_and(|alignment| data.len() % alignment != 0) {
+            block_device::set_direct_io(device, false)?;
+            direct_io_alignment = None;
+        }
+
+        match options.zero_method {
+            Some(zero_method)
+                if block.zero && data.len() as u64 % options.logical_block_size == 0 =>
+            {
+                block_device::zero_range(device, zero_method, block.offset, data.len() as u64)
+            }
+            _ => device.write_all_at(data, block.offset),
+        }?;
+        if let Some(hasher) = hasher.as_mut() {
+            hasher.update(data);
+        }
+
+        size = block.offset + data.len() as u64;
+        progress.bytes.store(size, Ordering::Relaxed);
+    }
+
+    check_canceled()?;
+    device.sync_all()?;
+
+    let Some(hasher) = hasher else {
+        return Ok(());
+    };
+
+    // read the device itself back, see `GduRestoreDiskImageDialog::verify_device`
+    progress.bytes.store(0, Ordering::Relaxed);
+    progress.verifying.store(true, Ordering::Relaxed);
+    let alignment = match block_device::set_direct_io(device, true) {
+        Ok(()) => options.logical_block_size as usize,
+        Err(err) => {
+            log::info!("Not using direct I/O for verifying the device: {err}");
+            block_device::set_direct_io(device, false)?;
+            block_device::drop_cache(device)?;
+            1
+        }
+    };
+    let mut mismatches = checkpoint::Mismatches::default();
+    for (n, hash) in hasher.all_hashes().iter().enumerate() {
+        check_canceled()?;
+        let offset = n as u64 * checkpoint::CHUNK_SIZE;
+        let len = checkpoint::CHUNK_SIZE.min(size - offset);
+        if checkpoint::read_back(device, offset, len, alignment)? != *hash {
+            log::error!("Chunk {n} read back from the device does not match the disk image");
+            mismatches.add(offset, len);
+        }
+        progress.bytes.store(offset + len, Ordering::Relaxed);
+    }
+
+    if mismatches.is_empty() {
+        return Ok(());
+    }
+    Err(mismatches.into_error(|num_bytes| glib::format_size(num_bytes).to_string()))
+}
@@ -0,0 +1,281 @@
+/* test-benchmark.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdubenchmark.h"
+
+#define MB (1000.0 * 1000.0)
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* Samples of one second each, at @rates in MB/s */
+static GArray *
+new_sustained_samples (const gdouble *rates, guint num_rates)
+{
+    GArray *samples;
+    guint64 offset = 0;
+    guint n;
+
+    samples = g_array_new (FALSE, FALSE, sizeof (GduBenchmarkSustainedSample));
+    for (n = 0; n < num_rates; n++) {
+        GduBenchmarkSustainedSample sample;
+
+        offset += (guint64) (rates[n] * MB);
+        sample.usec = (gint64) (n + 1) * G_USEC_PER_SEC;
+        sample.offset = offset;
+        sample.bytes_per_sec = rates[n] * MB;
+        g_array_append_val (samples, sample);
+    }
+
+    return samples;
+}
+
+static const GduBenchmarkSustainedSample *
+get_sample (GArray *samples, guint n)
+{
+    return &g_array_index (samples, GduBenchmarkSustainedSample, n);
+}
+
+static void
+test_write_cliff (void)
+{
+    g_autoptr(GArray) samples = NULL;
+    GduBenchmarkSustainedResult result;
+    gdouble rates[60];
+    guint n;
+
+    /* the write cache runs out after 30 seconds */
+    for (n = 0; n < G_N_ELEMENTS (rates); n++)
+        rates[n] = n < 30 ? 2000 : 500;
+    samples = new_sustained_samples (rates, G_N_ELEMENTS (rates));
+
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpfloat (result.burst_bytes_per_sec, ==, 2000 * MB);
+    g_assert_cmpfloat (result.steady_bytes_per_sec, ==, 500 * MB);
+    g_assert_cmpint (result.cliff_offset, ==, get_sample (samples, 29)->offset);
+    g_assert_cmpint (result.cliff_usec, ==, get_sample (samples, 29)->usec);
+}
+
+static void
+test_write_cliff_at_start (void)
+{
+    g_autoptr(GArray) samples = NULL;
+    GduBenchmarkSustainedResult result;
+    gdouble rates[60];
+    guint n;
+
+    /* the burst is too short to be more than the first few samples */
+    for (n = 0; n < G_N_ELEMENTS (rates); n++)
+        rates[n] = n < 4 ? 2000 : 500;
+    samples = new_sustained_samples (rates, G_N_ELEMENTS (rates));
+
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpfloat (result.burst_bytes_per_sec, ==, 2000 * MB);
+    g_assert_cmpint (result.cliff_offset, ==, get_sample (samples, 3)->offset);
+}
+
+static void
+test_write_no_cliff (void)
+{
+    g_autoptr(GArray) samples = NULL;
+    GduBenchmarkSustainedResult result;
+    gdouble rates[60];
+    guint n;
+
+    /* slowing down a little, as hard disks do towards the inner tracks */
+    for (n = 0; n < G_N_ELEMENTS (rates); n++)
+        rates[n] = 200 - n;
+    samples = new_sustained_samples (rates, G_N_ELEMENTS (rates));
+
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpfloat (result.steady_bytes_per_sec, >=, 0.7 * result.burst_bytes_per_sec);
+    g_assert_cmpint (result.cliff_offset, ==, -1);
+    g_assert_cmpint (result.cliff_usec, ==, -1);
+}
+
+static void
+test_write_cliff_noise (void)
+{
+    g_autoptr(GArray) samples = NULL;
+    GduBenchmarkSustainedResult result;
+    gdouble rates[90];
+    guint n;
+
+    /* garbage collection stalls the drive for a second now and then, before and after the cliff */
+    for (n = 0; n < G_N_ELEMENTS (rates); n++) {
+        rates[n] = n < 40 ? 2000 + (n % 3) * 100 : 400 + (n % 4) * 50;
+        if (n % 9 == 4)
+            rates[n] = 100;
+        if (n % 11 == 6 && n >= 40)
+            rates[n] = 1900;
+    }
+    samples = new_sustained_samples (rates, G_N_ELEMENTS (rates));
+
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpfloat (result.burst_bytes_per_sec, >=, 2000 * MB);
+    g_assert_cmpfloat (result.steady_bytes_per_sec, <=, 550 * MB);
+    g_assert_cmpint (result.cliff_offset, ==, get_sample (samples, 39)->offset);
+
+    /* without a cliff, the stalls alone are not taken for one */
+    for (n = 0; n < G_N_ELEMENTS (rates); n++)
+        rates[n] = n % 9 == 4 ? 100 : 2000 + (n % 3) * 100;
+    g_clear_pointer (&samples, g_array_unref);
+    samples = new_sustained_samples (rates, G_N_ELEMENTS (rates));
+
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpint (result.cliff_offset, ==, -1);
+}
+
+static void
+test_write_cliff_few_samples (void)
+{
+    g_autoptr(GArray) samples = NULL;
+    GduBenchmarkSustainedResult result;
+    const gdouble rates[] = { 2000, 100, 1500 };
+
+    samples = new_sustained_samples (rates, 0);
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpfloat (result.burst_bytes_per_sec, ==, 0);
+    g_assert_cmpint (result.cliff_offset, ==, -1);
+
+    /* too short to tell the burst from the steady rate */
+    g_clear_pointer (&samples, g_array_unref);
+    samples = new_sustained_samples (rates, G_N_ELEMENTS (rates));
+    gdu_benchmark_find_write_cliff (samples, &result);
+    g_assert_cmpfloat (result.burst_bytes_per_sec, ==, 1500 * MB);
+    g_assert_cmpfloat (result.steady_bytes_per_sec, ==, 1500 * MB);
+    g_assert_cmpint (result.cliff_offset, ==, -1);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+/* The bucket @usec is counted in */
+static guint
+get_bucket (gint64 usec)
+{
+    GduBenchmarkHistogram histogram = { 0 };
+    guint n;
+
+    gdu_benchmark_histogram_add (&histogram, usec);
+    for (n = 0; n < GDU_BENCHMARK_HISTOGRAM_NUM_BUCKETS; n++) {
+        if (histogram.counts[n] > 0)
+            return n;
+    }
+    g_assert_not_reached ();
+}
+
+static void
+test_histogram_buckets (void)
+{
+    /* 1 µs per bucket up to 32 µs, then 16 buckets per power of two */
+    g_assert_cmpuint (get_bucket (0), ==, 0);
+    g_assert_cmpuint (get_bucket (1), ==, 1);
+    g_assert_cmpuint (get_bucket (31), ==, 31);
+    g_assert_cmpuint (get_bucket (32), ==, 32);
+    g_assert_cmpuint (get_bucket (33), ==, 32);
+    g_assert_cmpuint (get_bucket (34), ==, 33);
+    g_assert_cmpuint (get_bucket (63), ==, 47);
+    g_assert_cmpuint (get_bucket (64), ==, 48);
+    g_assert_cmpuint (get_bucket (67), ==, 48);
+    g_assert_cmpuint (get_bucket (68), ==, 49);
+    g_assert_cmpuint (get_bucket (127), ==, 63);
+    g_assert_cmpuint (get_bucket (128), ==, 64);
+
+    /* the last bucket takes everything from about 71 minutes on */
+    g_assert_cmpuint (get_bucket (G_MAXUINT32), ==, GDU_BENCHMARK_HISTOGRAM_NUM_BUCKETS - 1);
+    g_assert_cmpuint (get_bucket ((gint64) G_MAXUINT32 + 1), ==, GDU_BENCHMARK_HISTOGRAM_NUM_BUCKETS - 1);
+    g_assert_cmpuint (get_bucket (G_MAXINT64), ==, GDU_BENCHMARK_HISTOGRAM_NUM_BUCKETS - 1);
+    g_assert_cmpuint (get_bucket (-1), ==, 0);
+}
+
+static void
+test_histogram_precision (void)
+{
+    guint prev_bucket = 0;
+    gint64 usec;
+
+    for (usec = 0; usec < 10 * 1000 * 1000; usec += 1 + usec / 1000) {
+        GduBenchmarkHistogram histogram = { 0 };
+        guint bucket = get_bucket (usec);
+        gint64 value;
+
+        g_assert_cmpuint (bucket, >=, prev_bucket);
+        g_assert_cmpuint (bucket, <=, prev_bucket + 1);
+        prev_bucket = bucket;
+
+        /* the larger value keeps the maximum from hiding the value of the bucket */
+        gdu_benchmark_histogram_add (&histogram, usec);
+        gdu_benchmark_histogram_add (&histogram, G_MAXUINT32);
+        value = gdu_benchmark_histogram_get_percentile (&histogram, 50);
+        g_assert_cmpint (ABS (value - usec), <=, usec / 16 + 1);
+    }
+}
+
+static void
+test_histogram_percentiles (void)
+{
+    GduBenchmarkHistogram histogram = { 0 };
+    gint64 usec;
+
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 50), ==, -1);
+
+    for (usec = 1; usec <= 100; usec++)
+        gdu_benchmark_histogram_add (&histogram, usec);
+    g_assert_cmpuint (histogram.total_count, ==, 100);
+    g_assert_cmpint (histogram.max_usec, ==, 100);
+
+    /* within a bucket of 1 µs */
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 0), ==, 1);
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 10), ==, 10);
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 25.5), ==, 26);
+    /* the middle of the buckets of 2 µs and 4 µs */
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 50), ==, 51);
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 99), ==, 98);
+    /* never more than the largest value */
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 100), ==, 100);
+    g_assert_cmpint (gdu_benchmark_histogram_get_percentile (&histogram, 1000), ==, 100);
+}
+
+static void
+test_histogram_merge (void)
+{
+    GduBenchmarkHistogram histogram = { 0 };
+    GduBenchmarkHistogram first = { 0 };
+    GduBenchmarkHistogram second = { 0 };
+    gint64 usec;
+
+    for (usec = 0; usec < 1000; usec++) {
+        gdu_benchmark_histogram_add (&histogram, usec * 7);
+        gdu_benchmark_histogram_add (usec % 2 == 0 ? &first : &second, usec * 7);
+    }
+
+    gdu_benchmark_histogram_merge (&first, &second);
+    g_assert_cmpmem (first.counts, sizeof first.counts, histogram.counts, sizeof histogram.counts);
+    g_assert_cmpuint (first.total_count, ==, histogram.total_count);
+    g_assert_cmpint (first.max_usec, ==, histogram.max_usec);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/benchmark/write-cliff", test_write_cliff);
+    g_test_add_func ("/benchmark/write-cliff-at-start", test_write_cliff_at_start);
+    g_test_add_func ("/benchmark/write-no-cliff", test_write_no_cliff);
+    g_test_add_func ("/benchmark/write-cliff-noise", test_write_cliff_noise);
+    g_test_add_func ("/benchmark/write-cliff-few-samples", test_write_cliff_few_samples);
+    g_test_add_func ("/benchmark/histogram-buckets", test_histogram_buckets);
+    g_test_add_func ("/benchmark/histogram-precision", test_histogram_precision);
+    g_test_add_func ("/benchmark/histogram-percentiles", test_histogram_percentiles);
+    g_test_add_func ("/benchmark/histogram-merge", test_histogram_merge);
+
+    return g_test_run ();
+}
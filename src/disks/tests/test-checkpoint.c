@@ -0,0 +1,347 @@
+/* test-checkpoint.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gducheckpoint.h"
+
+#define CHUNK_SIZE GDU_CHECKPOINT_CHUNK_SIZE
+#define SOURCE "test-source"
+
+#define CHECKPOINT_FORMAT \
+    "[Checkpoint]\nSource=" SOURCE "\nSize=%d\nChunkSize=%d\nOffset=%d\nChunkHashes=%s;\n"
+
+/* Size of the pieces the data is generated and written in */
+#define PIECE_SIZE (1024 * 1024)
+
+typedef struct {
+    gint fd;
+    gchar *path;
+} Fixture;
+
+static void
+fixture_set_up (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GError) error = NULL;
+
+    fixture->fd = g_file_open_tmp ("gdu-test-checkpoint-XXXXXX", &fixture->path, &error);
+    g_assert_no_error (error);
+}
+
+static void
+fixture_tear_down (Fixture *fixture, gconstpointer user_data)
+{
+    close (fixture->fd);
+    g_unlink (fixture->path);
+    g_free (fixture->path);
+}
+
+/* The data of the copy, different in every piece so swapped or shifted pieces do not hash the same */
+static void
+fill_piece (guchar *buffer, gsize size, guint64 offset)
+{
+    gsize n;
+
+    for (n = 0; n < size; n++)
+        buffer[n] = (guchar) ((offset + n) * 7 + (offset + n) / PIECE_SIZE);
+}
+
+/* Writes @size bytes of data from @offset on to @fd and adds them to @checkpoint in pieces of @piece_size */
+static void
+copy_data (Fixture *fixture, GduCheckpoint *checkpoint, guint64 offset, guint64 size, gsize piece_size)
+{
+    g_autofree guchar *buffer = g_malloc (piece_size);
+    guint64 end = offset + size;
+
+    for (; offset < end; offset += piece_size) {
+        gsize num_bytes = MIN (piece_size, end - offset);
+
+        fill_piece (buffer, num_bytes, offset);
+        g_assert_cmpint (pwrite (fixture->fd, buffer, num_bytes, offset), ==, num_bytes);
+        gdu_checkpoint_add_data (checkpoint, buffer, num_bytes);
+    }
+}
+
+static gchar *
+hash_data (guint64 offset, guint64 size)
+{
+    g_autoptr(GChecksum) checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    g_autofree guchar *buffer = g_malloc (PIECE_SIZE);
+    guint64 end = offset + size;
+
+    while (offset < end) {
+        gsize num_bytes = MIN (PIECE_SIZE, end - offset);
+
+        fill_piece (buffer, num_bytes, offset);
+        g_checksum_update (checksum, buffer, num_bytes);
+        offset += num_bytes;
+    }
+
+    return g_strdup (g_checksum_get_string (checksum));
+}
+
+/* The chunk hashes of @checkpoint as saved */
+static GStrv
+get_hashes (GduCheckpoint *checkpoint)
+{
+    g_autoptr(GFile) file = NULL;
+    g_autoptr(GFileIOStream) stream = NULL;
+    g_autoptr(GKeyFile) key_file = NULL;
+    g_autoptr(GError) error = NULL;
+    GStrv hashes;
+
+    file = g_file_new_tmp ("gdu-test-checkpoint-XXXXXX.ini", &stream, &error);
+    g_assert_no_error (error);
+    gdu_checkpoint_save (checkpoint, file, NULL, &error);
+    g_assert_no_error (error);
+
+    key_file = g_key_file_new ();
+    g_key_file_load_from_file (key_file, g_file_peek_path (file), G_KEY_FILE_NONE, &error);
+    g_assert_no_error (error);
+    g_file_delete (file, NULL, NULL);
+
+    hashes = g_key_file_get_string_list (key_file, "Checkpoint", "ChunkHashes", NULL, NULL);
+    return hashes != NULL ? hashes : g_new0 (gchar *, 1);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_chunk_boundaries (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_auto(GStrv) hashes = NULL;
+    g_autofree gchar *first_hash = hash_data (0, CHUNK_SIZE);
+    g_autofree gchar *second_hash = hash_data (CHUNK_SIZE, CHUNK_SIZE);
+
+    /* an odd piece size makes pieces straddle the boundary between the chunks */
+    checkpoint = gdu_checkpoint_new (SOURCE, 2 * CHUNK_SIZE);
+    copy_data (fixture, checkpoint, 0, 2 * CHUNK_SIZE, 3 * 1000 * 1000 + 1);
+
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, 2 * CHUNK_SIZE);
+    hashes = get_hashes (checkpoint);
+    g_assert_cmpuint (g_strv_length (hashes), ==, 2);
+    g_assert_cmpstr (hashes[0], ==, first_hash);
+    g_assert_cmpstr (hashes[1], ==, second_hash);
+}
+
+static void
+test_partial_chunk (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_auto(GStrv) hashes = NULL;
+    g_autofree gchar *first_hash = hash_data (0, CHUNK_SIZE);
+
+    checkpoint = gdu_checkpoint_new (SOURCE, 2 * CHUNK_SIZE);
+
+    copy_data (fixture, checkpoint, 0, CHUNK_SIZE - 1, PIECE_SIZE);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, 0);
+
+    /* the last byte of the first chunk and half of the second one */
+    copy_data (fixture, checkpoint, CHUNK_SIZE - 1, CHUNK_SIZE / 2 + 1, PIECE_SIZE);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, CHUNK_SIZE);
+
+    hashes = get_hashes (checkpoint);
+    g_assert_cmpuint (g_strv_length (hashes), ==, 1);
+    g_assert_cmpstr (hashes[0], ==, first_hash);
+}
+
+static void
+test_zeroes (void)
+{
+    g_autoptr(GduCheckpoint) data_checkpoint = NULL;
+    g_autoptr(GduCheckpoint) zeroes_checkpoint = NULL;
+    g_autofree guchar *buffer = g_malloc0 (PIECE_SIZE);
+    g_auto(GStrv) data_hashes = NULL;
+    g_auto(GStrv) zeroes_hashes = NULL;
+    guint64 size = 2 * CHUNK_SIZE + PIECE_SIZE;
+    guint64 offset;
+
+    data_checkpoint = gdu_checkpoint_new (SOURCE, size);
+    for (offset = 0; offset < size; offset += PIECE_SIZE)
+        gdu_checkpoint_add_data (data_checkpoint, buffer, PIECE_SIZE);
+
+    /* both the whole chunks of zeroes and the ones zeroes are added to after data */
+    zeroes_checkpoint = gdu_checkpoint_new (SOURCE, size);
+    gdu_checkpoint_add_data (zeroes_checkpoint, buffer, PIECE_SIZE);
+    gdu_checkpoint_add_zeroes (zeroes_checkpoint, CHUNK_SIZE - PIECE_SIZE);
+    gdu_checkpoint_add_zeroes (zeroes_checkpoint, CHUNK_SIZE + PIECE_SIZE);
+
+    g_assert_cmpuint (gdu_checkpoint_get_offset (zeroes_checkpoint), ==, 2 * CHUNK_SIZE);
+    data_hashes = get_hashes (data_checkpoint);
+    zeroes_hashes = get_hashes (zeroes_checkpoint);
+    g_assert_true (g_strv_equal ((const gchar *const *) data_hashes, (const gchar *const *) zeroes_hashes));
+}
+
+static void
+test_verify (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GError) error = NULL;
+
+    checkpoint = gdu_checkpoint_new (SOURCE, 3 * CHUNK_SIZE);
+    copy_data (fixture, checkpoint, 0, 2 * CHUNK_SIZE + PIECE_SIZE, PIECE_SIZE);
+
+    g_assert_true (gdu_checkpoint_verify (checkpoint, fixture->fd, NULL, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, 2 * CHUNK_SIZE);
+}
+
+static void
+test_verify_mismatch (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GError) error = NULL;
+    guchar byte = 0;
+
+    checkpoint = gdu_checkpoint_new (SOURCE, 3 * CHUNK_SIZE);
+    copy_data (fixture, checkpoint, 0, 3 * CHUNK_SIZE, PIECE_SIZE);
+
+    /* a single byte changed in the second chunk drops it and every chunk after it */
+    g_assert_cmpint (pread (fixture->fd, &byte, 1, CHUNK_SIZE + CHUNK_SIZE / 2), ==, 1);
+    byte ^= 0x01;
+    g_assert_cmpint (pwrite (fixture->fd, &byte, 1, CHUNK_SIZE + CHUNK_SIZE / 2), ==, 1);
+
+    g_assert_true (gdu_checkpoint_verify (checkpoint, fixture->fd, NULL, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, CHUNK_SIZE);
+}
+
+static void
+test_verify_truncated (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GError) error = NULL;
+
+    checkpoint = gdu_checkpoint_new (SOURCE, 2 * CHUNK_SIZE);
+    copy_data (fixture, checkpoint, 0, 2 * CHUNK_SIZE, PIECE_SIZE);
+
+    /* the copy lost the end of the second chunk */
+    g_assert_cmpint (ftruncate (fixture->fd, 2 * CHUNK_SIZE - 1), ==, 0);
+
+    g_assert_true (gdu_checkpoint_verify (checkpoint, fixture->fd, NULL, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, CHUNK_SIZE);
+
+    /* hashing continues after the chunks that are left */
+    copy_data (fixture, checkpoint, CHUNK_SIZE, CHUNK_SIZE, PIECE_SIZE);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (checkpoint), ==, 2 * CHUNK_SIZE);
+}
+
+static void
+test_verify_cancelled (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+    g_autoptr(GError) error = NULL;
+
+    checkpoint = gdu_checkpoint_new (SOURCE, CHUNK_SIZE);
+    copy_data (fixture, checkpoint, 0, CHUNK_SIZE, PIECE_SIZE);
+
+    g_cancellable_cancel (cancellable);
+    g_assert_false (gdu_checkpoint_verify (checkpoint, fixture->fd, cancellable, &error));
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+}
+
+static void
+test_load (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GduCheckpoint) loaded = NULL;
+    g_autoptr(GFile) file = NULL;
+    g_autoptr(GFileIOStream) stream = NULL;
+    g_autoptr(GError) error = NULL;
+
+    checkpoint = gdu_checkpoint_new (SOURCE, 2 * CHUNK_SIZE);
+    copy_data (fixture, checkpoint, 0, CHUNK_SIZE + PIECE_SIZE, PIECE_SIZE);
+
+    file = g_file_new_tmp ("gdu-test-checkpoint-XXXXXX.ini", &stream, &error);
+    g_assert_no_error (error);
+    g_assert_true (gdu_checkpoint_save (checkpoint, file, NULL, &error));
+    g_assert_no_error (error);
+
+    loaded = gdu_checkpoint_load (file, &error);
+    g_file_delete (file, NULL, NULL);
+    g_assert_no_error (error);
+    g_assert_true (gdu_checkpoint_matches (loaded, SOURCE, 2 * CHUNK_SIZE));
+    g_assert_false (gdu_checkpoint_matches (loaded, "other-source", 2 * CHUNK_SIZE));
+    g_assert_false (gdu_checkpoint_matches (loaded, SOURCE, CHUNK_SIZE));
+    g_assert_cmpuint (gdu_checkpoint_get_offset (loaded), ==, CHUNK_SIZE);
+
+    /* the loaded hashes still match the copy */
+    g_assert_true (gdu_checkpoint_verify (loaded, fixture->fd, NULL, &error));
+    g_assert_no_error (error);
+    g_assert_cmpuint (gdu_checkpoint_get_offset (loaded), ==, CHUNK_SIZE);
+}
+
+static void
+assert_load_fails (const gchar *contents)
+{
+    g_autoptr(GduCheckpoint) checkpoint = NULL;
+    g_autoptr(GFile) file = NULL;
+    g_autoptr(GFileIOStream) stream = NULL;
+    g_autoptr(GError) error = NULL;
+
+    file = g_file_new_tmp ("gdu-test-checkpoint-XXXXXX.ini", &stream, &error);
+    g_assert_no_error (error);
+    g_file_replace_contents (file, contents, strlen (contents), NULL, FALSE, G_FILE_CREATE_NONE, NULL, NULL, &error);
+    g_assert_no_error (error);
+
+    checkpoint = gdu_checkpoint_load (file, &error);
+    g_file_delete (file, NULL, NULL);
+    g_assert_null (checkpoint);
+    g_assert_nonnull (error);
+}
+
+static void
+test_load_invalid (void)
+{
+    g_autofree gchar *hash = g_strnfill (64, 'a');
+    g_autofree gchar *not_hash = g_strnfill (64, 'g');
+    g_autofree gchar *wrong_offset = NULL;
+    g_autofree gchar *wrong_chunk_size = NULL;
+    g_autofree gchar *invalid_hash = NULL;
+
+    wrong_offset = g_strdup_printf (CHECKPOINT_FORMAT, 4 * CHUNK_SIZE, CHUNK_SIZE, 2 * CHUNK_SIZE, hash);
+    assert_load_fails (wrong_offset);
+
+    wrong_chunk_size = g_strdup_printf (CHECKPOINT_FORMAT, 4 * CHUNK_SIZE, CHUNK_SIZE / 2, CHUNK_SIZE / 2, hash);
+    assert_load_fails (wrong_chunk_size);
+
+    invalid_hash = g_strdup_printf (CHECKPOINT_FORMAT, 4 * CHUNK_SIZE, CHUNK_SIZE, CHUNK_SIZE, not_hash);
+    assert_load_fails (invalid_hash);
+
+    assert_load_fails ("[Checkpoint]\nSize=0\n");
+    assert_load_fails ("not a key file");
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add ("/checkpoint/chunk-boundaries", Fixture, NULL, fixture_set_up, test_chunk_boundaries,
+                fixture_tear_down);
+    g_test_add ("/checkpoint/partial-chunk", Fixture, NULL, fixture_set_up, test_partial_chunk, fixture_tear_down);
+    g_test_add_func ("/checkpoint/zeroes", test_zeroes);
+    g_test_add ("/checkpoint/verify", Fixture, NULL, fixture_set_up, test_verify, fixture_tear_down);
+    g_test_add ("/checkpoint/verify-mismatch", Fixture, NULL, fixture_set_up, test_verify_mismatch, fixture_tear_down);
+    g_test_add ("/checkpoint/verify-truncated", Fixture, NULL, fixture_set_up, test_verify_truncated,
+                fixture_tear_down);
+    g_test_add ("/checkpoint/verify-cancelled", Fixture, NULL, fixture_set_up, test_verify_cancelled,
+                fixture_tear_down);
+    g_test_add ("/checkpoint/load", Fixture, NULL, fixture_set_up, test_load, fixture_tear_down);
+    g_test_add_func ("/checkpoint/load-invalid", test_load_invalid);
+
+    return g_test_run ();
+}
@@ -0,0 +1,142 @@
+/* test-copyengine.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gducopyengine.h"
+
+#define KIB 1024
+#define MIB (1024 * KIB)
+
+/* A device that takes @request_usec per request of up to @sweet_size bytes
+ * and is half as fast per byte above that, e.g. because larger requests are
+ * split. The tuner measures real time, so the device really sleeps. The sizes
+ * differ enough in speed for the tests to pass on a busy machine, where every
+ * request takes longer than asked for.
+ */
+typedef struct {
+    gint64 request_usec;
+    gsize sweet_size;
+    /* the size of every block read */
+    GArray *block_sizes;
+} SimulatedDevice;
+
+static gboolean
+simulated_read (GduCopyBlock *block, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    SimulatedDevice *device = user_data;
+
+    if (block->size <= device->sweet_size)
+        g_usleep (device->request_usec);
+    else
+        g_usleep (device->request_usec * 2 * (block->size / device->sweet_size));
+    block->num_read = block->size;
+    g_array_append_val (device->block_sizes, block->size);
+
+    return TRUE;
+}
+
+static gboolean
+discard_write (GduCopyBlock *block, gpointer user_data, GCancellable *cancellable, GError **error)
+{
+    return TRUE;
+}
+
+/* Copies @size bytes from @device with blocks of @min_block_size up to @buffer_size.
+ * Returns the size of every block read.
+ */
+static GArray *
+run_copy (SimulatedDevice *device, gsize min_block_size, gsize buffer_size, guint64 size)
+{
+    g_autoptr(GduCopyEngine) engine = NULL;
+    g_autoptr(GError) error = NULL;
+    GduCopyExtent extent = { 0, size };
+
+    device->block_sizes = g_array_new (FALSE, FALSE, sizeof (gsize));
+
+    engine = gdu_copy_engine_new (4, buffer_size);
+    gdu_copy_engine_set_auto_tune (engine, min_block_size);
+    gdu_copy_engine_run (engine, &extent, 1, simulated_read, discard_write, device, NULL, &error);
+    g_assert_no_error (error);
+
+    return g_steal_pointer (&device->block_sizes);
+}
+
+/* Checks that the distinct sizes in @block_sizes, in the order they were used, are the
+ * @num_sizes sizes in @expected. The last block of the copy may be smaller.
+ */
+static void
+assert_block_sizes (GArray *block_sizes, const gsize *expected, guint num_sizes)
+{
+    guint num_used = 0;
+    guint n;
+
+    for (n = 0; n + 1 < block_sizes->len; n++) {
+        gsize size = g_array_index (block_sizes, gsize, n);
+
+        if (num_used > 0 && expected[num_used - 1] == size)
+            continue;
+        g_assert_cmpuint (num_used, <, num_sizes);
+        g_assert_cmpuint (size, ==, expected[num_used]);
+        num_used++;
+    }
+    g_assert_cmpuint (num_used, ==, num_sizes);
+    g_assert_cmpuint (g_array_index (block_sizes, gsize, n), <=, expected[num_sizes - 1]);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_tune_converge (void)
+{
+    g_autoptr(GArray) block_sizes = NULL;
+    SimulatedDevice device = { 5000, 256 * KIB, NULL };
+    const gsize expected[] = { 64 * KIB, 128 * KIB, 256 * KIB, 512 * KIB, 1 * MIB, 256 * KIB };
+
+    /* two larger sizes are tried before going back to the fastest one */
+    block_sizes = run_copy (&device, 64 * KIB, 16 * MIB, 48 * MIB);
+    assert_block_sizes (block_sizes, expected, G_N_ELEMENTS (expected));
+}
+
+static void
+test_tune_clamp (void)
+{
+    g_autoptr(GArray) block_sizes = NULL;
+    SimulatedDevice device = { 5000, G_MAXSIZE, NULL };
+    const gsize expected[] = { 64 * KIB, 128 * KIB, 256 * KIB };
+
+    /* every request takes the same time, so larger blocks are always faster */
+    block_sizes = run_copy (&device, 64 * KIB, 256 * KIB, 32 * MIB);
+    assert_block_sizes (block_sizes, expected, G_N_ELEMENTS (expected));
+}
+
+static void
+test_tune_min_too_large (void)
+{
+    g_autoptr(GArray) block_sizes = NULL;
+    SimulatedDevice device = { 0, G_MAXSIZE, NULL };
+    const gsize expected[] = { 256 * KIB };
+
+    /* the buffers are smaller than the minimum block size */
+    block_sizes = run_copy (&device, 1 * MIB, 256 * KIB, 10 * MIB + 4 * KIB);
+    assert_block_sizes (block_sizes, expected, G_N_ELEMENTS (expected));
+    g_assert_cmpuint (g_array_index (block_sizes, gsize, block_sizes->len - 1), ==, 4 * KIB);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/copyengine/tune-converge", test_tune_converge);
+    g_test_add_func ("/copyengine/tune-clamp", test_tune_clamp);
+    g_test_add_func ("/copyengine/tune-min-too-large", test_tune_min_too_large);
+
+    return g_test_run ();
+}
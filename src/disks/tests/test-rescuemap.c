@@ -0,0 +1,309 @@
+/* test-rescuemap.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include <glib/gstdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gducopyengine.h"
+#include "gdurescuemap.h"
+
+#define SIZE 0x100000
+
+typedef struct {
+    gchar *path;
+    GFile *file;
+} Fixture;
+
+static void
+fixture_set_up (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GError) error = NULL;
+    gint fd;
+
+    fd = g_file_open_tmp ("gdu-test-rescuemap-XXXXXX", &fixture->path, &error);
+    g_assert_no_error (error);
+    close (fd);
+    fixture->file = g_file_new_for_path (fixture->path);
+}
+
+static void
+fixture_tear_down (Fixture *fixture, gconstpointer user_data)
+{
+    g_unlink (fixture->path);
+    g_object_unref (fixture->file);
+    g_free (fixture->path);
+}
+
+/* Checks that the blocks with @status are the @num_extents pairs of offset and size in @expected */
+static void
+assert_extents (GduRescueMap *map, GduRescueStatus status, const guint64 *expected, guint num_extents)
+{
+    g_autoptr(GArray) extents = NULL;
+    guint64 num_bytes = 0;
+    guint n;
+
+    extents = gdu_rescue_map_get_extents (map, status);
+    g_assert_cmpuint (extents->len, ==, num_extents);
+    for (n = 0; n < num_extents; n++) {
+        GduCopyExtent *extent = &g_array_index (extents, GduCopyExtent, n);
+
+        g_assert_cmpuint (extent->offset, ==, expected[2 * n]);
+        g_assert_cmpuint (extent->size, ==, expected[2 * n + 1]);
+        num_bytes += extent->size;
+    }
+    g_assert_cmpuint (gdu_rescue_map_get_num_bytes (map, status), ==, num_bytes);
+}
+
+static GduRescueMap *
+load_map (Fixture *fixture, const gchar *contents, GError **error)
+{
+    g_autoptr(GError) local_error = NULL;
+
+    g_file_set_contents (fixture->path, contents, -1, &local_error);
+    g_assert_no_error (local_error);
+
+    return gdu_rescue_map_load (fixture->file, SIZE, NULL, error);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_new (void)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+    const guint64 non_tried[] = { 0, SIZE };
+
+    map = gdu_rescue_map_new (SIZE);
+    assert_extents (map, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 1);
+    assert_extents (map, GDU_RESCUE_STATUS_FINISHED, NULL, 0);
+}
+
+static void
+test_set (void)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+
+    map = gdu_rescue_map_new (SIZE);
+
+    /* splitting a block in three */
+    gdu_rescue_map_set (map, 0x1000, 0x2000, GDU_RESCUE_STATUS_FINISHED);
+    {
+        const guint64 finished[] = { 0x1000, 0x2000 };
+        const guint64 non_tried[] = { 0, 0x1000, 0x3000, SIZE - 0x3000 };
+
+        assert_extents (map, GDU_RESCUE_STATUS_FINISHED, finished, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 2);
+    }
+
+    /* overlapping the end of one block and the start of the next */
+    gdu_rescue_map_set (map, 0x2000, 0x2000, GDU_RESCUE_STATUS_BAD_SECTOR);
+    {
+        const guint64 finished[] = { 0x1000, 0x1000 };
+        const guint64 bad_sector[] = { 0x2000, 0x2000 };
+        const guint64 non_tried[] = { 0, 0x1000, 0x4000, SIZE - 0x4000 };
+
+        assert_extents (map, GDU_RESCUE_STATUS_FINISHED, finished, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_BAD_SECTOR, bad_sector, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 2);
+    }
+
+    /* covering several blocks completely, up to the end of the device */
+    gdu_rescue_map_set (map, 0x800, SIZE - 0x800, GDU_RESCUE_STATUS_NON_TRIMMED);
+    {
+        const guint64 non_trimmed[] = { 0x800, SIZE - 0x800 };
+        const guint64 non_tried[] = { 0, 0x800 };
+
+        assert_extents (map, GDU_RESCUE_STATUS_NON_TRIMMED, non_trimmed, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_FINISHED, NULL, 0);
+        assert_extents (map, GDU_RESCUE_STATUS_BAD_SECTOR, NULL, 0);
+    }
+
+    /* nothing changes without a size */
+    gdu_rescue_map_set (map, 0x100, 0, GDU_RESCUE_STATUS_FINISHED);
+    assert_extents (map, GDU_RESCUE_STATUS_FINISHED, NULL, 0);
+}
+
+static void
+test_set_merge (void)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+    const guint64 non_tried[] = { 0x3000, SIZE - 0x3000 };
+
+    map = gdu_rescue_map_new (SIZE);
+
+    /* in order, as the copy engine finishes blocks */
+    gdu_rescue_map_set (map, 0, 0x1000, GDU_RESCUE_STATUS_FINISHED);
+    gdu_rescue_map_set (map, 0x1000, 0x1000, GDU_RESCUE_STATUS_FINISHED);
+    {
+        const guint64 finished[] = { 0, 0x2000 };
+
+        assert_extents (map, GDU_RESCUE_STATUS_FINISHED, finished, 1);
+    }
+
+    /* filling a hole merges with both neighbours */
+    gdu_rescue_map_set (map, 0x2000, 0x1000, GDU_RESCUE_STATUS_BAD_SECTOR);
+    gdu_rescue_map_set (map, 0x2400, 0x400, GDU_RESCUE_STATUS_FINISHED);
+    gdu_rescue_map_set (map, 0x2000, 0x400, GDU_RESCUE_STATUS_FINISHED);
+    gdu_rescue_map_set (map, 0x2800, 0x800, GDU_RESCUE_STATUS_FINISHED);
+    {
+        const guint64 finished[] = { 0, 0x3000 };
+
+        assert_extents (map, GDU_RESCUE_STATUS_FINISHED, finished, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_BAD_SECTOR, NULL, 0);
+        assert_extents (map, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 1);
+    }
+
+    /* setting a range to the status it already has */
+    gdu_rescue_map_set (map, 0x1800, 0x1000, GDU_RESCUE_STATUS_FINISHED);
+    {
+        const guint64 finished[] = { 0, 0x3000 };
+
+        assert_extents (map, GDU_RESCUE_STATUS_FINISHED, finished, 1);
+        assert_extents (map, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 1);
+    }
+}
+
+static void
+test_save_load (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+    g_autoptr(GduRescueMap) loaded = NULL;
+    g_autoptr(GError) error = NULL;
+    g_autofree gchar *contents = NULL;
+    g_autofree gchar *reloaded_contents = NULL;
+    const guint64 finished[] = { 0, 0x1000, 0x3000, 0x1000 };
+    const guint64 non_trimmed[] = { 0x1000, 0x200 };
+    const guint64 bad_sector[] = { 0x1200, 0x200 };
+    const guint64 non_scraped[] = { 0x1400, 0x1c00 };
+    const guint64 non_tried[] = { 0x4000, SIZE - 0x4000 };
+
+    map = gdu_rescue_map_new (SIZE);
+    gdu_rescue_map_set (map, 0, 0x4000, GDU_RESCUE_STATUS_FINISHED);
+    gdu_rescue_map_set (map, 0x1000, 0x2000, GDU_RESCUE_STATUS_NON_SCRAPED);
+    gdu_rescue_map_set (map, 0x1000, 0x200, GDU_RESCUE_STATUS_NON_TRIMMED);
+    gdu_rescue_map_set (map, 0x1200, 0x200, GDU_RESCUE_STATUS_BAD_SECTOR);
+    gdu_rescue_map_set_position (map, 0x1400, GDU_RESCUE_STATUS_NON_SCRAPED);
+
+    gdu_rescue_map_save (map, fixture->file, NULL, &error);
+    g_assert_no_error (error);
+
+    loaded = gdu_rescue_map_load (fixture->file, SIZE, NULL, &error);
+    g_assert_no_error (error);
+    assert_extents (loaded, GDU_RESCUE_STATUS_FINISHED, finished, 2);
+    assert_extents (loaded, GDU_RESCUE_STATUS_NON_TRIMMED, non_trimmed, 1);
+    assert_extents (loaded, GDU_RESCUE_STATUS_BAD_SECTOR, bad_sector, 1);
+    assert_extents (loaded, GDU_RESCUE_STATUS_NON_SCRAPED, non_scraped, 1);
+    assert_extents (loaded, GDU_RESCUE_STATUS_NON_TRIED, non_tried, 1);
+
+    /* the position of the pass is kept as well */
+    g_file_get_contents (fixture->path, &contents, NULL, &error);
+    g_assert_no_error (error);
+    gdu_rescue_map_save (loaded, fixture->file, NULL, &error);
+    g_assert_no_error (error);
+    g_file_get_contents (fixture->path, &reloaded_contents, NULL, &error);
+    g_assert_no_error (error);
+    g_assert_cmpstr (reloaded_contents, ==, contents);
+    g_assert_nonnull (strstr (contents, "\n0x00001400     /\n"));
+}
+
+static void
+test_load_ddrescue (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+    g_autoptr(GError) error = NULL;
+    const guint64 finished[] = { 0, 0x80000 };
+    const guint64 bad_sector[] = { 0x80000, 0x80000 };
+
+    /* as written by ddrescue, with comments, decimal numbers, tabs and adjacent blocks of the same status */
+    map = load_map (fixture,
+                    "# Mapfile. Created by GNU ddrescue version 1.27\n"
+                    "# Command line: ddrescue /dev/sdb disk.img disk.map\n"
+                    "# current_pos  current_status  current_pass\n"
+                    "0x00080000     +               1\n"
+                    "#      pos        size  status\n"
+                    "0x00000000  0x00040000  +\n"
+                    "262144\t262144\t+\n"
+                    "\n"
+                    "  0x00080000  0x00080000  -  \n",
+                    &error);
+    g_assert_no_error (error);
+    assert_extents (map, GDU_RESCUE_STATUS_FINISHED, finished, 1);
+    assert_extents (map, GDU_RESCUE_STATUS_BAD_SECTOR, bad_sector, 1);
+}
+
+static void
+test_load_invalid (Fixture *fixture, gconstpointer user_data)
+{
+    const gchar *invalid_maps[] = {
+        /* a block without a status */
+        "0x0 ?\n0x00000000  0x00100000\n",
+        /* an unknown status */
+        "0x0 ?\n0x00000000  0x00100000  x\n",
+        /* a status longer than one character */
+        "0x0 ?\n0x00000000  0x00100000  ++\n",
+        /* garbage after a number */
+        "0x0 ?\n0x00000000  0x00100000z  +\n",
+        "0x0z ?\n0x00000000  0x00100000  +\n",
+        /* a gap between blocks */
+        "0x0 ?\n0x00000000  0x00040000  +\n0x00080000  0x00080000  -\n",
+        /* overlapping blocks */
+        "0x0 ?\n0x00000000  0x00080000  +\n0x00040000  0x000c0000  -\n",
+        /* past the end of the device */
+        "0x0 ?\n0x00000000  0x00200000  +\n",
+        /* a missing status line */
+        "0x00000000\n0x00000000  0x00100000  +\n",
+    };
+    guint n;
+
+    for (n = 0; n < G_N_ELEMENTS (invalid_maps); n++) {
+        g_autoptr(GduRescueMap) map = NULL;
+        g_autoptr(GError) error = NULL;
+
+        map = load_map (fixture, invalid_maps[n], &error);
+        g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+        g_assert_null (map);
+    }
+}
+
+static void
+test_load_incomplete (Fixture *fixture, gconstpointer user_data)
+{
+    g_autoptr(GduRescueMap) map = NULL;
+    g_autoptr(GError) error = NULL;
+
+    /* shorter than the device, for example the map of another device */
+    map = load_map (fixture, "0x0 ?\n0x00000000  0x00080000  +\n", &error);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+    g_assert_null (map);
+    g_clear_error (&error);
+
+    map = load_map (fixture, "# only comments\n", &error);
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA);
+    g_assert_null (map);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/rescuemap/new", test_new);
+    g_test_add_func ("/rescuemap/set", test_set);
+    g_test_add_func ("/rescuemap/set-merge", test_set_merge);
+    g_test_add ("/rescuemap/save-load", Fixture, NULL, fixture_set_up, test_save_load, fixture_tear_down);
+    g_test_add ("/rescuemap/load-ddrescue", Fixture, NULL, fixture_set_up, test_load_ddrescue, fixture_tear_down);
+    g_test_add ("/rescuemap/load-invalid", Fixture, NULL, fixture_set_up, test_load_invalid, fixture_tear_down);
+    g_test_add ("/rescuemap/load-incomplete", Fixture, NULL, fixture_set_up, test_load_incomplete, fixture_tear_down);
+
+    return g_test_run ();
+}
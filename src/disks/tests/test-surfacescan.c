@@ -0,0 +1,165 @@
+/* test-surfacescan.c
+ *
+ * Copyright 2026 The GNOME Project
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "config.h"
+
+#include "gdusurfacescan.h"
+
+/* as in gdusurfacescan.c */
+#define QUEUE_DEPTH 32
+
+#define NUM_REQUESTS 1024
+
+/* Reads NUM_REQUESTS requests with QUEUE_DEPTH in flight from a simulated disk, which works on one request
+ * after the other and spends @service_usec[n] on request n. Like the scan, every request that completed
+ * is taken at once when the thread wakes up, a little after the first of them completed, and a new one is
+ * submitted in its place.
+ *
+ * The time the scan records for every read is added to @region. Returns the longest time a request took
+ * from being submitted to being taken.
+ */
+static gint64
+simulate_reads (const gint64 *service_usec, GduSurfaceScanRegion *region)
+{
+    g_autoptr(GRand) rand = g_rand_new_with_seed (42);
+    gint64 submit_usec[NUM_REQUESTS] = { 0 };
+    gint64 completion_usec[NUM_REQUESTS];
+    gint64 last_completion_usec = 0;
+    gint64 max_latency_usec = 0;
+    guint num_submitted = 0;
+    guint num_taken = 0;
+    guint n;
+
+    for (; num_submitted < QUEUE_DEPTH; num_submitted++)
+        completion_usec[num_submitted] = (num_submitted > 0 ? completion_usec[num_submitted - 1] : 0)
+                                         + service_usec[num_submitted];
+
+    while (num_taken < NUM_REQUESTS) {
+        gint64 now_usec = completion_usec[num_taken] + g_rand_int (rand) % 2000;
+        gint64 latency_usec;
+        guint first = num_taken;
+
+        while (num_taken < num_submitted && completion_usec[num_taken] <= now_usec)
+            num_taken++;
+
+        latency_usec = gdu_surface_scan_get_service_usec (now_usec, last_completion_usec, submit_usec[first],
+                                                          num_taken - first);
+        last_completion_usec = now_usec;
+        for (n = first; n < num_taken; n++) {
+            gdu_surface_scan_region_add_read (region, latency_usec);
+            max_latency_usec = MAX (max_latency_usec, now_usec - submit_usec[n]);
+        }
+
+        for (; num_submitted < MIN (num_taken + QUEUE_DEPTH, NUM_REQUESTS); num_submitted++) {
+            submit_usec[num_submitted] = now_usec;
+            completion_usec[num_submitted] = MAX (completion_usec[num_submitted - 1], now_usec)
+                                             + service_usec[num_submitted];
+        }
+    }
+
+    return max_latency_usec;
+}
+
+/* A healthy hard disk reading 1 MiB in 6 to 8 ms, about 150 MB/s, with a short seek to the next track
+ * now and then
+ */
+static void
+fill_healthy_hdd (gint64 *service_usec)
+{
+    g_autoptr(GRand) rand = g_rand_new_with_seed (7);
+    guint n;
+
+    for (n = 0; n < NUM_REQUESTS; n++) {
+        service_usec[n] = 6000 + g_rand_int (rand) % 2000;
+        if (n % 100 == 99)
+            service_usec[n] += 15000;
+    }
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+static void
+test_healthy_hdd (void)
+{
+    GduSurfaceScanRegion region = { 0 };
+    gint64 service_usec[NUM_REQUESTS];
+    gint64 max_latency_usec;
+
+    fill_healthy_hdd (service_usec);
+    max_latency_usec = simulate_reads (service_usec, &region);
+
+    /* waiting behind the other requests in flight takes about 200 ms... */
+    g_assert_cmpint (max_latency_usec, >, 200000);
+    /* ...which isn't the disk being slow */
+    g_assert_cmpuint (region.num_requests, ==, NUM_REQUESTS);
+    g_assert_cmpint (region.total_latency_usec / region.num_requests, >=, 6000);
+    g_assert_cmpint (region.total_latency_usec / region.num_requests, <, 9000);
+    g_assert_cmpint (region.max_latency_usec, <, 32000);
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_FAST);
+}
+
+static void
+test_retried_sector (void)
+{
+    GduSurfaceScanRegion region = { 0 };
+    gint64 service_usec[NUM_REQUESTS];
+
+    /* the disk retries a sector for a second */
+    fill_healthy_hdd (service_usec);
+    service_usec[NUM_REQUESTS / 2] = 1000000;
+    simulate_reads (service_usec, &region);
+
+    g_assert_cmpint (region.max_latency_usec, >, 990000);
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_SLOWEST);
+}
+
+static void
+test_severity (void)
+{
+    GduSurfaceScanRegion region = { 0 };
+
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_NONE);
+
+    gdu_surface_scan_region_add_read (&region, 31999);
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_FAST);
+    gdu_surface_scan_region_add_read (&region, 32000);
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_SLOW);
+    gdu_surface_scan_region_add_read (&region, 128000);
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_SLOWER);
+    gdu_surface_scan_region_add_read (&region, 512000);
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_SLOWEST);
+
+    region.num_error_bytes = 512;
+    g_assert_cmpint (gdu_surface_scan_region_get_severity (&region), ==, GDU_SURFACE_SCAN_SEVERITY_ERROR);
+}
+
+static void
+test_latency_bucket (void)
+{
+    g_assert_cmpuint (gdu_surface_scan_get_latency_bucket (0), ==, 0);
+    g_assert_cmpuint (gdu_surface_scan_get_latency_bucket (999), ==, 0);
+    g_assert_cmpuint (gdu_surface_scan_get_latency_bucket (1000), ==, 1);
+    g_assert_cmpuint (gdu_surface_scan_get_latency_bucket (3999), ==, 2);
+    g_assert_cmpuint (gdu_surface_scan_get_latency_bucket (4000), ==, 3);
+    g_assert_cmpuint (gdu_surface_scan_get_latency_bucket (G_GINT64_CONSTANT (3600000000)), ==,
+                      GDU_SURFACE_SCAN_NUM_LATENCY_BUCKETS - 1);
+}
+
+/* ---------------------------------------------------------------------------------------------------- */
+
+int
+main (int argc, char *argv[])
+{
+    g_test_init (&argc, &argv, NULL);
+
+    g_test_add_func ("/surfacescan/healthy-hdd", test_healthy_hdd);
+    g_test_add_func ("/surfacescan/retried-sector", test_retried_sector);
+    g_test_add_func ("/surfacescan/severity", test_severity);
+    g_test_add_func ("/surfacescan/latency-bucket", test_latency_bucket);
+
+    return g_test_run ();
+}
@@ -0,0 +1,237 @@
+use std::io::{BufReader, ErrorKind, Read, Seek, SeekFrom};
+
+use crate::decoder_thread;
+
+/// Size of the header and of the footer of an XZ stream.
+const STREAM_HEADER_SIZE: u64 = 12;
+const HEADER_MAGIC: [u8; 6] = [0xfd, b'7', b'z', b'X', b'Z', 0x00];
+const FOOTER_MAGIC: [u8; 2] = *b"YZ";
+
+fn invalid_data() -> std::io::Error {
+    std::io::Error::new(
+        ErrorKind::InvalidData,
+        "File does not appear to be XZ compressed",
+    )
+}
+
+/// Reads a variable-length integer of the XZ index.
+fn read_vli(input: &mut impl Read) -> std::io::Result<u64> {
+    let mut value = 0;
+    for i in 0..9 {
+        let mut byte = [0; 1];
+        input.read_exact(&mut byte)?;
+        value |= ((byte[0] & 0x7f) as u64) << (i * 7);
+        if byte[0] & 0x80 == 0 {
+            return Ok(value);
+        }
+    }
+    Err(invalid_data())
+}
+
+/// Returns the size of the decompressed data of the XZ compressed `input`.
+///
+/// Only the stream footers and indexes at the end of each stream are read, so this takes the
+/// same time for images of any size. Concatenated streams and stream padding are supported.
+pub fn uncompressed_size(input: &mut (impl Read + Seek)) -> std::io::Result<u64> {
+    let mut end = input.seek(SeekFrom::End(0))?;
+    let mut size = 0u64;
+
+    // walk the streams backwards, from footer to index to header
+    while end > 0 {
+        if end < 2 * STREAM_HEADER_SIZE {
+            return Err(invalid_data());
+        }
+        let mut footer = [0; STREAM_HEADER_SIZE as usize];
+        input.seek(SeekFrom::Start(end - STREAM_HEADER_SIZE))?;
+        input.read_exact(&mut footer)?;
+        if footer[8..] == [0; 4] {
+            // stream padding
+            end -= 4;
+            continue;
+        }
+        if footer[10..] != FOOTER_MAGIC {
+            return Err(invalid_data());
+        }
+
+        let backward_size = u32::from_le_bytes([footer[4], footer[5], footer[6], footer[7]]);
+        let index_size = (backward_size as u64 + 1) * 4;
+        let index_start = (end - STREAM_HEADER_SIZE)
+            .checked_sub(index_size)
+            .ok_or_else(invalid_data)?;
+        input.seek(SeekFrom::Start(index_start))?;
+        let mut index = BufReader::new(input.by_ref()).take(index_size);
+        let mut indicator = [0; 1];
+        index.read_exact(&mut indicator)?;
+        if indicator[0] != 0 {
+            return Err(invalid_data());
+        }
+        let mut blocks_size = 0u64;
+        for _ in 0..read_vli(&mut index)? {
+            let unpadded_size = read_vli(&mut index)?;
+            let uncompressed_size = read_vli(&mut index)?;
+            // blocks are padded to a multiple of four bytes
+            blocks_size = blocks_size
+                .checked_add(unpadded_size.next_multiple_of(4))
+                .ok_or_else(invalid_data)?;
+            size = size
+                .checked_add(uncompressed_size)
+                .ok_or_else(invalid_data)?;
+        }
+        drop(index);
+
+        let stream_start = index_start
+            .checked_sub(blocks_size)
+            .and_then(|offset| offset.checked_sub(STREAM_HEADER_SIZE))
+            .ok_or_else(invalid_data)?;
+        let mut header_magic = [0; HEADER_MAGIC.len()];
+        input.seek(SeekFrom::Start(stream_start))?;
+        input.read_exact(&mut header_magic)?;
+        if header_magic != HEADER_MAGIC {
+            return Err(invalid_data());
+        }
+        end = stream_start;
+    }
+
+    Ok(size)
+}
+
+/// Soft memory limit of the multi-threaded decoder, like the default of `xz --threads`.
+///
+/// If decoding with all threads needs more memory, liblzma falls back to fewer threads.
+fn memlimit_threading() -> u64 {
+    let (pages, page_size) = unsafe {
+        (
+            libc::sysconf(libc::_SC_PHYS_PAGES),
+            libc::sysconf(libc::_SC_PAGESIZE),
+        )
+    };
+    if pages <= 0 || page_size <= 0 {
+        return u64::MAX;
+    }
+    pages as u64 * page_size as u64 / 4
+}
+
+/// Creates a decoder for the XZ compressed `input`.
+///
+/// Streams made of several blocks (e.g. by `xz --threads`) are decoded on all CPUs. Streams with
+/// a single block are decoded single-threaded, as it is not possible to split them.
+pub fn decoder<R: Read>(input: R) -> liblzma::read::XzDecoder<R> {
+    let threads = std::thread::available_parallelism().map_or(1, |n| n.get() as u32);
+    match liblzma::stream::MtStreamBuilder::new()
+        .threads(threads)
+        .memlimit_threading(memlimit_threading())
+        .memlimit_stop(u64::MAX)
+        .decoder()
+    {
+        Ok(stream) => liblzma::read::XzDecoder::new_stream(input, stream),
+        Err(err) => {
+            log::info!("Not using multi-threaded XZ decoding: {err}");
+            liblzma::read::XzDecoder::new(input)
+        }
+    }
+}
+
+/// Decodes the XZ compressed `input` on a separate thread, see [`decoder_thread::spawn`].
+pub fn spawn_decoder<R: Read + Send + 'static>(
+    input: R,
+) -> impl futures::io::AsyncRead + Unpin + 'static {
+    decoder_thread::spawn(move |sender| {
+        sender.forward(decoder(input));
+    })
+}
+
+#[cfg(test)]
+mod uncompressed_size_tests {
+    use std::io::Cursor;
+
+    use super::*;
+
+    fn data(size: usize) -> Vec<u8> {
+        (0..size).map(|n| ((n / 5) ^ (n / 1000)) as u8).collect()
+    }
+
+    fn compress(data: &[u8]) -> Vec<u8> {
+        let mut compressed = Vec::new();
+        liblzma::read::XzEncoder::new(data, 3)
+            .read_to_end(&mut compressed)
+            .unwrap();
+        compressed
+    }
+
+    #[test]
+    fn single_stream() {
+        let compressed = compress(&data(100_000));
+        assert_eq!(
+            uncompressed_size(&mut Cursor::new(&compressed)).unwrap(),
+            100_000
+        );
+    }
+
+    #[test]
+    fn several_blocks() {
+        // like xz --threads, which splits the stream into blocks
+        let stream = liblzma::stream::MtStreamBuilder::new()
+            .threads(2)
+            .block_size(64 * 1024)
+            .preset(3)
+            .encoder()
+            .unwrap();
+        let mut compressed = Vec::new();
+        liblzma::read::XzEncoder::new_stream(&data(300_000)[..], stream)
+            .read_to_end(&mut compressed)
+            .unwrap();
+        assert_eq!(
+            uncompressed_size(&mut Cursor::new(&compressed)).unwrap(),
+            300_000
+        );
+    }
+
+    #[test]
+    fn concatenated_streams_with_padding() {
+        let mut compressed = compress(&data(1000));
+        compressed.extend([0; 8]);
+        compressed.extend(compress(&data(2345)));
+        compressed.extend([0; 4]);
+        assert_eq!(
+            uncompressed_size(&mut Cursor::new(&compressed)).unwrap(),
+            3345
+        );
+    }
+
+    #[test]
+    fn empty_stream() {
+        assert_eq!(
+            uncompressed_size(&mut Cursor::new(&compress(&[]))).unwrap(),
+            0
+        );
+    }
+
+    #[test]
+    fn truncated() {
+        let compressed = compress(&data(10_000));
+        for len in [compressed.len() - 1, compressed.len() / 2, 10, 0] {
+            let mut input = Cursor::new(&compressed[..len]);
+            if len == 0 {
+                // an empty file has no streams at all
+                assert_eq!(uncompressed_size(&mut input).unwrap(), 0);
+            } else {
+                assert!(uncompressed_size(&mut input).is_err(), "{len} bytes");
+            }
+        }
+    }
+
+    #[test]
+    fn bogus_index() {
+        let mut compressed = compress(&data(10_000));
+        // the backward size in the footer points before the start of the file
+        let footer = compressed.len() - STREAM_HEADER_SIZE as usize;
+        compressed[footer + 4..footer + 8].copy_from_slice(&u32::MAX.to_le_bytes());
+        assert!(uncompressed_size(&mut Cursor::new(&compressed)).is_err());
+    }
+
+    #[test]
+    fn not_xz() {
+        let err = uncompressed_size(&mut Cursor::new(&[0x42; 100])).unwrap_err();
+        assert_eq!(err.kind(), ErrorKind::InvalidData);
+    }
+}
@@ -0,0 +1,612 @@
+use std::collections::VecDeque;
+use std::io::{BufReader, ErrorKind, Read, Seek, SeekFrom};
+use std::os::unix::fs::FileExt;
+use std::sync::{Arc, Mutex};
+
+use crate::decoder_thread;
+
+/// Magic number of a zstd frame.
+const FRAME_MAGIC: u32 = 0xfd2f_b528;
+/// Skippable frames have magic numbers `0x184d2a50` to `0x184d2a5f`.
+const SKIPPABLE_FRAME_MAGIC: u32 = 0x184d_2a50;
+const SKIPPABLE_FRAME_MAGIC_MASK: u32 = 0xffff_fff0;
+/// Magic number of the skippable frame with the seek table of the seekable format.
+const SEEK_TABLE_MAGIC: u32 = 0x184d_2a5e;
+/// Magic number at the end of the seek table footer.
+const SEEKABLE_MAGIC: u32 = 0x8f92_eab1;
+/// Size of the seek table footer: number of frames, descriptor and magic number.
+const SEEK_TABLE_FOOTER_SIZE: u64 = 9;
+
+/// Frames up to this size are decoded in parallel, larger ones are streamed.
+const MAX_PARALLEL_FRAME_SIZE: u64 = 64 * 1024 * 1024;
+/// More threads than this hardly decode faster than the device is written.
+const MAX_DECODER_THREADS: usize = 8;
+/// Limit for the decoded frames waiting to be sent.
+const MAX_BYTES_IN_FLIGHT: u64 = 256 * 1024 * 1024;
+/// Largest window a frame may use, as written by `zstd --long=31`. The decoder refuses windows
+/// above 128 MiB unless told otherwise.
+const WINDOW_LOG_MAX: u32 = if cfg!(target_pointer_width = "64") {
+    31
+} else {
+    30
+};
+
+/// A frame of a zstd file.
+#[derive(Debug, Clone, Copy)]
+pub struct Frame {
+    /// Offset of the frame in the compressed file.
+    pub offset: u64,
+    pub compressed_size: u64,
+    /// The size of the decompressed data, if it is stored in the file.
+    pub decompressed_size: Option<u64>,
+}
+
+fn invalid_data(message: &str) -> std::io::Error {
+    std::io::Error::new(ErrorKind::InvalidData, message)
+}
+
+fn read_u32(input: &mut impl Read) -> std::io::Result<u32> {
+    let mut bytes = [0; 4];
+    input.read_exact(&mut bytes)?;
+    Ok(u32::from_le_bytes(bytes))
+}
+
+/// Reads a little-endian integer of `size` bytes.
+fn read_uint(input: &mut impl Read, size: usize) -> std::io::Result<u64> {
+    let mut bytes = [0; 8];
+    input.read_exact(&mut bytes[..size])?;
+    Ok(u64::from_le_bytes(bytes))
+}
+
+/// Reads the seek table of the [seekable format], if `input` has one.
+///
+/// [seekable format]: https://github.com/facebook/zstd/blob/dev/contrib/seekable_format/zstd_seekable_compression_format.md
+fn seek_table(input: &mut (impl Read + Seek)) -> std::io::Result<Option<Vec<Frame>>> {
+    let file_size = input.seek(SeekFrom::End(0))?;
+    if file_size < SEEK_TABLE_FOOTER_SIZE + 8 {
+        return Ok(None);
+    }
+
+    input.seek(SeekFrom::End(-(SEEK_TABLE_FOOTER_SIZE as i64)))?;
+    let num_frames = read_u32(input)? as u64;
+    let mut descriptor = [0; 1];
+    input.read_exact(&mut descriptor)?;
+    if read_u32(input)? != SEEKABLE_MAGIC {
+        return Ok(None);
+    }
+
+    // each entry has the compressed and decompressed size, and maybe a checksum
+    let entry_size = if descriptor[0] & 0x80 != 0 { 12 } else { 8 };
+    let table_size = 8 + num_frames * entry_size + SEEK_TABLE_FOOTER_SIZE;
+    if table_size > file_size {
+        return Err(invalid_data("Invalid zstd seek table"));
+    }
+    input.seek(SeekFrom::Start(file_size - table_size))?;
+    if read_u32(input)? != SEEK_TABLE_MAGIC || read_u32(input)? as u64 != table_size - 8 {
+        return Err(invalid_data("Invalid zstd seek table"));
+    }
+
+    let mut entries = BufReader::new(input);
+    let mut frames = Vec::with_capacity(num_frames as usize);
+    let mut offset = 0;
+    for _ in 0..num_frames {
+        let compressed_size = read_u32(&mut entries)? as u64;
+        let decompressed_size = read_u32(&mut entries)? as u64;
+        if entry_size == 12 {
+            read_u32(&mut entries)?;
+        }
+        frames.push(Frame {
+            offset,
+            compressed_size,
+            decompressed_size: Some(decompressed_size),
+        });
+        offset += compressed_size;
+    }
+    if offset != file_size - table_size {
+        return Err(invalid_data("Invalid zstd seek table"));
+    }
+
+    Ok(Some(frames))
+}
+
+/// Finds the frames by walking the frame and block headers of `input`.
+///
+/// Only the headers are read, the blocks in between are skipped. Stops with `None` at the first
+/// frame that does not store its size or is larger than `max_frame_size`, without walking its
+/// blocks, as the whole file has to be streamed then anyway.
+fn walk_frames(
+    input: &mut (impl Read + Seek),
+    max_frame_size: u64,
+) -> std::io::Result<Option<Vec<Frame>>> {
+    let file_size = input.seek(SeekFrom::End(0))?;
+    input.seek(SeekFrom::Start(0))?;
+    let mut input = BufReader::new(input);
+    let mut frames = Vec::new();
+    let mut offset = 0;
+
+    while offset < file_size {
+        let magic = read_u32(&mut input)?;
+        if magic & SKIPPABLE_FRAME_MAGIC_MASK == SKIPPABLE_FRAME_MAGIC {
+            let size = read_u32(&mut input)? as u64;
+            input.seek_relative(size as i64)?;
+            offset += 8 + size;
+            continue;
+        }
+        if magic != FRAME_MAGIC {
+            return Err(invalid_data("File does not appear to be zstd compressed"));
+        }
+
+        let mut descriptor = [0; 1];
+        input.read_exact(&mut descriptor)?;
+        let descriptor = descriptor[0];
+        let single_segment = descriptor & 0x20 != 0;
+        let has_checksum = descriptor & 0x04 != 0;
+        let dictionary_id_size = [0, 1, 2, 4][(descriptor & 0x03) as usize];
+        let content_size_size = match descriptor >> 6 {
+            0 if single_segment => 1,
+            0 => 0,
+            1 => 2,
+            2 => 4,
+            _ => 8,
+        };
+        let window_descriptor_size = if single_segment { 0 } else { 1 };
+        input.seek_relative(window_descriptor_size + dictionary_id_size)?;
+        let decompressed_size = match content_size_size {
+            0 => None,
+            // the two byte field is stored with an offset of 256
+            2 => Some(read_uint(&mut input, 2)? + 256),
+            size => Some(read_uint(&mut input, size)?),
+        };
+        if !decompressed_size.is_some_and(|size| size <= max_frame_size) {
+            return Ok(None);
+        }
+        let mut frame_size = 5
+            + window_descriptor_size as u64
+            + dictionary_id_size as u64
+            + content_size_size as u64;
+
+        loop {
+            let header = read_uint(&mut input, 3)?;
+            let last_block = header & 1 != 0;
+            let block_size = match (header >> 1) & 0x03 {
+                // RLE blocks store a single byte
+                1 => 1,
+                3 => return Err(invalid_data("Invalid zstd block")),
+                _ => header >> 3,
+            };
+            input.seek_relative(block_size as i64)?;
+            frame_size += 3 + block_size;
+            if last_block {
+                break;
+            }
+        }
+        if has_checksum {
+            input.seek_relative(4)?;
+            frame_size += 4;
+        }
+
+        frames.push(Frame {
+            offset,
+            compressed_size: frame_size,
+            decompressed_size,
+        });
+        offset += frame_size;
+    }
+
+    Ok(Some(frames))
+}
+
+/// Returns the frames of the zstd compressed `input`, from its seek table if it has one.
+///
+/// Returns `None` if a frame does not store its size or is larger than `max_frame_size`.
+pub fn frames(
+    input: &mut (impl Read + Seek),
+    max_frame_size: u64,
+) -> std::io::Result<Option<Vec<Frame>>> {
+    match seek_table(input)? {
+        Some(frames)
+            if frames.iter().all(|frame| {
+                frame
+                    .decompressed_size
+                    .is_some_and(|size| size <= max_frame_size)
+            }) =>
+        {
+            Ok(Some(frames))
+        }
+        Some(_) => Ok(None),
+        None => walk_frames(input, max_frame_size),
+    }
+}
+
+/// Returns the size of the decompressed data of the zstd compressed `input`.
+///
+/// The size is taken from the seek table or the frame headers. It is `None` if a frame does not
+/// store its size, e.g. because it was compressed from a pipe, as only decompressing all of the
+/// data would tell.
+pub fn uncompressed_size(input: &mut (impl Read + Seek)) -> std::io::Result<Option<u64>> {
+    Ok(frames(input, u64::MAX)?.map(|frames| {
+        frames
+            .iter()
+            .filter_map(|frame| frame.decompressed_size)
+            .sum()
+    }))
+}
+
+/// Creates a streaming decoder for the zstd compressed `input`.
+pub fn decoder<R: Read>(input: R) -> std::io::Result<impl Read> {
+    let mut decoder = zstd::stream::read::Decoder::new(input)?;
+    decoder.window_log_max(WINDOW_LOG_MAX)?;
+    Ok(decoder)
+}
+
+/// Decodes `frames` of `input` on up to [`MAX_DECODER_THREADS`] CPUs and sends the data in order.
+///
+/// Each frame is decoded in chunks of [`decoder_thread::CHUNK_SIZE`], like the streaming decoder
+/// sends them.
+fn decode_parallel(
+    input: std::fs::File,
+    frames: Vec<Frame>,
+    sender: &mut decoder_thread::ChunkSender,
+) {
+    type Job = (Frame, std::sync::mpsc::Sender<std::io::Result<Vec<u8>>>);
+
+    let num_threads = std::thread::available_parallelism()
+        .map_or(1, |n| n.get())
+        .min(MAX_DECODER_THREADS);
+    let input = Arc::new(input);
+    let (job_sender, job_receiver) = std::sync::mpsc::channel::<Job>();
+    let job_receiver = Arc::new(Mutex::new(job_receiver));
+
+    for _ in 0..num_threads {
+        let input = input.clone();
+        let job_receiver = job_receiver.clone();
+        std::thread::spawn(move || {
+            loop {
+                // the lock is released before decoding, so the others can take the next frames
+                let job = job_receiver
+                    .lock()
+                    .expect("lock should not be poisoned")
+                    .recv();
+                let Ok((frame, result_sender)) = job else {
+                    // all frames are decoded
+                    break;
+                };
+                let mut compressed = vec![0; frame.compressed_size as usize];
+                let mut decoder = match input
+                    .read_exact_at(&mut compressed, frame.offset)
+                    .and_then(|_| decoder(compressed.as_slice()))
+                {
+                    Ok(decoder) => decoder,
+                    Err(err) => {
+                        let _ = result_sender.send(Err(err));
+                        continue;
+                    }
+                };
+                loop {
+                    let chunk = decoder_thread::read_chunk(&mut decoder);
+                    let done = !chunk
+                        .as_ref()
+                        .is_ok_and(|chunk| chunk.len() == decoder_thread::CHUNK_SIZE);
+                    // the frames after an error are not needed anymore
+                    if result_sender.send(chunk).is_err() || done {
+                        break;
+                    }
+                }
+            }
+        });
+    }
+
+    // Keep one more frame in flight than there are threads, as long as the decoded frames fit
+    // into the limit, and send the results in the order of the frames
+    let mut pending = VecDeque::new();
+    let mut bytes_in_flight = 0;
+    for frame in frames {
+        let frame_size = frame.decompressed_size.unwrap_or(0);
+        while !pending.is_empty()
+            && (pending.len() > num_threads || bytes_in_flight + frame_size > MAX_BYTES_IN_FLIGHT)
+        {
+            if !send_result(pending.pop_front(), &mut bytes_in_flight, sender) {
+                return;
+            }
+        }
+
+        // the decoded chunks of a frame are limited by MAX_BYTES_IN_FLIGHT, not by the channel
+        let (result_sender, result_receiver) = std::sync::mpsc::channel();
+        job_sender
+            .send((frame, result_sender))
+            .expect("decoder threads should be running");
+        pending.push_back((result_receiver, frame_size));
+        bytes_in_flight += frame_size;
+    }
+    while !pending.is_empty() {
+        if !send_result(pending.pop_front(), &mut bytes_in_flight, sender) {
+            return;
+        }
+    }
+}
+
+/// Waits for the chunks of a frame and sends them. Returns `false` if decoding should stop.
+fn send_result(
+    pending: Option<(std::sync::mpsc::Receiver<std::io::Result<Vec<u8>>>, u64)>,
+    bytes_in_flight: &mut u64,
+    sender: &mut decoder_thread::ChunkSender,
+) -> bool {
+    let Some((result_receiver, frame_size)) = pending else {
+        return false;
+    };
+    *bytes_in_flight -= frame_size;
+    let mut num_bytes = 0;
+    // the decoder thread hangs up after the last chunk of the frame
+    for chunk in result_receiver {
+        let failed = chunk.is_err();
+        if let Ok(chunk) = &chunk {
+            num_bytes += chunk.len() as u64;
+        }
+        if !sender.send(chunk) || failed {
+            return false;
+        }
+    }
+    if num_bytes != frame_size {
+        sender.send(Err(invalid_data("zstd frame has the wrong size")));
+        return false;
+    }
+    true
+}
+
+/// Decodes the zstd compressed `input` on separate threads, see [`decoder_thread::spawn`].
+///
+/// Files with several frames of known size (e.g. from `pzstd` or in the seekable format) are
+/// decoded frame by frame on several CPUs. Everything else, including the single frame written
+/// by `zstd --threads`, is streamed through a single decoder.
+pub fn spawn_decoder(mut input: std::fs::File) -> impl futures::io::AsyncRead + Unpin + 'static {
+    decoder_thread::spawn(move |sender| {
+        let frames = frames(&mut input, MAX_PARALLEL_FRAME_SIZE).and_then(|frames| {
+            input.seek(SeekFrom::Start(0))?;
+            Ok(frames)
+        });
+        match frames {
+            Ok(Some(frames)) if frames.len() > 1 => {
+                decode_parallel(input, frames, sender);
+            }
+            Ok(_) => match decoder(input) {
+                Ok(decoder) => {
+                    sender.forward(decoder);
+                }
+                Err(err) => {
+                    sender.send(Err(err));
+                }
+            },
+            Err(err) => {
+                sender.send(Err(err));
+            }
+        }
+    })
+}
+
+#[cfg(test)]
+mod frames_tests {
+    use std::io::Cursor;
+
+    use super::*;
+
+    /// Data that compresses, but not to nothing.
+    fn data(size: usize, seed: u8) -> Vec<u8> {
+        (0..size)
+            .map(|n| (n / 7) as u8 ^ seed.wrapping_mul(n as u8))
+            .collect()
+    }
+
+    /// Compresses each of `parts` to a frame of its own, which stores its size.
+    fn compress_frames(parts: &[&[u8]]) -> Vec<Vec<u8>> {
+        parts
+            .iter()
+            .map(|part| zstd::bulk::compress(part, 3).unwrap())
+            .collect()
+    }
+
+    /// Appends the seek table of the seekable format for `frames` of `parts`.
+    fn seekable(parts: &[&[u8]], frames: &[Vec<u8>], checksums: bool) -> Vec<u8> {
+        let entry_size = if checksums { 12 } else { 8 };
+        let mut file = frames.concat();
+        file.extend(SEEK_TABLE_MAGIC.to_le_bytes());
+        file.extend((frames.len() as u32 * entry_size + 9).to_le_bytes());
+        for (part, frame) in parts.iter().zip(frames) {
+            file.extend((frame.len() as u32).to_le_bytes());
+            file.extend((part.len() as u32).to_le_bytes());
+            if checksums {
+                file.extend(0u32.to_le_bytes());
+            }
+        }
+        file.extend((frames.len() as u32).to_le_bytes());
+        file.push(if checksums { 0x80 } else { 0 });
+        file.extend(SEEKABLE_MAGIC.to_le_bytes());
+        file
+    }
+
+    fn skippable_frame(content: &[u8]) -> Vec<u8> {
+        let mut frame = (SKIPPABLE_FRAME_MAGIC + 3).to_le_bytes().to_vec();
+        frame.extend((content.len() as u32).to_le_bytes());
+        frame.extend(content);
+        frame
+    }
+
+    fn assert_frames(frames: &[Frame], compressed: &[Vec<u8>], parts: &[&[u8]]) {
+        assert_eq!(frames.len(), parts.len());
+        let mut offset = 0;
+        for ((frame, compressed), part) in frames.iter().zip(compressed).zip(parts) {
+            assert_eq!(frame.offset, offset);
+            assert_eq!(frame.compressed_size, compressed.len() as u64);
+            assert_eq!(frame.decompressed_size, Some(part.len() as u64));
+            offset += compressed.len() as u64;
+        }
+    }
+
+    #[test]
+    fn seek_table_round_trip() {
+        let (a, b, c) = (data(100_000, 1), data(70_000, 2), data(300, 3));
+        let parts: [&[u8]; 3] = [&a, &b, &c];
+        let compressed = compress_frames(&parts);
+        for checksums in [false, true] {
+            let file = seekable(&parts, &compressed, checksums);
+            let frames = seek_table(&mut Cursor::new(&file)).unwrap().unwrap();
+            assert_frames(&frames, &compressed, &parts);
+
+            // each frame decodes on its own, as the parallel decoder does it
+            let decoded: Vec<u8> = frames
+                .iter()
+                .flat_map(|frame| {
+                    let start = frame.offset as usize;
+                    let end = start + frame.compressed_size as usize;
+                    zstd::bulk::decompress(
+                        &file[start..end],
+                        frame.decompressed_size.unwrap() as usize,
+                    )
+                    .unwrap()
+                })
+                .collect();
+            assert_eq!(decoded, parts.concat());
+            assert_eq!(
+                uncompressed_size(&mut Cursor::new(&file)).unwrap(),
+                Some(parts.concat().len() as u64)
+            );
+        }
+    }
+
+    #[test]
+    fn seek_table_truncated_footer() {
+        let a = data(10_000, 1);
+        let compressed = compress_frames(&[&a]);
+        let mut file = seekable(&[&a], &compressed, false);
+        file.pop();
+        assert!(seek_table(&mut Cursor::new(&file)).unwrap().is_none());
+        // shorter than a footer
+        assert!(seek_table(&mut Cursor::new(&file[..10])).unwrap().is_none());
+    }
+
+    #[test]
+    fn seek_table_bogus_frame_sizes() {
+        let (a, b) = (data(10_000, 1), data(20_000, 2));
+        let parts: [&[u8]; 2] = [&a, &b];
+        let compressed = compress_frames(&parts);
+        let file = seekable(&parts, &compressed, false);
+        let table_start = compressed.concat().len();
+
+        // the compressed sizes do not add up to the frames before the table
+        let mut bogus = file.clone();
+        bogus[table_start + 8] ^= 0x01;
+        let err = seek_table(&mut Cursor::new(&bogus)).unwrap_err();
+        assert_eq!(err.kind(), ErrorKind::InvalidData);
+
+        // more frames than fit into the file
+        let mut bogus = file.clone();
+        let num_frames = bogus.len() - SEEK_TABLE_FOOTER_SIZE as usize;
+        bogus[num_frames..num_frames + 4].copy_from_slice(&u32::MAX.to_le_bytes());
+        let err = seek_table(&mut Cursor::new(&bogus)).unwrap_err();
+        assert_eq!(err.kind(), ErrorKind::InvalidData);
+
+        // the size of the skippable frame does not match the number of frames
+        let mut bogus = file.clone();
+        bogus[table_start + 4] ^= 0x01;
+        let err = seek_table(&mut Cursor::new(&bogus)).unwrap_err();
+        assert_eq!(err.kind(), ErrorKind::InvalidData);
+    }
+
+    #[test]
+    fn walk_frames_without_seek_table() {
+        let (a, b) = (data(200_000, 1), data(5, 2));
+        let parts: [&[u8]; 2] = [&a, &b];
+        let compressed = compress_frames(&parts);
+        let file = compressed.concat();
+        assert!(seek_table(&mut Cursor::new(&file)).unwrap().is_none());
+        let frames = walk_frames(&mut Cursor::new(&file), u64::MAX)
+            .unwrap()
+            .unwrap();
+        assert_frames(&frames, &compressed, &parts);
+        assert_eq!(
+            uncompressed_size(&mut Cursor::new(&file)).unwrap(),
+            Some(200_005)
+        );
+    }
+
+    #[test]
+    fn walk_frames_skips_skippable_frames() {
+        let (a, b) = (data(50_000, 1), data(60_000, 2));
+        let parts: [&[u8]; 2] = [&a, &b];
+        let compressed = compress_frames(&parts);
+        // like pzstd, which stores the size of each frame in a skippable frame before it
+        let first_skippable = skippable_frame(&(compressed[0].len() as u32).to_le_bytes());
+        let second_skippable = skippable_frame(b"");
+        let file = [
+            first_skippable.clone(),
+            compressed[0].clone(),
+            second_skippable.clone(),
+            compressed[1].clone(),
+        ]
+        .concat();
+
+        let frames = frames(&mut Cursor::new(&file), u64::MAX).unwrap().unwrap();
+        assert_eq!(frames.len(), 2);
+        assert_eq!(frames[0].offset, first_skippable.len() as u64);
+        assert_eq!(
+            frames[1].offset,
+            (first_skippable.len() + compressed[0].len() + second_skippable.len()) as u64
+        );
+        assert_eq!(frames[1].compressed_size, compressed[1].len() as u64);
+    }
+
+    #[test]
+    fn walk_frames_stops_at_unknown_size() {
+        // the streaming encoder does not know the size when it writes the frame header
+        let mut encoder = zstd::stream::write::Encoder::new(Vec::new(), 3).unwrap();
+        std::io::Write::write_all(&mut encoder, &data(100_000, 1)).unwrap();
+        let file = [
+            compress_frames(&[&data(10, 2)]).concat(),
+            encoder.finish().unwrap(),
+        ]
+        .concat();
+
+        assert!(frames(&mut Cursor::new(&file), u64::MAX).unwrap().is_none());
+        assert_eq!(uncompressed_size(&mut Cursor::new(&file)).unwrap(), None);
+    }
+
+    #[test]
+    fn frames_larger_than_the_limit() {
+        let (a, b) = (data(1000, 1), data(3000, 2));
+        let parts: [&[u8]; 2] = [&a, &b];
+        let compressed = compress_frames(&parts);
+        for file in [compressed.concat(), seekable(&parts, &compressed, false)] {
+            assert!(frames(&mut Cursor::new(&file), 3000).unwrap().is_some());
+            assert!(frames(&mut Cursor::new(&file), 2999).unwrap().is_none());
+        }
+    }
+
+    #[test]
+    fn decode_parallel_in_chunks() {
+        let chunk_size = decoder_thread::CHUNK_SIZE;
+        let (a, b, c) = (
+            data(2 * chunk_size + 1000, 1),
+            data(chunk_size, 2),
+            data(300, 3),
+        );
+        let parts: [&[u8]; 3] = [&a, &b, &c];
+        let path = std::env::temp_dir().join(format!("gdu-zstd-decoder-{}", std::process::id()));
+        std::fs::write(&path, compress_frames(&parts).concat()).unwrap();
+        let input = std::fs::File::open(&path).unwrap();
+        std::fs::remove_file(&path).unwrap();
+
+        // the frames are larger than a chunk, or exactly one
+        let mut decoded = Vec::new();
+        futures::executor::block_on(futures::AsyncReadExt::read_to_end(
+            &mut spawn_decoder(input),
+            &mut decoded,
+        ))
+        .unwrap();
+        assert_eq!(decoded, parts.concat());
+    }
+
+    #[test]
+    fn walk_frames_not_zstd() {
+        let err = walk_frames(&mut Cursor::new(b"not zstd compressed"), u64::MAX).unwrap_err();
+        assert_eq!(err.kind(), ErrorKind::InvalidData);
+    }
+}